@@ -66,6 +66,8 @@ long unsigned generateProjectionSetupFine(
 		unsigned iclass,
 		ProjectionParams &ProjectionData);
 
+// The CUDA kernels take the weights as a dense (orientation x translation) array, the CPU kernels only
+// the significant ones, grouped by orientation as described by weight_start and weight_trans (see SignificantSamples)
 void runWavgKernel(
 		AccProjectorKernel &projector,
 		XFLOAT *eulers,
@@ -75,6 +77,8 @@ void runWavgKernel(
 		XFLOAT *trans_y,
 		XFLOAT *trans_z,
 		XFLOAT *sorted_weights,
+		unsigned long *weight_start,
+		unsigned long *weight_trans,
 		XFLOAT *ctfs,
 		XFLOAT *wdiff2s_parts,
 		XFLOAT *wdiff2s_AA,
@@ -101,6 +105,8 @@ void runBackProjectKernel(
 		XFLOAT *trans_y,
 		XFLOAT *trans_z,
 		XFLOAT* d_weights,
+		unsigned long* d_weight_start,
+		unsigned long* d_weight_trans,
 		XFLOAT* d_Minvsigma2s,
 		XFLOAT* d_ctfs,
 		unsigned long translation_num,
@@ -304,6 +304,8 @@ void runWavgKernel(
 		XFLOAT *trans_y,
 		XFLOAT *trans_z,
 		XFLOAT *sorted_weights,
+		unsigned long *weight_start,
+		unsigned long *weight_trans,
 		XFLOAT *ctfs,
 		XFLOAT *wdiff2s_parts,
 		XFLOAT *wdiff2s_AA,
@@ -337,6 +339,8 @@ void runWavgKernel(
 				trans_y,
 				trans_z,
 				sorted_weights,
+				weight_start,
+				weight_trans,
 				ctfs,
 				wdiff2s_parts,
 				wdiff2s_AA,
@@ -359,6 +363,8 @@ void runWavgKernel(
 				trans_y,
 				trans_z,
 				sorted_weights,
+				weight_start,
+				weight_trans,
 				ctfs,
 				wdiff2s_parts,
 				wdiff2s_AA,
@@ -381,6 +387,8 @@ void runWavgKernel(
 				trans_y,
 				trans_z,
 				sorted_weights,
+				weight_start,
+				weight_trans,
 				ctfs,
 				wdiff2s_parts,
 				wdiff2s_AA,
@@ -406,6 +414,8 @@ void runWavgKernel(
 				trans_y,
 				trans_z,
 				sorted_weights,
+				weight_start,
+				weight_trans,
 				ctfs,
 				wdiff2s_parts,
 				wdiff2s_AA,
@@ -428,6 +438,8 @@ void runWavgKernel(
 				trans_y,
 				trans_z,
 				sorted_weights,
+				weight_start,
+				weight_trans,
 				ctfs,
 				wdiff2s_parts,
 				wdiff2s_AA,
@@ -450,6 +462,8 @@ void runWavgKernel(
 				trans_y,
 				trans_z,
 				sorted_weights,
+				weight_start,
+				weight_trans,
 				ctfs,
 				wdiff2s_parts,
 				wdiff2s_AA,
@@ -473,6 +487,8 @@ void runBackProjectKernel(
 		XFLOAT *trans_y,
 		XFLOAT *trans_z,
 		XFLOAT* d_weights,
+		unsigned long* d_weight_start,
+		unsigned long* d_weight_trans,
 		XFLOAT* d_Minvsigma2s,
 		XFLOAT* d_ctfs,
 		unsigned long translation_num,
@@ -545,8 +561,8 @@ void runBackProjectKernel(
 						projector,
                         d_img_real, d_img_imag,
                         trans_x, trans_y,
-                        d_weights, d_Minvsigma2s, d_ctfs,
-                        translation_num, significant_weight, weight_norm, d_eulers,
+                        d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+                        translation_num, weight_norm, d_eulers,
                         BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
                         BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
                         (unsigned)imgX, (unsigned)imgY, (unsigned)imgX*imgY,
@@ -557,8 +573,8 @@ void runBackProjectKernel(
 						projector,
 						d_img_real, d_img_imag,
 						trans_x, trans_y,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 						(unsigned)imgX, (unsigned)imgY, (unsigned)imgX*imgY,
@@ -569,8 +585,8 @@ void runBackProjectKernel(
 						imageCount, BP_2D_BLOCK_SIZE,
 						d_img_real, d_img_imag,
 						trans_x, trans_y,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 						(unsigned)imgX, (unsigned)imgY, (unsigned)imgX*imgY,
@@ -580,8 +596,8 @@ void runBackProjectKernel(
 						imageCount, BP_2D_BLOCK_SIZE,
 						d_img_real, d_img_imag,
 						trans_x, trans_y,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 						(unsigned)imgX, (unsigned)imgY, (unsigned)imgX*imgY,
@@ -619,8 +635,8 @@ void runBackProjectKernel(
 					CpuKernels::backproject3D_SGD<true, true>(imageCount, BP_DATA3D_BLOCK_SIZE,
 						projector, d_img_real, d_img_imag,
 						trans_x, trans_y, trans_z,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, BP.padding_factor,
 						imgX, imgY, imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -629,8 +645,8 @@ void runBackProjectKernel(
 					CpuKernels::backproject3D_SGD<true, false>(imageCount, BP_DATA3D_BLOCK_SIZE,
 						projector, d_img_real, d_img_imag,
 						trans_x, trans_y, trans_z,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, BP.padding_factor,
 						imgX, imgY, imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -665,8 +681,8 @@ void runBackProjectKernel(
 					CpuKernels::backproject3D_SGD<false, true>(imageCount, BP_REF3D_BLOCK_SIZE,
 						projector, d_img_real, d_img_imag,
 						trans_x, trans_y, trans_z,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 						(unsigned)imgX, (unsigned)imgY, (unsigned)imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -675,8 +691,8 @@ void runBackProjectKernel(
 					CpuKernels::backproject3D_SGD<false, false>(imageCount, BP_REF3D_BLOCK_SIZE,
 						projector, d_img_real, d_img_imag,
 						trans_x, trans_y, trans_z,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 						(unsigned)imgX, (unsigned)imgY, (unsigned)imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -713,8 +729,8 @@ void runBackProjectKernel(
 					CpuKernels::backproject3D<true, true>(imageCount,BP_DATA3D_BLOCK_SIZE,
 						d_img_real, d_img_imag,
 						trans_x, trans_y, trans_z,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 						(unsigned)imgX, (unsigned)imgY, (unsigned)imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -723,8 +739,8 @@ void runBackProjectKernel(
 					CpuKernels::backproject3D<true, false>(imageCount,BP_DATA3D_BLOCK_SIZE,
 						d_img_real, d_img_imag,
 						trans_x, trans_y, trans_z,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 						(unsigned)imgX, (unsigned)imgY, (unsigned)imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -760,8 +776,8 @@ void runBackProjectKernel(
 				CpuKernels::backprojectRef3D<true>(imageCount,
 					d_img_real, d_img_imag,
 					trans_x, trans_y,
-					d_weights, d_Minvsigma2s, d_ctfs,
-					translation_num, significant_weight, weight_norm, d_eulers,
+					d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+					translation_num, weight_norm, d_eulers,
 					BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 					BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 					(unsigned)imgX, (unsigned)imgY, (unsigned)imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -770,8 +786,8 @@ void runBackProjectKernel(
 				CpuKernels::backprojectRef3D<false>(imageCount,
 					d_img_real, d_img_imag,
 					trans_x, trans_y,
-					d_weights, d_Minvsigma2s, d_ctfs,
-					translation_num, significant_weight, weight_norm, d_eulers,
+					d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+					translation_num, weight_norm, d_eulers,
 					BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 					BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 					(unsigned)imgX, (unsigned)imgY, (unsigned)imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -782,8 +798,8 @@ void runBackProjectKernel(
 					CpuKernels::backproject3D<false, true>(imageCount,BP_REF3D_BLOCK_SIZE,
 						d_img_real, d_img_imag,
 						trans_x, trans_y, trans_z,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 						(unsigned)imgX, (unsigned)imgY, (unsigned)imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -792,8 +808,8 @@ void runBackProjectKernel(
 					CpuKernels::backproject3D<false, false>(imageCount,BP_REF3D_BLOCK_SIZE,
 						d_img_real, d_img_imag,
 						trans_x, trans_y, trans_z,
-						d_weights, d_Minvsigma2s, d_ctfs,
-						translation_num, significant_weight, weight_norm, d_eulers,
+						d_weights, d_weight_start, d_weight_trans, d_Minvsigma2s, d_ctfs,
+						translation_num, weight_norm, d_eulers,
 						BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
 						BP.maxR, BP.maxR2, (XFLOAT)BP.padding_factor,
 						(unsigned)imgX, (unsigned)imgY, (unsigned)imgZ, (size_t)imgX*(size_t)imgY*(size_t)imgZ,
@@ -1,6 +1,7 @@
 #ifndef ACC_ML_OPTIMISER_H_
 #define ACC_ML_OPTIMISER_H_
 
+#include <vector>
 #include "src/acc/acc_ptr.h"
 
 #ifdef ALTCPU
@@ -129,6 +130,52 @@ public:
 };
 
 
+/*
+ * The significant weights of the fine pass for one image and class, as made by convertAllSquaredDifferencesToWeights
+ * for storeWeightedSums. They are grouped by orientation: the weights of the orientation with rot_idx i are
+ * weights[start[i]] ... weights[start[i+1]-1], for the translations in the same positions of trans_idx.
+ * This is what the CPU wavg and backprojection kernels use instead of a dense (orientation x translation) array.
+ */
+class SignificantSamples
+{
+public:
+	std::vector<XFLOAT> weights;
+	std::vector<unsigned long> trans_idx, start;
+
+	// Keep the n weights with weight >= significant_weight (counting sort on rot_idx)
+	void set(const XFLOAT *all_weights, const size_t *rot_idx, const size_t *all_trans_idx, size_t n, XFLOAT significant_weight)
+	{
+		size_t nr_orient = 0;
+		for (size_t i = 0; i < n; i++)
+			if (all_weights[i] >= significant_weight && rot_idx[i] + 1 > nr_orient)
+				nr_orient = rot_idx[i] + 1;
+
+		start.assign(nr_orient + 1, 0);
+		for (size_t i = 0; i < n; i++)
+			if (all_weights[i] >= significant_weight)
+				start[rot_idx[i] + 1]++;
+		for (size_t i = 0; i < nr_orient; i++)
+			start[i + 1] += start[i];
+
+		weights.resize(start[nr_orient]);
+		trans_idx.resize(start[nr_orient]);
+		std::vector<unsigned long> pos(start.begin(), start.end() - 1);
+		for (size_t i = 0; i < n; i++)
+			if (all_weights[i] >= significant_weight)
+			{
+				unsigned long p = pos[rot_idx[i]]++;
+				weights[p] = all_weights[i];
+				trans_idx[p] = all_trans_idx[i];
+			}
+	}
+
+	// Number of orientations, up to the last one with a significant weight (0 if there are none, or nothing was set yet)
+	unsigned long orientationNum()
+	{
+		return (start.size() > 0) ? start.size() - 1 : 0;
+	}
+};
+
 class OptimisationParamters
 {
 public:
@@ -149,6 +196,7 @@ public:
 	std::vector<MultidimArray<RFLOAT> > power_img;
 	MultidimArray<XFLOAT> Mweight;
 	std::vector<Indices> max_index;
+	std::vector<std::vector<SignificantSamples> > significant_samples;
 
 	OptimisationParamters (unsigned nr_images, unsigned long part_id):
 		metadata_offset(0),
@@ -163,6 +211,7 @@ public:
 		prior.resize(nr_images);
 		max_index.resize(nr_images);
 		sum_weight_class.resize(nr_images);
+		significant_samples.resize(nr_images);
 	};
 };
 
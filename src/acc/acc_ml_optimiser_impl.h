@@ -2087,6 +2087,29 @@ void convertAllSquaredDifferencesToWeights(unsigned exp_ipass,
 		}
 
 		op.significant_weight[img_id] = (RFLOAT) my_significant_weight;
+
+#ifndef _CUDA_ENABLED
+		// Hand only the significant fine-pass weights to storeWeightedSums, grouped by orientation
+		if (exp_ipass > 0)
+		{
+			op.significant_samples[img_id].resize(baseMLO->mymodel.nr_classes);
+			for (unsigned long exp_iclass = sp.iclass_min; exp_iclass <= sp.iclass_max; exp_iclass++)
+			{
+				if ((baseMLO->mymodel.pdf_class[exp_iclass] > 0.) && (FPCMasks[img_id][exp_iclass].weightNum > 0))
+				{
+					IndexedDataArray thisClassPassWeights(PassWeights[img_id], FPCMasks[img_id][exp_iclass]);
+					op.significant_samples[img_id][exp_iclass].set(
+							~thisClassPassWeights.weights,
+							~thisClassPassWeights.rot_idx,
+							~thisClassPassWeights.trans_idx,
+							FPCMasks[img_id][exp_iclass].weightNum,
+							my_significant_weight);
+				}
+				else
+					op.significant_samples[img_id][exp_iclass] = SignificantSamples();
+			}
+		}
+#endif
 		} // end loop img_id
 
 
@@ -2676,8 +2699,10 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 			CUSTOM_ALLOCATOR_REGION_NAME("BP_data");
 
 			// Loop from iclass_min to iclass_max to deal with seed generation in first iteration
+#ifdef _CUDA_ENABLED
 			AccPtr<XFLOAT> sorted_weights = ptrFactory.make<XFLOAT>((size_t)(ProjectionData[img_id].orientationNumAllClasses * translation_num));
 			sorted_weights.allAlloc();
+#endif
 			std::vector<AccPtr<XFLOAT> > eulers(baseMLO->mymodel.nr_classes, ptrFactory.make<XFLOAT>());
 
 			unsigned long classPos = 0;
@@ -2756,6 +2781,8 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 									 MAP WEIGHTS
 				======================================================*/
 
+				// The CPU kernels take op.significant_samples instead
+#ifdef _CUDA_ENABLED
 				CTIC(accMLO->timer,"pre_wavg_map");
 
 				for (long unsigned i = 0; i < orientation_num*translation_num; i++)
@@ -2767,8 +2794,11 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 
 				classPos+=orientation_num*translation_num;
 				CTOC(accMLO->timer,"pre_wavg_map");
+#endif
 			}
+#ifdef _CUDA_ENABLED
 			sorted_weights.cpToDevice();
+#endif
 
 			// These syncs are necessary (for multiple ranks on the same GPU), and (assumed) low-cost.
 			for (unsigned long iclass = sp.iclass_min; iclass <= sp.iclass_max; iclass++)
@@ -2798,6 +2828,17 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 						op.local_Minvsigma2[img_id].zdim,
 						op.local_Minvsigma2[img_id].xdim-1);
 
+#ifdef _CUDA_ENABLED
+				XFLOAT *weights = &(~sorted_weights)[classPos];
+				unsigned long *weight_start = NULL, *weight_trans = NULL;
+				long unsigned weight_orientation_num = orientation_num;
+#else
+				SignificantSamples &samples = op.significant_samples[img_id][iclass];
+				XFLOAT *weights = samples.weights.data();
+				unsigned long *weight_start = samples.start.data(), *weight_trans = samples.trans_idx.data();
+				long unsigned weight_orientation_num = samples.orientationNum();
+#endif
+
 				runWavgKernel(
 						projKernel,
 						~eulers[iclass],
@@ -2806,13 +2847,15 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 						&(~trans_xyz)[trans_x_offset], //~trans_x,
 						&(~trans_xyz)[trans_y_offset], //~trans_y,
 						&(~trans_xyz)[trans_z_offset], //~trans_z,
-						&(~sorted_weights)[classPos],
+						weights,
+						weight_start,
+						weight_trans,
 						~ctfs,
 						&(~wdiff2s)[sum_offset],
 						&(~wdiff2s)[AA_offset+AAXA_pos],
 						&(~wdiff2s)[XA_offset+AAXA_pos],
 						op,
-						orientation_num,
+						weight_orientation_num,
 						translation_num,
 						image_size,
 						img_id,
@@ -2898,6 +2941,18 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 					// Backproject every other particle into separate volumes
 					iproj_offset = (op.part_id % 2) * baseMLO->mymodel.nr_classes;
 
+
+#ifdef _CUDA_ENABLED
+				XFLOAT *weights = &(~sorted_weights)[classPos];
+				unsigned long *weight_start = NULL, *weight_trans = NULL;
+				long unsigned weight_orientation_num = orientation_num;
+#else
+				SignificantSamples &samples = op.significant_samples[img_id][iclass];
+				XFLOAT *weights = samples.weights.data();
+				unsigned long *weight_start = samples.start.data(), *weight_trans = samples.trans_idx.data();
+				long unsigned weight_orientation_num = samples.orientationNum();
+#endif
+
 				CTIC(accMLO->timer,"backproject");
 				runBackProjectKernel(
 					accMLO->bundle->backprojectors[iproj + iproj_offset],
@@ -2907,7 +2962,9 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 					&(~trans_xyz)[trans_x_offset], //~trans_x,
 					&(~trans_xyz)[trans_y_offset], //~trans_y,
 					&(~trans_xyz)[trans_z_offset], //~trans_z,
-					&(~sorted_weights)[classPos],
+					weights,
+					weight_start,
+					weight_trans,
 					~Minvsigma2s,
 					~ctfs,
 					translation_num,
@@ -2917,7 +2974,7 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 					op.local_Minvsigma2[img_id].xdim,
 					op.local_Minvsigma2[img_id].ydim,
 					op.local_Minvsigma2[img_id].zdim,
-					orientation_num,
+					weight_orientation_num,
 					accMLO->dataIs3D,
 					(baseMLO->do_grad),
 					ctf_premultiplied,
@@ -3129,12 +3186,6 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 				}
 			}
 
-			for (int n = 0; n < baseMLO->mymodel.nr_classes * baseMLO->mymodel.nr_bodies; n++)
-			{
-				if (!(baseMLO->do_skip_align || baseMLO->do_skip_rotate) )
-					baseMLO->wsum_model.pdf_direction[n] += thr_wsum_pdf_direction[n];
-			}
-
 			baseMLO->wsum_model.sigma2_offset += thr_wsum_sigma2_offset;
 
 			if (baseMLO->do_norm_correction && baseMLO->mymodel.nr_bodies == 1)
@@ -3142,7 +3193,18 @@ void storeWeightedSums(OptimisationParamters &op, SamplingParameters &sp,
 
 			baseMLO->wsum_model.LL += thr_sum_dLL;
 			baseMLO->wsum_model.ave_Pmax += thr_sum_Pmax;
-		}	
+		}
+
+		// The orientational pdfs are the largest of these sums: add them in a critical section of their own,
+		// so that one thread can add these while another one adds the sums above
+		if (!(baseMLO->do_skip_align || baseMLO->do_skip_rotate) )
+		{
+			#pragma omp critical(AccMLO_pdf_direction)
+			{
+				for (int n = 0; n < baseMLO->mymodel.nr_classes * baseMLO->mymodel.nr_bodies; n++)
+					baseMLO->wsum_model.pdf_direction[n] += thr_wsum_pdf_direction[n];
+			}
+		}
 	} // end if !do_skip_maximization
 
 	CTOC(accMLO->timer,"store_post_gpu");
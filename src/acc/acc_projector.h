@@ -9,6 +9,7 @@
 //#include "src/acc/cuda/cuda_kernels/cuda_device_utils.cuh"
 #ifndef _CUDA_ENABLED
 #include <complex>
+#include "src/float16.h"
 #endif
 
 class AccProjector
@@ -35,6 +36,10 @@ class AccProjector
 #else
 	std::complex<XFLOAT> *mdlComplex;
 	int externalFree;
+
+	// Reference in half precision (instead of mdlComplex), see initMdl
+	float16 *mdlHalf;
+	XFLOAT mdlHalfScale;
 #endif
 #endif  // PROJECTOR_NO_TEXTURES
 
@@ -62,6 +67,8 @@ public:
 #else
 		mdlComplex = 0;
 		externalFree = 0;
+		mdlHalf = 0;
+		mdlHalfScale = 1;
 #endif
 #endif
 	}
@@ -75,6 +82,17 @@ public:
 	void initMdl(Complex *data);
 #ifndef _CUDA_ENABLED
 void initMdl(std::complex<XFLOAT> *data);
+
+	// Use a reference that is stored in half precision: data interleaves the real and
+	// imaginary parts, which are multiplied by scale when they are interpolated.
+	// This halves the memory (and cache) used by the references, at the cost of
+	// relative errors of about 1e-4 in the projections. Like the above, data is not copied.
+	void initMdl(float16 *data, XFLOAT scale);
+
+	// Convert n complex values into the half-precision format of initMdl, and return its scale.
+	// The values are scaled such that the largest one is far from the float16 maximum, while
+	// small ones stay far above the smallest normal number (smaller ones are flushed to zero).
+	static XFLOAT convertToHalf(const Complex *data, size_t n, float16 *half);
 #endif
 
 	void clear();
@@ -176,6 +176,36 @@ void AccProjector::initMdl(std::complex<XFLOAT> *data)
 {
 	mdlComplex = data;  // No copy needed - everyone shares the complex reference arrays
 	externalFree = 1;   // This is shared memory freed outside the projector
+	mdlHalf = NULL;
+}
+
+void AccProjector::initMdl(float16 *data, XFLOAT scale)
+{
+	if ((mdlComplex != NULL) && (externalFree == 0))
+		delete [] mdlComplex;
+	mdlComplex = NULL;
+	externalFree = 1;
+	mdlHalf = data;     // Shared and freed outside the projector, like the complex arrays
+	mdlHalfScale = scale;
+}
+
+XFLOAT AccProjector::convertToHalf(const Complex *data, size_t n, float16 *half)
+{
+	RFLOAT max_abs = 0.;
+	for (size_t i = 0; i < n; i++)
+		max_abs = XMIPP_MAX(max_abs, XMIPP_MAX(ABS(data[i].real), ABS(data[i].imag)));
+
+	// Map the largest value onto 2^14: the interpolated values stay below the float16
+	// maximum (65504), and there are 28 bits of dynamic range above the smallest normal
+	XFLOAT scale = (max_abs > 0.) ? max_abs / 16384. : 1.;
+	RFLOAT inv_scale = 1. / scale;
+	for (size_t i = 0; i < n; i++)
+	{
+		half[2 * i] = float2half(data[i].real * inv_scale);
+		half[2 * i + 1] = float2half(data[i].imag * inv_scale);
+	}
+
+	return scale;
 }
 #endif
 
@@ -249,5 +279,6 @@ void AccProjector::clear()
 		delete [] mdlComplex;
 		mdlComplex = NULL;
 	}
+	mdlHalf = NULL;
 #endif  // ifdef CUDA
 }
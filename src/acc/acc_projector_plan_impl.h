@@ -26,9 +26,6 @@ void getOrientations(HealpixSampling &sampling, long int idir, long int ipsi, in
 		std::vector<int> &pointer_dir_nonzeroprior, std::vector<RFLOAT> &directions_prior,
 		std::vector<int> &pointer_psi_nonzeroprior, std::vector<RFLOAT> &psi_prior)
 {
-	my_rot.clear();
-	my_tilt.clear();
-	my_psi.clear();
 	long int my_idir, my_ipsi;
 	if (pointer_dir_nonzeroprior.size() > idir && pointer_psi_nonzeroprior.size() > ipsi)
 	{
@@ -43,46 +40,8 @@ void getOrientations(HealpixSampling &sampling, long int idir, long int ipsi, in
 		my_ipsi = ipsi;
 	}
 
-	if (oversampling_order == 0)
-	{
-		my_rot.push_back(sampling.rot_angles[my_idir]);
-		my_tilt.push_back(sampling.tilt_angles[my_idir]);
-		my_psi.push_back(sampling.psi_angles[my_ipsi]);
-	}
-	else if (!sampling.is_3D)
-	{
-		// for 2D sampling, only push back oversampled psi rotations
-		sampling.pushbackOversampledPsiAngles(my_ipsi, oversampling_order, 0., 0., my_rot, my_tilt, my_psi);
-	}
-	else
-	{
-		// Set up oversampled grid for 3D sampling
-		Healpix_Base HealPixOver(oversampling_order + sampling.healpix_order, NEST);
-		int fact = HealPixOver.Nside()/sampling.healpix_base.Nside();
-		int x, y, face;
-		RFLOAT rot, tilt;
-		// Get x, y and face for the original, coarse grid
-		long int ipix = sampling.directions_ipix[my_idir];
-		sampling.healpix_base.nest2xyf(ipix, x, y, face);
-		// Loop over the oversampled Healpix pixels on the fine grid
-		for (int j = fact * y; j < fact * (y+1); ++j)
-		{
-			for (int i = fact * x; i < fact * (x+1); ++i)
-			{
-				long int overpix = HealPixOver.xyf2nest(i, j, face);
-								// this one always has to be double (also for SINGLE_PRECISION CALCULATIONS) for call to external library
-				double zz, phi;
-				HealPixOver.pix2ang_z_phi(overpix, zz, phi);
-				rot = RAD2DEG(phi);
-				tilt = ACOSD(zz);
-
-				// The geometrical considerations about the symmetry below require that rot = [-180,180] and tilt [0,180]
-				sampling.checkDirection(rot, tilt);
-
-				sampling.pushbackOversampledPsiAngles(my_ipsi, oversampling_order, rot, tilt, my_rot, my_tilt, my_psi);
-			}
-		}
-	}
+	// Without random perturbation, which is applied through the R matrix in AccProjectorPlan::setup
+	sampling.getOversampledOrientations(my_idir, my_ipsi, oversampling_order, my_rot, my_tilt, my_psi);
 }
 
 void AccProjectorPlan::setup(
@@ -24,6 +24,10 @@ public:
 	PROJECTOR_PTR_TYPE mdlComplex;
 #else
 	std::complex<XFLOAT> *mdlComplex;
+
+	// Set (by makeKernel) instead of mdlComplex if the reference is stored in half precision
+	float16 *mdlHalf;
+	XFLOAT mdlHalfScale;
 #endif
 
 	AccProjectorKernel(
@@ -44,7 +48,12 @@ public:
 			padding_factor(padding_factor),
 			maxR(maxR), maxR2(maxR*maxR), maxR2_padded(maxR*maxR*padding_factor*padding_factor),
 			mdlComplex(mdlComplex)
-		{};
+		{
+#ifndef _CUDA_ENABLED
+			mdlHalf = NULL;
+			mdlHalfScale = 1;
+#endif
+		};
 
 	AccProjectorKernel(
 			int mdlX, int mdlY, int mdlZ,
@@ -62,6 +71,8 @@ public:
 				mdlReal(mdlReal), mdlImag(mdlImag)
 			{
 #ifndef _CUDA_ENABLED
+				mdlHalf = NULL;
+				mdlHalfScale = 1;
 std::complex<XFLOAT> *pData = mdlComplex;
 				for(size_t i=0; i<(size_t)mdlX * (size_t)mdlY * (size_t)mdlZ; i++) {
 					std::complex<XFLOAT> arrayval(*mdlReal ++, *mdlImag ++);
@@ -116,7 +127,10 @@ std::complex<XFLOAT> *pData = mdlComplex;
 real =   no_tex3D(mdlReal, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
 			imag = - no_tex3D(mdlImag, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
 #else
-			CpuKernels::complex3D(mdlComplex, real, imag, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
+			if (mdlHalf != NULL)
+				CpuKernels::complex3D_half(mdlHalf, mdlHalfScale, real, imag, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
+			else
+				CpuKernels::complex3D(mdlComplex, real, imag, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
 #endif
 
 			if(invers)
@@ -196,7 +210,10 @@ real =   no_tex3D(mdlReal, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
 real = no_tex3D(mdlReal, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
 			imag = no_tex3D(mdlImag, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
 	#else
-			CpuKernels::complex3D(mdlComplex, real, imag, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
+			if (mdlHalf != NULL)
+				CpuKernels::complex3D_half(mdlHalf, mdlHalfScale, real, imag, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
+			else
+				CpuKernels::complex3D(mdlComplex, real, imag, xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
 	#endif
 
 			if(invers)
@@ -269,7 +286,10 @@ __device__ __forceinline__
 real = no_tex2D(mdlReal, xp, yp, mdlX, mdlInitY);
 			imag = no_tex2D(mdlImag, xp, yp, mdlX, mdlInitY);
 	#else
-			CpuKernels::complex2D(mdlComplex, real, imag, xp, yp, mdlX, mdlInitY);
+			if (mdlHalf != NULL)
+				CpuKernels::complex2D_half(mdlHalf, mdlHalfScale, real, imag, xp, yp, mdlX, mdlInitY);
+			else
+				CpuKernels::complex2D(mdlComplex, real, imag, xp, yp, mdlX, mdlInitY);
 	#endif
 
 			if(invers)
@@ -323,6 +343,10 @@ p.mdlReal,
 #endif
 #endif
 				);
+#if defined(PROJECTOR_NO_TEXTURES) && !defined(_CUDA_ENABLED)
+		k.mdlHalf = p.mdlHalf;
+		k.mdlHalfScale = p.mdlHalfScale;
+#endif
 		return k;
 	}
 };  // class AccProjectorKernel
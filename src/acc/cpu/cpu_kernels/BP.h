@@ -21,10 +21,11 @@ void backproject2D(
 		XFLOAT *g_trans_x,
 		XFLOAT *g_trans_y,
 		XFLOAT* g_weights,
+		unsigned long* g_weight_start,
+		unsigned long* g_weight_trans,
 		XFLOAT* g_Minvsigma2s,
 		XFLOAT* g_ctfs,
 		unsigned long translation_num,
-		XFLOAT significant_weight,
 		XFLOAT weight_norm,
 		XFLOAT *g_eulers,
 		XFLOAT *g_model_real,
@@ -63,6 +64,10 @@ void backproject2D(
 	
 	for (unsigned long img=0; img<imageCount; img++) {
 
+		// Skip orientations without any significant weight
+		if (g_weight_start[img] == g_weight_start[img+1])
+			continue;
+
 		// Copy the rotation matrix to local variables
 		s_eulers[0] = g_eulers[img*9+0] * padding_factor;
 		s_eulers[1] = g_eulers[img*9+1] * padding_factor;
@@ -83,12 +88,10 @@ void backproject2D(
 			memset(real,   0,sizeof(XFLOAT)*img_x);
 			memset(imag,   0,sizeof(XFLOAT)*img_x);
 			
-			for (unsigned long itrans = 0; itrans < translation_num; itrans++)
+			for (unsigned long iw = g_weight_start[img]; iw < g_weight_start[img+1]; iw++)
 			{
-				XFLOAT weight = g_weights[img * translation_num + itrans];
-				
-				if (weight < significant_weight) 
-					continue;
+				unsigned long itrans = g_weight_trans[iw];
+				XFLOAT weight = g_weights[iw];
 
 				XFLOAT trans_cos_y, trans_sin_y;
 				if ( y < 0) {
@@ -234,10 +237,11 @@ void backproject3D(
 		XFLOAT *g_trans_y,
 		XFLOAT *g_trans_z,
 		XFLOAT* g_weights,
+		unsigned long* g_weight_start,
+		unsigned long* g_weight_trans,
 		XFLOAT* g_Minvsigma2s,
 		XFLOAT* g_ctfs,
 		unsigned long translation_num,
-		XFLOAT significant_weight,
 		XFLOAT weight_norm,
 		XFLOAT *g_eulers,
 		XFLOAT *g_model_real,
@@ -271,6 +275,10 @@ void backproject3D(
 
 	for (unsigned long img=0; img<imageCount; img++) {
 
+		// Skip orientations without any significant weight
+		if (g_weight_start[img] == g_weight_start[img+1])
+			continue;
+
 		 for (int i = 0; i < 9; i++)
 			 s_eulers[i] = g_eulers[img*9+i];
 
@@ -366,23 +374,19 @@ void backproject3D(
 
 					XFLOAT temp_real, temp_imag;
 
-					for (unsigned long itrans = 0; itrans < translation_num; itrans++)
+					for (unsigned long iw = g_weight_start[img]; iw < g_weight_start[img+1]; iw++)
 					{
-						weight = g_weights[img * translation_num + itrans];
-
-						if (weight >= significant_weight)
-						{
-							weight = weight * inv_minsigma_ctf;
+						unsigned long itrans = g_weight_trans[iw];
+						weight = g_weights[iw] * inv_minsigma_ctf;
                                                         Fweight[tid] += weight * ctf;
 
-							if(DATA3D)
-								CpuKernels::translatePixel(x, y, z, g_trans_x[itrans], g_trans_y[itrans], g_trans_z[itrans], img_real, img_imag, temp_real, temp_imag);
-							else
-								CpuKernels::translatePixel(x, y,    g_trans_x[itrans], g_trans_y[itrans],                    img_real, img_imag, temp_real, temp_imag);
+						if(DATA3D)
+							CpuKernels::translatePixel(x, y, z, g_trans_x[itrans], g_trans_y[itrans], g_trans_z[itrans], img_real, img_imag, temp_real, temp_imag);
+						else
+							CpuKernels::translatePixel(x, y,    g_trans_x[itrans], g_trans_y[itrans],                    img_real, img_imag, temp_real, temp_imag);
 
-							real[tid] += temp_real * weight;
-							imag[tid] += temp_imag * weight;
-						}
+						real[tid] += temp_real * weight;
+						imag[tid] += temp_imag * weight;
 					}
 
 					//BP
@@ -513,10 +517,11 @@ void backprojectRef3D(
 		XFLOAT *g_trans_x,
 		XFLOAT *g_trans_y,
 		XFLOAT* g_weights,
+		unsigned long* g_weight_start,
+		unsigned long* g_weight_trans,
 		XFLOAT* g_Minvsigma2s,
 		XFLOAT* g_ctfs,
 		unsigned long trans_num,
-		XFLOAT significant_weight,
 		XFLOAT weight_norm,
 		XFLOAT *g_eulers,
 		XFLOAT *g_model_real,
@@ -560,6 +565,10 @@ void backprojectRef3D(
 		
 	for (unsigned long img=0; img<imageCount; img++) {
 
+		// Skip orientations without any significant weight
+		if (g_weight_start[img] == g_weight_start[img+1])
+			continue;
+
 		for(int i = 0; i < 9; i++)
 			s_eulers[i] = g_eulers[img*9+i];
 
@@ -578,11 +587,10 @@ void backprojectRef3D(
 			memset(real,   0,sizeof(XFLOAT)*img_x);
 			memset(imag,   0,sizeof(XFLOAT)*img_x);
 
-			for (unsigned long itrans = 0; itrans < trans_num; itrans++)
+			for (unsigned long iw = g_weight_start[img]; iw < g_weight_start[img+1]; iw++)
 			{
-				XFLOAT weight = g_weights[img * trans_num + itrans];
-				if (weight < significant_weight)
-					continue;
+				unsigned long itrans = g_weight_trans[iw];
+				XFLOAT weight = g_weights[iw];
 
 				XFLOAT trans_cos_y, trans_sin_y;
 				if ( y < 0) {
@@ -773,10 +781,11 @@ void backproject3D_SGD(
 		XFLOAT *g_trans_y,
 		XFLOAT *g_trans_z,
 		XFLOAT* g_weights,
+		unsigned long* g_weight_start,
+		unsigned long* g_weight_trans,
 		XFLOAT* g_Minvsigma2s,
 		XFLOAT* g_ctfs,
 		unsigned long translation_num,
-		XFLOAT significant_weight,
 		XFLOAT weight_norm,
 		XFLOAT *g_eulers,
 		XFLOAT *g_model_real,
@@ -815,6 +824,10 @@ void backproject3D_SGD(
 		
 	for (unsigned long img=0; img<imageCount; img++) {
 
+		// Skip orientations without any significant weight
+		if (g_weight_start[img] == g_weight_start[img+1])
+			continue;
+
 		for (int i = 0; i < 9; i++)
 			s_eulers[i] = g_eulers[img*9+i];
 
@@ -926,23 +939,19 @@ void backproject3D_SGD(
 
 					XFLOAT temp_real, temp_imag;
 
-					for (unsigned long itrans = 0; itrans < translation_num; itrans++)
+					for (unsigned long iw = g_weight_start[img]; iw < g_weight_start[img+1]; iw++)
 					{
-						weight = g_weights[img * translation_num + itrans];
-
-						if (weight >= significant_weight)
-						{
-							weight = weight * inv_minsigma_ctf;
+						unsigned long itrans = g_weight_trans[iw];
+						weight = g_weights[iw] * inv_minsigma_ctf;
                                                         Fweight[tid] += weight * ctf;
 
-							if(DATA3D)
-								CpuKernels::translatePixel(x, y, z, g_trans_x[itrans], g_trans_y[itrans], g_trans_z[itrans], img_real, img_imag, temp_real, temp_imag);
-							else
-								CpuKernels::translatePixel(x, y,    g_trans_x[itrans], g_trans_y[itrans],                    img_real, img_imag, temp_real, temp_imag);
+						if(DATA3D)
+							CpuKernels::translatePixel(x, y, z, g_trans_x[itrans], g_trans_y[itrans], g_trans_z[itrans], img_real, img_imag, temp_real, temp_imag);
+						else
+							CpuKernels::translatePixel(x, y,    g_trans_x[itrans], g_trans_y[itrans],                    img_real, img_imag, temp_real, temp_imag);
 
-							real[tid] += (temp_real-ref_real[tid]) * weight;
-							imag[tid] += (temp_imag-ref_imag[tid]) * weight;
-						}
+						real[tid] += (temp_real-ref_real[tid]) * weight;
+						imag[tid] += (temp_imag-ref_imag[tid]) * weight;
 					}
 
 					//BP
@@ -1068,10 +1077,11 @@ void backproject2D_SGD(
 		XFLOAT *g_trans_x,
 		XFLOAT *g_trans_y,
 		XFLOAT* g_weights,
+		unsigned long* g_weight_start,
+		unsigned long* g_weight_trans,
 		XFLOAT* g_Minvsigma2s,
 		XFLOAT* g_ctfs,
 		unsigned long translation_num,
-		XFLOAT significant_weight,
 		XFLOAT weight_norm,
 		XFLOAT *g_eulers,
 		XFLOAT *g_model_real,
@@ -1110,6 +1120,10 @@ void backproject2D_SGD(
 
 	for (unsigned long img=0; img<imageCount; img++) {
 
+		// Skip orientations without any significant weight
+		if (g_weight_start[img] == g_weight_start[img+1])
+			continue;
+
 		// Copy the rotation matrix to local variables
 		s_eulers[0] = g_eulers[img*9+0];
 		s_eulers[1] = g_eulers[img*9+1];
@@ -1147,12 +1161,10 @@ void backproject2D_SGD(
 				ref_real *= ctf;
 				ref_imag *= ctf;
 
-				for (unsigned long itrans = 0; itrans < translation_num; itrans++)
+				for (unsigned long iw = g_weight_start[img]; iw < g_weight_start[img+1]; iw++)
 				{
-					XFLOAT weight = g_weights[img * translation_num + itrans];
-
-					if (weight < significant_weight)
-						continue;
+					unsigned long itrans = g_weight_trans[iw];
+					XFLOAT weight = g_weights[iw];
 
 					XFLOAT trans_cos_y, trans_sin_y;
 					if ( y < 0) {
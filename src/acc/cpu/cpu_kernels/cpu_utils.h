@@ -4,6 +4,7 @@
 #include <src/macros.h>
 #include <math.h>
 #include "src/acc/cpu/cpu_settings.h"
+#include "src/float16.h"
 #include <cassert>
 
 namespace CpuKernels
@@ -306,6 +307,100 @@ static void complex3D(
 	imag = dxy0[1] + (dxy1[1] - dxy0[1])*fz;	
 }
 
+// The same as complex2D and complex3D, but for a reference that is stored in half
+// precision (see AccProjector::initMdl). mdlHalf interleaves real and imaginary
+// parts, and the values are multiplied by scale after the interpolation.
+#ifndef __INTEL_COMPILER
+__attribute__((always_inline))
+#endif
+static inline
+void complex2D_half(float16 *mdlHalf, XFLOAT scale, XFLOAT &real, XFLOAT &imag,
+               XFLOAT xp, XFLOAT yp, int mdlX, int mdlInitY)
+{
+	int x0 = floorf(xp);
+	XFLOAT fx = xp - x0;
+
+	int y0 = floorf(yp);
+	XFLOAT fy = yp - y0;
+	y0 -= mdlInitY;
+
+	size_t offset1 = 2 * ((size_t)y0 * (size_t)mdlX + (size_t)x0);
+	size_t offset2 = offset1 + (size_t)2;
+	size_t offset3 = offset1 + (size_t)2 * (size_t)mdlX;
+	size_t offset4 = offset3 + (size_t)2;
+
+	XFLOAT dx0[2], dx1[2];
+	for (int c = 0; c < 2; c++)
+	{
+		XFLOAT d00 = half2float(mdlHalf[offset1 + c]);
+		XFLOAT d01 = half2float(mdlHalf[offset2 + c]);
+		XFLOAT d10 = half2float(mdlHalf[offset3 + c]);
+		XFLOAT d11 = half2float(mdlHalf[offset4 + c]);
+		dx0[c] = d00 + (d01 - d00) * fx;
+		dx1[c] = d10 + (d11 - d10) * fx;
+	}
+
+	real = (dx0[0] + (dx1[0] - dx0[0])*fy) * scale;
+	imag = (dx0[1] + (dx1[1] - dx0[1])*fy) * scale;
+}
+
+#ifndef __INTEL_COMPILER
+__attribute__((always_inline))
+#endif
+static inline
+void complex3D_half(
+				float16 *mdlHalf, XFLOAT scale,
+				XFLOAT &real, XFLOAT &imag,
+				XFLOAT xp, XFLOAT yp, XFLOAT zp, int mdlX, int mdlXY, int mdlInitY, int mdlInitZ
+		)
+{
+	int x0 = floorf(xp);
+	XFLOAT fx = xp - x0;
+
+	int y0 = floorf(yp);
+	XFLOAT fy = yp - y0;
+	y0 -= mdlInitY;
+
+	int z0 = floorf(zp);
+	XFLOAT fz = zp - z0;
+	z0 -= mdlInitZ;
+
+	size_t offset1 = 2 * ((size_t)z0*(size_t)mdlXY+(size_t)y0*(size_t)mdlX+(size_t)x0);
+	size_t offset2 = offset1 + (size_t)2;
+	size_t offset3 = offset1 + (size_t)2 * (size_t)mdlX;
+	size_t offset4 = offset3 + (size_t)2;
+	size_t offset5 = offset1 + (size_t)2 * (size_t)mdlXY;
+	size_t offset6 = offset2 + (size_t)2 * (size_t)mdlXY;
+	size_t offset7 = offset3 + (size_t)2 * (size_t)mdlXY;
+	size_t offset8 = offset4 + (size_t)2 * (size_t)mdlXY;
+
+	XFLOAT res[2];
+	for (int c = 0; c < 2; c++)
+	{
+		XFLOAT d000 = half2float(mdlHalf[offset1 + c]);
+		XFLOAT d001 = half2float(mdlHalf[offset2 + c]);
+		XFLOAT d010 = half2float(mdlHalf[offset3 + c]);
+		XFLOAT d011 = half2float(mdlHalf[offset4 + c]);
+		XFLOAT d100 = half2float(mdlHalf[offset5 + c]);
+		XFLOAT d101 = half2float(mdlHalf[offset6 + c]);
+		XFLOAT d110 = half2float(mdlHalf[offset7 + c]);
+		XFLOAT d111 = half2float(mdlHalf[offset8 + c]);
+		//-----------------------------
+		XFLOAT dx00 = d000 + (d001 - d000)*fx;
+		XFLOAT dx01 = d100 + (d101 - d100)*fx;
+		XFLOAT dx10 = d010 + (d011 - d010)*fx;
+		XFLOAT dx11 = d110 + (d111 - d110)*fx;
+		//-----------------------------
+		XFLOAT dxy0 = dx00 + (dx10 - dx00)*fy;
+		XFLOAT dxy1 = dx01 + (dx11 - dx01)*fy;
+		//-----------------------------
+		res[c] = dxy0 + (dxy1 - dxy0)*fz;
+	}
+
+	real = res[0] * scale;
+	imag = res[1] * scale;
+}
+
 } // end of namespace CpuKernels
 
 #endif //CPU_UTILITIES_H
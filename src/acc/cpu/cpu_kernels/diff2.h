@@ -10,6 +10,7 @@
 #include "src/acc/acc_projector.h"
 #include "src/acc/cpu/cpu_kernels/cpu_utils.h"
 #include "src/acc/cpu/cpu_kernels/helper.h"
+#include "src/acc/cpu/cpu_kernels/diff2_simd.h"
 
 namespace CpuKernels
 {
@@ -456,6 +457,11 @@ inline void diff2_coarse(
 				elements = image_size - start;
 
 			for (int i = 0; i < eulers_per_block; i ++) {
+				// Use the explicitly vectorised interpolation if this CPU supports it
+				if (Simd::projectPixels(projector, REF3D, elements, x[pass], y[pass], DATA3D ? z[pass] : NULL,
+				                        &s_eulers[i*16], s_ref_real[i], s_ref_imag[i]))
+					continue;
+
 				#pragma omp simd
 				for (int tid=0; tid<elements; tid++){
 
@@ -543,6 +549,19 @@ inline void diff2_coarse(
 				for (int j = 0; j < eulers_per_block; j ++)
 					diffi[j] = 0.0;
 
+#ifndef __INTEL_COMPILER
+				if (Simd::diff2Coarse(elements, eulers_per_block, block_sz,
+				                      trans_cos_x, trans_sin_x, trans_cos_y, trans_sin_y,
+				                      DATA3D ? trans_cos_z : NULL, DATA3D ? trans_sin_z : NULL,
+				                      s_real[pass], s_imag[pass], s_corr[pass],
+				                      &s_ref_real[0][0], &s_ref_imag[0][0], diffi))
+				{
+					for (int j = 0; j < eulers_per_block; j ++)
+						diff2s[i][j] += diffi[j];
+					continue;
+				}
+#endif  // not Intel Compiler
+
 #if _OPENMP > 201307	// For OpenMP 4.5 and later
 				#pragma omp simd reduction(+:diffi[:eulers_per_block])
 #endif
@@ -688,14 +707,17 @@ inline void diff2_fine_2D(
 				}
 			}
 
-			#pragma omp simd
-			for(int x = xstart; x < xend; x++) {
-				if(REF3D)
-					projector.project3Dmodel(x, y, e1, e2, e3, e4, e5, e6, 
-										 ref_real[x], ref_imag[x]);
-				else			                         
-					projector.project2Dmodel(x, y, e1, e2, e3, e4, 
-										 ref_real[x], ref_imag[x]);			                      
+			if (!Simd::projectRow(projector, REF3D, xstart, xend, y, 0, &g_eulers[offset], ref_real, ref_imag))
+			{
+				#pragma omp simd
+				for(int x = xstart; x < xend; x++) {
+					if(REF3D)
+						projector.project3Dmodel(x, y, e1, e2, e3, e4, e5, e6, 
+											 ref_real[x], ref_imag[x]);
+					else			                         
+						projector.project2Dmodel(x, y, e1, e2, e3, e4, 
+											 ref_real[x], ref_imag[x]);			                      
+				}
 			}
 
 			#pragma omp simd
@@ -727,6 +749,13 @@ inline void diff2_fine_2D(
 				XFLOAT *trans_sin_x = &sin_x[itrans][0];     
 
 				XFLOAT sum = (XFLOAT) 0.0;                   
+				if (Simd::diff2FineRow(xstart, xend, trans_cos_x, trans_sin_x, trans_cos_y, trans_sin_y, 1, 0, false,
+				                       imgs_real, imgs_imag, ref_real, ref_imag, sum))
+				{
+					s[itrans] += sum;
+					continue;
+				}
+
 				#pragma omp simd  reduction(+:sum) 
 				for(int x = xstart; x < xend; x++) {
 					XFLOAT ss = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
@@ -857,10 +886,13 @@ inline void diff2_fine_3D(
 					}
 				}
 
-				#pragma omp simd
-				for(int x = xstart_y; x < xend_y; x++) {
-					projector.project3Dmodel(x, y, z, e1, e2, e3, e4, e5, e6, e7, e8, e9, 
-											 ref_real[x], ref_imag[x]);
+				if (!Simd::projectRow(projector, true, xstart_y, xend_y, y, z, &g_eulers[offset], ref_real, ref_imag))
+				{
+					#pragma omp simd
+					for(int x = xstart_y; x < xend_y; x++) {
+						projector.project3Dmodel(x, y, z, e1, e2, e3, e4, e5, e6, e7, e8, e9, 
+												 ref_real[x], ref_imag[x]);
+					}
 				}
 
 				#pragma omp simd
@@ -902,6 +934,13 @@ inline void diff2_fine_3D(
 					XFLOAT *trans_sin_x = &sin_x[itrans][0];     
 
 					XFLOAT sum = (XFLOAT) 0.0;                   
+					if (Simd::diff2FineRow(xstart_y, xend_y, trans_cos_x, trans_sin_x, trans_cos_y, trans_sin_y,
+					                       trans_cos_z, trans_sin_z, true, imgs_real, imgs_imag, ref_real, ref_imag, sum))
+					{
+						s[itrans] += sum;
+						continue;
+					}
+
 					#pragma omp simd  reduction(+:sum) 
 					for(int x = xstart_y; x < xend_y; x++) {
 						XFLOAT s1  = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
@@ -0,0 +1,4 @@
+// AVX2 (+FMA, F16C) version of the vectorised difference kernels; only these kernels are compiled for it
+#define DIFF2_SIMD_NAMESPACE Avx2
+#define DIFF2_SIMD_TARGET "avx2,fma,f16c"
+#include "src/acc/cpu/cpu_kernels/diff2_simd_impl.h"
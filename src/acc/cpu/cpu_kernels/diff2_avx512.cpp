@@ -0,0 +1,5 @@
+// AVX-512 version of the vectorised difference kernels; only these kernels are compiled for it
+#define DIFF2_SIMD_NAMESPACE Avx512
+#define DIFF2_SIMD_TARGET "avx512f,avx2,fma,f16c"
+#define DIFF2_SIMD_AVX512
+#include "src/acc/cpu/cpu_kernels/diff2_simd_impl.h"
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include "src/acc/cpu/cpu_kernels/diff2_simd.h"
+
+namespace CpuKernels
+{
+namespace Simd
+{
+
+static Level detectLevel()
+{
+	Level level = NONE;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+		level = AVX2;
+	if (level == AVX2 && __builtin_cpu_supports("avx512f"))
+		level = AVX512;
+#endif
+
+	// Allow users to limit (but not to raise) the instruction set
+	const char *env = getenv("RELION_CPU_SIMD");
+	if (env != NULL)
+	{
+		Level requested = AVX512;
+		if (strcmp(env, "none") == 0)
+			requested = NONE;
+		else if (strcmp(env, "avx2") == 0)
+			requested = AVX2;
+		else if (strcmp(env, "avx512") != 0)
+			std::cerr << " WARNING: ignoring unknown value of RELION_CPU_SIMD: " << env << " (use none, avx2 or avx512)" << std::endl;
+		if (requested < level)
+			level = requested;
+	}
+
+	return level;
+}
+
+Level level()
+{
+	static const Level my_level = detectLevel();
+	return my_level;
+}
+
+bool projectPixels(AccProjectorKernel &projector, bool ref3D, int n,
+		const int *x, const int *y, const int *z, const XFLOAT *e,
+		XFLOAT *real, XFLOAT *imag)
+{
+	switch (level())
+	{
+	case AVX512:
+		return Avx512::projectPixels(projector, ref3D, n, x, y, z, e, real, imag);
+	case AVX2:
+		return Avx2::projectPixels(projector, ref3D, n, x, y, z, e, real, imag);
+	default:
+		return false;
+	}
+}
+
+bool projectRow(AccProjectorKernel &projector, bool ref3D, int xstart, int xend,
+		int y, int z, const XFLOAT *e, XFLOAT *real, XFLOAT *imag)
+{
+	switch (level())
+	{
+	case AVX512:
+		return Avx512::projectRow(projector, ref3D, xstart, xend, y, z, e, real, imag);
+	case AVX2:
+		return Avx2::projectRow(projector, ref3D, xstart, xend, y, z, e, real, imag);
+	default:
+		return false;
+	}
+}
+
+bool diff2Coarse(int n, int nr_eulers, int ref_stride,
+		const XFLOAT *cos_x, const XFLOAT *sin_x,
+		const XFLOAT *cos_y, const XFLOAT *sin_y,
+		const XFLOAT *cos_z, const XFLOAT *sin_z,
+		const XFLOAT *img_real, const XFLOAT *img_imag, const XFLOAT *corr,
+		const XFLOAT *ref_real, const XFLOAT *ref_imag, XFLOAT *diffi)
+{
+	switch (level())
+	{
+	case AVX512:
+		return Avx512::diff2Coarse(n, nr_eulers, ref_stride, cos_x, sin_x, cos_y, sin_y, cos_z, sin_z,
+				img_real, img_imag, corr, ref_real, ref_imag, diffi);
+	case AVX2:
+		return Avx2::diff2Coarse(n, nr_eulers, ref_stride, cos_x, sin_x, cos_y, sin_y, cos_z, sin_z,
+				img_real, img_imag, corr, ref_real, ref_imag, diffi);
+	default:
+		return false;
+	}
+}
+
+bool diff2FineRow(int xstart, int xend,
+		const XFLOAT *cos_x, const XFLOAT *sin_x,
+		XFLOAT cos_y, XFLOAT sin_y, XFLOAT cos_z, XFLOAT sin_z, bool do_z,
+		const XFLOAT *img_real, const XFLOAT *img_imag,
+		const XFLOAT *ref_real, const XFLOAT *ref_imag, XFLOAT &sum)
+{
+	switch (level())
+	{
+	case AVX512:
+		return Avx512::diff2FineRow(xstart, xend, cos_x, sin_x, cos_y, sin_y, cos_z, sin_z, do_z,
+				img_real, img_imag, ref_real, ref_imag, sum);
+	case AVX2:
+		return Avx2::diff2FineRow(xstart, xend, cos_x, sin_x, cos_y, sin_y, cos_z, sin_z, do_z,
+				img_real, img_imag, ref_real, ref_imag, sum);
+	default:
+		return false;
+	}
+}
+
+} // end of namespace Simd
+} // end of namespace CpuKernels
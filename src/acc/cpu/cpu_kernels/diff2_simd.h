@@ -0,0 +1,79 @@
+#ifndef DIFF2_SIMD_KERNELS_H_
+#define DIFF2_SIMD_KERNELS_H_
+
+#include <limits>
+#include "src/acc/cpu/cpu_settings.h"
+#include "src/acc/acc_projector.h"
+#include "src/acc/cpu/cpu_kernels/cpu_utils.h"
+#include "src/acc/acc_projectorkernel_impl.h"
+
+namespace CpuKernels
+{
+
+/*
+ *   	EXPLICITLY VECTORISED PARTS OF THE DIFFERENCE-BASED KERNELS
+ */
+
+// The coarse and fine difference kernels in diff2.h spend nearly all of their
+// time in three loops: the (gathered) trilinear interpolation of the reference,
+// the phase shift of the image (a complex multiplication) and the weighted sum
+// of the squared differences. The functions below do these with AVX2 or AVX-512
+// intrinsics. They are compiled for both instruction sets (diff2_avx2.cpp and
+// diff2_avx512.cpp), and the ones in namespace Simd pick the widest one the CPU
+// supports at run time. They return false when they cannot be used (older CPU,
+// double precision, or a reference too large for 32-bit gather indices), in
+// which case the kernels fall back to their auto-vectorised loops.
+//
+// Set RELION_CPU_SIMD to none, avx2 or avx512 to limit the instruction set.
+
+#define DIFF2_SIMD_DECLARATIONS \
+	bool projectPixels(AccProjectorKernel &projector, bool ref3D, int n, \
+			const int *x, const int *y, const int *z, const XFLOAT *e, \
+			XFLOAT *real, XFLOAT *imag); \
+	bool projectRow(AccProjectorKernel &projector, bool ref3D, int xstart, int xend, \
+			int y, int z, const XFLOAT *e, XFLOAT *real, XFLOAT *imag); \
+	bool diff2Coarse(int n, int nr_eulers, int ref_stride, \
+			const XFLOAT *cos_x, const XFLOAT *sin_x, \
+			const XFLOAT *cos_y, const XFLOAT *sin_y, \
+			const XFLOAT *cos_z, const XFLOAT *sin_z, \
+			const XFLOAT *img_real, const XFLOAT *img_imag, const XFLOAT *corr, \
+			const XFLOAT *ref_real, const XFLOAT *ref_imag, XFLOAT *diffi); \
+	bool diff2FineRow(int xstart, int xend, \
+			const XFLOAT *cos_x, const XFLOAT *sin_x, \
+			XFLOAT cos_y, XFLOAT sin_y, XFLOAT cos_z, XFLOAT sin_z, bool do_z, \
+			const XFLOAT *img_real, const XFLOAT *img_imag, \
+			const XFLOAT *ref_real, const XFLOAT *ref_imag, XFLOAT &sum);
+
+namespace Simd
+{
+	enum Level { NONE = 0, AVX2 = 1, AVX512 = 2 };
+
+	// Widest instruction set that is supported by this CPU (and allowed by RELION_CPU_SIMD)
+	Level level();
+
+	// Project the reference at the n pixels (x[i], y[i], z[i]) with the rotation matrix e (3x3, row-major),
+	// like AccProjectorKernel::project3Dmodel (ref3D) or project2Dmodel. z may be NULL for 2D data.
+	//
+	// projectRow does the same for the pixels (x, y, z) with xstart <= x < xend, and stores them in real[x], imag[x].
+	//
+	// diff2Coarse adds, for each of nr_eulers references, the weighted squared difference between the reference
+	// (ref_real[j * ref_stride + i]) and the image shifted by the phase factors (cos_x[i], sin_x[i]) etc., to diffi[j].
+	// cos_z and sin_z are NULL for 2D data.
+	//
+	// diff2FineRow sets sum to the squared difference between the reference and the shifted image along one row.
+	DIFF2_SIMD_DECLARATIONS
+}
+
+namespace Avx2
+{
+	DIFF2_SIMD_DECLARATIONS
+}
+
+namespace Avx512
+{
+	DIFF2_SIMD_DECLARATIONS
+}
+
+} // end of namespace CpuKernels
+
+#endif /* DIFF2_SIMD_KERNELS_H_ */
@@ -0,0 +1,396 @@
+// Body of the explicitly vectorised difference kernels, see diff2_simd.h.
+// This file is included by diff2_avx2.cpp and diff2_avx512.cpp, which define
+// DIFF2_SIMD_NAMESPACE and the instruction set DIFF2_SIMD_TARGET (and
+// DIFF2_SIMD_AVX512 for the wider one). Those files are compiled with the
+// normal flags: only the functions below get the target attribute, so that
+// no inline code of the included headers is ever compiled for an instruction
+// set the CPU may not have. On other architectures or compilers and in double
+// precision, all functions return false.
+
+#include <limits.h>
+#include "src/acc/cpu/cpu_kernels/diff2_simd.h"
+
+#if !defined(ACC_DOUBLE_PRECISION) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DIFF2_SIMD_ENABLED
+#include <immintrin.h>
+#define SIMD_INLINE static inline __attribute__((target(DIFF2_SIMD_TARGET)))
+#define SIMD_KERNEL __attribute__((target(DIFF2_SIMD_TARGET)))
+#endif
+
+namespace CpuKernels
+{
+namespace DIFF2_SIMD_NAMESPACE
+{
+
+#ifdef DIFF2_SIMD_ENABLED
+
+/*
+ * Thin wrappers around the intrinsics, so that the kernels below are the same for both instruction sets.
+ * Loads and stores take a mask of the valid lanes, which zeroes (or leaves alone) the lanes past the end of an array.
+ */
+#if defined(DIFF2_SIMD_AVX512)
+
+typedef __m512  vfloat;
+typedef __m512i vint;
+typedef __mmask16 vmask;
+static const int VLEN = 16;
+
+SIMD_INLINE vfloat vset(float a)                      { return _mm512_set1_ps(a); }
+SIMD_INLINE vint   vseti(int a)                       { return _mm512_set1_epi32(a); }
+SIMD_INLINE vint   viota()                            { return _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+SIMD_INLINE vmask  vfirst(int n)                      { return (n >= VLEN) ? (vmask)0xffff : (vmask)((1u << n) - 1); }
+SIMD_INLINE vfloat vload(const float *p, vmask m)     { return _mm512_maskz_loadu_ps(m, p); }
+SIMD_INLINE vint   vloadi(const int *p, vmask m)      { return _mm512_maskz_loadu_epi32(m, p); }
+SIMD_INLINE void   vstore(float *p, vfloat a, vmask m){ _mm512_mask_storeu_ps(p, m, a); }
+SIMD_INLINE vfloat vadd(vfloat a, vfloat b)           { return _mm512_add_ps(a, b); }
+SIMD_INLINE vfloat vsub(vfloat a, vfloat b)           { return _mm512_sub_ps(a, b); }
+SIMD_INLINE vfloat vmul(vfloat a, vfloat b)           { return _mm512_mul_ps(a, b); }
+SIMD_INLINE vfloat vfmadd(vfloat a, vfloat b, vfloat c)  { return _mm512_fmadd_ps(a, b, c); }  // a*b+c
+SIMD_INLINE vfloat vfnmadd(vfloat a, vfloat b, vfloat c) { return _mm512_fnmadd_ps(a, b, c); } // c-a*b
+SIMD_INLINE vfloat vfloor(vfloat a)                   { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+SIMD_INLINE vint   vtrunc(vfloat a)                   { return _mm512_cvttps_epi32(a); }
+SIMD_INLINE vfloat vfloat_of(vint a)                  { return _mm512_cvtepi32_ps(a); }
+SIMD_INLINE vint   vaddi(vint a, vint b)              { return _mm512_add_epi32(a, b); }
+SIMD_INLINE vint   vmuli(vint a, vint b)              { return _mm512_mullo_epi32(a, b); }
+SIMD_INLINE vmask  vand(vmask a, vmask b)             { return a & b; }
+SIMD_INLINE vmask  vnegative(vfloat a)                { return _mm512_cmp_ps_mask(a, _mm512_setzero_ps(), _CMP_LT_OQ); }
+SIMD_INLINE vmask  vle(vint a, vint b)                { return _mm512_cmple_epi32_mask(a, b); }
+SIMD_INLINE vfloat vnegate_if(vmask m, vfloat a)      { return _mm512_mask_sub_ps(a, m, _mm512_setzero_ps(), a); }
+SIMD_INLINE vfloat vzero_unless(vmask m, vfloat a)    { return _mm512_maskz_mov_ps(m, a); }
+SIMD_INLINE vint   vzero_unlessi(vmask m, vint a)     { return _mm512_maskz_mov_epi32(m, a); }
+SIMD_INLINE vfloat vgather(const float *p, vint idx)  { return _mm512_i32gather_ps(idx, p, 4); }
+SIMD_INLINE vint   vgatheri(const int *p, vint idx)   { return _mm512_i32gather_epi32(idx, p, 4); }
+SIMD_INLINE float  vsum(vfloat a)                     { return _mm512_reduce_add_ps(a); }
+// Convert the float16 in the lower (hi = false) or upper (hi = true) 16 bits of each lane
+SIMD_INLINE vfloat vhalf2float(vint a, bool hi)
+{
+	if (hi)
+		a = _mm512_srli_epi32(a, 16);
+	return _mm512_cvtph_ps(_mm512_cvtepi32_epi16(a));
+}
+
+#else // AVX2
+
+typedef __m256  vfloat;
+typedef __m256i vint;
+typedef __m256  vmask;
+static const int VLEN = 8;
+
+SIMD_INLINE vfloat vset(float a)                      { return _mm256_set1_ps(a); }
+SIMD_INLINE vint   vseti(int a)                       { return _mm256_set1_epi32(a); }
+SIMD_INLINE vint   viota()                            { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+SIMD_INLINE vmask  vfirst(int n)                      { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(n), viota())); }
+SIMD_INLINE vfloat vload(const float *p, vmask m)     { return _mm256_maskload_ps(p, _mm256_castps_si256(m)); }
+SIMD_INLINE vint   vloadi(const int *p, vmask m)      { return _mm256_maskload_epi32(p, _mm256_castps_si256(m)); }
+SIMD_INLINE void   vstore(float *p, vfloat a, vmask m){ _mm256_maskstore_ps(p, _mm256_castps_si256(m), a); }
+SIMD_INLINE vfloat vadd(vfloat a, vfloat b)           { return _mm256_add_ps(a, b); }
+SIMD_INLINE vfloat vsub(vfloat a, vfloat b)           { return _mm256_sub_ps(a, b); }
+SIMD_INLINE vfloat vmul(vfloat a, vfloat b)           { return _mm256_mul_ps(a, b); }
+SIMD_INLINE vfloat vfmadd(vfloat a, vfloat b, vfloat c)  { return _mm256_fmadd_ps(a, b, c); }  // a*b+c
+SIMD_INLINE vfloat vfnmadd(vfloat a, vfloat b, vfloat c) { return _mm256_fnmadd_ps(a, b, c); } // c-a*b
+SIMD_INLINE vfloat vfloor(vfloat a)                   { return _mm256_floor_ps(a); }
+SIMD_INLINE vint   vtrunc(vfloat a)                   { return _mm256_cvttps_epi32(a); }
+SIMD_INLINE vfloat vfloat_of(vint a)                  { return _mm256_cvtepi32_ps(a); }
+SIMD_INLINE vint   vaddi(vint a, vint b)              { return _mm256_add_epi32(a, b); }
+SIMD_INLINE vint   vmuli(vint a, vint b)              { return _mm256_mullo_epi32(a, b); }
+SIMD_INLINE vmask  vand(vmask a, vmask b)             { return _mm256_and_ps(a, b); }
+SIMD_INLINE vmask  vnegative(vfloat a)                { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ); }
+SIMD_INLINE vmask  vle(vint a, vint b)                { return _mm256_xor_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, b)), _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+SIMD_INLINE vfloat vnegate_if(vmask m, vfloat a)      { return _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_setzero_ps(), a), m); }
+SIMD_INLINE vfloat vzero_unless(vmask m, vfloat a)    { return _mm256_and_ps(m, a); }
+SIMD_INLINE vint   vzero_unlessi(vmask m, vint a)     { return _mm256_and_si256(_mm256_castps_si256(m), a); }
+SIMD_INLINE vfloat vgather(const float *p, vint idx)  { return _mm256_i32gather_ps(p, idx, 4); }
+SIMD_INLINE vint   vgatheri(const int *p, vint idx)   { return _mm256_i32gather_epi32(p, idx, 4); }
+SIMD_INLINE vfloat vhalf2float(vint a, bool hi)
+{
+	a = hi ? _mm256_srli_epi32(a, 16) : _mm256_and_si256(a, _mm256_set1_epi32(0xffff));
+	// Pack the 16-bit values into the lower half (packus works within each 128-bit lane)
+	a = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, a), 0xd8);
+	return _mm256_cvtph_ps(_mm256_castsi256_si128(a));
+}
+SIMD_INLINE float  vsum(vfloat a)
+{
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_movehdup_ps(s));
+	return _mm_cvtss_f32(s);
+}
+
+#endif
+
+// Pixels of the shifted image that diff2Coarse keeps at a time (a multiple of VLEN)
+#define DIFF2_SIMD_CHUNK 256
+
+// Linear interpolation a + (b - a) * f
+SIMD_INLINE vfloat vlerp(vfloat a, vfloat b, vfloat f)
+{
+	return vfmadd(vsub(b, a), f, a);
+}
+
+// Gather the complex reference at the (complex) offsets idx. Real and imaginary parts are interleaved,
+// so in full precision they are gathered at twice the offset (plus one), and in half precision both
+// are gathered at once as one 32-bit word. The half-precision values are not scaled yet.
+SIMD_INLINE void gatherComplex(AccProjectorKernel &p, vint idx, vfloat *d)
+{
+	if (p.mdlHalf != NULL)
+	{
+		vint w = vgatheri((const int *)p.mdlHalf, idx);
+		d[0] = vhalf2float(w, false);
+		d[1] = vhalf2float(w, true);
+	}
+	else
+	{
+		const float *mdl = (const float *)p.mdlComplex;
+		idx = vaddi(idx, idx);
+		d[0] = vgather(mdl, idx);
+		d[1] = vgather(mdl, vaddi(idx, vseti(1)));
+	}
+}
+
+// Interpolate the complex reference at (xp, yp, zp), see complex3D and complex2D in cpu_utils.h
+// and AccProjectorKernel::project3Dmodel / project2Dmodel.
+// Lanes that are not in valid, or outside the maximum radius, are set to zero.
+SIMD_INLINE void projectVector(AccProjectorKernel &p, bool ref3D, vmask valid,
+		vint x, vint y, vint z, const XFLOAT *e, vfloat &real, vfloat &imag)
+{
+	vfloat xf = vfloat_of(x), yf = vfloat_of(y), zf = vfloat_of(z);
+	vfloat pf = vset(p.padding_factor);
+
+	vfloat xp = vmul(vfmadd(vset(e[0]), xf, vfmadd(vset(e[1]), yf, vmul(vset(e[2]), zf))), pf);
+	vfloat yp = vmul(vfmadd(vset(e[3]), xf, vfmadd(vset(e[4]), yf, vmul(vset(e[5]), zf))), pf);
+	vfloat zp = vset(0.f);
+	vfloat r2 = vfmadd(xp, xp, vmul(yp, yp));
+	if (ref3D)
+	{
+		zp = vmul(vfmadd(vset(e[6]), xf, vfmadd(vset(e[7]), yf, vmul(vset(e[8]), zf))), pf);
+		r2 = vfmadd(zp, zp, r2);
+	}
+
+	// The scalar code compares the truncated radius
+	vmask inside = vand(valid, vle(vtrunc(r2), vseti(p.maxR2_padded)));
+
+	// Get complex conjugated hermitian symmetry pair
+	vmask invers = vnegative(xp);
+	xp = vnegate_if(invers, xp);
+	yp = vnegate_if(invers, yp);
+	zp = vnegate_if(invers, zp);
+
+	vfloat x0f = vfloor(xp), y0f = vfloor(yp), z0f = vfloor(zp);
+	vfloat fx = vsub(xp, x0f), fy = vsub(yp, y0f), fz = vsub(zp, z0f);
+	vint y0 = vaddi(vtrunc(y0f), vseti(-p.mdlInitY));
+	vint offset = vaddi(vmuli(y0, vseti(p.mdlX)), vtrunc(x0f));
+	if (ref3D)
+	{
+		vint z0 = vaddi(vtrunc(z0f), vseti(-p.mdlInitZ));
+		offset = vaddi(offset, vmuli(z0, vseti(p.mdlXY)));
+	}
+
+	vint idx000 = vzero_unlessi(inside, offset);
+	vint idx010 = vaddi(idx000, vseti(p.mdlX));
+
+	vfloat d00[2], d01[2], d10[2], d11[2];
+	gatherComplex(p, idx000, d00);
+	gatherComplex(p, vaddi(idx000, vseti(1)), d01);
+	gatherComplex(p, idx010, d10);
+	gatherComplex(p, vaddi(idx010, vseti(1)), d11);
+
+	vfloat res[2];
+	if (ref3D)
+	{
+		vint idx100 = vaddi(idx000, vseti(p.mdlXY));
+		vint idx110 = vaddi(idx010, vseti(p.mdlXY));
+		vfloat d100[2], d101[2], d110[2], d111[2];
+		gatherComplex(p, idx100, d100);
+		gatherComplex(p, vaddi(idx100, vseti(1)), d101);
+		gatherComplex(p, idx110, d110);
+		gatherComplex(p, vaddi(idx110, vseti(1)), d111);
+		for (int c = 0; c < 2; c++)
+		{
+			vfloat dxy0 = vlerp(vlerp(d00[c], d01[c], fx), vlerp(d10[c], d11[c], fx), fy);
+			vfloat dxy1 = vlerp(vlerp(d100[c], d101[c], fx), vlerp(d110[c], d111[c], fx), fy);
+			res[c] = vlerp(dxy0, dxy1, fz);
+		}
+	}
+	else
+	{
+		for (int c = 0; c < 2; c++)
+			res[c] = vlerp(vlerp(d00[c], d01[c], fx), vlerp(d10[c], d11[c], fx), fy);
+	}
+
+	if (p.mdlHalf != NULL)
+	{
+		vfloat scale = vset(p.mdlHalfScale);
+		res[0] = vmul(res[0], scale);
+		res[1] = vmul(res[1], scale);
+	}
+
+	real = vzero_unless(inside, res[0]);
+	imag = vzero_unless(inside, vnegate_if(invers, res[1]));
+}
+
+// Gathers use 32-bit indices into the interleaved floats of the reference
+SIMD_INLINE bool fitsGatherIndices(AccProjectorKernel &p, bool ref3D)
+{
+	size_t nr_floats = 2 * (ref3D ? (size_t)p.mdlXY * (size_t)p.mdlZ : (size_t)p.mdlXY);
+	return nr_floats < (size_t)INT_MAX;
+}
+
+SIMD_KERNEL bool projectPixels(AccProjectorKernel &projector, bool ref3D, int n,
+		const int *x, const int *y, const int *z, const XFLOAT *e,
+		XFLOAT *real, XFLOAT *imag)
+{
+	if (!fitsGatherIndices(projector, ref3D))
+		return false;
+
+	for (int i = 0; i < n; i += VLEN)
+	{
+		vmask valid = vfirst(n - i);
+		vint vz = (z == NULL) ? vseti(0) : vloadi(z + i, valid);
+		vfloat r, im;
+		projectVector(projector, ref3D, valid, vloadi(x + i, valid), vloadi(y + i, valid), vz, e, r, im);
+		vstore(real + i, r, valid);
+		vstore(imag + i, im, valid);
+	}
+	return true;
+}
+
+SIMD_KERNEL bool projectRow(AccProjectorKernel &projector, bool ref3D, int xstart, int xend,
+		int y, int z, const XFLOAT *e, XFLOAT *real, XFLOAT *imag)
+{
+	if (!fitsGatherIndices(projector, ref3D))
+		return false;
+
+	vint vy = vseti(y), vz = vseti(z);
+	for (int x = xstart; x < xend; x += VLEN)
+	{
+		vmask valid = vfirst(xend - x);
+		vfloat r, im;
+		projectVector(projector, ref3D, valid, vaddi(viota(), vseti(x)), vy, vz, e, r, im);
+		vstore(real + x, r, valid);
+		vstore(imag + x, im, valid);
+	}
+	return true;
+}
+
+// Phase factor of the shift: (cc, ss) = (cos_x, sin_x) * (cos_y, sin_y) [* (cos_z, sin_z)]
+SIMD_INLINE void shiftFactor(vfloat cx, vfloat sx, vfloat cy, vfloat sy, vfloat &cc, vfloat &ss)
+{
+	ss = vfmadd(sx, cy, vmul(cx, sy));
+	cc = vfnmadd(sx, sy, vmul(cx, cy));
+}
+
+SIMD_KERNEL bool diff2Coarse(int n, int nr_eulers, int ref_stride,
+		const XFLOAT *cos_x, const XFLOAT *sin_x,
+		const XFLOAT *cos_y, const XFLOAT *sin_y,
+		const XFLOAT *cos_z, const XFLOAT *sin_z,
+		const XFLOAT *img_real, const XFLOAT *img_imag, const XFLOAT *corr,
+		const XFLOAT *ref_real, const XFLOAT *ref_imag, XFLOAT *diffi)
+{
+	// First shift (a chunk of) the image once, then compare it with all references
+	XFLOAT shifted_real[DIFF2_SIMD_CHUNK], shifted_imag[DIFF2_SIMD_CHUNK];
+	for (int start = 0; start < n; start += DIFF2_SIMD_CHUNK)
+	{
+		const int m = (n - start < DIFF2_SIMD_CHUNK) ? n - start : DIFF2_SIMD_CHUNK;
+		for (int i = 0; i < m; i += VLEN)
+		{
+			vmask valid = vfirst(m - i);
+			vfloat cc, ss;
+			shiftFactor(vload(cos_x + start + i, valid), vload(sin_x + start + i, valid),
+			            vload(cos_y + start + i, valid), vload(sin_y + start + i, valid), cc, ss);
+			if (cos_z != NULL)
+			{
+				vfloat c = cc, s = ss;
+				shiftFactor(c, s, vload(cos_z + start + i, valid), vload(sin_z + start + i, valid), cc, ss);
+			}
+
+			vfloat re = vload(img_real + start + i, valid), im = vload(img_imag + start + i, valid);
+			vstore(shifted_real + i, vfnmadd(ss, im, vmul(cc, re)), valid);
+			vstore(shifted_imag + i, vfmadd(ss, re, vmul(cc, im)), valid);
+		}
+
+		for (int j = 0; j < nr_eulers; j++)
+		{
+			const XFLOAT *my_ref_real = ref_real + (size_t)j * ref_stride + start;
+			const XFLOAT *my_ref_imag = ref_imag + (size_t)j * ref_stride + start;
+			vfloat acc = vset(0.f);
+			for (int i = 0; i < m; i += VLEN)
+			{
+				vmask valid = vfirst(m - i);
+				vfloat diff_real = vsub(vload(my_ref_real + i, valid), vload(shifted_real + i, valid));
+				vfloat diff_imag = vsub(vload(my_ref_imag + i, valid), vload(shifted_imag + i, valid));
+				vfloat diff2 = vfmadd(diff_real, diff_real, vmul(diff_imag, diff_imag));
+				acc = vfmadd(diff2, vload(corr + start + i, valid), acc);
+			}
+			diffi[j] += vsum(acc);
+		}
+	}
+	return true;
+}
+
+SIMD_KERNEL bool diff2FineRow(int xstart, int xend,
+		const XFLOAT *cos_x, const XFLOAT *sin_x,
+		XFLOAT cos_y, XFLOAT sin_y, XFLOAT cos_z, XFLOAT sin_z, bool do_z,
+		const XFLOAT *img_real, const XFLOAT *img_imag,
+		const XFLOAT *ref_real, const XFLOAT *ref_imag, XFLOAT &sum)
+{
+	vfloat cy = vset(cos_y), sy = vset(sin_y);
+	vfloat cz = vset(cos_z), sz = vset(sin_z);
+	vfloat acc = vset(0.f);
+	for (int x = xstart; x < xend; x += VLEN)
+	{
+		vmask valid = vfirst(xend - x);
+		vfloat cc, ss;
+		shiftFactor(vload(cos_x + x, valid), vload(sin_x + x, valid), cy, sy, cc, ss);
+		if (do_z)
+		{
+			vfloat c = cc, s = ss;
+			shiftFactor(c, s, cz, sz, cc, ss);
+		}
+
+		vfloat re = vload(img_real + x, valid), im = vload(img_imag + x, valid);
+		vfloat diff_real = vsub(vload(ref_real + x, valid), vfnmadd(ss, im, vmul(cc, re)));
+		vfloat diff_imag = vsub(vload(ref_imag + x, valid), vfmadd(ss, re, vmul(cc, im)));
+		acc = vfmadd(diff_real, diff_real, vfmadd(diff_imag, diff_imag, acc));
+	}
+	sum = vsum(acc);
+	return true;
+}
+
+#else // not DIFF2_SIMD_ENABLED
+
+bool projectPixels(AccProjectorKernel &projector, bool ref3D, int n,
+		const int *x, const int *y, const int *z, const XFLOAT *e,
+		XFLOAT *real, XFLOAT *imag)
+{
+	return false;
+}
+
+bool projectRow(AccProjectorKernel &projector, bool ref3D, int xstart, int xend,
+		int y, int z, const XFLOAT *e, XFLOAT *real, XFLOAT *imag)
+{
+	return false;
+}
+
+bool diff2Coarse(int n, int nr_eulers, int ref_stride,
+		const XFLOAT *cos_x, const XFLOAT *sin_x,
+		const XFLOAT *cos_y, const XFLOAT *sin_y,
+		const XFLOAT *cos_z, const XFLOAT *sin_z,
+		const XFLOAT *img_real, const XFLOAT *img_imag, const XFLOAT *corr,
+		const XFLOAT *ref_real, const XFLOAT *ref_imag, XFLOAT *diffi)
+{
+	return false;
+}
+
+bool diff2FineRow(int xstart, int xend,
+		const XFLOAT *cos_x, const XFLOAT *sin_x,
+		XFLOAT cos_y, XFLOAT sin_y, XFLOAT cos_z, XFLOAT sin_z, bool do_z,
+		const XFLOAT *img_real, const XFLOAT *img_imag,
+		const XFLOAT *ref_real, const XFLOAT *ref_imag, XFLOAT &sum)
+{
+	return false;
+}
+
+#endif // DIFF2_SIMD_ENABLED
+
+} // end of namespace DIFF2_SIMD_NAMESPACE
+} // end of namespace CpuKernels
@@ -13,6 +13,10 @@
 namespace CpuKernels
 {
 
+// Only the significant weights are passed to these kernels (see SignificantSamples in acc_ml_optimiser.h):
+// those of orientation bid are g_weights[g_weight_start[bid]] ... g_weights[g_weight_start[bid+1] - 1],
+// for the translations in the same positions of g_weight_trans.
+
 // sincos lookup table optimization. Function translatePixel calls
 // sincos(x*tx + y*ty). We precompute 2D lookup tables for x and y directions.
 // The first dimension is x or y pixel index, and the second dimension is x or y
@@ -39,13 +43,14 @@ void wavg_ref3D(
 		XFLOAT * RESTRICT   g_trans_y,
 		XFLOAT * RESTRICT   g_trans_z,
 		XFLOAT * RESTRICT   g_weights,
+		unsigned long * RESTRICT g_weight_start,
+		unsigned long * RESTRICT g_weight_trans,
 		XFLOAT * RESTRICT   g_ctfs,
 		XFLOAT * RESTRICT   g_wdiff2s_parts,
 		XFLOAT * RESTRICT   g_wdiff2s_AA,
 		XFLOAT * RESTRICT   g_wdiff2s_XA,
 		unsigned long       trans_num,
 		XFLOAT              weight_norm,
-		XFLOAT              significant_weight,
 		XFLOAT              part_scale)
 {
 #ifdef DEBUG_CUDA
@@ -72,6 +77,10 @@ void wavg_ref3D(
 	
 	for(unsigned long bid=0; bid<orientation_num; bid++) {
 
+		// Don't project orientations without any significant weight
+		if (g_weight_start[bid] == g_weight_start[bid+1])
+			continue;
+
 		// Copy the rotation matrix to local variables
 		int offset = bid * 9;
 		XFLOAT e0 = g_eulers[offset  ], e1 = g_eulers[offset+1];
@@ -137,12 +146,9 @@ void wavg_ref3D(
 				}
 			}
 
-			for (unsigned long itrans = 0; itrans < trans_num; itrans++) {
-				XFLOAT weight = g_weights[bid * trans_num + itrans];
-				if (weight < significant_weight)
-					continue;
-
-				weight *= weight_norm_inverse;
+			for (unsigned long iw = g_weight_start[bid]; iw < g_weight_start[bid+1]; iw++) {
+				unsigned long itrans = g_weight_trans[iw];
+				XFLOAT weight = g_weights[iw] * weight_norm_inverse;
 				XFLOAT trans_cos_y, trans_sin_y;
 				if ( y < 0) {
 					trans_cos_y =  cos_y[itrans][-y];
@@ -223,13 +229,14 @@ void wavg_3D(
 		XFLOAT * RESTRICT   g_trans_y,
 		XFLOAT * RESTRICT   g_trans_z,
 		XFLOAT * RESTRICT   g_weights,
+		unsigned long * RESTRICT g_weight_start,
+		unsigned long * RESTRICT g_weight_trans,
 		XFLOAT * RESTRICT   g_ctfs,
 		XFLOAT * RESTRICT   g_wdiff2s_parts,
 		XFLOAT * RESTRICT   g_wdiff2s_AA,
 		XFLOAT * RESTRICT   g_wdiff2s_XA,
 		unsigned long       trans_num,
 		XFLOAT              weight_norm,
-		XFLOAT              significant_weight,
 		XFLOAT              part_scale)
 {
 #ifdef DEBUG_CUDA
@@ -255,6 +262,10 @@ void wavg_3D(
 	XFLOAT img_real[xSize], img_imag[xSize];
 		
 	for(unsigned long bid=0; bid<orientation_num; bid++) {
+		// Don't project orientations without any significant weight
+		if (g_weight_start[bid] == g_weight_start[bid+1])
+			continue;
+
 		// Copy the rotation matrix to local variables
 		int offset = bid * 9;
 		XFLOAT e0 = g_eulers[offset  ], e1 = g_eulers[offset+1];
@@ -308,12 +319,9 @@ void wavg_3D(
 					img_imag[x] = g_img_imag[pixel + x];
 				}
 
-				for (unsigned long itrans = 0; itrans < trans_num; itrans++) {
-					XFLOAT weight = g_weights[bid * trans_num + itrans];
-					if (weight < significant_weight)
-						continue;
-
-					weight *= weight_norm_inverse;
+				for (unsigned long iw = g_weight_start[bid]; iw < g_weight_start[bid+1]; iw++) {
+					unsigned long itrans = g_weight_trans[iw];
+					XFLOAT weight = g_weights[iw] * weight_norm_inverse;
 					XFLOAT trans_cos_z, trans_sin_z;
 					if ( z < 0) {
 						trans_cos_z =  cos_z[itrans][-z];
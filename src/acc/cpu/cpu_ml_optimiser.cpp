@@ -94,7 +94,10 @@ void MlDataBundle::setup(MlOptimiser *baseMLO)
 				baseMLO->mymodel.PPref[imodel].r_max,
 				baseMLO->mymodel.PPref[imodel].padding_factor);
 
-		projectors[imodel].initMdl(baseMLO->mdlClassComplex[imodel]);
+		if (baseMLO->do_cpu_half_refs)
+			projectors[imodel].initMdl(baseMLO->mdlClassHalf[imodel], baseMLO->mdlClassHalfScale[imodel]);
+		else
+			projectors[imodel].initMdl(baseMLO->mdlClassComplex[imodel]);
 
 	}
 
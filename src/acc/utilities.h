@@ -545,6 +545,8 @@ void kernel_wavg(
 		XFLOAT *g_trans_y,
 		XFLOAT *g_trans_z,
 		XFLOAT* g_weights,
+		unsigned long *g_weight_start,
+		unsigned long *g_weight_trans,
 		XFLOAT* g_ctfs,
 		XFLOAT *g_wdiff2s_parts,
 		XFLOAT *g_wdiff2s_AA,
@@ -593,13 +595,14 @@ void kernel_wavg(
 			g_trans_y,
 			g_trans_z,
 			g_weights,
+			g_weight_start,
+			g_weight_trans,
 			g_ctfs,
 			g_wdiff2s_parts,
 			g_wdiff2s_AA,
 			g_wdiff2s_XA,
 			translation_num,
 			weight_norm,
-			significant_weight,
 			part_scale);
 	}
 	else
@@ -615,13 +618,14 @@ void kernel_wavg(
 			g_trans_y,
 			g_trans_z,
 			g_weights,
+			g_weight_start,
+			g_weight_trans,
 			g_ctfs,
 			g_wdiff2s_parts,
 			g_wdiff2s_AA,
 			g_wdiff2s_XA,
 			translation_num,
 			weight_norm,
-			significant_weight,
 			part_scale);
 	}
 #endif
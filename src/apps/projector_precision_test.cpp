@@ -0,0 +1,280 @@
+/***************************************************************************
+ *
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+// Accuracy and speed of the half-precision references of the CPU-accelerated
+// code (relion_refine --cpu --cpu_half_refs) compared to full precision.
+//
+// The reference is the Fourier transform of a random set of Gaussian "atoms",
+// which is calculated analytically on the padded grid of the projector. It is
+// projected in random orientations from both the full- and half-precision copies,
+// and the projections, and their squared differences to a noisy image, are compared.
+
+#include <vector>
+#include <chrono>
+#include <src/args.h>
+#include <src/euler.h>
+#include <src/funcs.h>
+#ifdef ALTCPU
+#include "src/acc/cpu/cuda_stubs.h"
+#include "src/acc/acc_projector.h"
+#include "src/acc/cpu/cpu_kernels/diff2_simd.h"
+#endif
+
+#ifdef ALTCPU
+class projector_precision_test
+{
+public:
+
+	IOParser parser;
+	int box, nr_atoms, nr_orientations, random_seed;
+	RFLOAT padding_factor, atom_sigma, snr;
+
+	void read(int argc, char **argv)
+	{
+		parser.setCommandLine(argc, argv);
+		parser.addSection("Options");
+		box = textToInteger(parser.getOption("--box", "Box size of the images", "128"));
+		padding_factor = textToFloat(parser.getOption("--pad", "Oversampling factor of the reference", "2"));
+		nr_atoms = textToInteger(parser.getOption("--atoms", "Number of Gaussian atoms in the reference", "500"));
+		atom_sigma = textToFloat(parser.getOption("--atom_sigma", "Width of the atoms (in pixels)", "1"));
+		nr_orientations = textToInteger(parser.getOption("--n", "Number of orientations to compare", "500"));
+		snr = textToFloat(parser.getOption("--snr", "Signal-to-noise ratio of the image that the projections are compared to", "0.05"));
+		random_seed = textToInteger(parser.getOption("--random_seed", "Seed for the random number generator", "1"));
+
+		if (parser.checkForErrors())
+			REPORT_ERROR("Errors encountered on the command line, exiting...");
+	}
+
+	void run()
+	{
+		init_random_generator(random_seed);
+
+		// The same dimensions as Projector::initialiseData
+		int r_max = box / 2;
+		int pad_size = 2 * (ROUND(padding_factor * r_max) + 1) + 1;
+		int mdlX = pad_size / 2 + 1, mdlY = pad_size, mdlZ = pad_size;
+		int mdlInit = -(pad_size / 2);
+		size_t mdlXYZ = (size_t)mdlX * mdlY * mdlZ;
+
+		std::vector<RFLOAT> ax(nr_atoms), ay(nr_atoms), az(nr_atoms);
+		for (int i = 0; i < nr_atoms; i++)
+		{
+			// Uniformly within a sphere of a quarter of the box
+			do
+			{
+				ax[i] = rnd_unif(-1., 1.);
+				ay[i] = rnd_unif(-1., 1.);
+				az[i] = rnd_unif(-1., 1.);
+			}
+			while (ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i] > 1.);
+			ax[i] *= box / 4.;
+			ay[i] *= box / 4.;
+			az[i] *= box / 4.;
+		}
+
+		std::cout << " Calculating a reference of " << mdlX << " x " << mdlY << " x " << mdlZ << " ..." << std::endl;
+
+		// The phase factors are separable: tabulate exp(-2 pi i f x) for each atom and each coordinate
+		std::vector<Complex> tx((size_t)nr_atoms * mdlX), ty((size_t)nr_atoms * mdlY), tz((size_t)nr_atoms * mdlZ);
+		for (int a = 0; a < nr_atoms; a++)
+		{
+			for (int j = 0; j < mdlX; j++)
+				tx[(size_t)a * mdlX + j] = phaseFactor(j, ax[a]);
+			for (int i = 0; i < mdlY; i++)
+				ty[(size_t)a * mdlY + i] = phaseFactor(i + mdlInit, ay[a]);
+			for (int k = 0; k < mdlZ; k++)
+				tz[(size_t)a * mdlZ + k] = phaseFactor(k + mdlInit, az[a]);
+		}
+
+		std::vector<Complex> data(mdlXYZ, Complex(0., 0.));
+		RFLOAT max_r2 = (RFLOAT)(padding_factor * r_max + 2) * (padding_factor * r_max + 2);
+		for (int k = 0; k < mdlZ; k++)
+		for (int i = 0; i < mdlY; i++)
+		for (int j = 0; j < mdlX; j++)
+		{
+			RFLOAT x = j, y = i + mdlInit, z = k + mdlInit;
+			RFLOAT r2 = x * x + y * y + z * z;
+			if (r2 > max_r2)
+				continue;
+
+			Complex sum(0., 0.);
+			for (int a = 0; a < nr_atoms; a++)
+				sum += tx[(size_t)a * mdlX + j] * ty[(size_t)a * mdlY + i] * tz[(size_t)a * mdlZ + k];
+
+			// Frequencies in 1/pixel
+			RFLOAT f2 = r2 / (padding_factor * box * padding_factor * box);
+			RFLOAT amplitude = exp(-2. * PI * PI * atom_sigma * atom_sigma * f2);
+			data[(size_t)k * mdlX * mdlY + (size_t)i * mdlX + j] = sum * amplitude;
+		}
+
+		std::vector<std::complex<XFLOAT> > full(mdlXYZ);
+		for (size_t n = 0; n < mdlXYZ; n++)
+			full[n] = std::complex<XFLOAT>(data[n].real, data[n].imag);
+		std::vector<float16> half(2 * mdlXYZ);
+		XFLOAT scale = AccProjector::convertToHalf(&data[0], mdlXYZ, &half[0]);
+
+		std::cout << " Memory used by the reference: " << mdlXYZ * sizeof(std::complex<XFLOAT>) / (1024 * 1024) << " MB in full precision, "
+		          << mdlXYZ * 2 * sizeof(float16) / (1024 * 1024) << " MB in half precision" << std::endl;
+
+		int imgX = box / 2 + 1, imgY = box;
+		AccProjectorKernel kfull(mdlX, mdlY, mdlZ, imgX, imgY, 1, mdlInit, mdlInit, padding_factor, r_max, &full[0]);
+		AccProjectorKernel khalf(mdlX, mdlY, mdlZ, imgX, imgY, 1, mdlInit, mdlInit, padding_factor, r_max, &full[0]);
+		khalf.mdlComplex = NULL;
+		khalf.mdlHalf = &half[0];
+		khalf.mdlHalfScale = scale;
+
+		// Pixels of the (2D) image within r_max, in the order of the coarse diff2 kernels
+		std::vector<int> px, py;
+		for (int i = 0; i < imgY; i++)
+		for (int j = 0; j < imgX; j++)
+		{
+			int y = (i < imgX) ? i : i - imgY;
+			if (j * j + y * y <= r_max * r_max)
+			{
+				px.push_back(j);
+				py.push_back(y);
+			}
+		}
+		int npix = px.size();
+
+		std::vector<XFLOAT> eulers(9 * nr_orientations);
+		for (int iorient = 0; iorient < nr_orientations; iorient++)
+		{
+			Matrix2D<RFLOAT> A;
+			Euler_angles2matrix(rnd_unif(0., 360.), acos(rnd_unif(-1., 1.)) * 180. / PI, rnd_unif(0., 360.), A);
+			for (int i = 0; i < 9; i++)
+				eulers[9 * iorient + i] = A.mdata[i];
+		}
+
+		// Project all orientations from both references, with the explicitly vectorised code if available
+		std::vector<XFLOAT> full_real(npix * nr_orientations), full_imag(npix * nr_orientations);
+		std::vector<XFLOAT> half_real(npix * nr_orientations), half_imag(npix * nr_orientations);
+		double time_full = project(kfull, px, py, eulers, full_real, full_imag);
+		double time_half = project(khalf, px, py, eulers, half_real, half_imag);
+
+		// The image is the first projection plus white noise
+		RFLOAT signal2 = 0.;
+		for (int n = 0; n < npix; n++)
+			signal2 += full_real[n] * full_real[n] + full_imag[n] * full_imag[n];
+		RFLOAT sigma = sqrt(signal2 / (2. * npix * snr));
+		std::vector<XFLOAT> img_real(npix), img_imag(npix);
+		for (int n = 0; n < npix; n++)
+		{
+			img_real[n] = full_real[n] + rnd_gaus(0., sigma);
+			img_imag[n] = full_imag[n] + rnd_gaus(0., sigma);
+		}
+
+		double err2 = 0., ref2 = 0., max_err = 0., max_ref = 0.;
+		double max_diff2_error = 0., max_delta_diff2 = 0.;
+		std::vector<double> diff2_full(nr_orientations), diff2_half(nr_orientations);
+		for (int iorient = 0; iorient < nr_orientations; iorient++)
+		{
+			double d2f = 0., d2h = 0.;
+			for (int n = iorient * npix; n < (iorient + 1) * npix; n++)
+			{
+				double dr = half_real[n] - full_real[n], di = half_imag[n] - full_imag[n];
+				err2 += dr * dr + di * di;
+				ref2 += full_real[n] * full_real[n] + full_imag[n] * full_imag[n];
+				max_err = XMIPP_MAX(max_err, XMIPP_MAX(ABS(dr), ABS(di)));
+				max_ref = XMIPP_MAX(max_ref, XMIPP_MAX(ABS(full_real[n]), ABS(full_imag[n])));
+
+				int i = n - iorient * npix;
+				double fr = full_real[n] - img_real[i], fi = full_imag[n] - img_imag[i];
+				double hr = half_real[n] - img_real[i], hi = half_imag[n] - img_imag[i];
+				d2f += (fr * fr + fi * fi) / (2. * sigma * sigma);
+				d2h += (hr * hr + hi * hi) / (2. * sigma * sigma);
+			}
+			diff2_full[iorient] = d2f;
+			diff2_half[iorient] = d2h;
+			max_diff2_error = XMIPP_MAX(max_diff2_error, ABS(d2h - d2f) / d2f);
+		}
+
+		// What matters for the probabilities are differences in diff2 between orientations
+		int best_full = 0, best_half = 0;
+		for (int iorient = 0; iorient < nr_orientations; iorient++)
+		{
+			if (diff2_full[iorient] < diff2_full[best_full])
+				best_full = iorient;
+			if (diff2_half[iorient] < diff2_half[best_half])
+				best_half = iorient;
+		}
+		for (int iorient = 0; iorient < nr_orientations; iorient++)
+		{
+			double delta_full = diff2_full[iorient] - diff2_full[best_full];
+			double delta_half = diff2_half[iorient] - diff2_half[best_half];
+			max_delta_diff2 = XMIPP_MAX(max_delta_diff2, ABS(delta_half - delta_full));
+		}
+
+		std::cout << " Relative RMS error of the projections:        " << sqrt(err2 / ref2) << std::endl;
+		std::cout << " Maximum error relative to the largest value:  " << max_err / max_ref << std::endl;
+		std::cout << " Maximum relative error in diff2:              " << max_diff2_error << std::endl;
+		std::cout << " Maximum error in diff2 relative to the best:  " << max_delta_diff2 << " (in units of log-likelihood)" << std::endl;
+		std::cout << " Best orientation: " << best_full << " (full precision), " << best_half << " (half precision)" << std::endl;
+		std::cout << " Time for " << nr_orientations << " projections: " << time_full << " s (full precision), "
+		          << time_half << " s (half precision)" << std::endl;
+	}
+
+	// exp(-2 pi i f x) for the frequency of the padded coordinate c
+	Complex phaseFactor(int c, RFLOAT x)
+	{
+		RFLOAT phase = -2. * PI * c * x / (padding_factor * box);
+		return Complex(cos(phase), sin(phase));
+	}
+
+	double project(AccProjectorKernel &k, std::vector<int> &px, std::vector<int> &py, std::vector<XFLOAT> &eulers,
+			std::vector<XFLOAT> &real, std::vector<XFLOAT> &imag)
+	{
+		int npix = px.size();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int iorient = 0; iorient < nr_orientations; iorient++)
+		{
+			XFLOAT *e = &eulers[9 * iorient];
+			XFLOAT *r = &real[iorient * npix], *im = &imag[iorient * npix];
+			if (CpuKernels::Simd::projectPixels(k, true, npix, &px[0], &py[0], NULL, e, r, im))
+				continue;
+			for (int n = 0; n < npix; n++)
+				k.project3Dmodel(px[n], py[n], e[0], e[1], e[3], e[4], e[6], e[7], r[n], im[n]);
+		}
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+#endif
+
+int main(int argc, char *argv[])
+{
+#ifdef ALTCPU
+	projector_precision_test prm;
+
+	try
+	{
+		prm.read(argc, argv);
+		prm.run();
+	}
+	catch (RelionError XE)
+	{
+		std::cerr << XE;
+		return RELION_EXIT_FAILURE;
+	}
+
+	return RELION_EXIT_SUCCESS;
+#else
+	std::cerr << "This program requires RELION to be compiled with ALTCPU=ON." << std::endl;
+	return RELION_EXIT_FAILURE;
+#endif
+}
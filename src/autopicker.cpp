@@ -18,7 +18,11 @@
  * source code. Additional authorship citations may be added, but existing
  * author citations must be preserved.
  ***************************************************************************/
+#include <unistd.h>
+#include <exception>
+#include <omp.h>
 #include "src/autopicker.h"
+#include "src/spatial_hash.h"
 #include <src/jaz/single_particle/new_ft.h>
 
 //#define DEBUG
@@ -107,6 +111,7 @@ void AutoPicker::read(int argc, char **argv)
 	do_read_fom_maps = parser.checkOption("--read_fom_maps", "Skip probability calculations, re-read precalculated maps from disc");
 	do_optimise_scale = !parser.checkOption("--skip_optimise_scale", "Skip the optimisation of the micrograph scale for better prime factors in the FFTs. This runs slower, but at exactly the requested resolution.");
 	do_only_unfinished = parser.checkOption("--only_do_unfinished", "Only autopick those micrographs for which the coordinate file does not yet exist");
+	nr_threads = textToInteger(parser.getOption("--j", "Number of threads", "1"));
 	do_gpu = parser.checkOption("--gpu", "Use GPU acceleration when availiable");
 	gpu_ids = parser.getOption("--gpu", "Device ids for each MPI-thread","default");
 #ifndef _CUDA_ENABLED
@@ -1003,6 +1008,16 @@ void AutoPicker::run()
 		barstep = XMIPP_MAX(1, fn_micrographs.size() / 60);
 	}
 
+	// Pick several micrographs at the same time with LoG
+	if (do_LoG && !do_topaz_extract && nr_threads > 1)
+	{
+		if (!autoPickLoGMicrographs(0, fn_micrographs.size() - 1))
+			exit(RELION_EXIT_ABORTED);
+		if (verb > 0)
+			progress_bar(fn_micrographs.size());
+		return;
+	}
+
 	FileName fn_olddir="";
 	for (long int imic = 0; imic < fn_micrographs.size(); imic++)
 	{
@@ -3074,6 +3089,65 @@ void AutoPicker::autoPickTopazOneMicrograph(FileName &fn_mic, int rank)
 
 }
 
+bool AutoPicker::autoPickLoGMicrographs(long int first, long int last)
+{
+	// Make all output directories beforehand
+	FileName fn_olddir = "";
+	for (long int imic = first; imic <= last; imic++)
+	{
+		FileName fn_dir = getOutputRootName(fn_micrographs[imic]).beforeLastOf("/");
+		if (fn_dir != fn_olddir)
+		{
+			mktree(fn_dir);
+			fn_olddir = fn_dir;
+		}
+	}
+
+	// Each thread picks one micrograph at a time (with its own transformer and buffers), so that
+	// reading micrographs and writing coordinates on some threads overlap with filtering on the others
+	long int nr_done = 0;
+	long int barstep = XMIPP_MAX(1, (last - first + 1) / 60);
+	bool is_aborted = false;
+	std::exception_ptr pickException;
+	#pragma omp parallel for schedule(dynamic) num_threads(nr_threads)
+	for (long int imic = first; imic <= last; imic++)
+	{
+		bool do_skip;
+		#pragma omp critical(AutoPicker_progress)
+		do_skip = is_aborted || pickException;
+		if (do_skip)
+			continue;
+
+		try
+		{
+			autoPickLoGOneMicrograph(fn_micrographs[imic], imic);
+		}
+		catch (...)
+		{
+			// Nothing may escape the parallel region: keep the first exception and rethrow it after the region
+			#pragma omp critical(AutoPicker_progress)
+			if (!pickException)
+				pickException = std::current_exception();
+		}
+
+		#pragma omp critical(AutoPicker_progress)
+		{
+			nr_done++;
+			if (verb > 0 && nr_done % barstep == 0)
+				progress_bar(nr_done);
+
+			// Abort through the pipeline_control system
+			if (pipeline_control_check_abort_job())
+				is_aborted = true;
+		}
+	}
+
+	if (pickException)
+		std::rethrow_exception(pickException);
+
+	return !is_aborted;
+}
+
 void AutoPicker::autoPickLoGOneMicrograph(FileName &fn_mic, long int imic)
 {
 	Image<RFLOAT> Imic;
@@ -3091,9 +3165,6 @@ void AutoPicker::autoPickLoGOneMicrograph(FileName &fn_mic, long int imic)
 
 	if (!do_read_fom_maps)
 	{
-		// Always use the same random seed
-		init_random_generator(random_seed + imic);
-
 		// Read in the micrograph
 		Imic.read(fn_mic);
 		Imic().setXmippOrigin();
@@ -3133,13 +3204,20 @@ void AutoPicker::autoPickLoGOneMicrograph(FileName &fn_mic, long int imic)
 			rewindow(Imic, micrograph_size);
 
 			// Fill region outside the original window with white Gaussian noise to prevent all-zeros in Mstddev
-			FOR_ALL_ELEMENTS_IN_ARRAY2D(Imic())
+			// The random number generator is shared by all micrographs that are being picked in parallel
+			#pragma omp critical(AutoPicker_random)
 			{
-				if (i < FIRST_XMIPP_INDEX(micrograph_ysize)
-						|| i > LAST_XMIPP_INDEX(micrograph_ysize)
-						|| j < FIRST_XMIPP_INDEX(micrograph_xsize)
-						|| j > LAST_XMIPP_INDEX(micrograph_xsize) )
-					A2D_ELEM(Imic(), i, j) = rnd_gaus(0.,1.);
+				// Always use the same random seed
+				init_random_generator(random_seed + imic);
+
+				FOR_ALL_ELEMENTS_IN_ARRAY2D(Imic())
+				{
+					if (i < FIRST_XMIPP_INDEX(micrograph_ysize)
+							|| i > LAST_XMIPP_INDEX(micrograph_ysize)
+							|| j < FIRST_XMIPP_INDEX(micrograph_xsize)
+							|| j > LAST_XMIPP_INDEX(micrograph_xsize) )
+						A2D_ELEM(Imic(), i, j) = rnd_gaus(0.,1.);
+				}
 			}
 		}
 
@@ -3156,19 +3234,18 @@ void AutoPicker::autoPickLoGOneMicrograph(FileName &fn_mic, long int imic)
 
 			// Search for this micrograph in the metadata table
 			bool found = false;
-			FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDmic)
+			for (long int i = 0; i < MDmic.numberOfObjects(); i++)
 			{
 				FileName fn_tmp;
-				MDmic.getValue(EMDL_MICROGRAPH_NAME, fn_tmp);
+				MDmic.getValue(EMDL_MICROGRAPH_NAME, fn_tmp, i);
 				if (fn_tmp == fn_mic)
 				{
-					ctf.readByGroup(MDmic, &obsModel);
+					ctf.readByGroup(MDmic, &obsModel, i);
 					found = true;
 					break;
 				}
 			}
 			if (!found) REPORT_ERROR("Logic error: failed to find CTF information for " + fn_mic);
-
 			ctf.getFftwImage(Fctf, micrograph_size, micrograph_size, angpix, false, false, false, false, false, true);
 			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Fmic)
 			{
@@ -3648,6 +3725,10 @@ void AutoPicker::autoPickOneMicrograph(FileName &fn_mic, long int imic)
 		}
 	}
 
+	// The rotations of the references are the same for all micrographs
+	if (!do_read_fom_maps && psi_angles.empty())
+		precalculateRotatedReferences();
+
 	for (int iref = 0; iref < Mrefs.size(); iref++)
 	{
 		RFLOAT expected_Pratio; // the expectedFOM for this (ctf-corrected) reference
@@ -3679,177 +3760,183 @@ void AutoPicker::autoPickOneMicrograph(FileName &fn_mic, long int imic)
 #ifdef TIMING
 			timer.tic(TIMING_B3);
 #endif
-			Mccf_best.initConstant(-LARGE_NUMBER);
-			bool is_first_psi = true;
-			for (RFLOAT psi = 0. ; psi < 360.; psi+=psi_sampling)
-			{
-				// Get the Euler matrix
-				Matrix2D<RFLOAT> A(3,3);
-				Euler_angles2matrix(0., 0., psi, A);
-
-				// Now get the FT of the rotated (non-ctf-corrected) template
-				Faux.initZeros(downsize_mic, downsize_mic/2 + 1);
-				PPref[iref].get2DFourierTransform(Faux, A);
-
-#ifdef DEBUG
-				std::cerr << " psi= " << psi << std::endl;
-				windowFourierTransform(Faux, Faux2, micrograph_size);
-				CenterFFTbySign(Faux2);
-				tt().resize(micrograph_size, micrograph_size);
-				transformer.inverseFourierTransform(Faux2, tt());
-				tt.write("Mref_rot.spi");
-
-				windowFourierTransform(Fmic, Faux2, micrograph_size);
-				CenterFFTbySign(Faux2);
-				transformer.inverseFourierTransform(Faux2, tt());
-				tt.write("Mmic.spi");
-
-#endif
+			// The unrotated (CTF-corrected) reference gives the expected ratio of probabilities
+			// and the sum_ref_under_circ_mask and sum_ref2_under_circ_mask
+			getRotatedReference(iref, 0, Faux);
 #ifdef TIMING
 	timer.tic(TIMING_B4);
 #endif
-				// Apply the CTF on-the-fly (so same PPref can be used for many different micrographs)
-				if (do_ctf)
+			// Apply the CTF on-the-fly (so same PPref can be used for many different micrographs)
+			if (do_ctf)
+			{
+				FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Faux)
 				{
-					FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Faux)
-					{
-						DIRECT_MULTIDIM_ELEM(Faux, n) *= DIRECT_MULTIDIM_ELEM(Fctf, n);
-					}
+					DIRECT_MULTIDIM_ELEM(Faux, n) *= DIRECT_MULTIDIM_ELEM(Fctf, n);
+				}
+			}
 #ifdef TIMING
 	timer.toc(TIMING_B4);
 #endif
-#ifdef DEBUG
-				MultidimArray<RFLOAT> ttt(micrograph_size, micrograph_size);
-				windowFourierTransform(Faux, Faux2, micrograph_size);
-				CenterFFTbySign(Faux2);
-				transformer.inverseFourierTransform(Faux2, ttt);
-				ttt.setXmippOrigin();
-				tt().resize(particle_size, particle_size);
-				tt().setXmippOrigin();
-				FOR_ALL_ELEMENTS_IN_ARRAY2D(tt())
-				{
-					A2D_ELEM(tt(), i, j) = A2D_ELEM(ttt, i, j);
-				}
-				tt.write("Mref_rot_ctf.spi");
-#endif
-				}
-
-				if (is_first_psi)
-				{
+			{
 #ifdef TIMING
 	timer.tic(TIMING_B5);
 #endif
-					// Calculate the expected ratio of probabilities for this CTF-corrected reference
-					// and the sum_ref_under_circ_mask and sum_ref_under_circ_mask2
-					// Do this also if we're not recalculating the fom maps...
-					// This calculation needs to be done on an "non-shrinked" micrograph, in order to get the correct I^2 statistics
-					windowFourierTransform(Faux, Faux2, micrograph_size);
-					CenterFFTbySign(Faux2);
-					Maux.resize(micrograph_size, micrograph_size);
-					transformer.inverseFourierTransform(Faux2, Maux);
-					Maux.setXmippOrigin();
+				// Do this also if we're not recalculating the fom maps...
+				// This calculation needs to be done on an "non-shrinked" micrograph, in order to get the correct I^2 statistics
+				windowFourierTransform(Faux, Faux2, micrograph_size);
+				CenterFFTbySign(Faux2);
+				Maux.resize(micrograph_size, micrograph_size);
+				transformer.inverseFourierTransform(Faux2, Maux);
+				Maux.setXmippOrigin();
 #ifdef DEBUG
-					Image<RFLOAT> ttt;
-					ttt()=Maux;
-					ttt.write("Maux.spi");
+				Image<RFLOAT> ttt;
+				ttt()=Maux;
+				ttt.write("Maux.spi");
 #endif
-					sum_ref_under_circ_mask = 0.;
-					sum_ref2_under_circ_mask = 0.;
-					RFLOAT suma2 = 0.;
-					RFLOAT sumn = 1.;
-					MultidimArray<RFLOAT> Mctfref(particle_size, particle_size);
-					Mctfref.setXmippOrigin();
-					FOR_ALL_ELEMENTS_IN_ARRAY2D(Mctfref) // only loop over smaller Mctfref, but take values from large Maux!
+				sum_ref_under_circ_mask = 0.;
+				sum_ref2_under_circ_mask = 0.;
+				RFLOAT suma2 = 0.;
+				RFLOAT sumn = 1.;
+				MultidimArray<RFLOAT> Mctfref(particle_size, particle_size);
+				Mctfref.setXmippOrigin();
+				FOR_ALL_ELEMENTS_IN_ARRAY2D(Mctfref) // only loop over smaller Mctfref, but take values from large Maux!
+				{
+					if (i*i + j*j < particle_radius2)
 					{
-						if (i*i + j*j < particle_radius2)
-						{
-							suma2 += A2D_ELEM(Maux, i, j) * A2D_ELEM(Maux, i, j);
-							suma2 += 2. * A2D_ELEM(Maux, i, j) * rnd_gaus(0., 1.);
-							sum_ref_under_circ_mask += A2D_ELEM(Maux, i, j);
-							sum_ref2_under_circ_mask += A2D_ELEM(Maux, i, j) * A2D_ELEM(Maux, i, j);
-							sumn += 1.;
-						}
+						suma2 += A2D_ELEM(Maux, i, j) * A2D_ELEM(Maux, i, j);
+						suma2 += 2. * A2D_ELEM(Maux, i, j) * rnd_gaus(0., 1.);
+						sum_ref_under_circ_mask += A2D_ELEM(Maux, i, j);
+						sum_ref2_under_circ_mask += A2D_ELEM(Maux, i, j) * A2D_ELEM(Maux, i, j);
+						sumn += 1.;
+					}
 #ifdef DEBUG
-						A2D_ELEM(Mctfref, i, j) = A2D_ELEM(Maux, i, j);
+					A2D_ELEM(Mctfref, i, j) = A2D_ELEM(Maux, i, j);
 #endif
-					}
-					sum_ref_under_circ_mask /= sumn;
-					sum_ref2_under_circ_mask /= sumn;
-					expected_Pratio = exp(suma2 / (2. * sumn));
+				}
+				sum_ref_under_circ_mask /= sumn;
+				sum_ref2_under_circ_mask /= sumn;
+				expected_Pratio = exp(suma2 / (2. * sumn));
 #ifdef DEBUG
-					std::cerr << " expected_Pratio["<<iref<<"]= " << expected_Pratio << std::endl;
-					tt()=Mctfref;
-					tt.write("Mctfref.spi");
-					std::cerr << "suma2 " << suma2<< " sumn " << sumn << " suma2/2sumn="<< suma2 / (2. * sumn) << std::endl;
-					std::cerr << " nr_pixels_under_mask= " << nr_pixels_circular_mask << " nr_pixels_under_invmask= " << nr_pixels_circular_invmask << std::endl;
-					std::cerr << "sum_ref_under_circ_mask " << sum_ref_under_circ_mask << std::endl;
-					std::cerr << "sum_ref2_under_circ_mask " << sum_ref2_under_circ_mask << std::endl;
-					std::cerr << "expected_Pratio " << expected_Pratio << std::endl;
+				std::cerr << " expected_Pratio["<<iref<<"]= " << expected_Pratio << std::endl;
+				tt()=Mctfref;
+				tt.write("Mctfref.spi");
+				std::cerr << "suma2 " << suma2<< " sumn " << sumn << " suma2/2sumn="<< suma2 / (2. * sumn) << std::endl;
+				std::cerr << " nr_pixels_under_mask= " << nr_pixels_circular_mask << " nr_pixels_under_invmask= " << nr_pixels_circular_invmask << std::endl;
+				std::cerr << "sum_ref_under_circ_mask " << sum_ref_under_circ_mask << std::endl;
+				std::cerr << "sum_ref2_under_circ_mask " << sum_ref2_under_circ_mask << std::endl;
+				std::cerr << "expected_Pratio " << expected_Pratio << std::endl;
 #endif
 
-					// Maux goes back to the workSize
-					Maux.resize(workSize, workSize);
+				// Maux goes back to the workSize
+				Maux.resize(workSize, workSize);
 #ifdef TIMING
-					timer.toc(TIMING_B5);
+				timer.toc(TIMING_B5);
 #endif
-				}
+			}
 
 #ifdef TIMING
-				timer.tic(TIMING_B6);
+			timer.tic(TIMING_B6);
 #endif
-				// Now multiply template and micrograph to calculate the cross-correlation
-				FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Faux)
+			// Now correlate all rotations of the template with the micrograph, in parallel.
+			// Each thread keeps the best FOM (and its psi) over its own rotations, which are merged below.
+			const int nr_psi = psi_angles.size();
+			const int my_nr_threads = XMIPP_MAX(1, XMIPP_MIN(nr_threads, nr_psi));
+			std::vector<MultidimArray<RFLOAT> > thread_ccf_best(my_nr_threads), thread_psi_best(my_nr_threads);
+			#pragma omp parallel num_threads(my_nr_threads)
+			{
+				const int ithread = omp_get_thread_num();
+				MultidimArray<RFLOAT> &my_ccf_best = thread_ccf_best[ithread];
+				MultidimArray<RFLOAT> &my_psi_best = thread_psi_best[ithread];
+				my_ccf_best.resize(workSize, workSize);
+				my_ccf_best.initConstant(-LARGE_NUMBER);
+				my_psi_best.resize(workSize, workSize);
+
+				MultidimArray<Complex> Fref, Fcc;
+				MultidimArray<RFLOAT> Mcc(workSize, workSize);
+				FourierTransformer my_transformer;
+
+				#pragma omp for schedule(dynamic)
+				for (int ipsi = 0; ipsi < nr_psi; ipsi++)
 				{
-					DIRECT_MULTIDIM_ELEM(Faux, n) = conj(DIRECT_MULTIDIM_ELEM(Faux, n)) * DIRECT_MULTIDIM_ELEM(Fmic, n);
-				}
+					const RFLOAT psi = psi_angles[ipsi];
+					getRotatedReference(iref, ipsi, Fref);
 
-				// If we're not doing shrink, then Faux is bigger than Faux2!
-				windowFourierTransform(Faux, Faux2, workSize);
-				CenterFFTbySign(Faux2);
-				transformer.inverseFourierTransform(Faux2, Maux);
-#ifdef DEBUG
-				tt()=Maux*normfft;
-				tt.write("Mcc.spi");
-#endif
+					// Apply the CTF and multiply template and micrograph to calculate the cross-correlation
+					if (do_ctf)
+					{
+						FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Fref)
+						{
+							DIRECT_MULTIDIM_ELEM(Fref, n) = conj(DIRECT_MULTIDIM_ELEM(Fref, n) * DIRECT_MULTIDIM_ELEM(Fctf, n)) * DIRECT_MULTIDIM_ELEM(Fmic, n);
+						}
+					}
+					else
+					{
+						FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Fref)
+						{
+							DIRECT_MULTIDIM_ELEM(Fref, n) = conj(DIRECT_MULTIDIM_ELEM(Fref, n)) * DIRECT_MULTIDIM_ELEM(Fmic, n);
+						}
+					}
+
+					// If we're not doing shrink, then Fref is bigger than Fcc!
+					windowFourierTransform(Fref, Fcc, workSize);
+					CenterFFTbySign(Fcc);
+					my_transformer.inverseFourierTransform(Fcc, Mcc);
 
-				// Calculate ratio of prabilities P(ref)/P(zero)
-				// Keep track of the best values and their corresponding iref and psi
+					// Calculate ratio of prabilities P(ref)/P(zero)
+					// Keep track of the best values and their corresponding psi
 
-				// So now we already had precalculated: Mdiff2 = 1/sig*Sum(X^2) - 2/sig*Sum(X) + mu^2/sig*Sum(1)
-				// Still to do (per reference): - 2/sig*Sum(AX) + 2*mu/sig*Sum(A) + Sum(A^2)
-				FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Maux)
+					// So now we already had precalculated: Mdiff2 = 1/sig*Sum(X^2) - 2/sig*Sum(X) + mu^2/sig*Sum(1)
+					// Still to do (per reference): - 2/sig*Sum(AX) + 2*mu/sig*Sum(A) + Sum(A^2)
+					FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Mcc)
+					{
+						RFLOAT diff2 = - 2. * normfft * DIRECT_MULTIDIM_ELEM(Mcc, n);
+						diff2 += 2. * DIRECT_MULTIDIM_ELEM(Mmean, n) * sum_ref_under_circ_mask;
+						if (DIRECT_MULTIDIM_ELEM(Mstddev, n) > 1E-10)
+							diff2 /= DIRECT_MULTIDIM_ELEM(Mstddev, n);
+						diff2 += sum_ref2_under_circ_mask;
+						diff2 = exp(- diff2 / 2.); // exponentiate to reflect the Gaussian error model. sigma=1 after normalization, 0.4=1/sqrt(2pi)
+
+						// Store fraction of (1 - probability-ratio) wrt  (1 - expected Pratio)
+						diff2 = (diff2 - 1.) / (expected_Pratio - 1.);
+						if (diff2 > DIRECT_MULTIDIM_ELEM(my_ccf_best, n))
+						{
+							DIRECT_MULTIDIM_ELEM(my_ccf_best, n) = diff2;
+							DIRECT_MULTIDIM_ELEM(my_psi_best, n) = psi;
+						}
+					}
+				} // end for psi
+			} // end omp parallel
+
+			// Merge the best values of all threads. Ties go to the smallest psi, as they would when looping over psi in order.
+			// For helical segments, also combine Mccf_best and Mpsi_best of all references in the same pass.
+			Mccf_best.initConstant(-LARGE_NUMBER);
+			#pragma omp parallel for num_threads(nr_threads)
+			for (long int n = 0; n < NZYXSIZE(Mccf_best); n++)
+			{
+				for (int ithread = 0; ithread < my_nr_threads; ithread++)
 				{
-					RFLOAT diff2 = - 2. * normfft * DIRECT_MULTIDIM_ELEM(Maux, n);
-					diff2 += 2. * DIRECT_MULTIDIM_ELEM(Mmean, n) * sum_ref_under_circ_mask;
-					if (DIRECT_MULTIDIM_ELEM(Mstddev, n) > 1E-10)
-						diff2 /= DIRECT_MULTIDIM_ELEM(Mstddev, n);
-					diff2 += sum_ref2_under_circ_mask;
-					diff2 = exp(- diff2 / 2.); // exponentiate to reflect the Gaussian error model. sigma=1 after normalization, 0.4=1/sqrt(2pi)
-
-					// Store fraction of (1 - probability-ratio) wrt  (1 - expected Pratio)
-					diff2 = (diff2 - 1.) / (expected_Pratio - 1.);
-#ifdef DEBUG
-					DIRECT_MULTIDIM_ELEM(Maux, n) = diff2;
-#endif
-					if (diff2 > DIRECT_MULTIDIM_ELEM(Mccf_best, n))
+					RFLOAT ccf = DIRECT_MULTIDIM_ELEM(thread_ccf_best[ithread], n);
+					RFLOAT psi = DIRECT_MULTIDIM_ELEM(thread_psi_best[ithread], n);
+					if (ccf > DIRECT_MULTIDIM_ELEM(Mccf_best, n) ||
+					    (ccf == DIRECT_MULTIDIM_ELEM(Mccf_best, n) && psi < DIRECT_MULTIDIM_ELEM(Mpsi_best, n)))
 					{
-						DIRECT_MULTIDIM_ELEM(Mccf_best, n) = diff2;
+						DIRECT_MULTIDIM_ELEM(Mccf_best, n) = ccf;
 						DIRECT_MULTIDIM_ELEM(Mpsi_best, n) = psi;
 					}
 				}
-#ifdef DEBUG
-				std::cerr << " Maux.computeMax()= " << Maux.computeMax() << std::endl;
-				tt()=Maux;
-				tt.write("Mccf.spi");
-			    std::cerr << " Press any key to continue... "  << std::endl;
-			    char c;
-			    std::cin >> c;
-#endif
-			    is_first_psi = false;
+
+				if (autopick_helical_segments && DIRECT_MULTIDIM_ELEM(Mccf_best, n) > DIRECT_MULTIDIM_ELEM(Mccf_best_combined, n))
+				{
+					DIRECT_MULTIDIM_ELEM(Mccf_best_combined, n) = DIRECT_MULTIDIM_ELEM(Mccf_best, n);
+					if (do_amyloid)
+						DIRECT_MULTIDIM_ELEM(Mpsi_best_combined, n) = DIRECT_MULTIDIM_ELEM(Mpsi_best, n);
+					else
+						DIRECT_MULTIDIM_ELEM(Mclass_best_combined, n) = iref;
+				}
+			}
 #ifdef TIMING
-	timer.toc(TIMING_B6);
+			timer.toc(TIMING_B6);
 #endif
-			} // end for psi
 #ifdef TIMING
 	timer.toc(TIMING_B3);
 #endif
@@ -3883,27 +3970,8 @@ void AutoPicker::autoPickOneMicrograph(FileName &fn_mic, long int imic)
 #ifdef TIMING
 		timer.tic(TIMING_B8);
 #endif
-		if (autopick_helical_segments)
-		{
-			if (!do_read_fom_maps)
-			{
-				// Combine Mccf_best and Mpsi_best from all refs
-				FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Mccf_best)
-				{
-					RFLOAT new_ccf = DIRECT_MULTIDIM_ELEM(Mccf_best, n);
-					RFLOAT old_ccf = DIRECT_MULTIDIM_ELEM(Mccf_best_combined, n);
-					if (new_ccf > old_ccf)
-					{
-						DIRECT_MULTIDIM_ELEM(Mccf_best_combined, n) = new_ccf;
-						if (do_amyloid)
-							DIRECT_MULTIDIM_ELEM(Mpsi_best_combined, n) = DIRECT_MULTIDIM_ELEM(Mpsi_best, n);
-						else
-							DIRECT_MULTIDIM_ELEM(Mclass_best_combined, n) = iref;
-					}
-				}
-			}
-		}
-		else
+		// For helical segments, Mccf_best and Mpsi_best of all refs have been combined above
+		if (!autopick_helical_segments)
 		{
 			// Now that we have Mccf_best and Mpsi_best, get the peaks
 			std::vector<Peak> my_ref_peaks;
@@ -4021,6 +4089,52 @@ void AutoPicker::autoPickOneMicrograph(FileName &fn_mic, long int imic)
 	}
 }
 
+void AutoPicker::precalculateRotatedReferences()
+{
+	psi_angles.clear();
+	for (RFLOAT psi = 0. ; psi < 360.; psi+=psi_sampling)
+		psi_angles.push_back(psi);
+
+	// Only keep all rotations in memory if they take at most a quarter of the free memory
+	RFLOAT refs_Gb = (RFLOAT)PPref.size() * psi_angles.size() * downsize_mic * (downsize_mic/2 + 1) * sizeof(Complex) / (1024. * 1024. * 1024.);
+	RFLOAT free_Gb = (RFLOAT)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE) / (1024. * 1024. * 1024.);
+	Frefs_rot.clear();
+	if (refs_Gb > 0.25 * free_Gb)
+		return;
+
+	std::vector<std::vector<MultidimArray<Complex> > > Frefs(PPref.size());
+	for (int iref = 0; iref < PPref.size(); iref++)
+		Frefs[iref].resize(psi_angles.size());
+
+	#pragma omp parallel for collapse(2) schedule(dynamic) num_threads(nr_threads)
+	for (int iref = 0; iref < PPref.size(); iref++)
+	{
+		for (int ipsi = 0; ipsi < psi_angles.size(); ipsi++)
+		{
+			getRotatedReference(iref, ipsi, Frefs[iref][ipsi]);
+		}
+	}
+
+	Frefs_rot.swap(Frefs);
+}
+
+void AutoPicker::getRotatedReference(int iref, int ipsi, MultidimArray<Complex> &Fref)
+{
+	if (!Frefs_rot.empty())
+	{
+		Fref = Frefs_rot[iref][ipsi];
+		return;
+	}
+
+	// Get the Euler matrix
+	Matrix2D<RFLOAT> A(3,3);
+	Euler_angles2matrix(0., 0., psi_angles[ipsi], A);
+
+	// Now get the FT of the rotated (non-ctf-corrected) template
+	Fref.initZeros(downsize_mic, downsize_mic/2 + 1);
+	PPref[iref].get2DFourierTransform(Fref, A);
+}
+
 FileName AutoPicker::getOutputRootName(FileName fn_mic)
 {
 	FileName fn_pre, fn_jobnr, fn_post;
@@ -4159,67 +4273,88 @@ void AutoPicker::peakSearch(const MultidimArray<RFLOAT> &Mfom, const MultidimArr
 void AutoPicker::prunePeakClusters(std::vector<Peak> &peaks, int min_distance, float scale)
 {
 	float mind2 = ((float)min_distance*(float)min_distance)*scale*scale;
+	float clusd2 = (float)(particle_radius2)*scale*scale;
 	int nclus = 0;
 
+	// Peaks within the particle radius of each other are in the same cluster.
+	// Only the peaks in neighbouring cells of a grid with cells of that size need to be compared.
+	SpatialHash grid(sqrt(clusd2));
+	for (long int ipeak = 0; ipeak < peaks.size(); ipeak++)
+		grid.add(ipeak, peaks[ipeak].x, peaks[ipeak].y);
+
 	std::vector<Peak> pruned_peaks;
-	while (peaks.size() > 0)
+	std::vector<bool> is_clustered(peaks.size(), false);
+	std::vector<long int> candidates;
+	for (long int ipeak = 0; ipeak < peaks.size(); ipeak++)
 	{
+		if (is_clustered[ipeak])
+			continue;
+
 		nclus++;
-		std::vector<Peak> cluster;
-		cluster.push_back(peaks[0]);
-		peaks.erase(peaks.begin());
+		std::vector<long int> cluster;
+		cluster.push_back(ipeak);
+		is_clustered[ipeak] = true;
+		grid.remove(ipeak, peaks[ipeak].x, peaks[ipeak].y);
 		for (int iclus = 0; iclus < cluster.size(); iclus++)
 		{
-			int my_x = cluster[iclus].x;
-			int my_y = cluster[iclus].y;
-			for (int ipeakp = 0; ipeakp < peaks.size(); ipeakp++)
+			int my_x = peaks[cluster[iclus]].x;
+			int my_y = peaks[cluster[iclus]].y;
+
+			// Add the remaining peaks in the order of the input list
+			candidates.clear();
+			grid.getCandidates(my_x, my_y, 0., candidates);
+			std::sort(candidates.begin(), candidates.end());
+			for (int icand = 0; icand < candidates.size(); icand++)
 			{
+				long int ipeakp = candidates[icand];
 				float dx = (float)(my_x - peaks[ipeakp].x);
 				float dy = (float)(my_y - peaks[ipeakp].y);
-				if (dx*dx + dy*dy < ( (float)(particle_radius2)*scale*scale ))
+				if (dx*dx + dy*dy < clusd2)
 				{
-					// Put ipeakp in the cluster, and remove from the peaks list
-					cluster.push_back(peaks[ipeakp]);
-					peaks.erase(peaks.begin()+ipeakp);
-					ipeakp--;
+					// Put ipeakp in the cluster, and remove it from the grid
+					cluster.push_back(ipeakp);
+					is_clustered[ipeakp] = true;
+					grid.remove(ipeakp, peaks[ipeakp].x, peaks[ipeakp].y);
 				}
 			}
 		}
 
-		// Now search for the peak from the cluster with the best ccf.
-		// Then search again if there are any other peaks in the cluster that are further than particle_diameter apart from the selected peak
-		// If so, again search for the maximum
-		int ipass = 0;
-		while (cluster.size() > 0)
+		// Now take the peak from the cluster with the best ccf, remove all peaks within mind2 from it
+		// and take the best of the remaining ones, and so forth...
+		// That is: go through the cluster from the best to the worst peak (the first one in the cluster for equal ones)
+		// and keep those that are not within mind2 of a peak that was kept before.
+		std::vector<std::pair<RFLOAT, long int> > sorted_cluster;
+		for (int iclus = 0; iclus < cluster.size(); iclus++)
+			sorted_cluster.push_back(std::make_pair(-peaks[cluster[iclus]].relative_fom, (long int)iclus));
+		std::sort(sorted_cluster.begin(), sorted_cluster.end());
+
+		SpatialHash kept_grid(sqrt(mind2));
+		for (int isort = 0; isort < sorted_cluster.size(); isort++)
 		{
-			RFLOAT best_relative_fom=-1.;
-			Peak bestpeak;
-			for (int iclus = 0; iclus < cluster.size(); iclus++)
+			const Peak &mypeak = peaks[cluster[sorted_cluster[isort].second]];
+
+			bool is_close = false;
+			candidates.clear();
+			kept_grid.getCandidates(mypeak.x, mypeak.y, 0., candidates);
+			for (int icand = 0; icand < candidates.size(); icand++)
 			{
-				if ( cluster[iclus].relative_fom > best_relative_fom)
+				float dx = (float)(mypeak.x - peaks[candidates[icand]].x);
+				float dy = (float)(mypeak.y - peaks[candidates[icand]].y);
+				if (dx*dx + dy*dy < mind2)
 				{
-					best_relative_fom = cluster[iclus].relative_fom;
-					bestpeak = cluster[iclus];
+					is_close = true;
+					break;
 				}
 			}
 
-			// Store this peak as pruned
-			pruned_peaks.push_back(bestpeak);
-
-			// Remove all peaks within mind2 from the clusters
-			for (int iclus = 0; iclus < cluster.size(); iclus++)
+			if (!is_close)
 			{
-				float dx = (float)(cluster[iclus].x - bestpeak.x);
-				float dy = (float)(cluster[iclus].y - bestpeak.y);
-				if (dx*dx + dy*dy < mind2)
-				{
-					cluster.erase(cluster.begin()+iclus);
-					iclus--;
-				}
+				// Store this peak as pruned
+				pruned_peaks.push_back(mypeak);
+				kept_grid.add(cluster[sorted_cluster[isort].second], mypeak.x, mypeak.y);
 			}
-			ipass++;
 		}
-	} // end while peaks.size > 0
+	} // end for all peaks
 
 	// Set the pruned peaks back into the input vector
 	peaks = pruned_peaks;
@@ -4231,13 +4366,23 @@ void AutoPicker::removeTooCloselyNeighbouringPeaks(std::vector<Peak> &peaks, int
 	// Now only keep those peaks that are at least min_particle_distance number of pixels from any other peak
 	std::vector<Peak> pruned_peaks;
 	float mind2 = ((float)min_distance*(float)min_distance)*scale*scale;
+
+	// Only the peaks in neighbouring cells of a grid with cells of min_distance need to be compared
+	SpatialHash grid(sqrt(mind2));
+	for (long int ipeak = 0; ipeak < peaks.size(); ipeak++)
+		grid.add(ipeak, peaks[ipeak].x, peaks[ipeak].y);
+
+	std::vector<long int> candidates;
 	for (int ipeak = 0; ipeak < peaks.size(); ipeak++)
 	{
 		int my_x = peaks[ipeak].x;
 		int my_y = peaks[ipeak].y;
 		float my_mind2 = 9999999999.;
-		for (int ipeakp = 0; ipeakp < peaks.size(); ipeakp++)
+		candidates.clear();
+		grid.getCandidates(my_x, my_y, 0., candidates);
+		for (int icand = 0; icand < candidates.size(); icand++)
 		{
+			long int ipeakp = candidates[icand];
 			if (ipeakp != ipeak)
 			{
 				int dx = peaks[ipeakp].x - my_x;
@@ -96,6 +96,9 @@ public:
 	// Verbosity
 	int verb;
 
+	// Number of threads
+	int nr_threads;
+
 	// Random seed
 	long int random_seed;
 
@@ -151,6 +154,13 @@ public:
 	// FTs of the reference images (either for autopicking or for feature calculation)
 	std::vector<Projector > PPref;
 
+	// In-plane rotations (in degrees) for template matching
+	std::vector<RFLOAT> psi_angles;
+
+	// Rotated FTs of the reference images (before CTF correction) for all psi_angles: [iref][ipsi]
+	// Empty if they do not fit in memory; then the references are rotated for every micrograph.
+	std::vector<std::vector<MultidimArray<Complex> > > Frefs_rot;
+
 	// Use Laplacian-of-Gaussian filters instead of template-based picking
 	bool do_LoG;
 
@@ -410,6 +420,8 @@ public:
 	void trainTopaz();
 	void autoPickTopazOneMicrograph(FileName &fn_mic, int rank = 0);
 	void autoPickLoGOneMicrograph(FileName &fn_mic, long int imic);
+	// Pick micrographs first to last (inclusive) with LoG, nr_threads micrographs at a time. Returns false if the job was aborted.
+	bool autoPickLoGMicrographs(long int first, long int last);
 	void autoPickOneMicrograph(FileName &fn_mic, long int imic);
 
 	// Get the output coordinate filename given the micrograph filename
@@ -425,6 +437,12 @@ public:
 			MultidimArray<RFLOAT> &Mstddev,
 			MultidimArray<RFLOAT> &Mmean);
 
+	// Set psi_angles and, if they fit in memory, precalculate Frefs_rot
+	void precalculateRotatedReferences();
+
+	// Get the FT of reference iref rotated by psi_angles[ipsi], at size downsize_mic
+	void getRotatedReference(int iref, int ipsi, MultidimArray<Complex> &Fref);
+
 	// Peak search for all pixels above a given threshold in the map
 	void peakSearch(const MultidimArray<RFLOAT> &Mccf, const MultidimArray<RFLOAT> &Mpsi,
 			const MultidimArray<RFLOAT> &Mstddev, const MultidimArray<RFLOAT> &Mmean,
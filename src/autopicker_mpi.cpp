@@ -86,6 +86,16 @@ void AutoPickerMpi::run()
 		barstep = XMIPP_MAX(1, my_nr_micrographs / 60);
 	}
 
+	// Pick several micrographs at the same time with LoG
+	if (do_LoG && !do_topaz_extract && nr_threads > 1)
+	{
+		if (!autoPickLoGMicrographs(my_first_micrograph, my_last_micrograph))
+			MPI_Abort(MPI_COMM_WORLD, RELION_EXIT_ABORTED);
+		if (verb > 0)
+			progress_bar(my_nr_micrographs);
+		return;
+	}
+
 	FileName fn_olddir="";
 	for (long int imic = my_first_micrograph; imic <= my_last_micrograph; imic++)
 	{
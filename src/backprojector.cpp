@@ -1353,7 +1353,8 @@ void BackProjector::reconstruct(MultidimArray<RFLOAT> &vol_out,
                                 RFLOAT normalise,
                                 int minres_map,
                                 bool printTimes,
-                                Image<RFLOAT>* weight_out)
+                                Image<RFLOAT>* weight_out,
+                                GriddingReconstructor *gridder)
 {
 #ifdef TIMING
 	Timer ReconTimer;
@@ -1405,8 +1406,12 @@ void BackProjector::reconstruct(MultidimArray<RFLOAT> &vol_out,
         // Trick transformer with the right dimensions
         vol_out.setDimensions(pad_size, pad_size, pad_size, 1);
 
+	// A gridder does everything after the regularisation of the weights (in slabs), so then Fconv is never needed here
+	const bool do_gridder = (gridder != NULL && ref_dim == 3 && !skip_gridding && max_iter_preweight > 0);
+
 	FourierTransformer transformer;
-	transformer.setReal(vol_out); // Fake set real. 1. Allocate space for Fconv 2. calculate plans.
+	if (!do_gridder)
+		transformer.setReal(vol_out); // Fake set real. 1. Allocate space for Fconv 2. calculate plans.
 	MultidimArray<Complex>& Fconv = transformer.getFourierReference();
 	vol_out.clear(); // Reset dimensions to 0
 
@@ -1415,7 +1420,10 @@ void BackProjector::reconstruct(MultidimArray<RFLOAT> &vol_out,
 
 	// Go from projector-centered to FFTW-uncentered
 	MultidimArray<RFLOAT> Fweight;
-	Fweight.reshape(Fconv);
+	if (do_gridder)
+		Fweight.reshape(pad_size, pad_size, pad_size / 2 + 1);
+	else
+		Fweight.reshape(Fconv);
 	Projector::decenter(weight, Fweight, max_r2);
 
 	RCTOC(ReconTimer,ReconS_2);
@@ -1425,7 +1433,7 @@ void BackProjector::reconstruct(MultidimArray<RFLOAT> &vol_out,
 	if (do_map)
 	{
 		// Then, add the inverse of tau2-spectrum values to the weight
-		FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(Fconv)
+		FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(Fweight)
  		{
 			int r2 = kp * kp + ip * ip + jp * jp;
 			if (r2 < max_r2)
@@ -1533,6 +1541,25 @@ void BackProjector::reconstruct(MultidimArray<RFLOAT> &vol_out,
 			}
 		}
 	}
+	else if (do_gridder)
+	{
+		RCTIC(ReconTimer,ReconS_4);
+		// Same normalisation as below
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Fweight)
+		{
+			DIRECT_MULTIDIM_ELEM(Fweight, n) /= normalise;
+		}
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(data)
+		{
+			DIRECT_MULTIDIM_ELEM(data, n) /= normalise;
+		}
+		RCTOC(ReconTimer,ReconS_4);
+
+		// The gridder also applies the weights to the data and does the inverse FFT: it leaves the windowed map in vol_out
+		RCTIC(ReconTimer,ReconS_6);
+		gridder->reconstruct(*this, Fweight, max_iter_preweight, max_r2, vol_out);
+		RCTOC(ReconTimer,ReconS_6);
+	}
 	else
 	{
 		RCTIC(ReconTimer,ReconS_4);
@@ -1743,7 +1770,8 @@ void BackProjector::reconstruct(MultidimArray<RFLOAT> &vol_out,
 	// Pass the transformer to prevent making and clearing a new one before clearing the one declared above....
 	// The latter may give memory problems as detected by electric fence....
 	RCTIC(ReconTimer,ReconS_17);
-	windowToOridimRealSpace(transformer, vol_out, printTimes);
+	if (!do_gridder)
+		windowToOridimRealSpace(transformer, vol_out, printTimes);
 	RCTOC(ReconTimer,ReconS_17);
 
 #endif
@@ -2100,7 +2128,7 @@ void BackProjector::symmetrise(int nr_helical_asu, RFLOAT helical_twist, RFLOAT
 	enforceHermitianSymmetry();
 
 	// Then apply helical and point group symmetry (order irrelevant?)
-	applyHelicalSymmetry(nr_helical_asu, helical_twist, helical_rise);
+	applyHelicalSymmetry(nr_helical_asu, helical_twist, helical_rise, threads);
 
 	applyPointGroupSymmetry(threads);
 }
@@ -2124,158 +2152,189 @@ void BackProjector::enforceHermitianSymmetry()
 	}
 }
 
-void BackProjector::applyHelicalSymmetry(int nr_helical_asu, RFLOAT helical_twist, RFLOAT helical_rise)
+// Add the trilinear interpolations of data and weight at R * (j, i, k) to sum_data and sum_weight, for all points (k, i, j)
+// within sqrt(rmax2) from the origin and for all rotations R. If phase_shifts is not empty, it holds a phase shift
+// (cos, sin) for each rotation and each Z-plane of the arrays, which is applied to the interpolated data.
+// Different threads work on different Z-planes. Each X-row of the output arrays gets the contributions of all rotations
+// before moving on to the next one, so that it stays in the cache.
+static void addRotatedCopies(const MultidimArray<Complex > &data, const MultidimArray<RFLOAT> &weight,
+		const std::vector<Matrix2D<RFLOAT> > &rotations, const std::vector<Complex> &phase_shifts, int rmax2,
+		MultidimArray<Complex > &sum_data, MultidimArray<RFLOAT> &sum_weight, int threads)
+{
+	#pragma omp parallel for num_threads(threads) schedule(dynamic)
+	for (long int k=STARTINGZ(sum_weight); k<=FINISHINGZ(sum_weight); k++)
+	for (long int i=STARTINGY(sum_weight); i<=FINISHINGY(sum_weight); i++)
+	{
+		RFLOAT y = (RFLOAT)i;
+		RFLOAT z = (RFLOAT)k;
+		if (y*y + z*z > rmax2)
+			continue;
+
+		for (int irot = 0; irot < rotations.size(); irot++)
+		{
+			const Matrix2D<RFLOAT> &R = rotations[irot];
+
+			for (long int j=STARTINGX(sum_weight); j<=FINISHINGX(sum_weight); j++)
+			{
+				RFLOAT x = (RFLOAT)j; // STARTINGX(sum_weight) is zero!
+				RFLOAT r2 = x*x + y*y + z*z;
+				if (r2 > rmax2)
+					break;
+
+				// coords_output(x,y) = A * coords_input (xp,yp)
+				RFLOAT xp = x * R(0, 0) + y * R(0, 1) + z * R(0, 2);
+				RFLOAT yp = x * R(1, 0) + y * R(1, 1) + z * R(1, 2);
+				RFLOAT zp = x * R(2, 0) + y * R(2, 1) + z * R(2, 2);
+
+				bool is_neg_x;
+
+				// Only asymmetric half is stored
+				if (xp < 0)
+				{
+					// Get complex conjugated hermitian symmetry pair
+					xp = -xp;
+					yp = -yp;
+					zp = -zp;
+					is_neg_x = true;
+				}
+				else
+				{
+					is_neg_x = false;
+				}
+
+				// Trilinear interpolation (with physical coords)
+				// Subtract STARTINGY and STARTINGZ to accelerate access to data (STARTINGX=0)
+				// In that way use DIRECT_A3D_ELEM, rather than A3D_ELEM
+				int x0 = FLOOR(xp);
+				RFLOAT fx = xp - x0;
+				int x1 = x0 + 1;
+
+				int y0 = FLOOR(yp);
+				RFLOAT fy = yp - y0;
+				y0 -=  STARTINGY(data);
+				int y1 = y0 + 1;
+
+				int z0 = FLOOR(zp);
+				RFLOAT fz = zp - z0;
+				z0 -= STARTINGZ(data);
+				int z1 = z0 + 1;
+
+#ifdef CHECK_SIZE
+				if (x0 < 0 || y0 < 0 || z0 < 0 ||
+					x1 < 0 || y1 < 0 || z1 < 0 ||
+					x0 >= XSIZE(data) || y0  >= YSIZE(data) || z0 >= ZSIZE(data) ||
+					x1 >= XSIZE(data) || y1  >= YSIZE(data)  || z1 >= ZSIZE(data) 	)
+				{
+					std::cerr << " x0= " << x0 << " y0= " << y0 << " z0= " << z0 << std::endl;
+					std::cerr << " x1= " << x1 << " y1= " << y1 << " z1= " << z1 << std::endl;
+					data.printShape();
+					REPORT_ERROR("BackProjector::addRotatedCopies: checksize!!!");
+				}
+#endif
+				// First interpolate (complex) data
+				Complex d000 = DIRECT_A3D_ELEM(data, z0, y0, x0);
+				Complex d001 = DIRECT_A3D_ELEM(data, z0, y0, x1);
+				Complex d010 = DIRECT_A3D_ELEM(data, z0, y1, x0);
+				Complex d011 = DIRECT_A3D_ELEM(data, z0, y1, x1);
+				Complex d100 = DIRECT_A3D_ELEM(data, z1, y0, x0);
+				Complex d101 = DIRECT_A3D_ELEM(data, z1, y0, x1);
+				Complex d110 = DIRECT_A3D_ELEM(data, z1, y1, x0);
+				Complex d111 = DIRECT_A3D_ELEM(data, z1, y1, x1);
+
+				Complex dx00 = LIN_INTERP(fx, d000, d001);
+				Complex dx01 = LIN_INTERP(fx, d100, d101);
+				Complex dx10 = LIN_INTERP(fx, d010, d011);
+				Complex dx11 = LIN_INTERP(fx, d110, d111);
+
+				Complex dxy0 = LIN_INTERP(fy, dx00, dx10);
+				Complex dxy1 = LIN_INTERP(fy, dx01, dx11);
+
+				// Take complex conjugated for half with negative x
+				Complex ddd = LIN_INTERP(fz, dxy0, dxy1);
+				if (is_neg_x)
+					ddd = conj(ddd);
+
+				// Apply the phase shift (e.g. for a helical translation along Z)
+				if (!phase_shifts.empty())
+				{
+					const Complex &shift = phase_shifts[irot * ZSIZE(sum_weight) + k - STARTINGZ(sum_weight)];
+					RFLOAT a = shift.real;
+					RFLOAT b = shift.imag;
+					RFLOAT c = ddd.real;
+					RFLOAT d = ddd.imag;
+					RFLOAT ac = a * c;
+					RFLOAT bd = b * d;
+					RFLOAT ab_cd = (a + b) * (c + d);
+					ddd = Complex(ac - bd, ab_cd - ac - bd);
+				}
+
+				// Accumulated sum of the data term
+				A3D_ELEM(sum_data, k, i, j) += ddd;
+
+				// Then interpolate (real) weight
+				RFLOAT dd000 = DIRECT_A3D_ELEM(weight, z0, y0, x0);
+				RFLOAT dd001 = DIRECT_A3D_ELEM(weight, z0, y0, x1);
+				RFLOAT dd010 = DIRECT_A3D_ELEM(weight, z0, y1, x0);
+				RFLOAT dd011 = DIRECT_A3D_ELEM(weight, z0, y1, x1);
+				RFLOAT dd100 = DIRECT_A3D_ELEM(weight, z1, y0, x0);
+				RFLOAT dd101 = DIRECT_A3D_ELEM(weight, z1, y0, x1);
+				RFLOAT dd110 = DIRECT_A3D_ELEM(weight, z1, y1, x0);
+				RFLOAT dd111 = DIRECT_A3D_ELEM(weight, z1, y1, x1);
+
+				RFLOAT ddx00 = LIN_INTERP(fx, dd000, dd001);
+				RFLOAT ddx01 = LIN_INTERP(fx, dd100, dd101);
+				RFLOAT ddx10 = LIN_INTERP(fx, dd010, dd011);
+				RFLOAT ddx11 = LIN_INTERP(fx, dd110, dd111);
+
+				RFLOAT ddxy0 = LIN_INTERP(fy, ddx00, ddx10);
+				RFLOAT ddxy1 = LIN_INTERP(fy, ddx01, ddx11);
+
+				A3D_ELEM(sum_weight, k, i, j) += LIN_INTERP(fz, ddxy0, ddxy1);
+
+			} // end loop over the X-row
+		} // end loop over rotations
+	} // end loop over all rows of sum_weight
+}
+
+void BackProjector::applyHelicalSymmetry(int nr_helical_asu, RFLOAT helical_twist, RFLOAT helical_rise, int threads)
 {
 	if ( (nr_helical_asu < 2) || (ref_dim != 3) )
 		return;
 
 	int rmax2 = ROUND(r_max * padding_factor) * ROUND(r_max * padding_factor);
 
-	Matrix2D<RFLOAT> R(4, 4); // A matrix from the list
-	MultidimArray<RFLOAT> sum_weight;
-	MultidimArray<Complex > sum_data;
-	RFLOAT x, y, z, fx, fy, fz, xp, yp, zp, r2;
-	bool is_neg_x;
-	int x0, x1, y0, y1, z0, z1;
-	Complex d000, d001, d010, d011, d100, d101, d110, d111;
-	Complex dx00, dx01, dx10, dx11, dxy0, dxy1, ddd;
-	RFLOAT dd000, dd001, dd010, dd011, dd100, dd101, dd110, dd111;
-	RFLOAT ddx00, ddx01, ddx10, ddx11, ddxy0, ddxy1;
-
-	// First symmetry operator (not stored in SL) is the identity matrix
-	sum_weight = weight;
-	sum_data = data;
+	// First symmetry operator is the identity matrix: all other ones are rotations around Z,
+	// together with a phase shift for the helical translation along Z, which only depends on z
+	std::vector<Matrix2D<RFLOAT> > rotations;
+	std::vector<Complex> phase_shifts;
 	int h_min = -nr_helical_asu/2;
 	int h_max = -h_min + nr_helical_asu%2;
 	for (int hh = h_min; hh < h_max; hh++)
 	{
-		if (hh != 0) // h==0 is done before the for loop (where sum_data = data)
+		if (hh != 0)
 		{
+			Matrix2D<RFLOAT> R(4, 4);
 			RFLOAT rot_ang = hh * (-helical_twist);
 			rotation3DMatrix(rot_ang, 'Z', R);
 			R.setSmallValuesToZero(); // TODO: invert rotation matrix?
+			rotations.push_back(R);
 
-			// Loop over all points in the output (i.e. rotated, or summed) array
-			FOR_ALL_ELEMENTS_IN_ARRAY3D(sum_weight)
+			if (ABS(helical_rise) > 0.)
 			{
-				x = (RFLOAT)j; // STARTINGX(sum_weight) is zero!
-				y = (RFLOAT)i;
-				z = (RFLOAT)k;
-				r2 = x*x + y*y + z*z;
-				if (r2 <= rmax2)
+				RFLOAT zshift = hh * helical_rise;
+				zshift /= - ori_size * (RFLOAT)padding_factor;
+				for (long int k = STARTINGZ(weight); k <= FINISHINGZ(weight); k++)
 				{
-					// coords_output(x,y) = A * coords_input (xp,yp)
-					xp = x * R(0, 0) + y * R(0, 1) + z * R(0, 2);
-					yp = x * R(1, 0) + y * R(1, 1) + z * R(1, 2);
-					zp = x * R(2, 0) + y * R(2, 1) + z * R(2, 2);
-
-					// Only asymmetric half is stored
-					if (xp < 0)
-					{
-						// Get complex conjugated hermitian symmetry pair
-						xp = -xp;
-						yp = -yp;
-						zp = -zp;
-						is_neg_x = true;
-					}
-					else
-					{
-						is_neg_x = false;
-					}
-
-					// Trilinear interpolation (with physical coords)
-					// Subtract STARTINGY and STARTINGZ to accelerate access to data (STARTINGX=0)
-					// In that way use DIRECT_A3D_ELEM, rather than A3D_ELEM
-					x0 = FLOOR(xp);
-					fx = xp - x0;
-					x1 = x0 + 1;
-
-					y0 = FLOOR(yp);
-					fy = yp - y0;
-					y0 -=  STARTINGY(data);
-					y1 = y0 + 1;
-
-					z0 = FLOOR(zp);
-					fz = zp - z0;
-					z0 -= STARTINGZ(data);
-					z1 = z0 + 1;
-
-#ifdef CHECK_SIZE
-					if (x0 < 0 || y0 < 0 || z0 < 0 ||
-						x1 < 0 || y1 < 0 || z1 < 0 ||
-						x0 >= XSIZE(data) || y0  >= YSIZE(data) || z0 >= ZSIZE(data) ||
-						x1 >= XSIZE(data) || y1  >= YSIZE(data)  || z1 >= ZSIZE(data) 	)
-					{
-						std::cerr << " x0= " << x0 << " y0= " << y0 << " z0= " << z0 << std::endl;
-						std::cerr << " x1= " << x1 << " y1= " << y1 << " z1= " << z1 << std::endl;
-						data.printShape();
-						REPORT_ERROR("BackProjector::applyPointGroupSymmetry: checksize!!!");
-					}
-#endif
-					// First interpolate (complex) data
-					d000 = DIRECT_A3D_ELEM(data, z0, y0, x0);
-					d001 = DIRECT_A3D_ELEM(data, z0, y0, x1);
-					d010 = DIRECT_A3D_ELEM(data, z0, y1, x0);
-					d011 = DIRECT_A3D_ELEM(data, z0, y1, x1);
-					d100 = DIRECT_A3D_ELEM(data, z1, y0, x0);
-					d101 = DIRECT_A3D_ELEM(data, z1, y0, x1);
-					d110 = DIRECT_A3D_ELEM(data, z1, y1, x0);
-					d111 = DIRECT_A3D_ELEM(data, z1, y1, x1);
-
-					dx00 = LIN_INTERP(fx, d000, d001);
-					dx01 = LIN_INTERP(fx, d100, d101);
-					dx10 = LIN_INTERP(fx, d010, d011);
-					dx11 = LIN_INTERP(fx, d110, d111);
-					dxy0 = LIN_INTERP(fy, dx00, dx10);
-					dxy1 = LIN_INTERP(fy, dx01, dx11);
-
-					// Take complex conjugated for half with negative x
-					ddd = LIN_INTERP(fz, dxy0, dxy1);
-
-					if (is_neg_x)
-						ddd = conj(ddd);
+					RFLOAT dotp = 2 * PI * ((RFLOAT)k * zshift);
+					phase_shifts.push_back(Complex(cos(dotp), sin(dotp)));
+				}
+			}
+		}
+	}
 
-					// Also apply a phase shift for helical translation along Z
-					if (ABS(helical_rise) > 0.)
-					{
-						RFLOAT zshift = hh * helical_rise;
-						zshift /= - ori_size * (RFLOAT)padding_factor;
-						RFLOAT dotp = 2 * PI * (z * zshift);
-						RFLOAT a = cos(dotp);
-						RFLOAT b = sin(dotp);
-						RFLOAT c = ddd.real;
-						RFLOAT d = ddd.imag;
-						RFLOAT ac = a * c;
-						RFLOAT bd = b * d;
-						RFLOAT ab_cd = (a + b) * (c + d);
-						ddd = Complex(ac - bd, ab_cd - ac - bd);
-					}
-					// Accumulated sum of the data term
-					A3D_ELEM(sum_data, k, i, j) += ddd;
-
-					// Then interpolate (real) weight
-					dd000 = DIRECT_A3D_ELEM(weight, z0, y0, x0);
-					dd001 = DIRECT_A3D_ELEM(weight, z0, y0, x1);
-					dd010 = DIRECT_A3D_ELEM(weight, z0, y1, x0);
-					dd011 = DIRECT_A3D_ELEM(weight, z0, y1, x1);
-					dd100 = DIRECT_A3D_ELEM(weight, z1, y0, x0);
-					dd101 = DIRECT_A3D_ELEM(weight, z1, y0, x1);
-					dd110 = DIRECT_A3D_ELEM(weight, z1, y1, x0);
-					dd111 = DIRECT_A3D_ELEM(weight, z1, y1, x1);
-
-					ddx00 = LIN_INTERP(fx, dd000, dd001);
-					ddx01 = LIN_INTERP(fx, dd100, dd101);
-					ddx10 = LIN_INTERP(fx, dd010, dd011);
-					ddx11 = LIN_INTERP(fx, dd110, dd111);
-					ddxy0 = LIN_INTERP(fy, ddx00, ddx10);
-					ddxy1 = LIN_INTERP(fy, ddx01, ddx11);
-
-					A3D_ELEM(sum_weight, k, i, j) +=  LIN_INTERP(fz, ddxy0, ddxy1);
-
-				} // end if r2 <= rmax2
-			 } // end loop over all elements of sum_weight
-		} // end if hh!=0
-	} // end loop over hh
+	MultidimArray<RFLOAT> sum_weight = weight;
+	MultidimArray<Complex > sum_data = data;
+	addRotatedCopies(data, weight, rotations, phase_shifts, rmax2, sum_data, sum_weight, threads);
 
 	data = sum_data;
 	weight = sum_weight;
@@ -2293,137 +2352,21 @@ void BackProjector::applyPointGroupSymmetry(int threads)
 	int rmax2 = ROUND(r_max * padding_factor) * ROUND(r_max * padding_factor);
 	if (SL.SymsNo() > 0 && ref_dim == 3)
 	{
-		Matrix2D<RFLOAT> L(4, 4), R(4, 4); // A matrix from the list
-		MultidimArray<RFLOAT> sum_weight;
-		MultidimArray<Complex > sum_data;
-
 		// First symmetry operator (not stored in SL) is the identity matrix
-		sum_weight = weight;
-		sum_data = data;
-		// Loop over all other symmetry operators
+		std::vector<Matrix2D<RFLOAT> > rotations(SL.SymsNo());
 		for (int isym = 0; isym < SL.SymsNo(); isym++)
 		{
-			SL.get_matrices(isym, L, R);
+			Matrix2D<RFLOAT> L(4, 4);
+			rotations[isym].resize(4, 4);
+			SL.get_matrices(isym, L, rotations[isym]);
 #ifdef DEBUG_SYMM
-			std::cerr << " isym= " << isym << " R= " << R << std::endl;
-#endif
-			// Loop over all points in the output (i.e. rotated, or summed) array
-
-			#pragma omp parallel for num_threads(threads)
-			for (long int k=STARTINGZ(sum_weight); k<=FINISHINGZ(sum_weight); k++)
-			for (long int i=STARTINGY(sum_weight); i<=FINISHINGY(sum_weight); i++)
-			for (long int j=STARTINGX(sum_weight); j<=FINISHINGX(sum_weight); j++)
-			{
-	        	RFLOAT x = (RFLOAT)j; // STARTINGX(sum_weight) is zero!
-	        	RFLOAT y = (RFLOAT)i;
-	        	RFLOAT z = (RFLOAT)k;
-	        	RFLOAT r2 = x*x + y*y + z*z;
-
-	        	if (r2 <= rmax2)
-	        	{
-	        		// coords_output(x,y) = A * coords_input (xp,yp)
-					RFLOAT xp = x * R(0, 0) + y * R(0, 1) + z * R(0, 2);
-					RFLOAT yp = x * R(1, 0) + y * R(1, 1) + z * R(1, 2);
-					RFLOAT zp = x * R(2, 0) + y * R(2, 1) + z * R(2, 2);
-
-					bool is_neg_x;
-
-					// Only asymmetric half is stored
-					if (xp < 0)
-					{
-						// Get complex conjugated hermitian symmetry pair
-						xp = -xp;
-						yp = -yp;
-						zp = -zp;
-						is_neg_x = true;
-					}
-					else
-					{
-						is_neg_x = false;
-					}
-
-					// Trilinear interpolation (with physical coords)
-					// Subtract STARTINGY and STARTINGZ to accelerate access to data (STARTINGX=0)
-					// In that way use DIRECT_A3D_ELEM, rather than A3D_ELEM
-					int x0 = FLOOR(xp);
-					RFLOAT fx = xp - x0;
-					int x1 = x0 + 1;
-
-					int y0 = FLOOR(yp);
-					RFLOAT fy = yp - y0;
-					y0 -=  STARTINGY(data);
-					int y1 = y0 + 1;
-
-					int z0 = FLOOR(zp);
-					RFLOAT fz = zp - z0;
-					z0 -= STARTINGZ(data);
-					int z1 = z0 + 1;
-
-#ifdef CHECK_SIZE
-					if (x0 < 0 || y0 < 0 || z0 < 0 ||
-						x1 < 0 || y1 < 0 || z1 < 0 ||
-						x0 >= XSIZE(data) || y0  >= YSIZE(data) || z0 >= ZSIZE(data) ||
-						x1 >= XSIZE(data) || y1  >= YSIZE(data)  || z1 >= ZSIZE(data) 	)
-					{
-						std::cerr << " x0= " << x0 << " y0= " << y0 << " z0= " << z0 << std::endl;
-						std::cerr << " x1= " << x1 << " y1= " << y1 << " z1= " << z1 << std::endl;
-						data.printShape();
-						REPORT_ERROR("BackProjector::applyPointGroupSymmetry: checksize!!!");
-					}
+			std::cerr << " isym= " << isym << " R= " << rotations[isym] << std::endl;
 #endif
-					// First interpolate (complex) data
-					Complex d000 = DIRECT_A3D_ELEM(data, z0, y0, x0);
-					Complex d001 = DIRECT_A3D_ELEM(data, z0, y0, x1);
-					Complex d010 = DIRECT_A3D_ELEM(data, z0, y1, x0);
-					Complex d011 = DIRECT_A3D_ELEM(data, z0, y1, x1);
-					Complex d100 = DIRECT_A3D_ELEM(data, z1, y0, x0);
-					Complex d101 = DIRECT_A3D_ELEM(data, z1, y0, x1);
-					Complex d110 = DIRECT_A3D_ELEM(data, z1, y1, x0);
-					Complex d111 = DIRECT_A3D_ELEM(data, z1, y1, x1);
-
-					Complex dx00 = LIN_INTERP(fx, d000, d001);
-					Complex dx01 = LIN_INTERP(fx, d100, d101);
-					Complex dx10 = LIN_INTERP(fx, d010, d011);
-					Complex dx11 = LIN_INTERP(fx, d110, d111);
-
-					Complex dxy0 = LIN_INTERP(fy, dx00, dx10);
-					Complex dxy1 = LIN_INTERP(fy, dx01, dx11);
-
-					// Take complex conjugated for half with negative x
-					if (is_neg_x)
-					{
-						A3D_ELEM(sum_data, k, i, j) += conj(LIN_INTERP(fz, dxy0, dxy1));
-					}
-					else
-					{
-						A3D_ELEM(sum_data, k, i, j) += LIN_INTERP(fz, dxy0, dxy1);
-					}
-
-					// Then interpolate (real) weight
-					RFLOAT dd000 = DIRECT_A3D_ELEM(weight, z0, y0, x0);
-					RFLOAT dd001 = DIRECT_A3D_ELEM(weight, z0, y0, x1);
-					RFLOAT dd010 = DIRECT_A3D_ELEM(weight, z0, y1, x0);
-					RFLOAT dd011 = DIRECT_A3D_ELEM(weight, z0, y1, x1);
-					RFLOAT dd100 = DIRECT_A3D_ELEM(weight, z1, y0, x0);
-					RFLOAT dd101 = DIRECT_A3D_ELEM(weight, z1, y0, x1);
-					RFLOAT dd110 = DIRECT_A3D_ELEM(weight, z1, y1, x0);
-					RFLOAT dd111 = DIRECT_A3D_ELEM(weight, z1, y1, x1);
-
-					RFLOAT ddx00 = LIN_INTERP(fx, dd000, dd001);
-					RFLOAT ddx01 = LIN_INTERP(fx, dd100, dd101);
-					RFLOAT ddx10 = LIN_INTERP(fx, dd010, dd011);
-					RFLOAT ddx11 = LIN_INTERP(fx, dd110, dd111);
-
-					RFLOAT ddxy0 = LIN_INTERP(fy, ddx00, ddx10);
-					RFLOAT ddxy1 = LIN_INTERP(fy, ddx01, ddx11);
-
-					A3D_ELEM(sum_weight, k, i, j) += LIN_INTERP(fz, ddxy0, ddxy1);
-
-	        	} // end if r2 <= rmax2
-
-	        } // end loop over all elements of sum_weight
+		}
 
-	    } // end loop over symmetry operators
+		MultidimArray<RFLOAT> sum_weight = weight;
+		MultidimArray<Complex > sum_data = data;
+		addRotatedCopies(data, weight, rotations, std::vector<Complex>(), rmax2, sum_data, sum_weight, threads);
 
 	    data = sum_data;
 	    weight = sum_weight;
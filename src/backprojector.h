@@ -36,6 +36,24 @@
 #include "src/symmetries.h"
 #include <src/jaz/single_particle/complex_io.h>
 
+class BackProjector;
+
+/** Replaces the gridding in BackProjector::reconstruct: the iterative pre-weighting, its application to the data
+ * and the inverse FFT, e.g. to distribute it over several MPI processes (see backprojector_mpi.h)
+ */
+class GriddingReconstructor
+{
+public:
+	virtual ~GriddingReconstructor() {}
+
+	/* Fweight is in FFTW format, as in BackProjector::reconstruct, and may be cleared.
+	 * On return, vol_out holds the map windowed to ori_size (as from BackProjector::windowToOridimRealSpace),
+	 * without the gridding correction.
+	 */
+	virtual void reconstruct(BackProjector &BP, MultidimArray<RFLOAT> &Fweight,
+			int max_iter_preweight, int max_r2, MultidimArray<RFLOAT> &vol_out) = 0;
+};
+
 class BackProjector: public Projector
 {
 public:
@@ -308,6 +326,7 @@ public:
 	/* Get the 3D reconstruction
 		 * If do_map is true, 1 will be added to all weights
 		 * alpha will contain the noise-reduction spectrum
+		 * If gridder is given, it does the gridding of 3D references
 	*/
 	void reconstruct(MultidimArray<RFLOAT> &vol_out,
 	                 int max_iter_preweight,
@@ -317,7 +336,8 @@ public:
 	                 RFLOAT normalise = 1.,
 	                 int minres_map = -1,
 	                 bool printTimes= false,
-	                 Image<RFLOAT>* weight_out = 0);
+	                 Image<RFLOAT>* weight_out = 0,
+	                 GriddingReconstructor *gridder = NULL);
 
 	void reweightGrad();
 
@@ -366,7 +386,7 @@ public:
 
 	/* Applies helical symmetry. Note that helical_rise is in PIXELS here, as BackProjector doesn't know angpix
 	 */
-	void applyHelicalSymmetry(int nr_helical_asu = 1, RFLOAT helical_twist = 0., RFLOAT helical_rise = 0.);
+	void applyHelicalSymmetry(int nr_helical_asu = 1, RFLOAT helical_twist = 0., RFLOAT helical_rise = 0., int threads = 1);
 
 	/* Applies the symmetry from the SymList object to the weight and the data array
 	 */
@@ -0,0 +1,577 @@
+/***************************************************************************
+ *
+ * Author: "Sjors H.W. Scheres"
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+#include "src/backprojector_mpi.h"
+
+#ifdef RELION_SINGLE_PRECISION
+typedef fftwf_plan slab_plan;
+typedef fftwf_complex slab_complex;
+#define slab_plan_guru_dft fftwf_plan_guru_dft
+#define slab_plan_many_dft_c2r fftwf_plan_many_dft_c2r
+#define slab_plan_many_dft_r2c fftwf_plan_many_dft_r2c
+#define slab_iodim fftwf_iodim
+#define slab_execute fftwf_execute
+#define slab_destroy_plan fftwf_destroy_plan
+#else
+typedef fftw_plan slab_plan;
+typedef fftw_complex slab_complex;
+#define slab_plan_guru_dft fftw_plan_guru_dft
+#define slab_plan_many_dft_c2r fftw_plan_many_dft_c2r
+#define slab_plan_many_dft_r2c fftw_plan_many_dft_r2c
+#define slab_iodim fftw_iodim
+#define slab_execute fftw_execute
+#define slab_destroy_plan fftw_destroy_plan
+#endif
+
+// Parameters that the root sends to the helpers at the start of each reconstruction
+#define GRIDDING_NR_PARAMS 3
+
+// First Fourier-space row (Y) or real-space slice (Z) of rank r, when n of them are divided over size ranks
+static long int slabStart(int r, int size, long int n)
+{
+	return (n * r) / size;
+}
+
+// The rank that has row (or slice) i
+static int slabOwner(long int i, int size, long int n)
+{
+	int r = 0;
+	while (slabStart(r + 1, size, n) <= i)
+		r++;
+	return r;
+}
+
+// The row of the Fourier transform windowed to size n (see windowFourierTransform) with the frequency of row i
+// of a transform of size pad_size, or -1 if the windowed transform has nothing there (beyond max_r2)
+static long int windowedRow(long int i, long int pad_size, long int n, int max_r2)
+{
+	long int ip = (i < pad_size / 2 + 1) ? i : i - pad_size;
+	if (ip * ip > max_r2 || ip > n / 2 || ip < n / 2 + 1 - n)
+		return -1;
+	return (ip < 0) ? ip + n : ip;
+}
+
+// The 3D FFTs of an n x n x n volume that is cut into slabs over the ranks of comm
+// Fourier-space slab: rows y0 <= i < y0 + ny, stored as [i - y0][k][j]
+// Real-space slab: slices z0 <= k < z0 + nz, stored as [k - z0][i][j]
+// Like the plans in FourierTransformer, neither direction is normalised.
+class SlabFFT
+{
+public:
+	long int n, xsize, y0, ny, z0, nz;
+	std::vector<Complex> Fslab;
+	std::vector<RFLOAT> Mslab;
+
+	SlabFFT(MPI_Comm _comm, long int _n);
+	~SlabFFT();
+
+	// From Fslab to Mslab (this overwrites Fslab): along Z, transpose to Z-slabs, then the 2D c2r transforms
+	void inverse();
+
+	// From Mslab to Fslab: the 2D r2c transforms, transpose back to Y-slabs, then along Z
+	void forward();
+
+private:
+	MPI_Comm comm;
+	int size;
+	std::vector<Complex> Fplanes, sendbuf;
+	slab_plan plan_z_backward, plan_z_forward, plan_xy_c2r, plan_xy_r2c;
+	MPI_Datatype row_type;
+	std::vector<int> counts, displs, rcounts, rdispls;
+
+	// The plans point into the buffers, so no copies
+	SlabFFT(const SlabFFT &);
+	SlabFFT& operator=(const SlabFFT &);
+};
+
+SlabFFT::SlabFFT(MPI_Comm _comm, long int _n):
+		n(_n), comm(_comm),
+		plan_z_backward(NULL), plan_z_forward(NULL), plan_xy_c2r(NULL), plan_xy_r2c(NULL)
+{
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+
+	xsize = n / 2 + 1;
+	y0 = slabStart(rank, size, n);
+	ny = slabStart(rank + 1, size, n) - y0;
+	z0 = y0;
+	nz = ny;
+	const long int nrows = XMIPP_MAX(ny, 1) * n;
+	Fslab.resize(nrows * xsize);
+	Fplanes.resize(nrows * xsize);
+	sendbuf.resize(nrows * xsize);
+	Mslab.resize(XMIPP_MAX(nz, 1) * n * n);
+
+	// Plans: 1D transforms along Z of the Fourier slab, and 2D transforms of each slice of the real-space slab
+	if (ny > 0)
+	{
+		slab_iodim dim_z = {(int)n, (int)xsize, (int)xsize};
+		slab_iodim howmany[2] = {{(int)ny, (int)(n * xsize), (int)(n * xsize)}, {(int)xsize, 1, 1}};
+		int n_xy[2] = {(int)n, (int)n};
+		slab_complex *F = (slab_complex*) &Fslab[0];
+		slab_complex *G = (slab_complex*) &Fplanes[0];
+		#pragma omp critical(FourierTransformer_fftw_plan)
+		{
+			plan_z_backward = slab_plan_guru_dft(1, &dim_z, 2, howmany, F, F, FFTW_BACKWARD, FFTW_ESTIMATE);
+			plan_z_forward = slab_plan_guru_dft(1, &dim_z, 2, howmany, F, F, FFTW_FORWARD, FFTW_ESTIMATE);
+			plan_xy_c2r = slab_plan_many_dft_c2r(2, n_xy, nz, G, NULL, 1, n * xsize, &Mslab[0], NULL, 1, n * n, FFTW_ESTIMATE);
+			plan_xy_r2c = slab_plan_many_dft_r2c(2, n_xy, nz, &Mslab[0], NULL, 1, n * n, G, NULL, 1, n * xsize, FFTW_ESTIMATE);
+		}
+		if (plan_z_backward == NULL || plan_z_forward == NULL || plan_xy_c2r == NULL || plan_xy_r2c == NULL)
+			REPORT_ERROR("DistributedGriddingMpi: FFTW plans cannot be created");
+	}
+
+	// The transpose between the two slabs exchanges rows of xsize complex numbers
+	MPI_Type_contiguous(2 * xsize, MY_MPI_DOUBLE, &row_type);
+	MPI_Type_commit(&row_type);
+	counts.resize(size);
+	displs.resize(size);
+	rcounts.resize(size);
+	rdispls.resize(size);
+	for (int r = 0; r < size; r++)
+	{
+		long int nr = slabStart(r + 1, size, n) - slabStart(r, size, n);
+		counts[r] = ny * nr;
+		rcounts[r] = nr * nz;
+		displs[r] = (r == 0) ? 0 : displs[r - 1] + counts[r - 1];
+		rdispls[r] = (r == 0) ? 0 : rdispls[r - 1] + rcounts[r - 1];
+	}
+}
+
+SlabFFT::~SlabFFT()
+{
+	MPI_Type_free(&row_type);
+	if (ny > 0)
+	{
+		#pragma omp critical(FourierTransformer_fftw_plan)
+		{
+			slab_destroy_plan(plan_z_backward);
+			slab_destroy_plan(plan_z_forward);
+			slab_destroy_plan(plan_xy_c2r);
+			slab_destroy_plan(plan_xy_r2c);
+		}
+	}
+}
+
+void SlabFFT::inverse()
+{
+	if (ny > 0)
+		slab_execute(plan_z_backward);
+	for (int r = 0; r < size; r++)
+	{
+		long int rz0 = slabStart(r, size, n), rz1 = slabStart(r + 1, size, n);
+		Complex *dest = &sendbuf[displs[r] * xsize];
+		for (long int il = 0; il < ny; il++)
+			for (long int k = rz0; k < rz1; k++, dest += xsize)
+				memcpy(dest, &Fslab[(il * n + k) * xsize], xsize * sizeof(Complex));
+	}
+	MPI_Alltoallv(&sendbuf[0], &counts[0], &displs[0], row_type, &Fslab[0], &rcounts[0], &rdispls[0], row_type, comm);
+	for (int r = 0; r < size; r++)
+	{
+		long int ry0 = slabStart(r, size, n), ry1 = slabStart(r + 1, size, n);
+		Complex *src = &Fslab[rdispls[r] * xsize];
+		for (long int i = ry0; i < ry1; i++)
+			for (long int kl = 0; kl < nz; kl++, src += xsize)
+				memcpy(&Fplanes[(kl * n + i) * xsize], src, xsize * sizeof(Complex));
+	}
+	if (nz > 0)
+		slab_execute(plan_xy_c2r);
+}
+
+void SlabFFT::forward()
+{
+	if (nz > 0)
+		slab_execute(plan_xy_r2c);
+	for (int r = 0; r < size; r++)
+	{
+		long int ry0 = slabStart(r, size, n), ry1 = slabStart(r + 1, size, n);
+		Complex *dest = &sendbuf[rdispls[r] * xsize];
+		for (long int i = ry0; i < ry1; i++)
+			for (long int kl = 0; kl < nz; kl++, dest += xsize)
+				memcpy(dest, &Fplanes[(kl * n + i) * xsize], xsize * sizeof(Complex));
+	}
+	MPI_Alltoallv(&sendbuf[0], &rcounts[0], &rdispls[0], row_type, &Fplanes[0], &counts[0], &displs[0], row_type, comm);
+	for (int r = 0; r < size; r++)
+	{
+		long int rz0 = slabStart(r, size, n), rz1 = slabStart(r + 1, size, n);
+		Complex *src = &Fplanes[displs[r] * xsize];
+		for (long int il = 0; il < ny; il++)
+			for (long int k = rz0; k < rz1; k++, src += xsize)
+				memcpy(&Fslab[(il * n + k) * xsize], src, xsize * sizeof(Complex));
+	}
+	if (ny > 0)
+		slab_execute(plan_z_forward);
+}
+
+DistributedGriddingMpi::DistributedGriddingMpi(MPI_Comm _comm, int _root):
+		comm(_comm), root(_root)
+{
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &size);
+}
+
+void DistributedGriddingMpi::reconstruct(BackProjector &BP, MultidimArray<RFLOAT> &Fweight,
+		int max_iter_preweight, int max_r2, MultidimArray<RFLOAT> &vol_out)
+{
+	if (rank != root)
+		REPORT_ERROR("BUG: DistributedGriddingMpi::reconstruct should only be called on the root");
+
+	const int pad_size = ZSIZE(Fweight);
+	int params[GRIDDING_NR_PARAMS] = {max_iter_preweight, pad_size, max_r2};
+	MPI_Bcast(params, GRIDDING_NR_PARAMS, MPI_INT, root, comm);
+
+	std::vector<RFLOAT> my_Fweight;
+	scatterWeight(&Fweight, pad_size, my_Fweight);
+	Fweight.clear();
+
+	grid(BP, max_iter_preweight, pad_size, max_r2, my_Fweight, vol_out);
+
+	// Mask out corners to prevent aliasing artefacts (as in BackProjector::windowToOridimRealSpace)
+	softMaskOutsideMap(vol_out);
+}
+
+void DistributedGriddingMpi::help(const BackProjector &BP)
+{
+	if (rank == root)
+		REPORT_ERROR("BUG: DistributedGriddingMpi::help should not be called on the root");
+
+	while (true)
+	{
+		int params[GRIDDING_NR_PARAMS];
+		MPI_Bcast(params, GRIDDING_NR_PARAMS, MPI_INT, root, comm);
+		const int max_iter_preweight = params[0], pad_size = params[1], max_r2 = params[2];
+		if (max_iter_preweight <= 0)
+			break;
+
+		std::vector<RFLOAT> my_Fweight;
+		scatterWeight(NULL, pad_size, my_Fweight);
+
+		MultidimArray<RFLOAT> dummy;
+		grid(BP, max_iter_preweight, pad_size, max_r2, my_Fweight, dummy);
+	}
+}
+
+void DistributedGriddingMpi::finish()
+{
+	if (rank != root)
+		REPORT_ERROR("BUG: DistributedGriddingMpi::finish should only be called on the root");
+
+	int params[GRIDDING_NR_PARAMS] = {0, 0, 0};
+	MPI_Bcast(params, GRIDDING_NR_PARAMS, MPI_INT, root, comm);
+}
+
+void DistributedGriddingMpi::scatterWeight(const MultidimArray<RFLOAT> *Fweight, int pad_size, std::vector<RFLOAT> &my_Fweight)
+{
+	// The rows are ordered as [y][z] (see SlabFFT)
+	const long int xsize = pad_size / 2 + 1;
+	MPI_Datatype row_type;
+	MPI_Type_contiguous(xsize, MY_MPI_DOUBLE, &row_type);
+	MPI_Type_commit(&row_type);
+	if (rank == root)
+	{
+		std::vector<RFLOAT> buffer;
+		for (int r = 0; r < size; r++)
+		{
+			long int y0 = slabStart(r, size, pad_size), y1 = slabStart(r + 1, size, pad_size);
+			std::vector<RFLOAT> &slab = (r == root) ? my_Fweight : buffer;
+			slab.resize(XMIPP_MAX(y1 - y0, 1) * pad_size * xsize);
+			for (long int i = y0; i < y1; i++)
+				for (long int k = 0; k < pad_size; k++)
+					memcpy(&slab[((i - y0) * pad_size + k) * xsize], &DIRECT_A3D_ELEM(*Fweight, k, i, 0), xsize * sizeof(RFLOAT));
+			if (r != root)
+				MPI_Send(&slab[0], (y1 - y0) * pad_size, row_type, r, MPITAG_PACK, comm);
+		}
+	}
+	else
+	{
+		long int y0 = slabStart(rank, size, pad_size), y1 = slabStart(rank + 1, size, pad_size);
+		my_Fweight.resize(XMIPP_MAX(y1 - y0, 1) * pad_size * xsize);
+		MPI_Status status;
+		MPI_Recv(&my_Fweight[0], (y1 - y0) * pad_size, row_type, root, MPITAG_PACK, comm, &status);
+	}
+	MPI_Type_free(&row_type);
+}
+
+void DistributedGriddingMpi::scatterData(const BackProjector &BP, int pad_size, int max_r2, std::vector<Complex> &my_data)
+{
+	// Decentered as in Projector::decenter, with the rows ordered as [y][z] (see SlabFFT)
+	const long int P = pad_size, xsize = pad_size / 2 + 1;
+	MPI_Datatype row_type;
+	MPI_Type_contiguous(2 * xsize, MY_MPI_DOUBLE, &row_type);
+	MPI_Type_commit(&row_type);
+	if (rank == root)
+	{
+		std::vector<Complex> buffer;
+		for (int r = 0; r < size; r++)
+		{
+			long int y0 = slabStart(r, size, P), y1 = slabStart(r + 1, size, P);
+			std::vector<Complex> &slab = (r == root) ? my_data : buffer;
+			slab.resize(XMIPP_MAX(y1 - y0, 1) * P * xsize);
+			for (long int i = y0; i < y1; i++)
+			{
+				long int ip = (i < xsize) ? i : i - P;
+				for (long int k = 0; k < P; k++)
+				{
+					long int kp = (k < xsize) ? k : k - P;
+					Complex *row = &slab[((i - y0) * P + k) * xsize];
+					for (long int j = 0; j < xsize; j++)
+						row[j] = (kp * kp + ip * ip + j * j <= max_r2) ? A3D_ELEM(BP.data, kp, ip, j) : Complex(0., 0.);
+				}
+			}
+			if (r != root)
+				MPI_Send(&slab[0], (y1 - y0) * P, row_type, r, MPITAG_PACK, comm);
+		}
+	}
+	else
+	{
+		long int y0 = slabStart(rank, size, P), y1 = slabStart(rank + 1, size, P);
+		my_data.resize(XMIPP_MAX(y1 - y0, 1) * P * xsize);
+		MPI_Status status;
+		MPI_Recv(&my_data[0], (y1 - y0) * P, row_type, root, MPITAG_PACK, comm, &status);
+	}
+	MPI_Type_free(&row_type);
+}
+
+void DistributedGriddingMpi::grid(const BackProjector &BP, int max_iter_preweight, int pad_size, int max_r2,
+		std::vector<RFLOAT> &Fweight, MultidimArray<RFLOAT> &vol_out)
+{
+	std::vector<double> Fnewweight;
+	iterate(BP, max_iter_preweight, pad_size, max_r2, Fweight, Fnewweight);
+	std::vector<RFLOAT>().swap(Fweight);
+
+	// Apply the iteratively determined weights to the data (as in BackProjector::reconstruct)
+	const long int P = pad_size, xsize = pad_size / 2 + 1;
+	const long int y0 = slabStart(rank, size, P), ny = slabStart(rank + 1, size, P) - y0;
+	std::vector<Complex> Fconv;
+	scatterData(BP, pad_size, max_r2, Fconv);
+	for (long int n = 0; n < ny * P * xsize; n++)
+	{
+#ifdef  RELION_SINGLE_PRECISION
+		// Prevent numerical instabilities in single-precision reconstruction with very unevenly sampled orientations
+		if (Fnewweight[n] > 1e20)
+			Fnewweight[n] = 1e20;
+#endif
+		Fconv[n] = Fconv[n] * Fnewweight[n];
+	}
+	std::vector<double>().swap(Fnewweight);
+
+	// Window the transform to the padded original size and shift the map back to its origin, as windowFourierTransform
+	// and CenterFFTbySign in BackProjector::windowToOridimRealSpace. This sends each row to its rank in the windowed slabs.
+	long int padoridim = ROUND(BP.padding_factor * BP.ori_size);
+	padoridim += padoridim % 2;
+	const long int N = padoridim, nxsize = N / 2 + 1;
+	SlabFFT fft(comm, N);
+
+	std::vector<int> scounts(size, 0), sdispls(size, 0), rcounts(size, 0), rdispls(size, 0);
+	for (int r = 0; r < size; r++)
+	{
+		for (long int i = slabStart(r, size, P); i < slabStart(r + 1, size, P); i++)
+		{
+			long int iw = windowedRow(i, P, N, max_r2);
+			if (iw < 0)
+				continue;
+			int dest = slabOwner(iw, size, N);
+			if (r == rank)
+				scounts[dest]++;
+			if (dest == rank)
+				rcounts[r]++;
+		}
+	}
+	for (int r = 1; r < size; r++)
+	{
+		sdispls[r] = sdispls[r - 1] + scounts[r - 1];
+		rdispls[r] = rdispls[r - 1] + rcounts[r - 1];
+	}
+
+	const long int plane_size = N * nxsize;
+	std::vector<Complex> sendbuf(XMIPP_MAX(sdispls[size - 1] + scounts[size - 1], 1) * plane_size);
+	Complex *dest = &sendbuf[0];
+	for (int r = 0; r < size; r++)
+	{
+		for (long int il = 0; il < ny; il++)
+		{
+			long int iw = windowedRow(y0 + il, P, N, max_r2);
+			if (iw < 0 || slabOwner(iw, size, N) != r)
+				continue;
+			long int ip = (iw < nxsize) ? iw : iw - N;
+			for (long int kw = 0; kw < N; kw++)
+			{
+				long int kp = (kw < nxsize) ? kw : kw - N;
+				long int k = (kp < 0) ? kp + P : kp;
+				for (long int j = 0; j < nxsize; j++, dest++)
+				{
+					if (kp * kp + ip * ip + j * j <= max_r2)
+					{
+						*dest = Fconv[(il * P + k) * xsize + j];
+						if (((kw ^ iw ^ j) & 1) != 0)
+							*dest = -(*dest);
+					}
+					else
+						*dest = Complex(0., 0.);
+				}
+			}
+		}
+	}
+	std::vector<Complex>().swap(Fconv);
+
+	MPI_Datatype plane_type;
+	MPI_Type_contiguous(2 * plane_size, MY_MPI_DOUBLE, &plane_type);
+	MPI_Type_commit(&plane_type);
+	std::vector<Complex> recvbuf(XMIPP_MAX(rdispls[size - 1] + rcounts[size - 1], 1) * plane_size);
+	MPI_Alltoallv(&sendbuf[0], &scounts[0], &sdispls[0], plane_type, &recvbuf[0], &rcounts[0], &rdispls[0], plane_type, comm);
+	MPI_Type_free(&plane_type);
+	std::vector<Complex>().swap(sendbuf);
+
+	// The rows beyond max_r2 stay zero
+	std::fill(fft.Fslab.begin(), fft.Fslab.end(), Complex(0., 0.));
+	const Complex *src = &recvbuf[0];
+	for (int r = 0; r < size; r++)
+	{
+		for (long int i = slabStart(r, size, P); i < slabStart(r + 1, size, P); i++)
+		{
+			long int iw = windowedRow(i, P, N, max_r2);
+			if (iw < 0 || slabOwner(iw, size, N) != rank)
+				continue;
+			memcpy(&fft.Fslab[(iw - fft.y0) * plane_size], src, plane_size * sizeof(Complex));
+			src += plane_size;
+		}
+	}
+	std::vector<Complex>().swap(recvbuf);
+
+	fft.inverse();
+
+	// Window in real space to ori_size and normalise, as in BackProjector::windowToOridimRealSpace, then gather on the root
+	// The map is centred in the box, so slice k of the windowed map is slice k + offset of the padded one
+	const long int ori_size = BP.ori_size;
+	const long int offset = N / 2 + FIRST_XMIPP_INDEX(ori_size);
+	const RFLOAT normfft = (BP.data_dim == 3) ?
+			(RFLOAT)(BP.padding_factor * BP.padding_factor * BP.padding_factor) :
+			(RFLOAT)(BP.padding_factor * BP.padding_factor * BP.padding_factor * ori_size);
+	std::vector<int> slice_counts(size), slice_displs(size);
+	for (int r = 0; r < size; r++)
+	{
+		long int first = XMIPP_MIN(XMIPP_MAX(slabStart(r, size, N) - offset, 0), ori_size);
+		long int last = XMIPP_MIN(XMIPP_MAX(slabStart(r + 1, size, N) - offset, 0), ori_size);
+		slice_displs[r] = first;
+		slice_counts[r] = last - first;
+	}
+
+	const long int oz0 = slice_displs[rank], onz = slice_counts[rank];
+	std::vector<RFLOAT> my_slices(XMIPP_MAX(onz, 1) * ori_size * ori_size);
+	for (long int kl = 0; kl < onz; kl++)
+	{
+		long int kz = oz0 + kl + offset - fft.z0;
+		for (long int i = 0; i < ori_size; i++)
+		{
+			const RFLOAT *row = &fft.Mslab[(kz * N + i + offset) * N + offset];
+			RFLOAT *out = &my_slices[(kl * ori_size + i) * ori_size];
+			for (long int j = 0; j < ori_size; j++)
+				out[j] = row[j] / normfft;
+		}
+	}
+
+	MPI_Datatype slice_type;
+	MPI_Type_contiguous(ori_size * ori_size, MY_MPI_DOUBLE, &slice_type);
+	MPI_Type_commit(&slice_type);
+	if (rank == root)
+	{
+		vol_out.resize(ori_size, ori_size, ori_size);
+		vol_out.setXmippOrigin();
+	}
+	MPI_Gatherv(&my_slices[0], onz, slice_type, (rank == root) ? MULTIDIM_ARRAY(vol_out) : NULL,
+			&slice_counts[0], &slice_displs[0], slice_type, root, comm);
+	MPI_Type_free(&slice_type);
+}
+
+void DistributedGriddingMpi::iterate(const BackProjector &BP, int max_iter_preweight, int pad_size, int max_r2,
+		std::vector<RFLOAT> &Fweight, std::vector<double> &Fnewweight)
+{
+	const long int P = pad_size, xsize = pad_size / 2 + 1;
+	SlabFFT fft(comm, P);
+	const long int y0 = fft.y0, ny = fft.ny, z0 = fft.z0, nz = fft.nz;
+
+	// Fnewweight starts as 1 inside max_r2 and 0 outside (see BackProjector::reconstruct)
+	Fnewweight.resize(XMIPP_MAX(ny, 1) * P * xsize);
+	for (long int il = 0; il < ny; il++)
+	{
+		long int i = y0 + il;
+		long int ip = (i < xsize) ? i : i - P;
+		for (long int k = 0; k < P; k++)
+		{
+			long int kp = (k < xsize) ? k : k - P;
+			for (long int j = 0; j < xsize; j++)
+				Fnewweight[(il * P + k) * xsize + j] = (kp * kp + ip * ip + j * j < max_r2) ? 1. : 0.;
+		}
+	}
+
+	const RFLOAT normftblob = BP.tab_ftblob(0.);
+	const RFLOAT normfft = (RFLOAT)P * P * P;
+	const long int padhdim = pad_size / 2;
+
+	for (int iter = 0; iter < max_iter_preweight; iter++)
+	{
+		// Fconv = Fnewweight * Fweight
+		for (long int n = 0; n < ny * P * xsize; n++)
+			fft.Fslab[n] = Complex(Fnewweight[n] * Fweight[n], 0.);
+
+		fft.inverse();
+
+		// Multiply with FT of the blob kernel (as in BackProjector::convoluteBlobRealSpace)
+		for (long int kl = 0; kl < nz; kl++)
+		{
+			long int k = z0 + kl;
+			long int kp = (k < padhdim) ? k : k - P;
+			for (long int i = 0; i < P; i++)
+			{
+				long int ip = (i < padhdim) ? i : i - P;
+				RFLOAT *row = &fft.Mslab[(kl * P + i) * P];
+				for (long int j = 0; j < P; j++)
+				{
+					long int jp = (j < padhdim) ? j : j - P;
+					RFLOAT rval = sqrt((RFLOAT)(kp * kp + ip * ip + jp * jp)) / (BP.ori_size * BP.padding_factor);
+					row[j] *= BP.tab_ftblob(rval) / normftblob;
+				}
+			}
+		}
+
+		fft.forward();
+
+		// Apply division of Eq. [14] in Pipe & Menon (1999)
+		for (long int il = 0; il < ny; il++)
+		{
+			long int i = y0 + il;
+			long int ip = (i < xsize) ? i : i - P;
+			for (long int k = 0; k < P; k++)
+			{
+				long int kp = (k < xsize) ? k : k - P;
+				for (long int j = 0; j < xsize; j++)
+				{
+					if (kp * kp + ip * ip + j * j < max_r2)
+					{
+						long int n = (il * P + k) * xsize + j;
+						// Make sure no division by zero can occur....
+						RFLOAT w = XMIPP_MAX(1e-6, abs(fft.Fslab[n]) / normfft);
+						Fnewweight[n] /= w;
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,77 @@
+/***************************************************************************
+ *
+ * Author: "Sjors H.W. Scheres"
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+#ifndef SRC_BACKPROJECTOR_MPI_H_
+#define SRC_BACKPROJECTOR_MPI_H_
+
+#include <vector>
+#include "src/mpi.h"
+#include "src/backprojector.h"
+
+/** The gridding of BackProjector::reconstruct, distributed over all ranks of a communicator.
+ *
+ * The padded 3D Fourier volumes are cut into slabs, one per rank: along Y in Fourier space and along Z in real space.
+ * Each rank only stores its own slabs of Fweight, Fnewweight and the weighted data, and the 3D FFTs are done as
+ * 1D FFTs along Z on the Fourier slab, an all-to-all transpose, and 2D FFTs of the real-space slab (and back).
+ * This is used for the iterative pre-weighting, and for the final inverse FFT of the weighted data, after which
+ * only the map windowed to ori_size is gathered on the root. Apart from its BackProjector, the root therefore
+ * only holds the full Fweight until it has been scattered.
+ *
+ * The root rank calls reconstruct() with this object as gridder; all other ranks call help() at the same time,
+ * which keeps taking part in reconstructions until the root calls finish().
+ */
+class DistributedGriddingMpi: public GriddingReconstructor
+{
+	MPI_Comm comm;
+	int root, rank, size;
+
+public:
+	DistributedGriddingMpi(MPI_Comm _comm, int _root);
+
+	/** On the root rank: scatter Fweight and the data of BP, do the gridding together with the helpers,
+	 *  and gather the map windowed to ori_size in vol_out
+	 */
+	void reconstruct(BackProjector &BP, MultidimArray<RFLOAT> &Fweight,
+			int max_iter_preweight, int max_r2, MultidimArray<RFLOAT> &vol_out);
+
+	/** On all other ranks: help with the reconstructions of the root until it calls finish()
+	 *  BP should have the same size, padding and blob as the one that is being reconstructed on the root.
+	 */
+	void help(const BackProjector &BP);
+
+	/** On the root rank: release the helpers */
+	void finish();
+
+private:
+	// The gridding on this rank's slabs, from its slab of Fweight to (on the root) the windowed map in vol_out
+	void grid(const BackProjector &BP, int max_iter_preweight, int pad_size, int max_r2,
+			std::vector<RFLOAT> &Fweight, MultidimArray<RFLOAT> &vol_out);
+
+	// Send the Y-slabs of Fweight from the root to all ranks
+	void scatterWeight(const MultidimArray<RFLOAT> *Fweight, int pad_size, std::vector<RFLOAT> &my_Fweight);
+
+	// Send the Y-slabs of the decentered data of BP from the root to all ranks
+	void scatterData(const BackProjector &BP, int pad_size, int max_r2, std::vector<Complex> &my_data);
+
+	// The pre-weighting iterations on this rank's slabs
+	void iterate(const BackProjector &BP, int max_iter_preweight, int pad_size, int max_r2,
+			std::vector<RFLOAT> &Fweight, std::vector<double> &Fnewweight);
+};
+
+#endif /* SRC_BACKPROJECTOR_MPI_H_ */
@@ -18,6 +18,7 @@
  * author citations must be preserved.
  ***************************************************************************/
 #include "src/exp_model.h"
+#include "src/metadata_sidecar.h"
 #include <sys/statvfs.h>
 
 long int Experiment::numberOfParticles(int random_subset)
@@ -764,9 +765,29 @@ void Experiment::copyParticlesToScratch(int verb, bool do_copy, bool also_do_ctf
 	}
 }
 
+bool Experiment::openParticleCache(FileName fn_dir, bool do_build, RFLOAT keep_free_Gb, int verb)
+{
+	std::vector<std::string> img_names;
+	if (!MDimg.getStringColumn(EMDL_IMAGE_NAME, img_names))
+		REPORT_ERROR("Experiment::openParticleCache ERROR: the particles do not have an rlnImageName column");
+	std::vector<FileName> fn_imgs(img_names.begin(), img_names.end());
+
+	return particle_cache.open(fn_dir, fn_imgs, do_build, keep_free_Gb, verb);
+}
+
+bool Experiment::getImageFromCache(long int part_id, int img_id, MultidimArray<RFLOAT> &img)
+{
+	if (!particle_cache.isOpen())
+		return false;
+
+	particle_cache.getImage(particles[part_id].images[img_id].id, img);
+	return true;
+}
+
 // Read from file
 void Experiment::read(FileName fn_exp, bool do_ignore_particle_name, bool do_ignore_group_name, bool do_preread_images,
-                      bool need_tiltpsipriors_for_helical_refine, int verb)
+                      bool need_tiltpsipriors_for_helical_refine, int verb,
+                      const std::vector<EMDLabel> *desired_labels)
 {
 
 //#define DEBUG_READ
@@ -802,7 +823,7 @@ void Experiment::read(FileName fn_exp, bool do_ignore_particle_name, bool do_ign
 	{
 		// MDimg and MDopt have to be read at the same time, so that the optics groups can be
 		// renamed in case they are non-contiguous or not sorted
-		ObservationModel::loadSafely(fn_exp, obsModel, MDimg, "particles", verb);
+		ObservationModel::loadSafely(fn_exp, obsModel, MDimg, "particles", verb, true, desired_labels);
 		nr_images_per_optics_group.resize(obsModel.numberOfOpticsGroups(), 0);
 
 		// Set is_3D from MDopt
@@ -1107,4 +1128,14 @@ void Experiment::write(FileName fn_out)
 	}
 
 	fh.close();
+
+	std::vector<const MetaDataTable*> tables;
+	tables.push_back(&obsModel.opticsMdt);
+	tables.push_back(&MDimg);
+	if (nr_bodies > 1)
+	{
+		for (int ibody = 0; ibody < nr_bodies; ibody++)
+			tables.push_back(&MDbodies[ibody]);
+	}
+	MetaDataSidecar::write(fn_out, tables);
 }
@@ -26,6 +26,7 @@
 #include "src/metadata_table.h"
 #include "src/time.h"
 #include "src/ctf.h"
+#include "src/particle_cache.h"
 #include <src/jaz/single_particle/obs_model.h>
 
 /// Reserve large vectors with some reasonable estimate
@@ -211,6 +212,9 @@ public:
 	// Is this sub-tomograms?
 	bool is_3D;
 
+	// Memory-mapped copy of all particle images, in the order of MDimg
+	ParticleCache particle_cache;
+
 	// Empty Constructor
 	Experiment()
 	{
@@ -234,6 +238,7 @@ public:
 		nr_parts_on_scratch.clear();
 		free_space_Gb = 10;
 		is_3D = false;
+		particle_cache.close();
 		MDimg.clear();
 		MDimg.setIsList(false);
 		MDbodies.clear();
@@ -334,12 +339,21 @@ public:
 	// in that case, stop copying, and keep reading particles from where they were...
 	void copyParticlesToScratch(int verb, bool do_copy = true, bool also_do_ctf_image = false, RFLOAT free_scratch_Gb = 10);
 
+	// Map the particle cache for MDimg in directory fn_dir, and build it first if do_build and it does not exist yet
+	// Returns false if particles have to be read from where they are
+	bool openParticleCache(FileName fn_dir, bool do_build = true, RFLOAT keep_free_Gb = 10, int verb = 0);
+
+	// Get the image for a given part_id from the particle cache. Returns false if the particle cache is not used
+	bool getImageFromCache(long int part_id, int img_id, MultidimArray<RFLOAT> &img);
+
 	// Read from file
+	// If desired_labels is not NULL, only those columns of the particles table are read: pass it only if MDimg is not written out again
 	void read(
 		FileName fn_in,
 		bool do_ignore_particle_name = false,
 		bool do_ignore_group_name = false, bool do_preread_images = false,
-		bool need_tiltpsipriors_for_helical_refine = false, int verb = 0);
+		bool need_tiltpsipriors_for_helical_refine = false, int verb = 0,
+		const std::vector<EMDLabel> *desired_labels = NULL);
 
 	// Write
 	void write(FileName fn_root);
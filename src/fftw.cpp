@@ -48,6 +48,10 @@
 #include "src/args.h"
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <map>
+#include <list>
+#include <atomic>
 
 //#define TIMING_FFTW
 #ifdef TIMING_FFTW
@@ -66,6 +70,214 @@
 
 //#define DEBUG_PLANS
 
+// Plan cache --------------------------------------------------------------
+// All FourierTransformers share their plans through a process-wide cache, keyed by the type, shape and
+// alignment of the transform and by the number of planner threads (see setPlannerThreads). The arrays are
+// passed to the new-array execute functions in Transform(), so that one plan can be used by many
+// transformers (and threads) at the same time.
+//
+// Plans stay in the cache while any transformer uses them. Of the plans that are no longer used, only the
+// FFTW_PLAN_CACHE_MAX_UNUSED most recently released ones are kept, for the next transformer of that shape.
+//
+// By default plans are made with FFTW_ESTIMATE. Set RELION_FFTW_PLANNER to measure or patient to let FFTW
+// time the alternatives instead, and RELION_FFTW_WISDOM to a file name to read these timings at start-up
+// and to write them back at exit, so that later runs do not have to measure again.
+
+struct FourierTransformerPlans
+{
+	std::vector<long int> key;
+#ifdef RELION_SINGLE_PRECISION
+	fftwf_plan forward, backward;
+#else
+	fftw_plan forward, backward;
+#endif
+	int users;
+	// Position in fftw_unused_plans, if users == 0
+	std::list<FourierTransformerPlans*>::iterator unused_pos;
+};
+
+#define FFTW_PLAN_CACHE_MAX_UNUSED 32
+
+// Number of threads that new plans are made for; read outside the critical section in setPlans
+static std::atomic<int> fftw_planner_nthreads(1);
+
+// Everything below is protected by the FourierTransformer_fftw_plan critical section
+static std::map<std::vector<long int>, FourierTransformerPlans*> fftw_plan_cache;
+// Cached plans without users, least recently released first
+static std::list<FourierTransformerPlans*> fftw_unused_plans;
+static unsigned fftw_planner_flags = 0;
+static std::string fftw_wisdom_file = "";
+static bool fftw_wisdom_changed = false;
+
+#ifndef MKLFFT
+static void saveFFTWWisdom()
+{
+	if (!fftw_wisdom_changed)
+		return;
+
+	// Write to a temporary file first, as other (MPI) processes may be doing the same
+	std::string fn_tmp = fftw_wisdom_file + "." + integerToString(getpid()) + ".tmp";
+#ifdef RELION_SINGLE_PRECISION
+	int success = fftwf_export_wisdom_to_filename(fn_tmp.c_str());
+#else
+	int success = fftw_export_wisdom_to_filename(fn_tmp.c_str());
+#endif
+	if (!success || rename(fn_tmp.c_str(), fftw_wisdom_file.c_str()) != 0)
+	{
+		std::cerr << " WARNING: cannot write FFTW wisdom to " << fftw_wisdom_file << std::endl;
+		remove(fn_tmp.c_str());
+	}
+}
+#endif
+
+static unsigned getFFTWPlannerFlags()
+{
+	if (fftw_planner_flags != 0)
+		return fftw_planner_flags;
+
+	fftw_planner_flags = FFTW_ESTIMATE;
+	const char *env = getenv("RELION_FFTW_PLANNER");
+	if (env != NULL)
+	{
+		if (strcmp(env, "measure") == 0)
+			fftw_planner_flags = FFTW_MEASURE;
+		else if (strcmp(env, "patient") == 0)
+			fftw_planner_flags = FFTW_PATIENT;
+		else if (strcmp(env, "estimate") != 0)
+			std::cerr << " WARNING: ignoring unknown value of RELION_FFTW_PLANNER: " << env << " (use estimate, measure or patient)" << std::endl;
+	}
+
+#ifndef MKLFFT
+	env = getenv("RELION_FFTW_WISDOM");
+	if (env != NULL && fftw_planner_flags != FFTW_ESTIMATE)
+	{
+		fftw_wisdom_file = env;
+#ifdef RELION_SINGLE_PRECISION
+		fftwf_import_wisdom_from_filename(fftw_wisdom_file.c_str());
+#else
+		fftw_import_wisdom_from_filename(fftw_wisdom_file.c_str());
+#endif
+		atexit(saveFFTWWisdom);
+	}
+#endif
+
+	return fftw_planner_flags;
+}
+
+static int fftwAlignmentOf(void *ptr)
+{
+#if defined(MKLFFT)
+	// MKL's FFTW interface does not provide fftw_alignment_of
+	return (int)((size_t)ptr % 64);
+#elif defined(RELION_SINGLE_PRECISION)
+	return fftwf_alignment_of((float *)ptr);
+#else
+	return fftw_alignment_of((double *)ptr);
+#endif
+}
+
+// Make the forward and backward plans for a real-to-complex (is_complex = false) or complex-to-complex
+// transform of size N between in and out. Planning with FFTW_MEASURE or FFTW_PATIENT overwrites the arrays,
+// so then the plans are made on scratch arrays with the same alignment.
+static void makeFFTWPlans(FourierTransformerPlans &plans, bool is_complex, int ndim, int *N, void *in, void *out)
+{
+	unsigned flags = getFFTWPlannerFlags();
+
+	size_t nr_real = 1;
+	for (int i = 0; i < ndim; i++)
+		nr_real *= N[i];
+	size_t in_size = (is_complex) ? nr_real * sizeof(Complex) : nr_real * sizeof(RFLOAT);
+	size_t out_size = (is_complex) ? nr_real * sizeof(Complex) : (nr_real / N[ndim-1]) * (N[ndim-1]/2 + 1) * sizeof(Complex);
+
+	char *in_scratch = NULL, *out_scratch = NULL;
+	if (flags != FFTW_ESTIMATE)
+	{
+		const int max_alignment = 64;
+#ifdef RELION_SINGLE_PRECISION
+		in_scratch = (char *)fftwf_malloc(in_size + max_alignment);
+		out_scratch = (char *)fftwf_malloc(out_size + max_alignment);
+#else
+		in_scratch = (char *)fftw_malloc(in_size + max_alignment);
+		out_scratch = (char *)fftw_malloc(out_size + max_alignment);
+#endif
+		if (in_scratch == NULL || out_scratch == NULL)
+			flags = FFTW_ESTIMATE; // not enough memory to measure: fall back to estimating the plans
+		else
+		{
+			in = in_scratch + fftwAlignmentOf(in);
+			out = out_scratch + fftwAlignmentOf(out);
+		}
+	}
+
+#ifdef RELION_SINGLE_PRECISION
+	if (is_complex)
+	{
+		plans.forward = fftwf_plan_dft(ndim, N, (fftwf_complex*) in, (fftwf_complex*) out, FFTW_FORWARD, flags);
+		plans.backward = fftwf_plan_dft(ndim, N, (fftwf_complex*) out, (fftwf_complex*) in, FFTW_BACKWARD, flags);
+	}
+	else
+	{
+		plans.forward = fftwf_plan_dft_r2c(ndim, N, (float*) in, (fftwf_complex*) out, flags);
+		plans.backward = fftwf_plan_dft_c2r(ndim, N, (fftwf_complex*) out, (float*) in, flags);
+	}
+	fftwf_free(in_scratch);
+	fftwf_free(out_scratch);
+#else
+	if (is_complex)
+	{
+		plans.forward = fftw_plan_dft(ndim, N, (fftw_complex*) in, (fftw_complex*) out, FFTW_FORWARD, flags);
+		plans.backward = fftw_plan_dft(ndim, N, (fftw_complex*) out, (fftw_complex*) in, FFTW_BACKWARD, flags);
+	}
+	else
+	{
+		plans.forward = fftw_plan_dft_r2c(ndim, N, (double*) in, (fftw_complex*) out, flags);
+		plans.backward = fftw_plan_dft_c2r(ndim, N, (fftw_complex*) out, (double*) in, flags);
+	}
+	fftw_free(in_scratch);
+	fftw_free(out_scratch);
+#endif
+
+	if (flags != FFTW_ESTIMATE)
+		fftw_wisdom_changed = true;
+}
+
+static void destroyFFTWPlans(FourierTransformerPlans *plans)
+{
+#ifdef RELION_SINGLE_PRECISION
+	fftwf_destroy_plan(plans->forward);
+	fftwf_destroy_plan(plans->backward);
+#else
+	fftw_destroy_plan(plans->forward);
+	fftw_destroy_plan(plans->backward);
+#endif
+	delete plans;
+}
+
+// Take a reference to plans from the cache (inside critical(FourierTransformer_fftw_plan))
+static void acquireFFTWPlans(FourierTransformerPlans *plans)
+{
+	if (plans->users == 0)
+		fftw_unused_plans.erase(plans->unused_pos);
+	plans->users++;
+}
+
+// Release a reference to plans from the cache (inside critical(FourierTransformer_fftw_plan)).
+// Unused plans are kept for later, but the least recently used ones are destroyed once there are too many.
+static void releaseFFTWPlans(FourierTransformerPlans *plans)
+{
+	if (--plans->users > 0)
+		return;
+
+	plans->unused_pos = fftw_unused_plans.insert(fftw_unused_plans.end(), plans);
+	while (fftw_unused_plans.size() > FFTW_PLAN_CACHE_MAX_UNUSED)
+	{
+		FourierTransformerPlans *oldest = fftw_unused_plans.front();
+		fftw_unused_plans.pop_front();
+		fftw_plan_cache.erase(oldest->key);
+		destroyFFTWPlans(oldest);
+	}
+}
+
 // Constructors and destructors --------------------------------------------
 FourierTransformer::FourierTransformer():
 		plans_are_set(false)
@@ -88,18 +300,42 @@ FourierTransformer::~FourierTransformer()
 FourierTransformer::FourierTransformer(const FourierTransformer& op) :
 		plans_are_set(false)
 {
-	// Clear current object
-	clear();
+	init();
 	// New object is an extact copy of op
 	*this = op;
 }
 
+FourierTransformer& FourierTransformer::operator=(const FourierTransformer& op)
+{
+	if (this != &op)
+	{
+		clear();
+		fReal = op.fReal;
+		fComplex = op.fComplex;
+		fFourier = op.fFourier;
+		dataPtr = op.dataPtr;
+		// fFourier is a copy, so the plans are looked up again in the next call to setReal
+		complexDataPtr = NULL;
+		#pragma omp critical(FourierTransformer_fftw_plan)
+		{
+			sharedPlans = op.sharedPlans;
+			if (sharedPlans != NULL)
+				acquireFFTWPlans(sharedPlans);
+		}
+		fPlanForward = op.fPlanForward;
+		fPlanBackward = op.fPlanBackward;
+		plans_are_set = op.plans_are_set;
+	}
+	return *this;
+}
+
 void FourierTransformer::init()
 {
 	fReal = NULL;
 	fComplex = NULL;
 	fPlanForward = NULL;
 	fPlanBackward = NULL;
+	sharedPlans = NULL;
 	dataPtr = NULL;
 	complexDataPtr = NULL;
 }
@@ -107,7 +343,7 @@ void FourierTransformer::init()
 void FourierTransformer::clear()
 {
 	fFourier.clear();
-	// Clean-up all other FFTW-allocated memory
+	// Release the plans
 	destroyPlans();
 	// Initialise all pointers to NULL
 	init();
@@ -116,15 +352,19 @@ void FourierTransformer::clear()
 
 void FourierTransformer::cleanup()
 {
-	// First clear object and destroy plans
+	// First clear object and release plans
 	clear();
-	// Then clean up all the junk fftw keeps lying around
-	// SOMEHOW THE FOLLOWING IS NOT ALLOWED WHEN USING MULTPLE TRANSFORMER OBJECTS....
-#ifdef RELION_SINGLE_PRECISION
-	fftwf_cleanup();
-#else
-	fftw_cleanup();
-#endif
+	// Then destroy all cached plans that are no longer used by any transformer.
+	// (fftw_cleanup cannot be called here, as it would invalidate the plans of other transformers.)
+	#pragma omp critical(FourierTransformer_fftw_plan)
+	{
+		for (std::list<FourierTransformerPlans*>::iterator it = fftw_unused_plans.begin(); it != fftw_unused_plans.end(); ++it)
+		{
+			fftw_plan_cache.erase((*it)->key);
+			destroyFFTWPlans(*it);
+		}
+		fftw_unused_plans.clear();
+	}
 
 #ifdef DEBUG_PLANS
 	std::cerr << "CLEANED-UP this= "<<this<< std::endl;
@@ -132,23 +372,91 @@ void FourierTransformer::cleanup()
 
 }
 
+void FourierTransformer::setPlannerThreads(int nr_threads)
+{
+	#pragma omp critical(FourierTransformer_fftw_plan)
+	{
+		fftw_planner_nthreads = nr_threads;
+#ifdef MKLFFT
+		fftw_plan_with_nthreads(nr_threads);
+#endif
+	}
+}
+
 void FourierTransformer::destroyPlans()
 {
 	// Anything to do with plans has to be protected for threads!
+	// The plans themselves stay in the cache for other transformers of the same shape.
+	#pragma omp critical(FourierTransformer_fftw_plan)
+	{
+		if (sharedPlans != NULL)
+			releaseFFTWPlans(sharedPlans);
+		sharedPlans = NULL;
+		fPlanForward = NULL;
+		fPlanBackward = NULL;
+		plans_are_set = false;
+	}
+}
+
+void FourierTransformer::setPlans(bool is_complex, int ndim, int *N, void *in, void *out)
+{
+	// The key of the plan cache: type, shape and alignment of the arrays and the number of planner threads
+	// (and the planner flags, which cannot change)
+	std::vector<long int> key(ndim + 5);
+	key[0] = (is_complex) ? 1 : 0;
+	key[1] = ndim;
+	for (int i = 0; i < ndim; i++)
+		key[2 + i] = N[i];
+	key[2 + ndim] = fftwAlignmentOf(in);
+	key[3 + ndim] = fftwAlignmentOf(out);
+	key[4 + ndim] = fftw_planner_nthreads;
+
+	// Nothing to do if the new arrays can use the current plans
+	if (sharedPlans != NULL && sharedPlans->key == key)
+		return;
+
+	RCTIC(TIMING_FFTW_PLAN);
 	#pragma omp critical(FourierTransformer_fftw_plan)
 	{
-		if (plans_are_set)
+		FourierTransformerPlans *oldPlans = sharedPlans;
+
+		std::map<std::vector<long int>, FourierTransformerPlans*>::iterator it = fftw_plan_cache.find(key);
+		if (it != fftw_plan_cache.end())
 		{
-#ifdef RELION_SINGLE_PRECISION
-			fftwf_destroy_plan(fPlanForward);
-			fftwf_destroy_plan(fPlanBackward);
-#else
-			fftw_destroy_plan(fPlanForward);
-			fftw_destroy_plan(fPlanBackward);
-#endif
-			plans_are_set = false;
+			sharedPlans = it->second;
+			acquireFFTWPlans(sharedPlans);
+		}
+		else
+		{
+			sharedPlans = new FourierTransformerPlans();
+			sharedPlans->key = key;
+			sharedPlans->users = 1;
+			makeFFTWPlans(*sharedPlans, is_complex, ndim, N, in, out);
+			if (sharedPlans->forward == NULL || sharedPlans->backward == NULL)
+			{
+				delete sharedPlans;
+				sharedPlans = NULL;
+			}
+			else
+				fftw_plan_cache[key] = sharedPlans;
 		}
+
+		// Only release the old plans now, so that they cannot be destroyed just before they are needed again
+		if (oldPlans != NULL)
+			releaseFFTWPlans(oldPlans);
 	}
+	RCTOC(TIMING_FFTW_PLAN);
+
+	if (sharedPlans == NULL)
+		REPORT_ERROR("FFTW plans cannot be created");
+
+	fPlanForward = sharedPlans->forward;
+	fPlanBackward = sharedPlans->backward;
+	plans_are_set = true;
+
+#ifdef DEBUG_PLANS
+	std::cerr << " SETPLANS fPlanForward= " << fPlanForward << " fPlanBackward= " << fPlanBackward  <<" this= "<<this<< std::endl;
+#endif
 }
 
 // Initialization ----------------------------------------------------------
@@ -188,7 +496,7 @@ void FourierTransformer::setReal(MultidimArray<RFLOAT> &input, bool force_new_pl
 			if (YSIZE(input)==1)
 				ndim=1;
 		}
-		int *N = new int[ndim];
+		int N[3];
 		switch (ndim)
 		{
 		case 1:
@@ -205,40 +513,9 @@ void FourierTransformer::setReal(MultidimArray<RFLOAT> &input, bool force_new_pl
 			break;
 		}
 
-		// Destroy both forward and backward plans if they already exist
-		destroyPlans();
-
-		// Make new plans
-		plans_are_set = true;
-
-		RCTIC(TIMING_FFTW_PLAN);
+		// Get the (cached) plans for this shape
+		setPlans(false, ndim, N, MULTIDIM_ARRAY(*fReal), MULTIDIM_ARRAY(fFourier));
 
-		#pragma omp critical(FourierTransformer_fftw_plan)
-		{
-#ifdef RELION_SINGLE_PRECISION
-			fPlanForward = fftwf_plan_dft_r2c(ndim, N, MULTIDIM_ARRAY(*fReal),
-							  (fftwf_complex*) MULTIDIM_ARRAY(fFourier), FFTW_ESTIMATE);
-			fPlanBackward = fftwf_plan_dft_c2r(ndim, N,
-							   (fftwf_complex*) MULTIDIM_ARRAY(fFourier), MULTIDIM_ARRAY(*fReal),
-							   FFTW_ESTIMATE);
-#else
-			fPlanForward = fftw_plan_dft_r2c(ndim, N, MULTIDIM_ARRAY(*fReal),
-							 (fftw_complex*) MULTIDIM_ARRAY(fFourier), FFTW_ESTIMATE);
-			fPlanBackward = fftw_plan_dft_c2r(ndim, N,
-							  (fftw_complex*) MULTIDIM_ARRAY(fFourier), MULTIDIM_ARRAY(*fReal),
-							  FFTW_ESTIMATE);
-#endif
-		}	
-		RCTOC(TIMING_FFTW_PLAN);
-
-		if (fPlanForward == NULL || fPlanBackward == NULL)
-			REPORT_ERROR("FFTW plans cannot be created");
-
-#ifdef DEBUG_PLANS
-		std::cerr << " SETREAL fPlanForward= " << fPlanForward << " fPlanBackward= " << fPlanBackward  <<" this= "<<this<< std::endl;
-#endif
-
-		delete [] N;
 		dataPtr=MULTIDIM_ARRAY(*fReal);
 		complexDataPtr = MULTIDIM_ARRAY(fFourier);
 
@@ -267,7 +544,7 @@ void FourierTransformer::setReal(MultidimArray<Complex > &input, bool force_new_
 			if (YSIZE(input)==1)
 				ndim=1;
 		}
-		int *N = new int[ndim];
+		int N[3];
 		switch (ndim)
 		{
 		case 1:
@@ -284,32 +561,9 @@ void FourierTransformer::setReal(MultidimArray<Complex > &input, bool force_new_
 			break;
 		}
 
-		// Destroy both forward and backward plans if they already exist
-		destroyPlans();
-
-		plans_are_set = true;
-
-		RCTIC(TIMING_FFTW_PLAN);
-		#pragma omp critical(FourierTransformer_fftw_plan)
-		{
-#ifdef RELION_SINGLE_PRECISION
-			fPlanForward = fftwf_plan_dft(ndim, N, (fftwf_complex*) MULTIDIM_ARRAY(*fComplex),
-						      (fftwf_complex*) MULTIDIM_ARRAY(fFourier), FFTW_FORWARD, FFTW_ESTIMATE);
-			fPlanBackward = fftwf_plan_dft(ndim, N, (fftwf_complex*) MULTIDIM_ARRAY(fFourier),
-						       (fftwf_complex*) MULTIDIM_ARRAY(*fComplex), FFTW_BACKWARD, FFTW_ESTIMATE);
-#else
-			fPlanForward = fftw_plan_dft(ndim, N, (fftw_complex*) MULTIDIM_ARRAY(*fComplex),
-						     (fftw_complex*) MULTIDIM_ARRAY(fFourier), FFTW_FORWARD, FFTW_ESTIMATE);
-			fPlanBackward = fftw_plan_dft(ndim, N, (fftw_complex*) MULTIDIM_ARRAY(fFourier),
-						      (fftw_complex*) MULTIDIM_ARRAY(*fComplex), FFTW_BACKWARD, FFTW_ESTIMATE);
-#endif
-		}		
-		RCTOC(TIMING_FFTW_PLAN);
-
-		if (fPlanForward == NULL || fPlanBackward == NULL)
-			REPORT_ERROR("FFTW plans cannot be created");
+		// Get the (cached) plans for this shape
+		setPlans(true, ndim, N, MULTIDIM_ARRAY(*fComplex), MULTIDIM_ARRAY(fFourier));
 
-		delete [] N;
 		complexDataPtr=MULTIDIM_ARRAY(*fComplex);
 	}
 }
@@ -147,6 +147,9 @@
  *	Vmag(k,i,j)=20*log10(abs(Vfft(k,i,j)));
  * @endcode
  */
+// Forward and backward plans that are shared by all transformers of the same shape (see fftw.cpp)
+struct FourierTransformerPlans;
+
 class FourierTransformer
 {
 public:
@@ -191,6 +194,9 @@ public:
 	 */
 	FourierTransformer(const FourierTransformer& op);
 
+	/** Assignment (shares the plans of op) */
+	FourierTransformer& operator=(const FourierTransformer& op);
+
 	/** Compute the Fourier transform of a MultidimArray, 2D and 3D.
 	    If getCopy is false, an alias to the transformed data is returned.
 	    This is a faster option since a copy of all the data is avoided,
@@ -332,19 +338,33 @@ public:
 	/* Pointer to the array of complex<RFLOAT> with which the plan was computed */
 	Complex * complexDataPtr;
 
+	/* Entry of the plan cache that holds fPlanForward and fPlanBackward */
+	FourierTransformerPlans * sharedPlans;
+
 	/* Initialise all pointers to NULL */
 	void init();
 
 	/** Clear object */
 	void clear();
 
-	/** This calls fftw_cleanup.
+	/** Clear the object and destroy all cached plans that are no longer in use.
 	*/
 	void cleanup();
 
-	/** Destroy both forward and backward fftw planes (mutex locked */
+	/** Set the number of threads that new plans will use (fftw_plan_with_nthreads with MKLFFT).
+	 *  Transformers only share cached plans that were made for the same number of threads,
+	 *  so call this instead of fftw_plan_with_nthreads.
+	*/
+	static void setPlannerThreads(int nr_threads);
+
+	/** Release both forward and backward fftw plans (mutex locked).
+	    The plans stay in the plan cache until cleanup() is called. */
 	void destroyPlans();
 
+	/** Get the forward and backward plans for a transform of size N (with ndim dimensions)
+	    between in and out from the plan cache, or make them if they are not there yet. */
+	void setPlans(bool is_complex, int ndim, int *N, void *in, void *out);
+
 	/** Computes the transform, specified in Init() function
 	    If normalization=true the forward transform is normalized
 	    (no normalization is made in the inverse transform)
@@ -45,6 +45,7 @@ void HealpixSampling::clear()
 	R_repository_relax.clear();
 	pgGroup = pgOrder = 0;
 	pgGroupRelaxSym = pgOrderRelaxSym = 0;
+	clearOrientationTables();
 
 }
 
@@ -482,6 +483,7 @@ void HealpixSampling::setOrientations(int _order, RFLOAT _psi_step)
 	rot_angles.clear();
 	tilt_angles.clear();
 	psi_angles.clear();
+	clearOrientationTables();
 
 	if (_order >= 0)
 		healpix_order = _order;
@@ -555,6 +557,9 @@ void HealpixSampling::setOrientations(int _order, RFLOAT _psi_step)
 	writeAllOrientationsToBild("orients_final.bild", "1 0 0 ", 0.020);
 #endif
 
+	// Precalculate all oversampled orientations, so that getOrientations does not need to do so for every particle
+	precalculateOrientationTables();
+
 }
 
 /* Set only a single orientation */
@@ -567,6 +572,7 @@ void HealpixSampling::addOneOrientation(RFLOAT rot, RFLOAT tilt, RFLOAT psi, boo
 		tilt_angles.clear();
 		psi_angles.clear();
 	}
+	clearOrientationTables();
 
 	// 3D directions
 	if (is_3D)
@@ -693,209 +699,230 @@ void HealpixSampling::selectOrientationsWithNonZeroPriorProbability(
 		RFLOAT best_ang = 9999.;
 		long int best_idir = -999;
 
-		for (long int idir = 0; idir < rot_angles.size(); idir++)
-		{
-			// Check if this direction was met before as symmetry mate
-			if (idir_flag[idir] == true)
-					continue;
+		// With priors on both rot and tilt, only the directions near the prior (or near one of its symmetry mates) can have
+		// a non-zero prior probability. If possible, find those through the HEALPix grid, rather than checking all directions.
+		std::vector<long int> near_idirs;
+		bool use_near_idirs = (sigma_rot > 0. && sigma_tilt > 0. && !isRelax &&
+				findDirectionsNearPrior(prior_rot, prior_tilt, sigma_cutoff * XMIPP_MAX(sigma_rot, sigma_tilt),
+						do_bimodal_search_psi, near_idirs));
 
-			bool is_nonzero_pdf = false;
-
-			// Any prior involving BOTH rot and tilt.
-			if ( (sigma_rot > 0.) && (sigma_tilt > 0.) )
+		for (int ipass = 0; ipass < 2; ipass++)
+		{
+			long int nr_idirs = (use_near_idirs) ? near_idirs.size() : rot_angles.size();
+			for (long int ii = 0; ii < nr_idirs; ii++)
 			{
-				// Get the direction of the prior
-				Matrix1D<RFLOAT> prior_direction, my_direction, sym_direction, best_direction;
-				Euler_angles2direction(prior_rot, prior_tilt, prior_direction);
+				long int idir = (use_near_idirs) ? near_idirs[ii] : ii;
 
-				// Get the current direction in the loop
-				Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
-				best_direction = my_direction;
+				// Check if this direction was met before as symmetry mate
+				if (idir_flag[idir] == true)
+						continue;
+
+				bool is_nonzero_pdf = false;
 
-				// Loop over all symmetry operators to find the operator that brings this direction nearest to the prior if no symmetry relaxation
-				if (!isRelax)
+				// Any prior involving BOTH rot and tilt.
+				if ( (sigma_rot > 0.) && (sigma_tilt > 0.) )
 				{
-					RFLOAT best_dotProduct = dotProduct(prior_direction, my_direction);
-					for (int j = 0; j < R_repository.size(); j++)
+					// Get the direction of the prior
+					Matrix1D<RFLOAT> prior_direction, my_direction, sym_direction, best_direction;
+					Euler_angles2direction(prior_rot, prior_tilt, prior_direction);
+
+					// Get the current direction in the loop
+					Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
+					best_direction = my_direction;
+
+					// Loop over all symmetry operators to find the operator that brings this direction nearest to the prior if no symmetry relaxation
+					if (!isRelax)
 					{
-						sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
-						RFLOAT my_dotProduct = dotProduct(prior_direction, sym_direction);
-						if (my_dotProduct > best_dotProduct)
+						RFLOAT best_dotProduct = dotProduct(prior_direction, my_direction);
+						for (int j = 0; j < R_repository.size(); j++)
 						{
-							best_direction = sym_direction;
-							best_dotProduct = my_dotProduct;
+							sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
+							RFLOAT my_dotProduct = dotProduct(prior_direction, sym_direction);
+							if (my_dotProduct > best_dotProduct)
+							{
+								best_direction = sym_direction;
+								best_dotProduct = my_dotProduct;
+							}
 						}
 					}
-				}
 
-				// Now that we have the best direction, find the corresponding prior probability
-				RFLOAT diffang = ACOSD( dotProduct(best_direction, prior_direction) );
-				if (diffang > 180.)
-					diffang = ABS(diffang - 360.);
-				if (do_bimodal_search_psi && (diffang > 90.))  // KThurber
-					diffang = ABS(diffang - 180.);	// KThurber
+					// Now that we have the best direction, find the corresponding prior probability
+					RFLOAT diffang = ACOSD( dotProduct(best_direction, prior_direction) );
+					if (diffang > 180.)
+						diffang = ABS(diffang - 360.);
+					if (do_bimodal_search_psi && (diffang > 90.))  // KThurber
+						diffang = ABS(diffang - 180.);	// KThurber
 
-				// Only consider differences within sigma_cutoff * sigma_rot
-				// TODO: If sigma_rot and sigma_tilt are not the same (NOT for helices)?
-				RFLOAT biggest_sigma = XMIPP_MAX(sigma_rot, sigma_tilt);
-				if (diffang < sigma_cutoff * biggest_sigma)
-				{
-					// TODO!!! If tilt is zero then any rot will be OK!!!!!
-					//std::cerr<<"Best direction index: "<<idir<<std::endl;
-					pointer_dir_nonzeroprior.push_back(idir);
-					RFLOAT prior = gaussian1D(diffang, biggest_sigma, 0.);
-					sumprior += prior;
-					if (isRelax)
+					// Only consider differences within sigma_cutoff * sigma_rot
+					// TODO: If sigma_rot and sigma_tilt are not the same (NOT for helices)?
+					RFLOAT biggest_sigma = XMIPP_MAX(sigma_rot, sigma_tilt);
+					if (diffang < sigma_cutoff * biggest_sigma)
 					{
-						idir_flag[idir] = true;
-						RFLOAT my_prior = prior / R_repository_relax.size();
-						directions_prior.push_back(my_prior);
-						findSymmetryMate(idir, my_prior, pointer_dir_nonzeroprior, directions_prior, idir_flag);
+						// TODO!!! If tilt is zero then any rot will be OK!!!!!
+						//std::cerr<<"Best direction index: "<<idir<<std::endl;
+						pointer_dir_nonzeroprior.push_back(idir);
+						RFLOAT prior = gaussian1D(diffang, biggest_sigma, 0.);
+						sumprior += prior;
+						if (isRelax)
+						{
+							idir_flag[idir] = true;
+							RFLOAT my_prior = prior / R_repository_relax.size();
+							directions_prior.push_back(my_prior);
+							findSymmetryMate(idir, my_prior, pointer_dir_nonzeroprior, directions_prior, idir_flag);
+						}
+						else
+							directions_prior.push_back(prior);
+						is_nonzero_pdf = true;
 					}
-					else
-						directions_prior.push_back(prior);
-					is_nonzero_pdf = true;
-				}
 
 
-				// Keep track of the nearest direction
-				if (diffang < best_ang)
-				{
-					best_idir = idir;
-					best_ang = diffang;
+					// Keep track of the nearest direction
+					if (diffang < best_ang)
+					{
+						best_idir = idir;
+						best_ang = diffang;
+					}
 				}
-			}
-			else if (sigma_rot > 0.)
-			{
-				Matrix1D<RFLOAT> my_direction, sym_direction;
-				RFLOAT sym_rot, sym_tilt;
-
-				// Get the current direction in the loop
-				Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
-				RFLOAT diffang = calculateDeltaRot(my_direction, prior_rot);
-				RFLOAT best_diffang = diffang;
-				for (int j = 0; j < R_repository.size(); j++)
+				else if (sigma_rot > 0.)
 				{
-					sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
-					diffang = calculateDeltaRot(sym_direction, prior_rot);
+					Matrix1D<RFLOAT> my_direction, sym_direction;
+					RFLOAT sym_rot, sym_tilt;
 
-					if (diffang < best_diffang)
-						best_diffang = diffang;
-				}
+					// Get the current direction in the loop
+					Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
+					RFLOAT diffang = calculateDeltaRot(my_direction, prior_rot);
+					RFLOAT best_diffang = diffang;
+					for (int j = 0; j < R_repository.size(); j++)
+					{
+						sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
+						diffang = calculateDeltaRot(sym_direction, prior_rot);
 
-				// Only consider differences within sigma_cutoff * sigma_rot
-				if (best_diffang < sigma_cutoff * sigma_rot)
-				{
-					RFLOAT prior = gaussian1D(best_diffang, sigma_rot, 0.);
-					pointer_dir_nonzeroprior.push_back(idir);
-					directions_prior.push_back(prior);
-					sumprior += prior;
-					is_nonzero_pdf = true;
-				}
+						if (diffang < best_diffang)
+							best_diffang = diffang;
+					}
 
-				// Keep track of the nearest direction
-				if (best_diffang < best_ang)
-				{
-					best_idir = idir;
-					best_ang = diffang;
+					// Only consider differences within sigma_cutoff * sigma_rot
+					if (best_diffang < sigma_cutoff * sigma_rot)
+					{
+						RFLOAT prior = gaussian1D(best_diffang, sigma_rot, 0.);
+						pointer_dir_nonzeroprior.push_back(idir);
+						directions_prior.push_back(prior);
+						sumprior += prior;
+						is_nonzero_pdf = true;
+					}
+
+					// Keep track of the nearest direction
+					if (best_diffang < best_ang)
+					{
+						best_idir = idir;
+						best_ang = diffang;
+					}
 				}
-			}
-			else if (sigma_tilt > 0.)
-			{
-				Matrix1D<RFLOAT> my_direction, sym_direction;
-				RFLOAT sym_rot, sym_tilt;
+				else if (sigma_tilt > 0.)
+				{
+					Matrix1D<RFLOAT> my_direction, sym_direction;
+					RFLOAT sym_rot, sym_tilt;
 
-				// Get the current direction in the loop
-				Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
+					// Get the current direction in the loop
+					Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
 
-				// Loop over all symmetry operators to find the operator that brings this direction nearest to the prior
-				RFLOAT diffang = ABS(tilt_angles[idir] - prior_tilt);
-				if (diffang > 180.)
-					diffang = ABS(diffang - 360.);
-				RFLOAT best_diffang = diffang;
-				for (int j = 0; j < R_repository.size(); j++)
-				{
-					sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
-					Euler_direction2angles(sym_direction, sym_rot, sym_tilt);
-					diffang = ABS(sym_tilt - prior_tilt);
+					// Loop over all symmetry operators to find the operator that brings this direction nearest to the prior
+					RFLOAT diffang = ABS(tilt_angles[idir] - prior_tilt);
 					if (diffang > 180.)
 						diffang = ABS(diffang - 360.);
-					if (diffang < best_diffang)
-						best_diffang = diffang;
-				}
+					RFLOAT best_diffang = diffang;
+					for (int j = 0; j < R_repository.size(); j++)
+					{
+						sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
+						Euler_direction2angles(sym_direction, sym_rot, sym_tilt);
+						diffang = ABS(sym_tilt - prior_tilt);
+						if (diffang > 180.)
+							diffang = ABS(diffang - 360.);
+						if (diffang < best_diffang)
+							best_diffang = diffang;
+					}
 
-				// Only consider differences within sigma_cutoff * sigma_tilt
-				if (best_diffang < sigma_cutoff * sigma_tilt)
+					// Only consider differences within sigma_cutoff * sigma_tilt
+					if (best_diffang < sigma_cutoff * sigma_tilt)
+					{
+						RFLOAT prior = gaussian1D(best_diffang, sigma_tilt, 0.);
+						pointer_dir_nonzeroprior.push_back(idir);
+						directions_prior.push_back(prior);
+						sumprior += prior;
+						is_nonzero_pdf = true;
+					}
+
+					// Keep track of the nearest direction
+					if (best_diffang < best_ang)
+					{
+						best_idir = idir;
+						best_ang = diffang;
+					}
+				} // end if any prior involving rot and/or tilt
+				else
 				{
-					RFLOAT prior = gaussian1D(best_diffang, sigma_tilt, 0.);
+					// If no prior on the directions: just add all of them
 					pointer_dir_nonzeroprior.push_back(idir);
-					directions_prior.push_back(prior);
-					sumprior += prior;
+					directions_prior.push_back(1.);
+					sumprior += 1.;
 					is_nonzero_pdf = true;
 				}
 
-				// Keep track of the nearest direction
-				if (best_diffang < best_ang)
+				// For priors on deviations from (0,90)-degree (rot,tilt) angles in multi-body refinement
+				if (sigma_tilt_from_ninety > 0. && is_nonzero_pdf)
 				{
-					best_idir = idir;
-					best_ang = diffang;
-				}
-			} // end if any prior involving rot and/or tilt
-			else
-			{
-				// If no prior on the directions: just add all of them
-				pointer_dir_nonzeroprior.push_back(idir);
-				directions_prior.push_back(1.);
-				sumprior += 1.;
-				is_nonzero_pdf = true;
-			}
+					// Get the current direction in the loop (re-do, as sometimes sigma_rot and sigma_tilt are both zero!
+					Matrix1D<RFLOAT> my_direction, best_direction, sym_direction;
+					Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
 
-			// For priors on deviations from (0,90)-degree (rot,tilt) angles in multi-body refinement
-			if (sigma_tilt_from_ninety > 0. && is_nonzero_pdf)
-			{
-				// Get the current direction in the loop (re-do, as sometimes sigma_rot and sigma_tilt are both zero!
-				Matrix1D<RFLOAT> my_direction, best_direction, sym_direction;
-				Euler_angles2direction(rot_angles[idir], tilt_angles[idir], my_direction);
-
-				// Loop over all symmetry operators to find the operator that brings this direction nearest to the prior
-				RFLOAT best_dotProduct = dotProduct(prior90_direction, my_direction);
-				best_direction = my_direction;
-				for (int j = 0; j < R_repository.size(); j++)
-				{
-					sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
-					RFLOAT my_dotProduct = dotProduct(prior90_direction, sym_direction);
-					if (my_dotProduct > best_dotProduct)
+					// Loop over all symmetry operators to find the operator that brings this direction nearest to the prior
+					RFLOAT best_dotProduct = dotProduct(prior90_direction, my_direction);
+					best_direction = my_direction;
+					for (int j = 0; j < R_repository.size(); j++)
 					{
-						best_direction = sym_direction;
-						best_dotProduct = my_dotProduct;
+						sym_direction =  L_repository[j] * (my_direction.transpose() * R_repository[j]).transpose();
+						RFLOAT my_dotProduct = dotProduct(prior90_direction, sym_direction);
+						if (my_dotProduct > best_dotProduct)
+						{
+							best_direction = sym_direction;
+							best_dotProduct = my_dotProduct;
+						}
 					}
-				}
 
-				// Now that we have the best direction, find the corresponding prior probability
-				RFLOAT diffang = ACOSD( dotProduct(best_direction, prior90_direction) );
-				if (diffang < -180.)
-					diffang = ABS(diffang + 360.);
-				else if (diffang > 180.)
-					diffang = ABS(diffang - 360.);
-				diffang = ABS(diffang);
+					// Now that we have the best direction, find the corresponding prior probability
+					RFLOAT diffang = ACOSD( dotProduct(best_direction, prior90_direction) );
+					if (diffang < -180.)
+						diffang = ABS(diffang + 360.);
+					else if (diffang > 180.)
+						diffang = ABS(diffang - 360.);
+					diffang = ABS(diffang);
 
-				long int mypos = pointer_dir_nonzeroprior.size() - 1;
-				// Check tilt angle is within 3*sigma_tilt_from_ninety
-				if (diffang > sigma_cutoff * sigma_tilt_from_ninety)
-				{
-					pointer_dir_nonzeroprior.pop_back();
-					directions_prior.pop_back();
-				}
-				else
-				{
-					RFLOAT prior = gaussian1D(diffang, sigma_tilt_from_ninety, 0.);
-					directions_prior[mypos] *= prior;
-					sumprior_withsigmafromzero += directions_prior[mypos];
+					long int mypos = pointer_dir_nonzeroprior.size() - 1;
+					// Check tilt angle is within 3*sigma_tilt_from_ninety
+					if (diffang > sigma_cutoff * sigma_tilt_from_ninety)
+					{
+						pointer_dir_nonzeroprior.pop_back();
+						directions_prior.pop_back();
+					}
+					else
+					{
+						RFLOAT prior = gaussian1D(diffang, sigma_tilt_from_ninety, 0.);
+						directions_prior[mypos] *= prior;
+						sumprior_withsigmafromzero += directions_prior[mypos];
+					}
 				}
-			}
-			// Here add the code for relax symmetry to find the symmetry mates
+				// Here add the code for relax symmetry to find the symmetry mates
 
-		} // end for idir
+			} // end for idir
+
+			// If none of the directions near the prior had a non-zero prior probability, check all of them for the nearest one
+			if (directions_prior.size() > 0 || !use_near_idirs)
+				break;
+			use_near_idirs = false;
+			sumprior = sumprior_withsigmafromzero = 0.;
+			best_ang = 9999.;
+			best_idir = -999;
+		}
 
 		//Normalise the prior probability distribution to have sum 1 over all psi-angles
 		for (long int idir = 0; idir < directions_prior.size(); idir++)
@@ -1046,6 +1073,54 @@ void HealpixSampling::selectOrientationsWithNonZeroPriorProbability(
 	return;
 }
 
+bool HealpixSampling::findDirectionsNearPrior(RFLOAT rot, RFLOAT tilt, RFLOAT max_ang, bool do_bimodal, std::vector<long int> &idirs)
+{
+	idirs.clear();
+
+	// For coarse samplings or large search ranges it is not worth it
+	if (!is_3D || ipix_to_idir.size() != healpix_base.Npix() || healpix_order < 4 || max_ang >= 90.)
+		return false;
+
+	Matrix1D<RFLOAT> prior_direction, sym_direction;
+	Euler_angles2direction(rot, tilt, prior_direction);
+
+	std::vector<int> listpix;
+	for (int j = 0; j < R_repository.size(); j++)
+	{
+		// dotProduct(prior_direction, L * R^T * my_direction) = dotProduct(R * L^T * prior_direction, my_direction),
+		// so the directions that this symmetry operator brings near the prior are near R * L^T * prior_direction
+		sym_direction = R_repository[j] * (prior_direction.transpose() * L_repository[j]).transpose();
+
+		for (int iflip = 0; iflip < ((do_bimodal) ? 2 : 1); iflip++)
+		{
+			if (iflip == 1)
+				sym_direction *= -1.;
+
+			// HEALPix disc queries are not well-defined with the centre exactly on one of the poles
+			if (ABS(ZZ(sym_direction)) > 1. - 1e-8)
+			{
+				idirs.clear();
+				return false;
+			}
+
+			vec3 centre(XX(sym_direction), YY(sym_direction), ZZ(sym_direction));
+			healpix_base.query_disc_inclusive(pointing(centre), DEG2RAD(max_ang), listpix);
+			for (int i = 0; i < listpix.size(); i++)
+			{
+				int idir = ipix_to_idir[listpix[i]];
+				if (idir >= 0)
+					idirs.push_back(idir);
+			}
+		}
+	}
+
+	// Discs of different symmetry mates may overlap
+	std::sort(idirs.begin(), idirs.end());
+	idirs.erase(std::unique(idirs.begin(), idirs.end()), idirs.end());
+
+	return true;
+}
+
 void HealpixSampling::findSymmetryMate(long int idir_, RFLOAT prior_,
     		std::vector<int> &pointer_dir_nonzeroprior,
 			std::vector<RFLOAT> &directions_prior, std::vector<bool> &idir_flag)
@@ -1806,14 +1881,113 @@ void HealpixSampling::getTranslationsInPixel(long int itrans, int oversampling_o
 
 }
 
+// Same as Euler_angles2matrix, but from the precalculated sines and cosines of the Euler angles
+static void eulerTrig2matrix(const RFLOAT *dir, const RFLOAT *psi, Matrix2D<RFLOAT> &A)
+{
+	RFLOAT ca = dir[2], sa = dir[3], cb = dir[4], sb = dir[5], cg = psi[1], sg = psi[2];
+	RFLOAT cc = cb * ca;
+	RFLOAT cs = cb * sa;
+	RFLOAT sc = sb * ca;
+	RFLOAT ss = sb * sa;
+
+	A.resize(3, 3);
+	A(0, 0) =  cg * cc - sg * sa;
+	A(0, 1) =  cg * cs + sg * ca;
+	A(0, 2) = -cg * sb;
+	A(1, 0) = -sg * cc - cg * sa;
+	A(1, 1) = -sg * cs + cg * ca;
+	A(1, 2) = sg * sb;
+	A(2, 0) =  sc;
+	A(2, 1) =  ss;
+	A(2, 2) = cb;
+}
+
+void HealpixSampling::clearOrientationTables()
+{
+	table_directions.clear();
+	table_psi_angles.clear();
+	ipix_to_idir.clear();
+}
+
+void HealpixSampling::precalculateOrientationTables()
+{
+	clearOrientationTables();
+
+	// Directions added by addOneOrientation have no pixel on the coarse grid to be oversampled
+	if (directions_ipix.size() == 0 || (is_3D && directions_ipix[0] < 0))
+		return;
+
+	if (is_3D)
+	{
+		ipix_to_idir.resize(healpix_base.Npix(), -1);
+		for (long int idir = 0; idir < directions_ipix.size(); idir++)
+			ipix_to_idir[directions_ipix[idir]] = idir;
+	}
+
+	// Do not use more than ~100Mb (in double precision) for the directions of one oversampling order
+	const long int max_table_directions = 2 * 1024 * 1024;
+
+	table_directions.resize(max_table_oversampling + 1);
+	table_psi_angles.resize(max_table_oversampling + 1);
+	for (int oversampling_order = 0; oversampling_order <= max_table_oversampling; oversampling_order++)
+	{
+		// The oversampled orientations come as all oversampled psi-angles for each oversampled direction
+		long int nr_psi_over = (oversampling_order == 0) ? 1 : ROUND(std::pow(2., oversampling_order));
+		long int nr_dir_over = oversamplingFactorOrientations(oversampling_order) / nr_psi_over;
+		if (rot_angles.size() * nr_dir_over > max_table_directions)
+			break;
+
+		// Fill local tables first, as getOversampledOrientations uses the tables as soon as they are non-empty
+		std::vector<RFLOAT> directions, psis;
+		directions.reserve(6 * rot_angles.size() * nr_dir_over);
+		psis.reserve(3 * psi_angles.size() * nr_psi_over);
+
+		std::vector<RFLOAT> my_rot, my_tilt, my_psi;
+		for (long int idir = 0; idir < rot_angles.size(); idir++)
+		{
+			my_rot.clear();
+			my_tilt.clear();
+			my_psi.clear();
+			getOversampledOrientations(idir, 0, oversampling_order, my_rot, my_tilt, my_psi);
+			for (long int iover = 0; iover < my_rot.size(); iover += nr_psi_over)
+			{
+				RFLOAT rot = DEG2RAD(my_rot[iover]);
+				RFLOAT tilt = DEG2RAD(my_tilt[iover]);
+				directions.push_back(my_rot[iover]);
+				directions.push_back(my_tilt[iover]);
+				directions.push_back(cos(rot));
+				directions.push_back(sin(rot));
+				directions.push_back(cos(tilt));
+				directions.push_back(sin(tilt));
+			}
+		}
+
+		for (long int ipsi = 0; ipsi < psi_angles.size(); ipsi++)
+		{
+			my_rot.clear();
+			my_tilt.clear();
+			my_psi.clear();
+			pushbackOversampledPsiAngles(ipsi, oversampling_order, 0., 0., my_rot, my_tilt, my_psi);
+			for (long int iover = 0; iover < my_psi.size(); iover++)
+			{
+				RFLOAT psi = DEG2RAD(my_psi[iover]);
+				psis.push_back(my_psi[iover]);
+				psis.push_back(cos(psi));
+				psis.push_back(sin(psi));
+			}
+		}
+
+		table_directions[oversampling_order].swap(directions);
+		table_psi_angles[oversampling_order].swap(psis);
+	}
+}
+
 void HealpixSampling::getOrientations(long int idir, long int ipsi, int oversampling_order,
 		std::vector<RFLOAT > &my_rot, std::vector<RFLOAT > &my_tilt, std::vector<RFLOAT > &my_psi,
 		std::vector<int> &pointer_dir_nonzeroprior, std::vector<RFLOAT> &directions_prior,
-		std::vector<int> &pointer_psi_nonzeroprior, std::vector<RFLOAT> &psi_prior)
+		std::vector<int> &pointer_psi_nonzeroprior, std::vector<RFLOAT> &psi_prior,
+		std::vector<Matrix2D<RFLOAT> > *my_A)
 {
-	my_rot.clear();
-	my_tilt.clear();
-	my_psi.clear();
 	long int my_idir, my_ipsi;
 	if (pointer_dir_nonzeroprior.size() > idir && pointer_psi_nonzeroprior.size() > ipsi)
 	{
@@ -1828,6 +2002,53 @@ void HealpixSampling::getOrientations(long int idir, long int ipsi, int oversamp
 		my_ipsi = ipsi;
 	}
 
+	// Random perturbation
+	bool do_perturb = (ABS(random_perturbation) > 0.);
+
+	// For the 3D perturbation the rotation matrices are needed anyway
+	std::vector<Matrix2D<RFLOAT> > perturb_A;
+	if (my_A == NULL && do_perturb && is_3D)
+		my_A = &perturb_A;
+
+	getOversampledOrientations(my_idir, my_ipsi, oversampling_order, my_rot, my_tilt, my_psi, my_A);
+
+	if (do_perturb)
+	{
+		RFLOAT myperturb = random_perturbation * getAngularSampling();
+		Matrix2D<RFLOAT> R(3,3);
+		if (is_3D)
+			Euler_angles2matrix(myperturb, myperturb, myperturb, R);
+		else
+			Euler_angles2matrix(0., 0., myperturb, R);
+		for (int iover = 0; iover < my_rot.size(); iover++)
+		{
+			if (my_A != NULL)
+				(*my_A)[iover] = (*my_A)[iover] * R;
+
+			if (is_3D)
+			{
+				Euler_matrix2angles((*my_A)[iover],
+									my_rot[iover],
+									my_tilt[iover],
+									my_psi[iover]);
+			}
+			else
+			{
+				my_psi[iover] += myperturb;
+			}
+		}
+	}
+
+}
+
+void HealpixSampling::getOversampledOrientations(long int my_idir, long int my_ipsi, int oversampling_order,
+		std::vector<RFLOAT > &my_rot, std::vector<RFLOAT > &my_tilt, std::vector<RFLOAT > &my_psi,
+		std::vector<Matrix2D<RFLOAT> > *my_A)
+{
+	my_rot.clear();
+	my_tilt.clear();
+	my_psi.clear();
+
 #ifdef DEBUG_CHECKSIZES
 		if (my_idir >= rot_angles.size())
 		{
@@ -1841,6 +2062,29 @@ void HealpixSampling::getOrientations(long int idir, long int ipsi, int oversamp
 		}
 #endif
 
+	if (oversampling_order < table_directions.size() && table_directions[oversampling_order].size() > 0)
+	{
+		// Use the precalculated tables
+		long int nr_psi_over = table_psi_angles[oversampling_order].size() / (3 * psi_angles.size());
+		long int nr_dir_over = table_directions[oversampling_order].size() / (6 * rot_angles.size());
+		const RFLOAT *dir = &table_directions[oversampling_order][6 * my_idir * nr_dir_over];
+		if (my_A != NULL)
+			my_A->resize(nr_dir_over * nr_psi_over);
+		for (long int idir_over = 0; idir_over < nr_dir_over; idir_over++, dir += 6)
+		{
+			const RFLOAT *psi = &table_psi_angles[oversampling_order][3 * my_ipsi * nr_psi_over];
+			for (long int ipsi_over = 0; ipsi_over < nr_psi_over; ipsi_over++, psi += 3)
+			{
+				my_rot.push_back(dir[0]);
+				my_tilt.push_back(dir[1]);
+				my_psi.push_back(psi[0]);
+				if (my_A != NULL)
+					eulerTrig2matrix(dir, psi, (*my_A)[my_rot.size() - 1]);
+			}
+		}
+		return;
+	}
+
 	if (oversampling_order == 0)
 	{
 		my_rot.push_back(rot_angles[my_idir]);
@@ -1882,36 +2126,13 @@ void HealpixSampling::getOrientations(long int idir, long int ipsi, int oversamp
 		}
 	}
 
-
-	// Random perturbation
-	if (ABS(random_perturbation) > 0.)
+	if (my_A != NULL)
 	{
-		RFLOAT myperturb = random_perturbation * getAngularSampling();
+		my_A->resize(my_rot.size());
 		for (int iover = 0; iover < my_rot.size(); iover++)
-		{
-			if (is_3D)
-			{
-				Matrix2D<RFLOAT> A(3,3), R(3,3);
-				Euler_angles2matrix(my_rot[iover],
-									my_tilt[iover],
-									my_psi[iover],
-									A);
-				Euler_angles2matrix(myperturb, myperturb, myperturb, R);
-				A = A * R;
-				Euler_matrix2angles(A,
-									my_rot[iover],
-									my_tilt[iover],
-									my_psi[iover]);
-			}
-			else
-			{
-				my_psi[iover] += myperturb;
-			}
-		}
+			Euler_angles2matrix(my_rot[iover], my_tilt[iover], my_psi[iover], (*my_A)[iover]);
 	}
 
-
-
 }
 
 
@@ -97,6 +97,18 @@ public:
     /** vector with the X,Y(,Z)-translations (as of v3.1 in Angstroms!) */
     std::vector<RFLOAT> translations_x, translations_y, translations_z;
 
+    /** Highest oversampling order for which setOrientations precalculates the tables of oversampled orientations */
+    int max_table_oversampling;
+
+    /** Tables of oversampled orientations, one per oversampling order (empty if not precalculated).
+     *  table_directions holds (rot, tilt, cos(rot), sin(rot), cos(tilt), sin(tilt)) for all oversampled directions of all directions,
+     *  table_psi_angles holds (psi, cos(psi), sin(psi)) for all oversampled psi-angles of all psi-angles.
+     */
+    std::vector<std::vector<RFLOAT> > table_directions, table_psi_angles;
+
+    /** For each pixel of healpix_base: its index in the vector of directions (or -1 if it is not one of them) */
+    std::vector<int> ipix_to_idir;
+
 
 public:
 
@@ -114,7 +126,8 @@ public:
 		limit_tilt(0),
 		healpix_order(0),
 		pgOrder(0),
-		pgOrderRelaxSym(0)
+		pgOrderRelaxSym(0),
+		max_table_oversampling(1)
     {}
 
     // Destructor
@@ -127,6 +140,7 @@ public:
     	translations_x.clear();
     	translations_y.clear();
     	translations_z.clear();
+    	clearOrientationTables();
     }
 
     // Start from all empty vectors and meaningless parameters
@@ -228,6 +242,13 @@ public:
      */
     RFLOAT calculateDeltaRot(Matrix1D<RFLOAT> my_direction, RFLOAT rot_prior);
 
+    /* Get the (sorted) indices of all directions within max_ang degrees from (rot, tilt) or from one of its symmetry mates
+     * (and from their opposite directions if do_bimodal), using the neighbourhood queries of the HEALPix grid.
+     * A few directions that lie slightly further away may also be returned.
+     * Returns false if this cannot be done (e.g. for directions that are not on the HEALPix grid), and then idirs is empty.
+     */
+    bool findDirectionsNearPrior(RFLOAT rot, RFLOAT tilt, RFLOAT max_ang, bool do_bimodal, std::vector<long int> &idirs);
+
     /* Select all orientations with zero prior probabilities
      * store all these in the vectors pointer_dir_nonzeroprior and pointer_psi_nonzeroprior
      * Also precalculate their prior probabilities and store in directions_prior and psi_prior
@@ -354,11 +375,32 @@ public:
      *
      * If only_nonzero_prior is true, then only the orientations with non-zero prior probabilities will be returned
      * This is for local angular searches
+     *
+     * If my_A is not NULL, it will be filled with the (3x3) rotation matrices of all triplets
      */
     void getOrientations(long int idir, long int ipsi, int oversampling_order,
     		std::vector<RFLOAT > &my_rot, std::vector<RFLOAT > &my_tilt, std::vector<RFLOAT > &my_psi,
     		std::vector<int> &pointer_dir_nonzeroprior, std::vector<RFLOAT> &directions_prior,
-    		std::vector<int> &pointer_psi_nonzeroprior, std::vector<RFLOAT> &psi_prior);
+    		std::vector<int> &pointer_psi_nonzeroprior, std::vector<RFLOAT> &psi_prior,
+    		std::vector<Matrix2D<RFLOAT> > *my_A = NULL);
+
+    /* As getOrientations, but for direction my_idir and psi-angle my_ipsi of the full sampling (i.e. not through the
+     * nonzeroprior pointers) and without the random perturbation.
+     * The triplets (and their rotation matrices) are taken from the precalculated tables when these are available.
+     */
+    void getOversampledOrientations(long int my_idir, long int my_ipsi, int oversampling_order,
+    		std::vector<RFLOAT > &my_rot, std::vector<RFLOAT > &my_tilt, std::vector<RFLOAT > &my_psi,
+    		std::vector<Matrix2D<RFLOAT> > *my_A = NULL);
+
+    /* Precalculate the tables of oversampled orientations for oversampling orders 0 to max_table_oversampling,
+     * and the index from HEALPix pixels to directions.
+     * This is done at the end of setOrientations, so the tables are only rebuilt when the sampling changes.
+     * Tables that would be too large (e.g. for very fine samplings) are left empty.
+     */
+    void precalculateOrientationTables();
+
+    /* Empty the tables of oversampled orientations, e.g. after changing the list of directions */
+    void clearOrientationTables();
 
     /* Gets the vector of psi angles for a more finely (oversampled) sampling and
      * pushes each instance back into the oversampled_orientations vector with the given rot and tilt
@@ -0,0 +1,162 @@
+/***************************************************************************
+ *
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "src/image_prefetcher.h"
+#include "src/image.h"
+
+void ImagePrefetcher::start()
+{
+	if (is_running)
+		return;
+
+	do_stop = false;
+	is_running = true;
+	worker = std::thread(&ImagePrefetcher::run, this);
+}
+
+void ImagePrefetcher::stop()
+{
+	if (is_running)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			do_stop = true;
+		}
+		cond.notify_all();
+		worker.join();
+		is_running = false;
+	}
+
+	batches.clear();
+	do_stop = false;
+}
+
+void ImagePrefetcher::push(long int key, const std::vector<FileName> &fn_imgs)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		batches.push_back(Batch());
+		batches.back().key = key;
+		batches.back().fn_imgs = fn_imgs;
+	}
+	cond.notify_all();
+}
+
+int ImagePrefetcher::size()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return batches.size();
+}
+
+bool ImagePrefetcher::take(long int key, std::vector<MultidimArray<RFLOAT> > &imgs)
+{
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		size_t ibatch = 0;
+		while (ibatch < batches.size() && batches[ibatch].key != key)
+			ibatch++;
+		if (ibatch == batches.size())
+			return false;
+
+		// Batches before this one will never be asked for. The one being read, if any, is not
+		// dropped here but only once it has been read, as the worker still writes into it.
+		while (ibatch > 0 && batches.front().is_done)
+		{
+			batches.pop_front();
+			ibatch--;
+		}
+
+		while (!batches[ibatch].is_done)
+			cond.wait(lock);
+		while (ibatch > 0)
+		{
+			batches.pop_front();
+			ibatch--;
+		}
+
+		imgs.swap(batches.front().imgs);
+		error = batches.front().error;
+		batches.pop_front();
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+
+	return true;
+}
+
+void ImagePrefetcher::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		// Batches are read in order, so the first one that is not done is the next one
+		size_t ibatch = 0;
+		while (ibatch < batches.size() && batches[ibatch].is_done)
+			ibatch++;
+
+		if (do_stop)
+			return;
+		if (ibatch == batches.size())
+		{
+			cond.wait(lock);
+			continue;
+		}
+
+		// Read without holding the lock, so that new batches can be pushed meanwhile.
+		// Nobody else removes a batch that is not done, so its reference stays valid.
+		Batch &batch = batches[ibatch];
+		lock.unlock();
+
+		std::vector<MultidimArray<RFLOAT> > imgs(batch.fn_imgs.size());
+		std::exception_ptr error;
+		try
+		{
+			fImageHandler hFile;
+			FileName fn_stack, fn_open_stack = "";
+			long int dump;
+			for (size_t i = 0; i < batch.fn_imgs.size(); i++)
+			{
+				batch.fn_imgs[i].decompose(dump, fn_stack);
+				if (fn_stack != fn_open_stack)
+				{
+					hFile.openFile(fn_stack, WRITE_READONLY);
+					fn_open_stack = fn_stack;
+				}
+				Image<RFLOAT> img;
+				img.readFromOpenFile(batch.fn_imgs[i], hFile, -1, false);
+				img().setXmippOrigin();
+				imgs[i] = img();
+			}
+		}
+		catch (...)
+		{
+			// Nothing may escape the thread, so keep any exception for take()
+			error = std::current_exception();
+		}
+
+		lock.lock();
+		batch.imgs.swap(imgs);
+		batch.error = error;
+		batch.is_done = true;
+		cond.notify_all();
+	}
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+ *
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef IMAGE_PREFETCHER_H
+#define IMAGE_PREFETCHER_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "src/filename.h"
+#include "src/multidim_array.h"
+
+/*	class ImagePrefetcher:
+ *
+ *	Reads batches of images on a background thread, so that reading the next
+ *	pool of particles from disc overlaps with processing the current one.
+ *
+ *	Batches are read in the order in which they were pushed. Each batch is
+ *	identified by a key (the first particle of the pool); take() waits until
+ *	the batch with that key has been read and hands over its images, each with
+ *	its Xmipp origin set. Batches in front of it that were never taken are dropped.
+ *
+ *	Any exception while reading a batch is rethrown by take() on the calling thread.
+ */
+class ImagePrefetcher
+{
+public:
+
+	ImagePrefetcher() : do_stop(false), is_running(false) {}
+
+	~ImagePrefetcher()
+	{
+		stop();
+	}
+
+	// Start the background thread
+	void start();
+
+	// Stop the background thread, and drop all batches that have not been taken
+	void stop();
+
+	// Queue the images fn_imgs to be read as batch key
+	void push(long int key, const std::vector<FileName> &fn_imgs);
+
+	// Number of batches that are queued, being read or read but not taken yet
+	int size();
+
+	// Wait until batch key has been read and move its images into imgs.
+	// Returns false if no batch with that key was queued.
+	bool take(long int key, std::vector<MultidimArray<RFLOAT> > &imgs);
+
+private:
+
+	struct Batch
+	{
+		long int key;
+		std::vector<FileName> fn_imgs;
+		std::vector<MultidimArray<RFLOAT> > imgs;
+		bool is_done;
+		std::exception_ptr error;
+
+		Batch() : key(-1), is_done(false) {}
+	};
+
+	std::deque<Batch> batches;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::thread worker;
+	bool do_stop, is_running;
+
+	void run();
+
+	// Not copyable
+	ImagePrefetcher(const ImagePrefetcher&);
+	ImagePrefetcher& operator=(const ImagePrefetcher&);
+};
+
+#endif
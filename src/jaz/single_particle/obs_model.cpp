@@ -30,6 +30,7 @@
 #include "io/star_converter.h"
 
 #include <src/backprojector.h>
+#include <src/metadata_sidecar.h>
 
 #include <set>
 #include <omp.h>
@@ -1271,7 +1272,8 @@ Matrix2D<RFLOAT> ObservationModel::applyScaleDifference(
 
 void ObservationModel::loadSafely(std::string filename, ObservationModel& obsModel,
 								  MetaDataTable& particlesMdt, std::string tablename,
-								  int verb, bool do_die_upon_error)
+								  int verb, bool do_die_upon_error,
+								  const std::vector<EMDLabel> *desired_labels)
 {
 	MetaDataTable opticsMdt;
 
@@ -1279,22 +1281,22 @@ void ObservationModel::loadSafely(std::string filename, ObservationModel& obsMod
 
 	if (tablename == "discover")
 	{
-		if (particlesMdt.read(filename, "particles"))
+		if (particlesMdt.read(filename, "particles", false, desired_labels))
 		{
 			mytablename = "particles";
 		}
-		else if (particlesMdt.read(filename, "micrographs"))
+		else if (particlesMdt.read(filename, "micrographs", false, desired_labels))
 		{
 			mytablename = "micrographs";
 		}
-		else if (particlesMdt.read(filename, "movies"))
+		else if (particlesMdt.read(filename, "movies", false, desired_labels))
 		{
 			mytablename = "movies";
 		}
 	}
 	else
 	{
-		particlesMdt.read(filename, tablename);
+		particlesMdt.read(filename, tablename, false, desired_labels);
 		mytablename = tablename;
 	}
 	opticsMdt.read(filename, "optics");
@@ -1392,8 +1394,14 @@ void ObservationModel::saveNew(
 
 	particlesMdt.setName(tablename);
 	particlesMdt.write(of);
+	of.close();
 
 	std::rename(tmpfilename.c_str(), filename.c_str());
+
+	std::vector<const MetaDataTable*> tables;
+	tables.push_back(&opticsMdt);
+	tables.push_back(&particlesMdt);
+	MetaDataSidecar::write(filename, tables);
 }
 
 void ObservationModel::save(MetaDataTable &particlesMdt, std::string filename, std::string tablename)
@@ -1406,8 +1414,14 @@ void ObservationModel::save(MetaDataTable &particlesMdt, std::string filename, s
 
 	particlesMdt.setName(tablename);
 	particlesMdt.write(of);
+	of.close();
 
 	std::rename(tmpfilename.c_str(), filename.c_str());
+
+	std::vector<const MetaDataTable*> tables;
+	tables.push_back(&opticsMdt);
+	tables.push_back(&particlesMdt);
+	MetaDataSidecar::write(filename, tables);
 }
 
 bool ObservationModel::containsAllColumnsNeededForPrediction(const MetaDataTable& partMdt)
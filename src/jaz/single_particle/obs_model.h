@@ -143,11 +143,13 @@ class ObservationModel
 		// tablename can be "particles", "micrographs" or "movies".
 		// If tablename is "discover", the function will try to read
 		// the data table with all three names (in that order).
+		// If desired_labels is not NULL, only those columns of the data table are read (see MetaDataTable::read).
 
 		static void loadSafely(
 				std::string filename, ObservationModel& obsModel,
 				MetaDataTable& particlesMdt, std::string tablename = "particles",
-				int verb = 0, bool do_die_upon_error = true);
+				int verb = 0, bool do_die_upon_error = true,
+				const std::vector<EMDLabel> *desired_labels = NULL);
 
 		static void saveNew(
 				MetaDataTable& particlesMdt, MetaDataTable& opticsMdt,
@@ -31,26 +31,23 @@
 
 class MetaDataTable;
 
+/*	class MetaDataContainer:
+ *
+ *	A handle to one row of a MetaDataTable. The values themselves are stored
+ *	column by column inside the table, so a container holds no data of its own
+ *	and is only valid as long as its table is. It always refers to the row at
+ *	position 'row', also after the table has been sorted or rows were removed.
+ */
 class MetaDataContainer
 {
     public:
-		
+
 		MetaDataContainer();
-		MetaDataContainer(MetaDataTable* table, long doubleCount, long intCount,
-						  long boolCount, long stringCount, long doubleVectorCount, long unknownCount);
-		MetaDataContainer(MetaDataTable* table, MetaDataContainer* mdc);
+		MetaDataContainer(MetaDataTable* table, long row);
 
-		
 			MetaDataTable* table;
-	
-			std::vector<double> doubles;
-			std::vector<long> ints;
-			std::vector<bool> bools;
-			std::vector<std::string> strings;
-			std::vector<std::vector<double> > doubleVectors;
-			std::vector<std::string> unknowns;
+			long row;
 
-			
 		void getValue(long offset, double& dest) const;
 		void getValue(long offset, float& dest) const;
 		void getValue(long offset, int& dest) const;
@@ -59,7 +56,7 @@ class MetaDataContainer
 		void getValue(long offset, std::string& dest) const;
 		void getValue(long offset, std::vector<double>& dest) const;
 		void getValue(long offset, std::vector<float>& dest) const;
-		
+
 		void setValue(long offset, const double& src);
 		void setValue(long offset, const float& src);
 		void setValue(long offset, const int& src);
@@ -0,0 +1,717 @@
+/***************************************************************************
+ *
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_map>
+#include "src/metadata_sidecar.h"
+#include "src/metadata_table.h"
+
+/* File layout (all integers little-endian, as written by the host):
+ *
+ *   header:     char magic[8], uint32 format version, uint32 byte-order mark,
+ *               uint64 STAR file size, int64 STAR mtime (s), int64 STAR mtime (ns),
+ *               uint64 hash of the STAR file contents (see hashStarFile), uint64 offset of the block directory
+ *   columns:    each column block starts at an 8-byte aligned offset
+ *   directory:  uint32 number of blocks, then per block:
+ *                 string name, uint32 is_list, int32 version, uint64 rows, uint32 columns,
+ *                 then per column: string label, uint32 type, uint64 offset, uint64 size
+ *
+ * Strings in the directory are stored as uint32 length + characters.
+ */
+
+#define SIDECAR_MAGIC "RLNSTARB"
+#define SIDECAR_FORMAT_VERSION 2
+#define SIDECAR_BYTE_ORDER_MARK 0x01020304
+#define SIDECAR_HEADER_SIZE 56
+// Number of bytes at the start and at the end of the STAR file that are hashed
+#define SIDECAR_HASH_BYTES 65536
+
+enum SidecarColumnType
+{
+	SIDECAR_DOUBLE = 1,
+	SIDECAR_INT = 2,
+	SIDECAR_BOOL = 3,
+	SIDECAR_STRING = 4,
+	SIDECAR_DOUBLE_VECTOR = 5,
+	SIDECAR_UNKNOWN = 6
+};
+
+static int sidecarTypeOf(EMDLabel label)
+{
+	if (EMDL::isDouble(label)) return SIDECAR_DOUBLE;
+	else if (EMDL::isInt(label)) return SIDECAR_INT;
+	else if (EMDL::isBool(label)) return SIDECAR_BOOL;
+	else if (EMDL::isString(label)) return SIDECAR_STRING;
+	else if (EMDL::isDoubleVector(label)) return SIDECAR_DOUBLE_VECTOR;
+	else return SIDECAR_UNKNOWN;
+}
+
+static bool statStarFile(const FileName &fn_star, uint64_t &size, int64_t &mtime_s, int64_t &mtime_ns)
+{
+	struct stat st;
+	if (stat(fn_star.c_str(), &st) != 0)
+		return false;
+
+	size = st.st_size;
+	mtime_s = st.st_mtime;
+#if defined(__APPLE__)
+	mtime_ns = st.st_mtimespec.tv_nsec;
+#else
+	mtime_ns = st.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+// FNV-1a hash of the first and last SIDECAR_HASH_BYTES of the STAR file (of all of it, if it is smaller).
+// This catches edits that keep the size and the modification time, e.g. on file systems with a coarse time stamp,
+// as long as they touch the header, the first rows or the last rows.
+static bool hashStarFile(const FileName &fn_star, uint64_t size, uint64_t &hash)
+{
+	std::ifstream fh(fn_star.c_str(), std::ios::in | std::ios::binary);
+	if (!fh)
+		return false;
+
+	std::vector<char> buffer;
+	if (size <= 2 * SIDECAR_HASH_BYTES)
+	{
+		buffer.resize(size);
+		fh.read(buffer.data(), size);
+	}
+	else
+	{
+		buffer.resize(2 * SIDECAR_HASH_BYTES);
+		fh.read(buffer.data(), SIDECAR_HASH_BYTES);
+		fh.seekg(size - SIDECAR_HASH_BYTES);
+		fh.read(buffer.data() + SIDECAR_HASH_BYTES, SIDECAR_HASH_BYTES);
+	}
+	if (!fh)
+		return false;
+
+	hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < buffer.size(); i++)
+	{
+		hash ^= (unsigned char)buffer[i];
+		hash *= 1099511628211ULL;
+	}
+	return true;
+}
+
+// Writing helpers
+
+template <typename T>
+static void putPod(std::ofstream &fh, const T &value)
+{
+	fh.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void putString(std::ofstream &fh, const std::string &str)
+{
+	putPod(fh, (uint32_t)str.length());
+	fh.write(str.data(), str.length());
+}
+
+static void padTo8(std::ofstream &fh)
+{
+	const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	const long pos = fh.tellp();
+	if (pos % 8 != 0)
+		fh.write(zeros, 8 - pos % 8);
+}
+
+struct MetaDataSidecar::ColumnEntry
+{
+	std::string label;
+	uint32_t type;
+	uint64_t offset, size;
+};
+
+struct MetaDataSidecar::BlockEntry
+{
+	std::string name;
+	uint32_t is_list;
+	int32_t version;
+	uint64_t rows;
+	std::vector<ColumnEntry> columns;
+};
+
+// Reading helpers: bounds-checked cursor over the mapped file
+
+class SidecarCursor
+{
+public:
+
+	SidecarCursor(const char *data, size_t size, size_t pos) : data(data), size(size), pos(pos), ok(true) {}
+
+	template <typename T>
+	T get()
+	{
+		T value = T();
+		if (pos + sizeof(T) > size)
+		{
+			ok = false;
+			return value;
+		}
+		memcpy(&value, data + pos, sizeof(T));
+		pos += sizeof(T);
+		return value;
+	}
+
+	std::string getString()
+	{
+		const uint32_t len = get<uint32_t>();
+		if (!ok || pos + len > size)
+		{
+			ok = false;
+			return "";
+		}
+		std::string out(data + pos, len);
+		pos += len;
+		return out;
+	}
+
+	const char *data;
+	size_t size, pos;
+	bool ok;
+};
+
+class MetaDataSidecar::Mapping
+{
+public:
+
+	Mapping() : data(NULL), size(0) {}
+
+	~Mapping()
+	{
+		if (data != NULL) munmap((void*)data, size);
+	}
+
+	bool open(const FileName &fn)
+	{
+		int fd = ::open(fn.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < SIDECAR_HEADER_SIZE)
+		{
+			close(fd);
+			return false;
+		}
+		size = st.st_size;
+
+		void *ptr = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (ptr == MAP_FAILED) return false;
+
+		data = (const char*)ptr;
+		return true;
+	}
+
+	const char *data;
+	size_t size;
+};
+
+bool MetaDataSidecar::readDirectory(const Mapping &map, const FileName &fn_star, std::vector<BlockEntry> &blocks)
+{
+	SidecarCursor cur(map.data, map.size, 0);
+
+	if (memcmp(map.data, SIDECAR_MAGIC, 8) != 0) return false;
+	cur.pos = 8;
+	if (cur.get<uint32_t>() != SIDECAR_FORMAT_VERSION) return false;
+	if (cur.get<uint32_t>() != SIDECAR_BYTE_ORDER_MARK) return false;
+
+	uint64_t star_size;
+	int64_t star_mtime_s, star_mtime_ns;
+	if (!statStarFile(fn_star, star_size, star_mtime_s, star_mtime_ns)) return false;
+	if (cur.get<uint64_t>() != star_size) return false;
+	if (cur.get<int64_t>() != star_mtime_s) return false;
+	if (cur.get<int64_t>() != star_mtime_ns) return false;
+	const uint64_t sidecar_hash = cur.get<uint64_t>();
+	uint64_t star_hash;
+	if (!cur.ok || !hashStarFile(fn_star, star_size, star_hash) || sidecar_hash != star_hash) return false;
+
+	cur.pos = cur.get<uint64_t>();
+	if (!cur.ok) return false;
+
+	const uint32_t nr_blocks = cur.get<uint32_t>();
+	for (uint32_t iblock = 0; iblock < nr_blocks && cur.ok; iblock++)
+	{
+		BlockEntry block;
+		block.name = cur.getString();
+		block.is_list = cur.get<uint32_t>();
+		block.version = cur.get<int32_t>();
+		block.rows = cur.get<uint64_t>();
+
+		const uint32_t nr_columns = cur.get<uint32_t>();
+		for (uint32_t icol = 0; icol < nr_columns && cur.ok; icol++)
+		{
+			ColumnEntry col;
+			col.label = cur.getString();
+			col.type = cur.get<uint32_t>();
+			col.offset = cur.get<uint64_t>();
+			col.size = cur.get<uint64_t>();
+
+			if (col.offset % 8 != 0 || col.offset > map.size || col.size > map.size - col.offset)
+				return false;
+
+			block.columns.push_back(col);
+		}
+		blocks.push_back(block);
+	}
+
+	return cur.ok;
+}
+
+// Check that a column block is consistent with the number of rows before anything is decoded
+bool MetaDataSidecar::validateColumn(const Mapping &map, const ColumnEntry &col, uint64_t rows)
+{
+	const char *base = map.data + col.offset;
+
+	switch (col.type)
+	{
+	case SIDECAR_DOUBLE:
+	case SIDECAR_INT:
+		return col.size >= rows * 8;
+	case SIDECAR_BOOL:
+		return col.size >= rows;
+	case SIDECAR_STRING:
+	case SIDECAR_UNKNOWN:
+	{
+		if (col.size < 8) return false;
+		uint64_t nr_dict;
+		memcpy(&nr_dict, base, 8);
+		if (nr_dict > col.size / 8) return false;
+		const uint64_t index_start = 8 + 8 * (nr_dict + 1);
+		const uint64_t chars_start = index_start + ((rows * 4 + 7) / 8) * 8;
+		if (chars_start > col.size) return false;
+
+		const uint64_t *dict_offsets = (const uint64_t*)(base + 8);
+		if (dict_offsets[nr_dict] > col.size - chars_start) return false;
+		for (uint64_t i = 0; i < nr_dict; i++)
+			if (dict_offsets[i] > dict_offsets[i + 1]) return false;
+
+		const uint32_t *index = (const uint32_t*)(base + index_start);
+		for (uint64_t i = 0; i < rows; i++)
+			if (index[i] >= nr_dict) return false;
+		return true;
+	}
+	case SIDECAR_DOUBLE_VECTOR:
+	{
+		if (col.size < 8 * (rows + 1)) return false;
+		const uint64_t *offsets = (const uint64_t*)base;
+		for (uint64_t i = 0; i < rows; i++)
+			if (offsets[i] > offsets[i + 1]) return false;
+		return offsets[rows] <= (col.size - 8 * (rows + 1)) / 8;
+	}
+	default:
+		return false;
+	}
+}
+
+FileName MetaDataSidecar::getName(const FileName &fn_star)
+{
+	return fn_star + "b";
+}
+
+bool MetaDataSidecar::isEnabled()
+{
+	const char *env = getenv("RELION_STAR_SIDECAR");
+	if (env == NULL) return false;
+
+	std::string val(env);
+	return !(val == "" || val == "0" || val == "false" || val == "no");
+}
+
+bool MetaDataSidecar::isUpToDate(const FileName &fn_star)
+{
+	const FileName fn_side = getName(fn_star);
+	if (!exists(fn_side)) return false;
+
+	Mapping map;
+	if (!map.open(fn_side)) return false;
+
+	std::vector<BlockEntry> blocks;
+	return readDirectory(map, fn_star, blocks);
+}
+
+void MetaDataSidecar::remove(const FileName &fn_star)
+{
+	const FileName fn_side = getName(fn_star);
+	if (exists(fn_side))
+		std::remove(fn_side.c_str());
+}
+
+void MetaDataSidecar::write(const FileName &fn_star, const MetaDataTable &table)
+{
+	std::vector<const MetaDataTable*> tables(1, &table);
+	write(fn_star, tables);
+}
+
+void MetaDataSidecar::write(const FileName &fn_star, const std::vector<const MetaDataTable*> &tables)
+{
+	// Never leave a sidecar behind that describes an older version of the STAR file
+	remove(fn_star);
+
+	if (!isEnabled()) return;
+
+	uint64_t star_size;
+	int64_t star_mtime_s, star_mtime_ns;
+	if (!statStarFile(fn_star, star_size, star_mtime_s, star_mtime_ns))
+		REPORT_ERROR("MetaDataSidecar::write: cannot find STAR file " + fn_star);
+	uint64_t star_hash;
+	if (!hashStarFile(fn_star, star_size, star_hash))
+		REPORT_ERROR("MetaDataSidecar::write: cannot read STAR file " + fn_star);
+
+	const FileName fn_side = getName(fn_star);
+	const FileName fn_tmp = fn_side + ".tmp";
+	std::ofstream fh(fn_tmp.c_str(), std::ios::out | std::ios::binary);
+	if (!fh)
+		REPORT_ERROR("MetaDataSidecar::write: cannot write to file: " + fn_side);
+
+	fh.write(SIDECAR_MAGIC, 8);
+	putPod(fh, (uint32_t)SIDECAR_FORMAT_VERSION);
+	putPod(fh, (uint32_t)SIDECAR_BYTE_ORDER_MARK);
+	putPod(fh, star_size);
+	putPod(fh, star_mtime_s);
+	putPod(fh, star_mtime_ns);
+	putPod(fh, star_hash);
+	putPod(fh, (uint64_t)0); // offset of the directory, filled in below
+
+	std::vector<BlockEntry> blocks;
+
+	for (int itab = 0; itab < tables.size(); itab++)
+	{
+		const MetaDataTable &mdt = *tables[itab];
+
+		// MetaDataTable::write skips empty tables, so there is nothing to read back either
+		if (mdt.isEmpty()) continue;
+
+		BlockEntry block;
+		block.name = mdt.getName();
+		block.is_list = mdt.isList;
+		// readStar assumes 30000 if there is no "# version" line
+		block.version = (mdt.getVersion() >= 30000) ? MetaDataTable::getCurrentVersion() : 30000;
+		block.rows = mdt.isList ? 1 : mdt.numberOfObjects();
+
+		const long rows = block.rows;
+
+		for (int i = 0; i < mdt.activeLabels.size(); i++)
+		{
+			const EMDLabel label = mdt.activeLabels[i];
+
+			// Neither of these is written to the STAR file as a column
+			if (label == EMDL_COMMENT) continue;
+			if (label == EMDL_SORTED_IDX && !mdt.isList) continue;
+
+			ColumnEntry col;
+			col.label = (label == EMDL_UNKNOWN_LABEL) ? mdt.getUnknownLabelNameAt(i) : EMDL::label2Str(label);
+			col.type = sidecarTypeOf(label);
+
+			padTo8(fh);
+			col.offset = fh.tellp();
+
+			if (col.type == SIDECAR_DOUBLE)
+			{
+				// Store exactly what reading the (rounded) STAR file would produce
+				std::vector<double> values(rows);
+				std::string str;
+				for (long r = 0; r < rows; r++)
+				{
+					mdt.getValueToString(label, str, r);
+					values[r] = strtod(str.c_str(), NULL);
+				}
+				fh.write((const char*)&values[0], rows * sizeof(double));
+			}
+			else if (col.type == SIDECAR_INT)
+			{
+				std::vector<int64_t> values(rows);
+				long val;
+				for (long r = 0; r < rows; r++)
+				{
+					mdt.getValue(label, val, r);
+					values[r] = val;
+				}
+				fh.write((const char*)&values[0], rows * sizeof(int64_t));
+			}
+			else if (col.type == SIDECAR_BOOL)
+			{
+				std::vector<uint8_t> values(rows);
+				bool val;
+				for (long r = 0; r < rows; r++)
+				{
+					mdt.getValue(label, val, r);
+					values[r] = val;
+				}
+				fh.write((const char*)&values[0], rows);
+			}
+			else if (col.type == SIDECAR_STRING || col.type == SIDECAR_UNKNOWN)
+			{
+				const long off = (col.type == SIDECAR_UNKNOWN) ? mdt.unknownLabelPosition2Offset[i] : mdt.label2offset[label];
+
+				std::unordered_map<std::string, uint32_t> dict;
+				std::vector<const std::string*> entries;
+				std::vector<uint32_t> index(rows);
+
+				const std::vector<std::string> &column = (col.type == SIDECAR_UNKNOWN) ? mdt.unknownColumns[off] : mdt.stringColumns[off];
+				for (long r = 0; r < rows; r++)
+				{
+					const std::string &val = column[r];
+
+					std::unordered_map<std::string, uint32_t>::iterator it = dict.find(val);
+					if (it == dict.end())
+					{
+						it = dict.insert(std::make_pair(val, (uint32_t)entries.size())).first;
+						entries.push_back(&it->first);
+					}
+					index[r] = it->second;
+				}
+
+				putPod(fh, (uint64_t)entries.size());
+				uint64_t pos = 0;
+				putPod(fh, pos);
+				for (long e = 0; e < entries.size(); e++)
+				{
+					pos += entries[e]->length();
+					putPod(fh, pos);
+				}
+				fh.write((const char*)&index[0], rows * sizeof(uint32_t));
+				padTo8(fh);
+				for (long e = 0; e < entries.size(); e++)
+					fh.write(entries[e]->data(), entries[e]->length());
+			}
+			else if (col.type == SIDECAR_DOUBLE_VECTOR)
+			{
+				// As for doubles, go through the text representation to match the STAR file
+				std::vector<uint64_t> offsets(rows + 1, 0);
+				std::vector<double> values;
+				std::string str;
+				for (long r = 0; r < rows; r++)
+				{
+					mdt.getValueToString(label, str, r);
+					char *rest = &str[0];
+					char *token;
+					while ((token = strtok_r(rest, "[,]", &rest)) != 0)
+						values.push_back(strtod(token, NULL));
+					offsets[r + 1] = values.size();
+				}
+				fh.write((const char*)&offsets[0], (rows + 1) * sizeof(uint64_t));
+				if (values.size() > 0)
+					fh.write((const char*)&values[0], values.size() * sizeof(double));
+			}
+
+			col.size = (uint64_t)fh.tellp() - col.offset;
+			block.columns.push_back(col);
+		}
+
+		blocks.push_back(block);
+	}
+
+	padTo8(fh);
+	const uint64_t dir_offset = fh.tellp();
+
+	putPod(fh, (uint32_t)blocks.size());
+	for (int iblock = 0; iblock < blocks.size(); iblock++)
+	{
+		const BlockEntry &block = blocks[iblock];
+		putString(fh, block.name);
+		putPod(fh, block.is_list);
+		putPod(fh, block.version);
+		putPod(fh, block.rows);
+		putPod(fh, (uint32_t)block.columns.size());
+		for (int icol = 0; icol < block.columns.size(); icol++)
+		{
+			const ColumnEntry &col = block.columns[icol];
+			putString(fh, col.label);
+			putPod(fh, col.type);
+			putPod(fh, col.offset);
+			putPod(fh, col.size);
+		}
+	}
+
+	fh.seekp(SIDECAR_HEADER_SIZE - 8);
+	putPod(fh, dir_offset);
+
+	if (!fh)
+		REPORT_ERROR("MetaDataSidecar::write: error while writing to file: " + fn_side);
+	fh.close();
+
+	std::rename(fn_tmp.c_str(), fn_side.c_str());
+}
+
+long int MetaDataSidecar::read(const FileName &fn_star, MetaDataTable &mdt, const std::string &name,
+                               bool do_only_count, const std::vector<EMDLabel> *desired_labels)
+{
+	const FileName fn_side = getName(fn_star);
+	if (!exists(fn_side)) return -1;
+
+	Mapping map;
+	if (!map.open(fn_side)) return -1;
+
+	std::vector<BlockEntry> blocks;
+	if (!readDirectory(map, fn_star, blocks)) return -1;
+
+	for (int iblock = 0; iblock < blocks.size(); iblock++)
+	{
+		if (name == "" || name == blocks[iblock].name)
+		{
+			const long int ret = decodeBlock(map, blocks[iblock], mdt, do_only_count, desired_labels);
+			if (ret >= 0)
+				mdt.version = blocks[iblock].version;
+			return ret;
+		}
+	}
+
+	// No such data block: the same as readStar
+	mdt.clear();
+	return 0;
+}
+
+bool MetaDataSidecar::readAll(const FileName &fn_star, std::vector<MetaDataTable> &out, bool do_only_count)
+{
+	const FileName fn_side = getName(fn_star);
+	if (!exists(fn_side)) return false;
+
+	Mapping map;
+	if (!map.open(fn_side)) return false;
+
+	std::vector<BlockEntry> blocks;
+	if (!readDirectory(map, fn_star, blocks)) return false;
+
+	std::vector<MetaDataTable> tables(blocks.size());
+	for (int iblock = 0; iblock < blocks.size(); iblock++)
+	{
+		if (decodeBlock(map, blocks[iblock], tables[iblock], do_only_count, NULL) < 0)
+			return false;
+	}
+
+	out.swap(tables);
+	return true;
+}
+
+long int MetaDataSidecar::decodeBlock(const Mapping &map, const BlockEntry &block, MetaDataTable &mdt,
+                                      bool do_only_count, const std::vector<EMDLabel> *desired_labels)
+{
+	// Resolve and validate all columns first, so that mdt is never left half-filled
+	std::vector<EMDLabel> labels(block.columns.size());
+	std::vector<bool> wanted(block.columns.size());
+
+	for (int icol = 0; icol < block.columns.size(); icol++)
+	{
+		const ColumnEntry &col = block.columns[icol];
+
+		EMDLabel label = EMDL::str2Label(col.label);
+		if (label == EMDL_UNDEFINED)
+			label = EMDL_UNKNOWN_LABEL;
+
+		// A label may have changed its type between RELION versions
+		if (sidecarTypeOf(label) != col.type)
+			return -1;
+
+		labels[icol] = label;
+		wanted[icol] = (desired_labels == NULL ||
+		                std::find(desired_labels->begin(), desired_labels->end(), label) != desired_labels->end());
+
+		if (wanted[icol] && !validateColumn(map, col, block.rows))
+			return -1;
+	}
+
+	mdt.clear();
+	mdt.setName(block.name);
+	mdt.setIsList(block.is_list);
+
+	for (int icol = 0; icol < block.columns.size(); icol++)
+	{
+		if (!wanted[icol]) continue;
+
+		if (labels[icol] == EMDL_UNKNOWN_LABEL)
+			std::cerr << " + WARNING: will ignore (but maintain) values for the unknown label: " << block.columns[icol].label << std::endl;
+
+		mdt.addLabel(labels[icol], block.columns[icol].label);
+	}
+
+	// Just like readStarLoop, only count the rows if that is all that is needed
+	if (do_only_count && !block.is_list)
+		return block.rows;
+
+	const long rows = block.rows;
+	mdt.resizeColumns(0, rows);
+	mdt.nrRows = rows;
+
+	for (int icol = 0, ipos = 0; icol < block.columns.size(); icol++)
+	{
+		if (!wanted[icol]) continue;
+
+		const ColumnEntry &col = block.columns[icol];
+		const char *base = map.data + col.offset;
+		const EMDLabel label = labels[icol];
+		const long off = (label == EMDL_UNKNOWN_LABEL) ? mdt.unknownLabelPosition2Offset[ipos] : mdt.label2offset[label];
+		ipos++;
+
+		if (col.type == SIDECAR_DOUBLE)
+		{
+			const double *values = (const double*)base;
+			mdt.doubleColumns[off].assign(values, values + rows);
+		}
+		else if (col.type == SIDECAR_INT)
+		{
+			const int64_t *values = (const int64_t*)base;
+			mdt.intColumns[off].assign(values, values + rows);
+		}
+		else if (col.type == SIDECAR_BOOL)
+		{
+			const uint8_t *values = (const uint8_t*)base;
+			for (long r = 0; r < rows; r++)
+				mdt.boolColumns[off][r] = (values[r] != 0);
+		}
+		else if (col.type == SIDECAR_STRING || col.type == SIDECAR_UNKNOWN)
+		{
+			uint64_t nr_dict;
+			memcpy(&nr_dict, base, 8);
+			const uint64_t *dict_offsets = (const uint64_t*)(base + 8);
+			const uint64_t index_start = 8 + 8 * (nr_dict + 1);
+			const uint32_t *index = (const uint32_t*)(base + index_start);
+			const char *chars = base + index_start + ((rows * 4 + 7) / 8) * 8;
+
+			std::vector<std::string> &column = (col.type == SIDECAR_UNKNOWN) ? mdt.unknownColumns[off] : mdt.stringColumns[off];
+			for (long r = 0; r < rows; r++)
+			{
+				const uint32_t e = index[r];
+				column[r].assign(chars + dict_offsets[e], dict_offsets[e + 1] - dict_offsets[e]);
+			}
+		}
+		else if (col.type == SIDECAR_DOUBLE_VECTOR)
+		{
+			const uint64_t *offsets = (const uint64_t*)base;
+			const double *values = (const double*)(base + 8 * (rows + 1));
+			for (long r = 0; r < rows; r++)
+				mdt.doubleVectorColumns[off][r].assign(values + offsets[r], values + offsets[r + 1]);
+		}
+	}
+
+	mdt.firstObject();
+
+	return block.is_list ? 1 : rows;
+}
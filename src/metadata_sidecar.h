@@ -0,0 +1,96 @@
+/***************************************************************************
+ *
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef METADATA_SIDECAR_H
+#define METADATA_SIDECAR_H
+
+#include <vector>
+#include <stdint.h>
+#include <string>
+#include "src/filename.h"
+#include "src/metadata_label.h"
+
+class MetaDataTable;
+
+/*	class MetaDataSidecar:
+ *
+ *	Binary columnar companion of a STAR file. For "run_it025_data.star",
+ *	the sidecar is called "run_it025_data.starb" and holds exactly the values that
+ *	parsing the STAR file would produce, but stored per column:
+ *
+ *	  - doubles, ints and bools as contiguous typed arrays,
+ *	  - strings (and unknown labels) as a dictionary plus one 32-bit index per row,
+ *	  - double vectors as a row offset array plus one array of values.
+ *
+ *	The sidecar records the size, the modification time (in ns) and a hash of the
+ *	first and last 64 kB of the STAR file it was written for. MetaDataTable::read
+ *	and MetaDataTable::readAll use it instead of the STAR file only if all of these
+ *	still match, so editing or overwriting the STAR file by any other means silently
+ *	falls back to normal STAR parsing.
+ *
+ *	The file is memory-mapped for reading and only the columns that a program
+ *	asks for are decoded; the pages of all other columns are never touched.
+ *
+ *	Writing sidecars is opt-in: set the environment variable
+ *	RELION_STAR_SIDECAR to a non-zero value.
+ */
+class MetaDataSidecar
+{
+public:
+
+	// Name of the sidecar belonging to fn_star
+	static FileName getName(const FileName &fn_star);
+
+	// Is writing of sidecars enabled through RELION_STAR_SIDECAR?
+	static bool isEnabled();
+
+	// Does fn_star have a sidecar that matches its current size, modification time and contents hash?
+	static bool isUpToDate(const FileName &fn_star);
+
+	// Write the sidecar for fn_star, which must already have been written from these tables.
+	// Does nothing unless isEnabled(). Any stale sidecar is removed in that case.
+	static void write(const FileName &fn_star, const std::vector<const MetaDataTable*> &tables);
+	static void write(const FileName &fn_star, const MetaDataTable &table);
+
+	// Remove the sidecar of fn_star if there is one
+	static void remove(const FileName &fn_star);
+
+	/* Read a single data block (the first one if name is empty) into mdt.
+	 * If desired_labels is not NULL, only those columns are decoded.
+	 * Returns the same value as MetaDataTable::readStar would, or -1 if
+	 * the sidecar could not be used. */
+	static long int read(const FileName &fn_star, MetaDataTable &mdt, const std::string &name = "",
+	                     bool do_only_count = false, const std::vector<EMDLabel> *desired_labels = NULL);
+
+	// Read all data blocks. Returns false if the sidecar could not be used.
+	static bool readAll(const FileName &fn_star, std::vector<MetaDataTable> &out, bool do_only_count = false);
+
+private:
+
+	class Mapping;
+	struct ColumnEntry;
+	struct BlockEntry;
+
+	static bool readDirectory(const Mapping &map, const FileName &fn_star, std::vector<BlockEntry> &blocks);
+	static bool validateColumn(const Mapping &map, const ColumnEntry &col, uint64_t rows);
+	static long int decodeBlock(const Mapping &map, const BlockEntry &block, MetaDataTable &mdt,
+	                            bool do_only_count, const std::vector<EMDLabel> *desired_labels);
+};
+
+#endif
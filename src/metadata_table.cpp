@@ -42,50 +42,45 @@
  *	e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 
+#include <exception>
+#include <omp.h>
 #include "src/metadata_table.h"
+#include "src/spatial_hash.h"
 #include "src/metadata_label.h"
+#include "src/metadata_sidecar.h"
 
 MetaDataTable::MetaDataTable()
-:	objects(0),
+:	nrRows(0),
+	reservedRows(0),
 	label2offset(EMDL_LAST_LABEL, -1),
+	activeLabels(0),
 	current_objectID(0),
-	doubleLabels(0),
-	intLabels(0),
-	boolLabels(0),
-	stringLabels(0),
-	doubleVectorLabels(0),
-	unknownLabels(0),
 	isList(false),
 	name(""),
 	comment(""),
-	version(CURRENT_MDT_VERSION),
-	activeLabels(0)
+	version(CURRENT_MDT_VERSION)
 {
 }
 
 MetaDataTable::MetaDataTable(const MetaDataTable &MD)
-:	objects(MD.objects.size()),
+:	doubleColumns(MD.doubleColumns),
+	intColumns(MD.intColumns),
+	boolColumns(MD.boolColumns),
+	stringColumns(MD.stringColumns),
+	doubleVectorColumns(MD.doubleVectorColumns),
+	unknownColumns(MD.unknownColumns),
+	nrRows(MD.nrRows),
+	reservedRows(0),
 	label2offset(MD.label2offset),
-	unknownLabelPosition2Offset(MD.unknownLabelPosition2Offset),
+	activeLabels(MD.activeLabels),
 	unknownLabelNames(MD.unknownLabelNames),
+	unknownLabelPosition2Offset(MD.unknownLabelPosition2Offset),
 	current_objectID(0),
-	doubleLabels(MD.doubleLabels),
-	intLabels(MD.intLabels),
-	boolLabels(MD.boolLabels),
-	stringLabels(MD.stringLabels),
-	doubleVectorLabels(MD.doubleVectorLabels),
-	unknownLabels(MD.unknownLabels),
 	isList(MD.isList),
 	name(MD.name),
 	comment(MD.comment),
-	version(MD.version),
-	activeLabels(MD.activeLabels)
+	version(MD.version)
 {
-	for (size_t idx = 0; idx < MD.objects.size(); idx++)
-	{
-		objects[idx] = new MetaDataContainer(*(MD.objects[idx]));
-		objects[idx]->table = this;
-	}
 }
 
 MetaDataTable& MetaDataTable::operator = (const MetaDataTable &MD)
@@ -94,17 +89,18 @@ MetaDataTable& MetaDataTable::operator = (const MetaDataTable &MD)
 	{
 		clear();
 
-		objects.resize(MD.objects.size());
+		doubleColumns = MD.doubleColumns;
+		intColumns = MD.intColumns;
+		boolColumns = MD.boolColumns;
+		stringColumns = MD.stringColumns;
+		doubleVectorColumns = MD.doubleVectorColumns;
+		unknownColumns = MD.unknownColumns;
+		nrRows = MD.nrRows;
+
 		label2offset = MD.label2offset;
 		unknownLabelPosition2Offset = MD.unknownLabelPosition2Offset;
 		unknownLabelNames = MD.unknownLabelNames;
 		current_objectID = 0;
-		doubleLabels = MD.doubleLabels;
-		intLabels = MD.intLabels;
-		boolLabels = MD.boolLabels;
-		stringLabels = MD.stringLabels;
-		doubleVectorLabels = MD.doubleVectorLabels;
-		unknownLabels = MD.unknownLabels;
 
 		isList = MD.isList;
 		name = MD.name;
@@ -112,12 +108,6 @@ MetaDataTable& MetaDataTable::operator = (const MetaDataTable &MD)
 		version = MD.version;
 
 		activeLabels = MD.activeLabels;
-
-		for (long int idx = 0; idx < MD.objects.size(); idx++)
-		{
-			objects[idx] = new MetaDataContainer(this, MD.objects[idx]);
-			objects[idx]->table = this;
-		}
 	}
 
 	return *this;
@@ -130,41 +120,35 @@ void MetaDataTable::setIsList(bool is_list)
 
 MetaDataTable::~MetaDataTable()
 {
-	for (long i = 0; i < objects.size(); i++)
-	{
-		delete objects[i];
-	}
 }
 
 bool MetaDataTable::isEmpty() const
 {
-	return (objects.size()==0);
+	return (nrRows == 0);
 }
 
 size_t MetaDataTable::numberOfObjects() const
 {
-	return objects.size();
+	return nrRows;
 }
 
 void MetaDataTable::clear()
 {
-	for (long i = 0; i < objects.size(); i++)
-	{
-		delete objects[i];
-	}
-	objects.clear();
+	doubleColumns.clear();
+	intColumns.clear();
+	boolColumns.clear();
+	stringColumns.clear();
+	doubleVectorColumns.clear();
+	unknownColumns.clear();
+	nrRows = 0;
+	reservedRows = 0;
+	rowHandles.clear();
 
 	label2offset = std::vector<long>(EMDL_LAST_LABEL, -1);
 	current_objectID = 0;
 	unknownLabelPosition2Offset.clear();
 	unknownLabelNames.clear();
 
-	doubleLabels = 0;
-	intLabels = 0;
-	boolLabels = 0;
-	stringLabels = 0;
-	unknownLabels = 0;
-
 	isList = false;
 	name = "";
 	comment = "";
@@ -221,6 +205,117 @@ std::string MetaDataTable::getUnknownLabelNameAt(int i) const
 	return unknownLabelNames[unknownLabelPosition2Offset[i]];
 }
 
+// Number of threads for reading or writing STAR files: from the given environment
+// variable if it is set, otherwise the OpenMP maximum
+static int starThreadsFromEnvironment(const char *env_name)
+{
+	char *env_threads = getenv(env_name);
+	if (env_threads != NULL && atoi(env_threads) > 0)
+		return atoi(env_threads);
+
+	return omp_get_max_threads();
+}
+
+// Copy 'n' characters right-aligned into a 12-character field, like snprintf(buffer, 13, "%12...")
+// does; longer output is truncated to 12 characters.
+static void alignForSTAR(const char *reversed, int n, char *buffer)
+{
+	int pos = 0;
+	for (int i = n; i < 12; i++)
+		buffer[pos++] = ' ';
+	for (int i = n - 1; i >= 0 && pos < 12; i--)
+		buffer[pos++] = reversed[i];
+	buffer[pos] = '\0';
+}
+
+// Fast path for snprintf(buffer, 13, "%12.6f") (or "%12.5f" for negative values) with
+// 0.001 <= |v| <= 100000. Returns false if v is too close to a rounding tie to decide
+// without exact decimal arithmetic; the caller should then use snprintf.
+static bool fixedPointForSTAR(double v, char *buffer)
+{
+	const bool negative = (v < 0.);
+	const int decimals = negative ? 5 : 6;
+	const double scaled = negative ? -v * 1e5 : v * 1e6;
+
+	// scaled <= 1e11, so it is off by at most 1e-5 from the exact product
+	const double whole = floor(scaled);
+	const double fraction = scaled - whole;
+	if (fabs(fraction - 0.5) < 1e-4)
+		return false;
+
+	unsigned long long r = (unsigned long long)whole + ((fraction > 0.5) ? 1 : 0);
+
+	char reversed[32];
+	int n = 0;
+	for (int i = 0; i < decimals; i++)
+	{
+		reversed[n++] = '0' + r % 10;
+		r /= 10;
+	}
+	reversed[n++] = '.';
+	do
+	{
+		reversed[n++] = '0' + r % 10;
+		r /= 10;
+	}
+	while (r > 0);
+	if (negative)
+		reversed[n++] = '-';
+
+	alignForSTAR(reversed, n, buffer);
+	return true;
+}
+
+// Format a double exactly as it is written in STAR files (at most 12 characters)
+static void doubleToSTAR(double v, char *buffer)
+{
+	if ((ABS(v) > 0. && ABS(v) < 0.001) || ABS(v) > 100000.)
+	{
+		if (v < 0.)
+		{
+			snprintf(buffer,13, "%12.5e", v);
+		}
+		else
+		{
+			snprintf(buffer,13, "%12.6e", v);
+		}
+	}
+	else if (v == 0. && !std::signbit(v))
+	{
+		strcpy(buffer, "    0.000000");
+	}
+	else if (!(std::isfinite(v) && v != 0. && fixedPointForSTAR(v, buffer)))
+	{
+		if (v < 0.)
+		{
+			snprintf(buffer,13, "%12.5f", v);
+		}
+		else
+		{
+			snprintf(buffer,13, "%12.6f", v);
+		}
+	}
+}
+
+// Format an integer exactly as snprintf(buffer, 13, "%12ld", v)
+static void intToSTAR(long v, char *buffer)
+{
+	char reversed[32];
+	int n = 0;
+	// Work with negative numbers, so that LONG_MIN needs no special case
+	long r = (v < 0) ? v : -v;
+	do
+	{
+		reversed[n++] = '0' - (char)(r % 10);
+		r /= 10;
+	}
+	while (r != 0);
+	if (v < 0)
+		reversed[n++] = '-';
+
+	alignForSTAR(reversed, n, buffer);
+}
+
 bool MetaDataTable::getValueToString(EMDLabel label, std::string &value, long objectID, bool escape) const
 {
 	// SHWS 18jul2018: this function previously had a stringstream, but it greatly slowed down
@@ -250,34 +345,13 @@ bool MetaDataTable::getValueToString(EMDLabel label, std::string &value, long ob
 			double v;
 			if(!getValue(label, v, objectID)) return false;
 
-			if ((ABS(v) > 0. && ABS(v) < 0.001) || ABS(v) > 100000.)
-			{
-				if (v < 0.)
-				{
-					snprintf(buffer,13, "%12.5e", v);
-				}
-				else
-				{
-					snprintf(buffer,13, "%12.6e", v);
-				}
-			}
-			else
-			{
-				if (v < 0.)
-				{
-					snprintf(buffer,13, "%12.5f", v);
-				}
-				else
-				{
-					snprintf(buffer,13, "%12.6f", v);
-				}
-			}
+			doubleToSTAR(v, buffer);
 		}
 		else if (EMDL::isInt(label))
 		{
 			long v;
 			if (!getValue(label, v, objectID)) return false;
-			snprintf(buffer,13, "%12ld", v);
+			intToSTAR(v, buffer);
 		}
 		else if (EMDL::isBool(label))
 		{
@@ -377,7 +451,7 @@ bool MetaDataTable::setUnknownValue(int labelPosition, const std::string &value)
 
 	if (offset > -1)
 	{
-		objects[current_objectID]->unknowns[offset] = value;
+		unknownColumns[offset][current_objectID] = value;
 		return true;
 	}
 	else
@@ -386,6 +460,30 @@ bool MetaDataTable::setUnknownValue(int labelPosition, const std::string &value)
 	}
 }
 
+// Parse "[1.0,2.0,3.0]" as written by getValueToString for double vectors
+static void doubleVectorFromString(const std::string &value, std::vector<double> &v)
+{
+	v.clear();
+	v.reserve(32);
+
+	char* temp = new char[value.size()+1];
+	strcpy(temp, value.c_str());
+
+	char* token;
+	char* rest = temp;
+
+	while ((token = strtok_r(rest, "[,]", &rest)) != 0)
+	{
+		double d;
+		std::stringstream sts(token);
+		sts >> d;
+
+		v.push_back(d);
+	}
+
+	delete[] temp;
+}
+
 bool MetaDataTable::setValueFromString(
 		EMDLabel label, const std::string &value, long int objectID)
 {
@@ -418,24 +516,7 @@ bool MetaDataTable::setValueFromString(
 		else if (EMDL::isDoubleVector(label))
 		{
 			std::vector<double> v;
-			v.reserve(32);
-
-			char* temp = new char[value.size()+1];
-			strcpy(temp, value.c_str());
-
-			char* token;
-			char* rest = temp;
-
-			while ((token = strtok_r(rest, "[,]", &rest)) != 0)
-			{
-				double d;
-				std::stringstream sts(token);
-				sts >> d;
-
-				v.push_back(d);
-			}
-
-			delete[] temp;
+			doubleVectorFromString(value, v);
 
 			return setValue(label, v, objectID);
 		}
@@ -445,82 +526,44 @@ bool MetaDataTable::setValueFromString(
 	return false;
 }
 
-// comparators used for sorting
-
-struct MdDoubleComparator
-{
-	MdDoubleComparator(long index) : index(index) {}
-
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
-	{
-		return lh->doubles[index] < rh->doubles[index];
-	}
-
-	long index;
-};
-
-struct MdIntComparator
-{
-	MdIntComparator(long index) : index(index) {}
-
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
-	{
-		return lh->ints[index] < rh->ints[index];
-	}
-
-	long index;
-};
+// comparators used for sorting: they compare row indices by the values in one column
 
-struct MdStringComparator
+template <typename T>
+struct MdColumnComparator
 {
-	MdStringComparator(long index) : index(index) {}
+	MdColumnComparator(const std::vector<T> &column) : column(column) {}
 
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
+	bool operator()(long lh, long rh) const
 	{
-		return lh->strings[index] < rh->strings[index];
+		return column[lh] < column[rh];
 	}
 
-	long index;
+	const std::vector<T> &column;
 };
 
 struct MdStringAfterAtComparator
 {
-	MdStringAfterAtComparator(long index) : index(index) {}
+	MdStringAfterAtComparator(const std::vector<std::string> &column) : column(column) {}
 
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
+	bool operator()(long lh, long rh) const
 	{
-		std::string slh = lh->strings[index];
-		std::string srh = rh->strings[index];
-		slh = slh.substr(slh.find("@")+1);
-		srh = srh.substr(srh.find("@")+1);
-		return slh < srh;
+		const std::string &slh = column[lh];
+		const std::string &srh = column[rh];
+		return slh.compare(slh.find("@")+1, std::string::npos, srh, srh.find("@")+1, std::string::npos) < 0;
 	}
 
-	long index;
+	const std::vector<std::string> &column;
 };
 
-struct MdStringBeforeAtComparator
+// The number before the @ of a string, as used by MdStringBeforeAtComparator
+static long beforeAtNumber(const std::string &str)
 {
-	MdStringBeforeAtComparator(long index) : index(index) {}
-
-	bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const
-	{
-		std::string slh = lh->strings[index];
-		std::string srh = rh->strings[index];
-		slh = slh.substr(0, slh.find("@"));
-		srh = srh.substr(0, srh.find("@"));
-		std::stringstream stslh, stsrh;
-		stslh << slh;
-		stsrh << srh;
-		long ilh, irh;
-		stslh >> ilh;
-		stsrh >> irh;
-
-		return ilh < irh;
-	}
-
-	long index;
-};
+	std::stringstream ststr;
+	ststr << str.substr(0, str.find("@"));
+	long result;
+	ststr >> result;
+	return result;
+}
 
 void MetaDataTable::sort(EMDLabel name, bool do_reverse, bool only_set_index, bool do_random)
 {
@@ -534,7 +577,7 @@ void MetaDataTable::sort(EMDLabel name, bool do_reverse, bool only_set_index, bo
 	}
 
 	std::vector<std::pair<double,long int> > vp;
-	vp.reserve(objects.size());
+	vp.reserve(nrRows);
 	long int i = 0;
 
 	FOR_ALL_OBJECTS_IN_METADATA_TABLE(*this)
@@ -574,14 +617,14 @@ void MetaDataTable::sort(EMDLabel name, bool do_reverse, bool only_set_index, bo
 	else
 	{
 		// Change the actual order in the MetaDataTable
-		std::vector<MetaDataContainer*> objs(objects.size());
+		std::vector<long> order(vp.size());
 
 		for (long j = 0; j < vp.size(); j++)
 		{
-			objs[j] = objects[vp[j].second];
+			order[j] = vp[j].second;
 		}
 
-		objects = objs;
+		permuteRows(order);
 	}
 	// reset pointer to the beginning of the table
 	firstObject();
@@ -589,30 +632,41 @@ void MetaDataTable::sort(EMDLabel name, bool do_reverse, bool only_set_index, bo
 
 void MetaDataTable::newSort(const EMDLabel label, bool do_reverse, bool do_sort_after_at, bool do_sort_before_at)
 {
+	std::vector<long> order(nrRows);
+	for (long i = 0; i < nrRows; i++)
+		order[i] = i;
+
+	const long off = label2offset[label];
+	if (off < 0 && (EMDL::isString(label) || EMDL::isDouble(label) || EMDL::isInt(label)))
+		REPORT_ERROR("Cannot sort on a label that is not in the table: " + EMDL::label2Str(label));
+
 	if (EMDL::isString(label))
 	{
 		if (do_sort_after_at)
 		{
-			std::stable_sort(objects.begin(), objects.end(),
-							 MdStringAfterAtComparator(label2offset[label]));
+			std::stable_sort(order.begin(), order.end(),
+			                 MdStringAfterAtComparator(stringColumns[off]));
 		}
 		else if (do_sort_before_at)
 		{
-			std::stable_sort(objects.begin(), objects.end(),
-							 MdStringBeforeAtComparator(label2offset[label]));
+			// Parse the numbers once per row instead of once per comparison
+			std::vector<long> keys(nrRows);
+			for (long i = 0; i < nrRows; i++)
+				keys[i] = beforeAtNumber(stringColumns[off][i]);
+			std::stable_sort(order.begin(), order.end(), MdColumnComparator<long>(keys));
 		}
 		else
 		{
-			std::stable_sort(objects.begin(), objects.end(), MdStringComparator(label2offset[label]));
+			std::stable_sort(order.begin(), order.end(), MdColumnComparator<std::string>(stringColumns[off]));
 		}
 	}
 	else if (EMDL::isDouble(label))
 	{
-		std::stable_sort(objects.begin(), objects.end(), MdDoubleComparator(label2offset[label]));
+		std::stable_sort(order.begin(), order.end(), MdColumnComparator<double>(doubleColumns[off]));
 	}
 	else if (EMDL::isInt(label))
 	{
-		std::stable_sort(objects.begin(), objects.end(), MdIntComparator(label2offset[label]));
+		std::stable_sort(order.begin(), order.end(), MdColumnComparator<long>(intColumns[off]));
 	}
 	else
 	{
@@ -621,7 +675,56 @@ void MetaDataTable::newSort(const EMDLabel label, bool do_reverse, bool do_sort_
 
 	if (do_reverse)
 	{
-		std::reverse(objects.begin(), objects.end());
+		std::reverse(order.begin(), order.end());
+	}
+
+	permuteRows(order);
+}
+
+void MetaDataTable::permuteRows(const std::vector<long> &order)
+{
+	for (long c = 0; c < doubleColumns.size(); c++)
+	{
+		std::vector<double> tmp(nrRows);
+		for (long i = 0; i < nrRows; i++)
+			tmp[i] = doubleColumns[c][order[i]];
+		doubleColumns[c].swap(tmp);
+	}
+	for (long c = 0; c < intColumns.size(); c++)
+	{
+		std::vector<long> tmp(nrRows);
+		for (long i = 0; i < nrRows; i++)
+			tmp[i] = intColumns[c][order[i]];
+		intColumns[c].swap(tmp);
+	}
+	for (long c = 0; c < boolColumns.size(); c++)
+	{
+		std::vector<unsigned char> tmp(nrRows);
+		for (long i = 0; i < nrRows; i++)
+			tmp[i] = boolColumns[c][order[i]];
+		boolColumns[c].swap(tmp);
+	}
+	// Strings and vectors are swapped rather than copied
+	for (long c = 0; c < stringColumns.size(); c++)
+	{
+		std::vector<std::string> tmp(nrRows);
+		for (long i = 0; i < nrRows; i++)
+			tmp[i].swap(stringColumns[c][order[i]]);
+		stringColumns[c].swap(tmp);
+	}
+	for (long c = 0; c < doubleVectorColumns.size(); c++)
+	{
+		std::vector<std::vector<double> > tmp(nrRows);
+		for (long i = 0; i < nrRows; i++)
+			tmp[i].swap(doubleVectorColumns[c][order[i]]);
+		doubleVectorColumns[c].swap(tmp);
+	}
+	for (long c = 0; c < unknownColumns.size(); c++)
+	{
+		std::vector<std::string> tmp(nrRows);
+		for (long i = 0; i < nrRows; i++)
+			tmp[i].swap(unknownColumns[c][order[i]]);
+		unknownColumns[c].swap(tmp);
 	}
 }
 
@@ -677,70 +780,40 @@ void MetaDataTable::addLabel(EMDLabel label, std::string unknownLabel)
 
 		if (EMDL::isDouble(label))
 		{
-			id = doubleLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->doubles.push_back(0);
-			}
-
-			doubleLabels++;
+			id = doubleColumns.size();
+			doubleColumns.push_back(std::vector<double>());
+			doubleColumns.back().reserve(reservedRows);
+			doubleColumns.back().resize(nrRows, 0.);
 		}
 		else if (EMDL::isInt(label))
 		{
-			id = intLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->ints.push_back(0);
-			}
-
-			intLabels++;
+			id = intColumns.size();
+			intColumns.push_back(std::vector<long>());
+			intColumns.back().reserve(reservedRows);
+			intColumns.back().resize(nrRows, 0);
 		}
 		else if (EMDL::isBool(label))
 		{
-			id = boolLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->bools.push_back(false);
-			}
-
-			boolLabels++;
+			id = boolColumns.size();
+			boolColumns.push_back(std::vector<unsigned char>(nrRows, 0));
 		}
 		else if (EMDL::isString(label))
 		{
-			id = stringLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->strings.push_back("empty");
-			}
-
-			stringLabels++;
+			id = stringColumns.size();
+			stringColumns.push_back(std::vector<std::string>());
+			stringColumns.back().reserve(reservedRows);
+			stringColumns.back().resize(nrRows, "empty");
 		}
 		else if (EMDL::isDoubleVector(label))
 		{
-			id = doubleVectorLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->doubleVectors.push_back(std::vector<double>());
-			}
-
-			doubleVectorLabels++;
+			id = doubleVectorColumns.size();
+			doubleVectorColumns.push_back(std::vector<std::vector<double> >(nrRows));
 		}
 		else if (EMDL::isUnknown(label))
 		{
-			id = unknownLabels;
-
-			for (long i = 0; i < objects.size(); i++)
-			{
-				objects[i]->unknowns.push_back("empty");
-			}
-
+			id = unknownColumns.size();
+			unknownColumns.push_back(std::vector<std::string>(nrRows, "empty"));
 			unknownLabelNames.push_back(unknownLabel);
-			unknownLabels++;
 		}
 
 		activeLabels.push_back(label);
@@ -783,16 +856,48 @@ void MetaDataTable::append(const MetaDataTable& mdt)
 			REPORT_ERROR("ERROR in appending metadata tables with not the same columns!");
 	}
 
-	// Now append
-	objects.reserve(objects.size() + mdt.numberOfObjects());
-	for (long i = 0; i < mdt.objects.size(); i++)
+	// Now append, one column at a time
+	const long nr_old = nrRows;
+	nrRows += mdt.nrRows;
+	for (long i = 0; i < activeLabels.size(); i++)
 	{
-		objects.push_back(new MetaDataContainer(
-			this, doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels));
+		EMDLabel label = activeLabels[i];
 
-		setObjectUnsafe(mdt.getObject(i), objects.size() - 1);
+		if (label != EMDL_UNKNOWN_LABEL)
+		{
+			long myOff = label2offset[label];
+			long srcOff = mdt.label2offset[label];
+
+			if (EMDL::isDouble(label))
+				doubleColumns[myOff].insert(doubleColumns[myOff].end(),
+					mdt.doubleColumns[srcOff].begin(), mdt.doubleColumns[srcOff].end());
+			else if (EMDL::isInt(label))
+				intColumns[myOff].insert(intColumns[myOff].end(),
+					mdt.intColumns[srcOff].begin(), mdt.intColumns[srcOff].end());
+			else if (EMDL::isBool(label))
+				boolColumns[myOff].insert(boolColumns[myOff].end(),
+					mdt.boolColumns[srcOff].begin(), mdt.boolColumns[srcOff].end());
+			else if (EMDL::isString(label))
+				stringColumns[myOff].insert(stringColumns[myOff].end(),
+					mdt.stringColumns[srcOff].begin(), mdt.stringColumns[srcOff].end());
+			else if (EMDL::isDoubleVector(label))
+				doubleVectorColumns[myOff].insert(doubleVectorColumns[myOff].end(),
+					mdt.doubleVectorColumns[srcOff].begin(), mdt.doubleVectorColumns[srcOff].end());
+		}
+		else
+		{
+			long myOff = unknownLabelPosition2Offset[i];
+			long srcOff = mdt.getUnknownLabelOffset(unknownLabelNames[myOff]);
+			if (srcOff < 0)
+				REPORT_ERROR("MetaDataTable::append: logic error. cannot find srcOff.");
+			unknownColumns[myOff].insert(unknownColumns[myOff].end(),
+				mdt.unknownColumns[srcOff].begin(), mdt.unknownColumns[srcOff].end());
+		}
 	}
 
+	// Columns that are not active (deactivated labels) still need one value per row
+	resizeColumns(nr_old, nrRows);
+
 	// reset pointer to the beginning of the table
 	firstObject();
 }
@@ -804,7 +909,17 @@ MetaDataContainer* MetaDataTable::getObject(long objectID) const
 
 	checkObjectID(objectID,  "MetaDataTable::getObject");
 
-	return objects[objectID];
+	// Handles are created on demand; existing ones never move
+	MetaDataContainer *handle;
+	#pragma omp critical(MetaDataTable_rowHandles)
+	{
+		while (rowHandles.size() <= objectID)
+			rowHandles.push_back(MetaDataContainer(const_cast<MetaDataTable*>(this), rowHandles.size()));
+
+		handle = &rowHandles[objectID];
+	}
+
+	return handle;
 }
 
 void MetaDataTable::setObject(MetaDataContainer* data, long objectID)
@@ -828,92 +943,118 @@ void MetaDataTable::setValuesOfDefinedLabels(MetaDataContainer* data, long objec
 
 void MetaDataTable::reserve(size_t capacity)
 {
-	objects.reserve(capacity);
+	reservedRows = capacity;
+
+	for (long c = 0; c < doubleColumns.size(); c++)
+		doubleColumns[c].reserve(capacity);
+	for (long c = 0; c < intColumns.size(); c++)
+		intColumns[c].reserve(capacity);
+	for (long c = 0; c < stringColumns.size(); c++)
+		stringColumns[c].reserve(capacity);
+	for (long c = 0; c < unknownColumns.size(); c++)
+		unknownColumns[c].reserve(capacity);
+}
+
+void MetaDataTable::resizeColumns(long nr_old, long nr_new)
+{
+	for (long c = 0; c < doubleColumns.size(); c++)
+		if (doubleColumns[c].size() == nr_old) doubleColumns[c].resize(nr_new, 0.);
+	for (long c = 0; c < intColumns.size(); c++)
+		if (intColumns[c].size() == nr_old) intColumns[c].resize(nr_new, 0);
+	for (long c = 0; c < boolColumns.size(); c++)
+		if (boolColumns[c].size() == nr_old) boolColumns[c].resize(nr_new, false);
+	for (long c = 0; c < stringColumns.size(); c++)
+		if (stringColumns[c].size() == nr_old) stringColumns[c].resize(nr_new, "");
+	for (long c = 0; c < doubleVectorColumns.size(); c++)
+		if (doubleVectorColumns[c].size() == nr_old) doubleVectorColumns[c].resize(nr_new);
+	for (long c = 0; c < unknownColumns.size(); c++)
+		if (unknownColumns[c].size() == nr_old) unknownColumns[c].resize(nr_new, "");
+}
+
+long MetaDataTable::getUnknownLabelOffset(const std::string &unknownLabel) const
+{
+	for (int j = 0; j < unknownLabelNames.size(); j++)
+	{
+		if (unknownLabelNames[j] == unknownLabel)
+			return j;
+	}
+	return -1;
 }
 
 void MetaDataTable::setObjectUnsafe(MetaDataContainer* data, long objectID)
 {
-	MetaDataContainer* obj = objects[objectID];
+	const MetaDataTable &src = *(data->table);
+	const long srcRow = data->row;
 
-	for (long i = 0; i < data->table->activeLabels.size(); i++)
+	for (long i = 0; i < src.activeLabels.size(); i++)
 	{
-		EMDLabel label = data->table->activeLabels[i];
+		EMDLabel label = src.activeLabels[i];
 
 		if (label != EMDL_UNKNOWN_LABEL)
 		{
 			long myOff = label2offset[label];
-			long srcOff = data->table->label2offset[label];
+			long srcOff = src.label2offset[label];
 
 			if (myOff < 0) continue;
 
 			if (EMDL::isDouble(label))
 			{
-				obj->doubles[myOff] = data->doubles[srcOff];
+				doubleColumns[myOff][objectID] = src.doubleColumns[srcOff][srcRow];
 			}
 			else if (EMDL::isInt(label))
 			{
-				obj->ints[myOff] = data->ints[srcOff];
+				intColumns[myOff][objectID] = src.intColumns[srcOff][srcRow];
 			}
 			else if (EMDL::isBool(label))
 			{
-				obj->bools[myOff] = data->bools[srcOff];
+				boolColumns[myOff][objectID] = src.boolColumns[srcOff][srcRow];
 			}
 			else if (EMDL::isString(label))
 			{
-				obj->strings[myOff] = data->strings[srcOff];
+				stringColumns[myOff][objectID] = src.stringColumns[srcOff][srcRow];
 			}
 			else if (EMDL::isDoubleVector(label))
 			{
-				obj->doubleVectors[myOff] = data->doubleVectors[srcOff];
+				doubleVectorColumns[myOff][objectID] = src.doubleVectorColumns[srcOff][srcRow];
 			}
 		}
 		else
 		{
-			std::string unknownLabel = data->table->getUnknownLabelNameAt(i);
-			long srcOff = data->table->unknownLabelPosition2Offset[i];
-			long myOff = -1;
-
-			for (int j = 0; j < unknownLabelNames.size(); j++)
-			{
-				if (unknownLabelNames[j] == unknownLabel)
-				{
-					myOff = j;
-					break;
-				}
-			}
+			long srcOff = src.unknownLabelPosition2Offset[i];
+			long myOff = getUnknownLabelOffset(src.getUnknownLabelNameAt(i));
 
 			if (myOff < 0)
 				REPORT_ERROR("MetaDataTable::setObjectUnsafe: logic error. cannot find srcOff.");
 
-			obj->unknowns[myOff] = data->unknowns[srcOff];
+			unknownColumns[myOff][objectID] = src.unknownColumns[srcOff][srcRow];
 		}
 	}
 }
 
 void MetaDataTable::addObject()
 {
-	objects.push_back(new MetaDataContainer(
-		this, doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels));
+	resizeColumns(nrRows, nrRows + 1);
+	nrRows++;
 
-	current_objectID = objects.size()-1;
+	current_objectID = nrRows-1;
 }
 
 void MetaDataTable::addObject(MetaDataContainer* data)
 {
-	objects.push_back(new MetaDataContainer(
-		this, doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels));
+	resizeColumns(nrRows, nrRows + 1);
+	nrRows++;
 
-	setObject(data, objects.size()-1);
-	current_objectID = objects.size()-1;
+	setObject(data, nrRows-1);
+	current_objectID = nrRows-1;
 }
 
 void MetaDataTable::addValuesOfDefinedLabels(MetaDataContainer* data)
 {
-	objects.push_back(new MetaDataContainer(
-		this, doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels));
+	resizeColumns(nrRows, nrRows + 1);
+	nrRows++;
 
-	setValuesOfDefinedLabels(data, objects.size()-1);
-	current_objectID = objects.size()-1;
+	setValuesOfDefinedLabels(data, nrRows-1);
+	current_objectID = nrRows-1;
 }
 
 void MetaDataTable::removeObject(long objectID)
@@ -922,10 +1063,25 @@ void MetaDataTable::removeObject(long objectID)
 
 	checkObjectID(i, "MetaDataTable::removeObject");
 
-	delete objects[i];
-	objects.erase(objects.begin() + i);
+	for (long c = 0; c < doubleColumns.size(); c++)
+		doubleColumns[c].erase(doubleColumns[c].begin() + i);
+	for (long c = 0; c < intColumns.size(); c++)
+		intColumns[c].erase(intColumns[c].begin() + i);
+	for (long c = 0; c < boolColumns.size(); c++)
+		boolColumns[c].erase(boolColumns[c].begin() + i);
+	for (long c = 0; c < stringColumns.size(); c++)
+		stringColumns[c].erase(stringColumns[c].begin() + i);
+	for (long c = 0; c < doubleVectorColumns.size(); c++)
+		doubleVectorColumns[c].erase(doubleVectorColumns[c].begin() + i);
+	for (long c = 0; c < unknownColumns.size(); c++)
+		unknownColumns[c].erase(unknownColumns[c].begin() + i);
+	nrRows--;
+
+	// Handles beyond the new end would point past the table
+	if (rowHandles.size() > nrRows)
+		rowHandles.resize(nrRows);
 
-	current_objectID = objects.size() - 1;
+	current_objectID = nrRows - 1;
 }
 
 long int MetaDataTable::firstObject()
@@ -938,7 +1094,7 @@ long int MetaDataTable::nextObject()
 {
 	current_objectID++;
 
-	if (current_objectID >= objects.size())
+	if (current_objectID >= nrRows)
 	{
 		return NO_MORE_OBJECTS;
 	}
@@ -956,6 +1112,103 @@ long int MetaDataTable::goToObject(long int objectID)
 	return current_objectID;
 }
 
+// Same result as "std::istringstream(str) >> value", but without constructing a stream,
+// which is slow and serialises threads on the global locale.
+static double doubleFromSTAR(const std::string &str)
+{
+	const char *c = str.c_str();
+	const char *digits = (*c == '-' || *c == '+') ? c + 1 : c;
+
+	if ((*digits >= '0' && *digits <= '9') || *digits == '.')
+	{
+		// Hexadecimal numbers are read differently by streams
+		if (!(digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')))
+		{
+			const double result = strtod(c, NULL);
+			if (std::isfinite(result))
+				return result;
+		}
+	}
+
+	// Rare cases (nan, inf, overflow, garbage): let the stream decide
+	double result = 0.;
+	std::istringstream i(str);
+	i >> result;
+	return result;
+}
+
+// As above, for integers. strtol in base 10 behaves like operator>> for all input.
+static long intFromSTAR(const std::string &str)
+{
+	return strtol(str.c_str(), NULL, 10);
+}
+
+// Would this line be empty after simplify()?
+static bool isBlankSTARLine(const char *begin, const char *end)
+{
+	for (const char *c = begin; c < end; c++)
+	{
+		if (*c != ' ' && *c != '\t' && *c != '\n' && *c != '\v' &&
+		    *c != '\b' && *c != '\r' && *c != '\f' && *c != '\a')
+			return false;
+	}
+	return true;
+}
+
+int MetaDataTable::parseStarLoopLine(const std::string &line, long row)
+{
+	const int num_labels = activeLabels.size();
+	const std::string simplified = simplify(line);
+
+	int pos = 0;
+	std::string value;
+	int labelPosition = 0;
+	while (nextTokenInSTAR(simplified, pos, value))
+	{
+		if (labelPosition >= num_labels)
+			return num_labels + 1;
+
+		const EMDLabel label = activeLabels[labelPosition];
+
+		if (label == EMDL_UNKNOWN_LABEL)
+		{
+			unknownColumns[unknownLabelPosition2Offset[labelPosition]][row] = value;
+		}
+		else
+		{
+			const long off = label2offset[label];
+
+			if (EMDL::isString(label))
+			{
+				setValueAt(off, row, value);
+			}
+			else if (EMDL::isDouble(label))
+			{
+				doubleColumns[off][row] = doubleFromSTAR(value);
+			}
+			else if (EMDL::isInt(label))
+			{
+				intColumns[off][row] = intFromSTAR(value);
+			}
+			else if (EMDL::isBool(label))
+			{
+				bool v;
+				std::istringstream i(value);
+				i >> v;
+				boolColumns[off][row] = v;
+			}
+			else if (EMDL::isDoubleVector(label))
+			{
+				doubleVectorFromString(value, doubleVectorColumns[off][row]);
+			}
+		}
+
+		labelPosition++;
+	}
+
+	return labelPosition;
+}
+
 long int MetaDataTable::readStarLoop(std::ifstream& in, bool do_only_count)
 {
 	setIsList(false);
@@ -963,6 +1216,8 @@ long int MetaDataTable::readStarLoop(std::ifstream& in, bool do_only_count)
 	//Read column labels
 	int labelPosition = 0;
 	std::string line, token;
+	std::streampos data_start = in.tellg();
+	bool found_data = false;
 
 	// First read all the column labels
 	while (getline(in, line, '\n'))
@@ -970,7 +1225,10 @@ long int MetaDataTable::readStarLoop(std::ifstream& in, bool do_only_count)
 		line = simplify(line);
 		// TODO: handle comments...
 		if (line[0] == '#' || line[0] == '\0' || line[0] == ';')
+		{
+			data_start = in.tellg();
 			continue;
+		}
 
 		if (line[0] == '_') // label definition line
 		{
@@ -991,62 +1249,140 @@ long int MetaDataTable::readStarLoop(std::ifstream& in, bool do_only_count)
 			addLabel(label, token);
 
 			labelPosition++;
+			data_start = in.tellg();
 		}
 		else // found first data line
 		{
+			found_data = true;
 			break;
 		}
 	}
 
-	// Then fill the table (dont read another line until the one from above has been handled)
-	bool is_first = true;
-	long int nr_objects = 0;
+	if (!found_data)
+		return 0;
+
+	// Then fill the table: go back to the first data line and read everything
+	// up to the first empty line in large blocks
+	in.clear();
+	in.seekg(data_start);
+
+	const int nr_threads = starThreadsFromEnvironment("RELION_STAR_READ_THREADS");
+
+	const long block_size = 64 * 1024 * 1024;
 	const int num_labels = activeLabels.size();
 
-	while (is_first || getline(in, line, '\n'))
+	long int nr_objects = 0;
+	std::vector<char> buffer;
+	std::vector<long> line_begin, line_end;
+	std::streamoff buffer_start = data_start; // file offset of buffer[0]
+	long carry = 0; // bytes of an incomplete line from the previous block
+
+	while (true)
 	{
-		is_first = false;
+		buffer.resize(carry + block_size);
+		in.read(&buffer[carry], block_size);
+		const long length = carry + in.gcount();
+		const bool at_eof = (in.gcount() < block_size);
 
-		line = simplify(line);
-		// Stop at empty line
-		if (line[0] == '\0')
-			break;
+		// Split the block into lines, until the first empty one
+		line_begin.clear();
+		line_end.clear();
+		long pos = 0, after_loop = -1;
+		while (pos < length)
+		{
+			const char *nl = (const char*)memchr(&buffer[pos], '\n', length - pos);
+			if (nl == NULL && !at_eof)
+				break; // incomplete line; finish it with the next block
+
+			const long end = (nl == NULL) ? length : (nl - &buffer[0]);
+			const long next = (nl == NULL) ? length : end + 1;
+
+			if (isBlankSTARLine(&buffer[pos], &buffer[end]))
+			{
+				after_loop = next;
+				break;
+			}
+
+			line_begin.push_back(pos);
+			line_end.push_back(end);
+			pos = next;
+		}
+
+		const long nr_lines = line_begin.size();
+		nr_objects += nr_lines;
 
-		nr_objects++;
-		if (!do_only_count)
+		if (!do_only_count && nr_lines > 0)
 		{
-			// Add a new line to the table
-			addObject();
+			const long first_row = nrRows;
+			resizeColumns(nrRows, nrRows + nr_lines);
+			nrRows += nr_lines;
+
+			// Lines that went wrong: the first one is reported below, exactly as in a sequential read
+			long first_bad_line = nr_lines;
+			int first_bad_count = 0;
+			std::exception_ptr first_error;
 
-			// Parse data values
-			int pos = 0;
-			std::string value;
-			labelPosition = 0;
-			while (nextTokenInSTAR(line, pos, value))
+			#pragma omp parallel for num_threads(nr_threads) schedule(dynamic, 1024) if(nr_lines > 1024)
+			for (long i = 0; i < nr_lines; i++)
 			{
-				if (labelPosition >= num_labels)
+				const std::string raw(&buffer[line_begin[i]], &buffer[line_end[i]]);
+
+				int count;
+				std::exception_ptr error;
+				try
 				{
-					std::cerr << "Error in line: " << line << std::endl;
-					REPORT_ERROR("A line in the STAR file contains more columns than the number of labels.");
+					count = parseStarLoopLine(raw, first_row + i);
 				}
-				// Check whether this is an unknown label
-				if (activeLabels[labelPosition] == EMDL_UNKNOWN_LABEL)
+				catch (...)
 				{
-					setUnknownValue(labelPosition, value);
+					error = std::current_exception();
+					count = -1;
 				}
-				else
+
+				// For backward-compatibility for cases like "fn_mtf <empty>", don't die if num_labels == 2.
+				if (count < 0 || count > num_labels || (count < num_labels && num_labels > 2))
 				{
-					setValueFromString(activeLabels[labelPosition], value);
+					#pragma omp critical(MetaDataTable_readStarLoop)
+					{
+						if (i < first_bad_line)
+						{
+							first_bad_line = i;
+							first_bad_count = count;
+							first_error = error;
+						}
+					}
 				}
-				labelPosition++;
 			}
-			if (labelPosition < num_labels && num_labels > 2)
+
+			if (first_bad_line < nr_lines)
 			{
-				// For backward-compatibility for cases like "fn_mtf <empty>", don't die if num_labels == 2.
-				std::cerr << "Error in line: " << line << std::endl;
-				REPORT_ERROR("A line in the STAR file contains fewer columns than the number of labels. Expected = " + integerToString(num_labels) + " Found = " +  integerToString(labelPosition));
+				if (first_error)
+					std::rethrow_exception(first_error);
+
+				std::cerr << "Error in line: " << simplify(std::string(&buffer[line_begin[first_bad_line]], &buffer[line_end[first_bad_line]])) << std::endl;
+				if (first_bad_count > num_labels)
+					REPORT_ERROR("A line in the STAR file contains more columns than the number of labels.");
+				else
+					REPORT_ERROR("A line in the STAR file contains fewer columns than the number of labels. Expected = " + integerToString(num_labels) + " Found = " +  integerToString(first_bad_count));
 			}
 		}
+
+		if (after_loop >= 0)
+		{
+			// Leave the stream just after the empty line, as getline would have
+			in.clear();
+			in.seekg(buffer_start + after_loop);
+			break;
+		}
+
+		if (at_eof)
+			break;
+
+		// Keep the incomplete line for the next block
+		carry = length - pos;
+		if (carry > 0)
+			memmove(&buffer[0], &buffer[pos], carry);
+		buffer_start += pos;
 	}
 
 	return nr_objects;
@@ -1056,7 +1392,7 @@ bool MetaDataTable::readStarList(std::ifstream& in)
 {
 	setIsList(true);
 	addObject();
-	long int objectID = objects.size() - 1;
+	long int objectID = nrRows - 1;
 
 	std::string line, firstword, value;
 
@@ -1193,6 +1529,10 @@ long int MetaDataTable::readStar(std::ifstream& in, const std::string &name, boo
 
 std::vector<MetaDataTable> MetaDataTable::readAll(const std::string &in, int expectedNumber, bool do_only_count)
 {
+	std::vector<MetaDataTable> out;
+	if (MetaDataSidecar::readAll(in, out, do_only_count))
+		return out;
+
 	std::ifstream ifs(in);
 	return readAll(ifs, expectedNumber, do_only_count);
 }
@@ -1260,7 +1600,8 @@ std::vector<MetaDataTable> MetaDataTable::readAll(
 
 	return out;
 }
-long int MetaDataTable::read(const FileName &filename, const std::string &name, bool do_only_count)
+long int MetaDataTable::read(const FileName &filename, const std::string &name, bool do_only_count,
+                             const std::vector<EMDLabel> *desired_labels)
 {
 
 	// Clear current table
@@ -1269,6 +1610,14 @@ long int MetaDataTable::read(const FileName &filename, const std::string &name,
 	// Check for an :star extension
 	FileName fn_read = filename.removeFileFormat();
 
+	// Use the binary sidecar if it still describes this STAR file
+	long int ret = MetaDataSidecar::read(fn_read, *this, name, do_only_count, desired_labels);
+	if (ret >= 0)
+	{
+		firstObject();
+		return ret;
+	}
+
 	std::ifstream in(fn_read.data(), std::ios_base::in);
 
 	if (in.fail())
@@ -1276,10 +1625,28 @@ long int MetaDataTable::read(const FileName &filename, const std::string &name,
 		REPORT_ERROR( (std::string) "MetaDataTable::read: File " + fn_read + " does not exist" );
 	}
 
-	const long int ret = readStar(in, name, do_only_count);
+	ret = readStar(in, name, do_only_count);
 
 	in.close();
 
+	// Without a sidecar, all columns have been parsed anyway; just drop the unwanted ones
+	if (desired_labels != NULL)
+	{
+		std::vector<EMDLabel> labels = activeLabels;
+		std::vector<std::string> unknownNames(labels.size());
+		for (int i = 0; i < labels.size(); i++)
+		{
+			if (labels[i] == EMDL_UNKNOWN_LABEL)
+				unknownNames[i] = getUnknownLabelNameAt(i);
+		}
+
+		for (int i = 0; i < labels.size(); i++)
+		{
+			if (std::find(desired_labels->begin(), desired_labels->end(), labels[i]) == desired_labels->end())
+				deactivateLabel(labels[i], unknownNames[i]);
+		}
+	}
+
 	// Go to the first object
 	firstObject();
 
@@ -1294,82 +1661,16 @@ void MetaDataTable::write(std::ostream& out) const
 		return;
 	}
 
-	if (version >= 30000)
-	{
-		out << "\n";
-		out << "# version " << getCurrentVersion() <<"\n";
-	}
-
-	out << "\n";
-	out << "data_" << getName() <<"\n";
-
-	if (containsComment())
-	{
-		out << "# "<< comment << "\n";
-	}
-
-	out << "\n";
-
 	if (!isList)
 	{
-		// Write loop header structure
-		out << "loop_ \n";
-
-		for (long i = 0, n_printed = 1; i < activeLabels.size(); i++)
-		{
-			EMDLabel l = activeLabels[i];
-			if (l == EMDL_UNKNOWN_LABEL)
-			{
-				out << "_" << getUnknownLabelNameAt(i) << " #" << (n_printed++) << " \n";
-			}
-			else if (l != EMDL_COMMENT && l != EMDL_SORTED_IDX) // EMDL_SORTED_IDX is only for internal use, never write it out!
-			{
-				out << "_" << EMDL::label2Str(l) << " #" << (n_printed++) << " \n";
-			}
-		}
-
-		// Write actual data block
-		for (long int idx = 0; idx < objects.size(); idx++)
-		{
-			std::string entryComment = "";
-
-			for (long i = 0; i < activeLabels.size(); i++)
-			{
-				EMDLabel l = activeLabels[i];
-
-				if (l == EMDL_UNKNOWN_LABEL)
-				{
-					out.width(10);
-					std::string token, val;
-					long offset = unknownLabelPosition2Offset[i];
-					val = objects[idx]->unknowns[offset];
-					escapeStringForSTAR(val);
-					out << val << " ";
-				}
-				else if (l != EMDL_COMMENT && l != EMDL_SORTED_IDX)
-				{
-					out.width(10);
-					std::string val;
-					getValueToString(l, val, idx, true); // escape=true
-					out << val << " ";
-				}
-				if (l == EMDL_COMMENT)
-				{
-					getValue(EMDL_COMMENT, entryComment, idx);
-				}
-			}
-			if (entryComment != std::string(""))
-			{
-				out << "# " << entryComment;
-			}
-			out << "\n";
-		}
-		// Finish table with a white-line
-		out << " \n";
-
+		writeLoopHeader(out);
+		writeLoopRows(out);
+		writeLoopFooter(out);
 	}
 	else // isList
 	{
+		writeBlockStart(out);
+
 		// Get first object. In this case (row format) there is a single object
 		std::string entryComment = "";
 		int maxWidth=10;
@@ -1402,7 +1703,7 @@ void MetaDataTable::write(std::ostream& out) const
 			{
 				std::string labelName = getUnknownLabelNameAt(i);
 				int w = labelName.length();
-				out << "_" << labelName << std::setw(12 + maxWidth - w) << " " << objects[0]->unknowns[unknownLabelPosition2Offset[i]] << "\n";
+				out << "_" << labelName << std::setw(12 + maxWidth - w) << " " << unknownColumns[unknownLabelPosition2Offset[i]][0] << "\n";
 			}
 			else if (l != EMDL_COMMENT)
 			{
@@ -1424,6 +1725,163 @@ void MetaDataTable::write(std::ostream& out) const
 	}
 }
 
+void MetaDataTable::writeBlockStart(std::ostream& out) const
+{
+	if (version >= 30000)
+	{
+		out << "\n";
+		out << "# version " << getCurrentVersion() <<"\n";
+	}
+
+	out << "\n";
+	out << "data_" << getName() <<"\n";
+
+	if (containsComment())
+	{
+		out << "# "<< comment << "\n";
+	}
+
+	out << "\n";
+}
+
+void MetaDataTable::writeLoopHeader(std::ostream& out) const
+{
+	writeBlockStart(out);
+
+	// Write loop header structure
+	out << "loop_ \n";
+
+	for (long i = 0, n_printed = 1; i < activeLabels.size(); i++)
+	{
+		EMDLabel l = activeLabels[i];
+		if (l == EMDL_UNKNOWN_LABEL)
+		{
+			out << "_" << getUnknownLabelNameAt(i) << " #" << (n_printed++) << " \n";
+		}
+		else if (l != EMDL_COMMENT && l != EMDL_SORTED_IDX) // EMDL_SORTED_IDX is only for internal use, never write it out!
+		{
+			out << "_" << EMDL::label2Str(l) << " #" << (n_printed++) << " \n";
+		}
+	}
+}
+
+void MetaDataTable::writeLoopRows(std::ostream& out, long first, long last) const
+{
+	if (last < 0 || last > nrRows)
+		last = nrRows;
+
+	const int nr_threads = starThreadsFromEnvironment("RELION_STAR_WRITE_THREADS");
+
+	// Each thread formats a contiguous range of rows into its own buffer;
+	// the buffers are then written in order. Batches bound the memory used.
+	const long rows_per_thread = 4096;
+	std::vector<std::string> buffers(nr_threads);
+
+	for (long batch_start = first; batch_start < last; batch_start += nr_threads * rows_per_thread)
+	{
+		const long batch_end = XMIPP_MIN(last, batch_start + nr_threads * rows_per_thread);
+		const long rows_per_buffer = (batch_end - batch_start + nr_threads - 1) / nr_threads;
+
+		#pragma omp parallel for num_threads(nr_threads) schedule(static, 1) if(batch_end - batch_start > 1024)
+		for (int ibuf = 0; ibuf < nr_threads; ibuf++)
+		{
+			std::string &buffer = buffers[ibuf];
+			buffer.clear();
+
+			const long row_end = XMIPP_MIN(batch_end, batch_start + (ibuf + 1) * rows_per_buffer);
+			for (long idx = batch_start + ibuf * rows_per_buffer; idx < row_end; idx++)
+				formatStarLoopRow(idx, buffer);
+		}
+
+		for (int ibuf = 0; ibuf < nr_threads; ibuf++)
+			out.write(buffers[ibuf].data(), buffers[ibuf].size());
+	}
+}
+
+void MetaDataTable::writeLoopFooter(std::ostream& out)
+{
+	// Finish table with a white-line
+	out << " \n";
+}
+
+// Append a value as "out.width(10); out << val << " ";" would write it
+static void appendForSTAR(std::string &line, const char *val, size_t length)
+{
+	if (length < 10)
+		line.append(10 - length, ' ');
+	line.append(val, length);
+	line += ' ';
+}
+
+static void appendStringForSTAR(std::string &line, const std::string &val)
+{
+	// Only strings that need quoting (or are empty) take the slow path through escapeStringForSTAR
+	if (val.length() > 0 && val[0] != '"' && val[0] != '\'' && val.find_first_of(" \t") == std::string::npos)
+	{
+		appendForSTAR(line, val.data(), val.length());
+	}
+	else
+	{
+		std::string escaped = val;
+		escapeStringForSTAR(escaped);
+		appendForSTAR(line, escaped.data(), escaped.length());
+	}
+}
+
+void MetaDataTable::formatStarLoopRow(long idx, std::string &line) const
+{
+	std::string entryComment = "";
+	char buffer[14];
+
+	for (long i = 0; i < activeLabels.size(); i++)
+	{
+		EMDLabel l = activeLabels[i];
+
+		if (l == EMDL_UNKNOWN_LABEL)
+		{
+			appendStringForSTAR(line, unknownColumns[unknownLabelPosition2Offset[i]][idx]);
+		}
+		else if (l == EMDL_COMMENT)
+		{
+			getValueAt(label2offset[l], idx, entryComment);
+		}
+		else if (l != EMDL_SORTED_IDX)
+		{
+			const long off = label2offset[l];
+
+			if (EMDL::isDouble(l))
+			{
+				doubleToSTAR(doubleColumns[off][idx], buffer);
+				appendForSTAR(line, buffer, strlen(buffer));
+			}
+			else if (EMDL::isInt(l))
+			{
+				intToSTAR(intColumns[off][idx], buffer);
+				appendForSTAR(line, buffer, strlen(buffer));
+			}
+			else if (EMDL::isString(l))
+			{
+				std::string val;
+				getValueAt(off, idx, val);
+				appendStringForSTAR(line, val);
+			}
+			else
+			{
+				std::string val;
+				getValueToString(l, val, idx, true); // escape=true
+				appendForSTAR(line, val.data(), val.length());
+			}
+		}
+	}
+
+	if (entryComment != std::string(""))
+	{
+		line += "# ";
+		line += entryComment;
+	}
+	line += '\n';
+}
+
 void MetaDataTable::write(const FileName &fn_out) const
 {
 	std::ofstream  fh;
@@ -1437,6 +1895,7 @@ void MetaDataTable::write(const FileName &fn_out) const
 	// Rename to prevent errors with programs in pipeliner reading in incomplete STAR files
 	std::rename(fn_tmp.c_str(), fn_out.c_str());
 
+	MetaDataSidecar::write(fn_out, *this);
 }
 
 void MetaDataTable::columnHistogram(EMDLabel label, std::vector<RFLOAT> &histX, std::vector<RFLOAT> &histY,
@@ -1447,36 +1906,121 @@ void MetaDataTable::columnHistogram(EMDLabel label, std::vector<RFLOAT> &histX,
 	if (!containsLabel(label))
 		REPORT_ERROR("ERROR: The column specified is not present in the MetaDataTable.");
 
+	if (!(EMDL::isDouble(label) || EMDL::isInt(label) || EMDL::isBool(label)))
+		REPORT_ERROR("Cannot use --stat_column for this type of column");
+
 	std::vector<RFLOAT> values;
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(*this)
+	getNumericColumn(label, values);
+
+	std::string title = EMDL::label2Str(label);
+	histogram(values, histX, histY, verb, title, plot2D, nr_bin, hist_min, hist_max, do_fractional_instead, do_cumulative_instead);
+}
+
+bool MetaDataTable::getNumericColumn(EMDLabel label, std::vector<RFLOAT> &values) const
+{
+	const long off = label2offset[label];
+	if (off < 0)
+		return false;
+
+	if (EMDL::isDouble(label))
 	{
-		RFLOAT val;
-		if (EMDL::isDouble(label))
-		{
-			getValue(label, val);
-		}
-		else if (EMDL::isInt(label))
-		{
-			long aux;
-			getValue(label, aux);
-			val = aux;
-		}
-		else if (EMDL::isBool(label))
+		values.assign(doubleColumns[off].begin(), doubleColumns[off].end());
+	}
+	else if (EMDL::isInt(label))
+	{
+		values.assign(intColumns[off].begin(), intColumns[off].end());
+	}
+	else if (EMDL::isBool(label))
+	{
+		values.resize(nrRows);
+		for (long i = 0; i < nrRows; i++)
+			values[i] = boolColumns[off][i] ? 1 : 0;
+	}
+	else
+	{
+		REPORT_ERROR("MetaDataTable::getNumericColumn: not a numeric label: " + EMDL::label2Str(label));
+	}
+
+	return true;
+}
+
+bool MetaDataTable::getStringColumn(EMDLabel label, std::vector<std::string> &values) const
+{
+	if (!EMDL::isString(label))
+		REPORT_ERROR("MetaDataTable::getStringColumn: not a string label: " + EMDL::label2Str(label));
+
+	const long off = label2offset[label];
+	if (off < 0)
+		return false;
+
+	values.resize(nrRows);
+	for (long i = 0; i < nrRows; i++)
+		getValueAt(off, i, values[i]);
+
+	return true;
+}
+
+MetaDataTable MetaDataTable::selectRows(const std::vector<long> &rows) const
+{
+	MetaDataTable MDout;
+	MDout.addMissingLabels(this);
+
+	const long nr_out = rows.size();
+	for (long r = 0; r < nr_out; r++)
+		checkObjectID(rows[r], "MetaDataTable::selectRows");
+
+	for (long i = 0; i < activeLabels.size(); i++)
+	{
+		EMDLabel label = activeLabels[i];
+
+		if (label != EMDL_UNKNOWN_LABEL)
 		{
-			bool aux;
-			getValue(label, aux);
-			val = aux ? 1 : 0;
+			long srcOff = label2offset[label];
+			long myOff = MDout.label2offset[label];
+
+			if (EMDL::isDouble(label))
+			{
+				MDout.doubleColumns[myOff].resize(nr_out);
+				for (long r = 0; r < nr_out; r++)
+					MDout.doubleColumns[myOff][r] = doubleColumns[srcOff][rows[r]];
+			}
+			else if (EMDL::isInt(label))
+			{
+				MDout.intColumns[myOff].resize(nr_out);
+				for (long r = 0; r < nr_out; r++)
+					MDout.intColumns[myOff][r] = intColumns[srcOff][rows[r]];
+			}
+			else if (EMDL::isBool(label))
+			{
+				MDout.boolColumns[myOff].resize(nr_out);
+				for (long r = 0; r < nr_out; r++)
+					MDout.boolColumns[myOff][r] = boolColumns[srcOff][rows[r]];
+			}
+			else if (EMDL::isString(label))
+			{
+				MDout.stringColumns[myOff].resize(nr_out);
+				for (long r = 0; r < nr_out; r++)
+					MDout.stringColumns[myOff][r] = stringColumns[srcOff][rows[r]];
+			}
+			else if (EMDL::isDoubleVector(label))
+			{
+				MDout.doubleVectorColumns[myOff].resize(nr_out);
+				for (long r = 0; r < nr_out; r++)
+					MDout.doubleVectorColumns[myOff][r] = doubleVectorColumns[srcOff][rows[r]];
+			}
 		}
 		else
 		{
-			REPORT_ERROR("Cannot use --stat_column for this type of column");
+			long srcOff = unknownLabelPosition2Offset[i];
+			long myOff = MDout.getUnknownLabelOffset(unknownLabelNames[srcOff]);
+			MDout.unknownColumns[myOff].resize(nr_out);
+			for (long r = 0; r < nr_out; r++)
+				MDout.unknownColumns[myOff][r] = unknownColumns[srcOff][rows[r]];
 		}
-		values.push_back(val);
 	}
+	MDout.nrRows = nr_out;
 
-
-	std::string title = EMDL::label2Str(label);
-	histogram(values, histX, histY, verb, title, plot2D, nr_bin, hist_min, hist_max, do_fractional_instead, do_cumulative_instead);
+	return MDout;
 }
 
 void MetaDataTable::histogram(std::vector<RFLOAT> &values, std::vector<RFLOAT> &histX, std::vector<RFLOAT> &histY,
@@ -1617,7 +2161,7 @@ void MetaDataTable::addToCPlot2D(CPlot2D *plot2D, EMDLabel xaxis, EMDLabel yaxis
 	double mydbl;
 	long int myint;
 	double xval, yval;
-	for (long int idx = 0; idx < objects.size(); idx++)
+	for (long int idx = 0; idx < nrRows; idx++)
 	{
 		const long offx = label2offset[xaxis];
 		if (offx < 0)
@@ -1629,12 +2173,12 @@ void MetaDataTable::addToCPlot2D(CPlot2D *plot2D, EMDLabel xaxis, EMDLabel yaxis
 		}
 		else if (EMDL::isDouble(xaxis))
 		{
-			objects[idx]->getValue(offx, mydbl);
+			getValueAt(offx, idx, mydbl);
 			xval = mydbl;
 		}
 		else if (EMDL::isInt(xaxis))
 		{
-			objects[idx]->getValue(offx, myint);
+			getValueAt(offx, idx, myint);
 			xval = myint;
 		}
 		else
@@ -1646,12 +2190,12 @@ void MetaDataTable::addToCPlot2D(CPlot2D *plot2D, EMDLabel xaxis, EMDLabel yaxis
 
 		if (EMDL::isDouble(yaxis))
 		{
-			objects[idx]->getValue(offy, mydbl);
+			getValueAt(offy, idx, mydbl);
 			yval = mydbl;
 		}
 		else if (EMDL::isInt(yaxis))
 		{
-			objects[idx]->getValue(offy, myint);
+			getValueAt(offy, idx, myint);
 			yval = myint;
 		}
 		else
@@ -1680,16 +2224,20 @@ void MetaDataTable::printLabels(std::ostream &ost)
 
 void MetaDataTable::randomiseOrder()
 {
-	std::random_shuffle(objects.begin(), objects.end());
+	std::vector<long> order(nrRows);
+	for (long i = 0; i < nrRows; i++)
+		order[i] = i;
+	std::random_shuffle(order.begin(), order.end());
+	permuteRows(order);
 }
 
 void MetaDataTable::checkObjectID(long id, std::string caller) const
 {
-	if (id >= objects.size() || id < 0)
+	if (id >= nrRows || id < 0)
 	{
 		std::stringstream sts0, sts1;
 		sts0 << id;
-		sts1 << objects.size();
+		sts1 << nrRows;
 		REPORT_ERROR(caller+": object " + sts0.str()
 					 + " out of bounds! (" + sts1.str() + " objects present)");
 	}
@@ -1942,31 +2490,21 @@ MetaDataTable subsetMetaDataTable(MetaDataTable &MDin, EMDLabel label, RFLOAT mi
 	if (!MDin.containsLabel(label))
 		REPORT_ERROR("subsetMetadataTable ERROR: input MetaDataTable does not contain label: " +  EMDL::label2Str(label));
 
-	MetaDataTable MDout;
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDin)
-	{
-		bool do_include = false;
-		if (EMDL::isInt(label))
-		{
-			long val;
-			MDin.getValue(label, val);
-			do_include = ((RFLOAT)val <= max_value && (RFLOAT)val >= min_value);
-		}
-		else
-		{
-			RFLOAT val;
-			MDin.getValue(label, val);
-			do_include = ((RFLOAT)val <= max_value && (RFLOAT)val >= min_value);
-		}
-
-		if (do_include)
-		{
-			MDout.addObject(MDin.getObject(current_object));
-		}
+	std::vector<RFLOAT> values;
+	MDin.getNumericColumn(label, values);
 
+	std::vector<long> selected;
+	for (long i = 0; i < values.size(); i++)
+	{
+		if (values[i] <= max_value && values[i] >= min_value)
+			selected.push_back(i);
 	}
 
-	return MDout;
+	// As before, an empty selection gives a table without any labels
+	if (selected.size() == 0)
+		return MetaDataTable();
+
+	return MDin.selectRows(selected);
 
 }
 
@@ -1979,21 +2517,22 @@ MetaDataTable subsetMetaDataTable(MetaDataTable &MDin, EMDLabel label, std::stri
 	if (!MDin.containsLabel(label))
 		REPORT_ERROR("subsetMetadataTable ERROR: input MetaDataTable does not contain label: " +  EMDL::label2Str(label));
 
-	MetaDataTable MDout;
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDin)
-	{
-		std::string val;
-		MDin.getValue(label, val);
+	std::vector<std::string> values;
+	MDin.getStringColumn(label, values);
 
-		bool found = (val.find(search_str) != std::string::npos);
+	std::vector<long> selected;
+	for (long i = 0; i < values.size(); i++)
+	{
+		bool found = (values[i].find(search_str) != std::string::npos);
 
 		if ((!exclude && found) || (exclude && !found))
-		{
-			MDout.addObject(MDin.getObject(current_object));
-		}
+			selected.push_back(i);
 	}
 
-	return MDout;
+	if (selected.size() == 0)
+		return MetaDataTable();
+
+	return MDin.selectRows(selected);
 }
 
 MetaDataTable removeDuplicatedParticles(MetaDataTable &MDin, EMDLabel mic_label, RFLOAT threshold, RFLOAT origin_scale, FileName fn_removed, bool verb)
@@ -2024,43 +2563,58 @@ MetaDataTable removeDuplicatedParticles(MetaDataTable &MDin, EMDLabel mic_label,
 
     RFLOAT threshold_sq = threshold * threshold;
 
-	// group by micrograph
-	std::map<std::string, std::vector<long> > grouped;
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDin)
-	{
-		std::string mic_name;
-		MDin.getValue(mic_label, mic_name);
-
-		RFLOAT val1, val2;
-		MDin.getValue(EMDL_ORIENT_ORIGIN_X_ANGSTROM, val1);
-		MDin.getValue(EMDL_IMAGE_COORD_X, val2);
-		xs[current_object] = -val1 * origin_scale + val2;
-		MDin.getValue(EMDL_ORIENT_ORIGIN_Y_ANGSTROM, val1);
-		MDin.getValue(EMDL_IMAGE_COORD_Y, val2);
-		ys[current_object] = -val1 * origin_scale + val2;
-
-		if (dataIs3D)
-        {
-            MDin.getValue(EMDL_ORIENT_ORIGIN_Z_ANGSTROM, val1);
-            MDin.getValue(EMDL_IMAGE_COORD_Z, val2);
-            zs[current_object] = -val1 * origin_scale + val2;
-        }
+	std::vector<std::string> mic_names;
+	MDin.getStringColumn(mic_label, mic_names);
 
-		grouped[mic_name].push_back(current_object);
+	std::vector<RFLOAT> origins, coords;
+	MDin.getNumericColumn(EMDL_ORIENT_ORIGIN_X_ANGSTROM, origins);
+	MDin.getNumericColumn(EMDL_IMAGE_COORD_X, coords);
+	for (long i = 0; i < xs.size(); i++)
+		xs[i] = -origins[i] * origin_scale + coords[i];
+	MDin.getNumericColumn(EMDL_ORIENT_ORIGIN_Y_ANGSTROM, origins);
+	MDin.getNumericColumn(EMDL_IMAGE_COORD_Y, coords);
+	for (long i = 0; i < ys.size(); i++)
+		ys[i] = -origins[i] * origin_scale + coords[i];
+	if (dataIs3D)
+	{
+		MDin.getNumericColumn(EMDL_ORIENT_ORIGIN_Z_ANGSTROM, origins);
+		MDin.getNumericColumn(EMDL_IMAGE_COORD_Z, coords);
+		for (long i = 0; i < zs.size(); i++)
+			zs[i] = -origins[i] * origin_scale + coords[i];
 	}
 
+	// group by micrograph
+	std::map<std::string, std::vector<long> > grouped;
+	for (long i = 0; i < mic_names.size(); i++)
+		grouped[mic_names[i]].push_back(i);
+
 	// find duplicate
+	// Only particles in neighbouring cells of a grid with cells of the threshold distance need to be compared
+	std::vector<long int> candidates;
 	for (std::map<std::string, std::vector<long> >::iterator it = grouped.begin(); it != grouped.end(); ++it)
 	{
 		long n_particles = it->second.size();
 
+		SpatialHash grid(fabs(threshold));
+		for (long i = 0; i < n_particles; i++)
+		{
+			long part_id = it->second[i];
+			grid.add(part_id, xs[part_id], ys[part_id], (dataIs3D) ? zs[part_id] : 0.);
+		}
+
 		for (long i = 0; i < n_particles; i++)
 		{
 			long part_id1 = it->second[i];
 
-			for (long j = i + 1; j < n_particles; j++)
+			// Particles are compared with the ones after them in the (ordered) group only
+			candidates.clear();
+			grid.getCandidates(xs[part_id1], ys[part_id1], (dataIs3D) ? zs[part_id1] : 0., candidates, dataIs3D);
+			for (long j = 0; j < candidates.size(); j++)
 			{
-				long part_id2 = it->second[j];
+				long part_id2 = candidates[j];
+				if (part_id2 <= part_id1)
+					continue;
+
 				RFLOAT dist_sq = (xs[part_id1] - xs[part_id2]) * (xs[part_id1] - xs[part_id2]) + (ys[part_id1] - ys[part_id2]) * (ys[part_id1] - ys[part_id2]);
 				if (dataIs3D)
                     dist_sq += (zs[part_id1] - zs[part_id2]) * (zs[part_id1] - zs[part_id2]);
@@ -2076,20 +2630,21 @@ MetaDataTable removeDuplicatedParticles(MetaDataTable &MDin, EMDLabel mic_label,
 	}
 
 
-	MetaDataTable MDout, MDremoved;
-	long n_removed = 0;
-	FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDin)
+	std::vector<long> kept, removed;
+	for (long i = 0; i < valid.size(); i++)
 	{
-		if (valid[current_object])
-		{
-			MDout.addObject(MDin.getObject(current_object));
-		}
+		if (valid[i])
+			kept.push_back(i);
 		else
-		{
-			MDremoved.addObject(MDin.getObject(current_object));
-			n_removed++;
-		}
+			removed.push_back(i);
 	}
+	long n_removed = removed.size();
+
+	MetaDataTable MDout, MDremoved;
+	if (kept.size() > 0)
+		MDout = MDin.selectRows(kept);
+	if (removed.size() > 0)
+		MDremoved = MDin.selectRows(removed);
 
 	if (fn_removed != "")
 		MDremoved.write(fn_removed);
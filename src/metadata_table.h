@@ -30,6 +30,7 @@
 #define METADATA_TABLE_H
 
 #include <map>
+#include <deque>
 #include <vector>
 #include <iostream>
 #include <iterator>
@@ -76,13 +77,19 @@
  *	- the rows are stored in per-type contiguous blocks of memory
  *
  *	2020/Nov/12:
- *	  This class is organized as an array (`objects`) of structures (`MetaDataContainer`).
+ *	  This class was organized as an array (`objects`) of structures (`MetaDataContainer`).
+ *
+ *	  Since then, the values are stored as a structure of arrays: there is one contiguous
+ *	  array per column, grouped by data type (e.g. `doubleColumns[off][row]`).
+ *	  This avoids one set of heap allocations per row and lets whole-column operations
+ *	  (sorting, histograms, subsets) scan contiguous memory. `MetaDataContainer` is now
+ *	  only a handle to a row (table + row index), as returned by `getObject`.
  *
  *        `activeLabels` contains all valid labels.
- *        Even when a label is `deactivateLabel`-ed, the values remain in `MetaDataContainer`s.
+ *        Even when a label is `deactivateLabel`-ed, its column remains in storage.
  *        The label is only removed from `activeLabels`.
  *
- *        Each data type (int, double, etc) contains its own storage array inside `MetaDataContainer`.
+ *        Each data type (int, double, etc) has its own set of columns.
  *        Thus, values in `label2offsets` are NOT unique. Accessing columns via a wrong type is
  *        very DANGEROUS. Use `cmake -DMDT_TYPE_CHECK=ON` to enable runtime checks.
  *
@@ -95,20 +102,40 @@
  *        Whenever `activeLabels` is modified, `unknownLabelPosition2Offset` MUST be updated accordingly.
  *        When the label for a column is EMD_UNKNOWN_LABEL, the corresponding element in
  *        `unknownLabelPosition2Offset` must store the offset in `unknownLabelNames` and
- *        `MetaDataContainer->unknowns`. Otherwise, the value does not matter.
+ *        `unknownColumns`. Otherwise, the value does not matter.
  */
 class MetaDataTable
 {
-	// Effectively stores all metadata
-	std::vector<MetaDataContainer*> objects;
-
-	// Maps labels to corresponding indices in the vectors in MetaDataContainer.
+	// The binary sidecar reads and writes the storage directly
+	friend class MetaDataSidecar;
+	friend class MetaDataContainer;
+
+	// Effectively stores all metadata: one array per column, indexed by row
+	std::vector<std::vector<double> > doubleColumns;
+	std::vector<std::vector<long> > intColumns;
+	// (bools are stored as unsigned char, as std::vector<bool> packs bits and different rows could not be set from different threads)
+	std::vector<std::vector<unsigned char> > boolColumns;
+	std::vector<std::vector<std::string> > stringColumns;
+	std::vector<std::vector<std::vector<double> > > doubleVectorColumns;
+	std::vector<std::vector<std::string> > unknownColumns;
+
+	// Number of rows in every column
+	long nrRows;
+
+	// Capacity requested through reserve(), also applied to columns added later
+	long reservedRows;
+
+	// Row handles given out by getObject(); a deque keeps them at fixed addresses
+	// They are created on demand, inside critical(MetaDataTable_rowHandles), as getObject may be called from several threads
+	mutable std::deque<MetaDataContainer> rowHandles;
+
+	// Maps labels to corresponding indices in the column arrays of the matching type.
 	// The length of label2offset is always equal to the number of defined labels (~320)
 	// e.g.:
 	// the value of "defocus-U" for row r is stored in:
-	//	 objects[r]->doubles[label2offset[EMDL_CTF_DEFOCUSU]]
+	//	 doubleColumns[label2offset[EMDL_CTF_DEFOCUSU]][r]
 	// the value of "image name" is stored in:
-	//	 objects[r]->strings[label2offset[EMDL_IMAGE_NAME]]
+	//	 stringColumns[label2offset[EMDL_IMAGE_NAME]][r]
 	std::vector<long> label2offset;
 
 	/** What labels have been read from a docfile/metadata file
@@ -123,9 +150,6 @@ class MetaDataTable
 	// Current object id
 	long current_objectID;
 
-	// Number of labels of each type
-	long doubleLabels, intLabels, boolLabels, stringLabels, doubleVectorLabels, unknownLabels;
-
 	// Is this a 2D table or a 1D list?
 	bool isList;
 
@@ -285,7 +309,13 @@ public:
 
 	long goToObject(long objectID);
 
-	// Read a STAR loop structure
+	/* Read a STAR loop structure
+	 *
+	 * The data lines are read from the stream in large blocks, and each block is
+	 * tokenized and converted by several threads at once. The number of threads is
+	 * taken from the environment variable RELION_STAR_READ_THREADS, and defaults to
+	 * the OpenMP maximum (i.e. OMP_NUM_THREADS).
+	 */
 	long int readStarLoop(std::ifstream& in, bool do_only_count = false);
 
 	/* Read a STAR list
@@ -316,15 +346,41 @@ public:
 
 	long int readStar(std::ifstream& in, const std::string &name = "", bool do_only_count = false);
 
-	// Read a MetaDataTable (get file format from extension)
-	long int read(const FileName &filename, const std::string &name = "", bool do_only_count = false);
+	/* Read a MetaDataTable (get file format from extension)
+	 *
+	 * If an up-to-date binary sidecar exists (see metadata_sidecar.h), it is used instead of the STAR file.
+	 * If desired_labels is not NULL, only those columns are kept. With a sidecar, the other columns are
+	 * not even decoded, so programs that only need a few columns should pass them here.
+	 */
+	long int read(const FileName &filename, const std::string &name = "", bool do_only_count = false,
+	              const std::vector<EMDLabel> *desired_labels = NULL);
 
 	// Write a MetaDataTable in STAR format
 	void write(std::ostream& out = std::cout) const;
 
+	/* Write a STAR loop in pieces, e.g. to stream a table whose rows are produced in batches:
+	 * call writeLoopHeader once, then writeLoopRows for each batch, and finally writeLoopFooter.
+	 * All batches must have the same labels in the same order as the table used for the header.
+	 * Rows [first, last) are formatted by several threads (RELION_STAR_WRITE_THREADS, or the
+	 * OpenMP maximum), and written in order. Unlike write(), this also writes empty tables.
+	 */
+	void writeLoopHeader(std::ostream& out) const;
+	void writeLoopRows(std::ostream& out, long first = 0, long last = -1) const;
+	static void writeLoopFooter(std::ostream& out);
+
 	// Write to a single file
 	void write(const FileName & fn_out) const;
 
+	// Copy a whole numeric column (double, int or bool) into 'values'.
+	// Returns false if the label is not present.
+	bool getNumericColumn(EMDLabel label, std::vector<RFLOAT> &values) const;
+
+	// Copy a whole string column into 'values'. Returns false if the label is not present.
+	bool getStringColumn(EMDLabel label, std::vector<std::string> &values) const;
+
+	// Make a new table with the same labels that contains the given rows, in that order
+	MetaDataTable selectRows(const std::vector<long> &rows) const;
+
 	// Make a histogram of a column
 	void columnHistogram(EMDLabel label, std::vector<RFLOAT> &histX, std::vector<RFLOAT> &histY, int verb = 0, CPlot2D *plot2D = NULL,
 	                     long int nr_bin = -1, RFLOAT hist_min = -LARGE_NUMBER, RFLOAT hist_max = LARGE_NUMBER,
@@ -373,6 +429,55 @@ private:
 	 *  Same as setObject, but assumes that all labels are present. */
 	void setObjectUnsafe(MetaDataContainer* data, long objId);
 
+	// Reorder all columns so that new row i is old row order[i]
+	void permuteRows(const std::vector<long> &order);
+
+	// Grow every column that currently has nr_old rows to nr_new rows of default values
+	void resizeColumns(long nr_old, long nr_new);
+
+	// The "# version" and "data_" lines that start each data block
+	void writeBlockStart(std::ostream& out) const;
+
+	// Append one formatted row of a loop, including the new line
+	void formatStarLoopRow(long idx, std::string &line) const;
+
+	// Offset of an unknown label in unknownColumns, or -1
+	long getUnknownLabelOffset(const std::string &unknownLabel) const;
+
+	/* Tokenize one data line of a STAR loop into the existing row 'row'.
+	 * Returns the number of values on the line, stopping at one more than the number of labels. */
+	int parseStarLoopLine(const std::string &line, long row);
+
+	// Typed access to a single cell by column offset
+	void getValueAt(long off, long row, double& dest) const { dest = doubleColumns[off][row]; }
+	void getValueAt(long off, long row, float& dest) const { dest = (float)doubleColumns[off][row]; }
+	void getValueAt(long off, long row, int& dest) const { dest = (int)intColumns[off][row]; }
+	void getValueAt(long off, long row, long& dest) const { dest = intColumns[off][row]; }
+	void getValueAt(long off, long row, bool& dest) const { dest = boolColumns[off][row]; }
+	void getValueAt(long off, long row, std::string& dest) const
+	{
+		const std::string &src = stringColumns[off][row];
+		dest = (src == "\"\"") ? "" : src;
+	}
+	void getValueAt(long off, long row, std::vector<double>& dest) const { dest = doubleVectorColumns[off][row]; }
+	void getValueAt(long off, long row, std::vector<float>& dest) const
+	{
+		const std::vector<double> &src = doubleVectorColumns[off][row];
+		dest.assign(src.begin(), src.end());
+	}
+
+	void setValueAt(long off, long row, const double& src) { doubleColumns[off][row] = src; }
+	void setValueAt(long off, long row, const float& src) { doubleColumns[off][row] = src; }
+	void setValueAt(long off, long row, const int& src) { intColumns[off][row] = src; }
+	void setValueAt(long off, long row, const long& src) { intColumns[off][row] = src; }
+	void setValueAt(long off, long row, const bool& src) { boolColumns[off][row] = src; }
+	void setValueAt(long off, long row, const std::string& src) { stringColumns[off][row] = (src.length() == 0) ? "\"\"" : src; }
+	void setValueAt(long off, long row, const std::vector<double>& src) { doubleVectorColumns[off][row] = src; }
+	void setValueAt(long off, long row, const std::vector<float>& src)
+	{
+		doubleVectorColumns[off][row].assign(src.begin(), src.end());
+	}
+
 };
 
 void compareMetaDataTable(MetaDataTable &MD1, MetaDataTable &MD2,
@@ -446,7 +551,7 @@ bool MetaDataTable::getValue(EMDLabel label, T& value, long objectID) const
 			checkObjectID(objectID,  "MetaDataTable::getValue");
 		}
 
-		objects[objectID]->getValue(off, value);
+		getValueAt(off, objectID, value);
 		return true;
 	}
 	else
@@ -492,7 +597,7 @@ bool MetaDataTable::setValue(EMDLabel label, const T &value, long int objectID)
 
 	if (off > -1)
 	{
-		objects[objectID]->setValue(off, value);
+		setValueAt(off, objectID, value);
 		return true;
 	}
 	else
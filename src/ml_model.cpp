@@ -1806,6 +1806,62 @@ void MlWsumModel::initZeros()
 #define MAX_PACK_SIZE 67101000
 #endif
 
+// Loop over the packed elements n of the BPref data and weight arrays (see MlWsumModel::getPackedRowLengths)
+#define FOR_ALL_PACKED_ELEMENTS(row_lengths, row_size) \
+	for (long int row = 0, n0 = 0; row < (row_lengths).size(); row++, n0 += (row_size)) \
+		for (long int n = n0; n < n0 + (row_lengths)[row]; n++)
+
+long int MlWsumModel::getMaxNonZeroR2()
+{
+	long int max_r2 = -1;
+	for (int iclass = 0; iclass < BPref.size(); iclass++)
+	{
+		const MultidimArray<Complex > &data = BPref[iclass].data;
+		const MultidimArray<RFLOAT> &weight = BPref[iclass].weight;
+		if (!data.sameShape(weight))
+			REPORT_ERROR("MlWsumModel::getMaxNonZeroR2 BUG: data and weight arrays have different shapes");
+
+		// Only the last non-zero element of each X-row matters
+		for (long int k = STARTINGZ(data); k <= FINISHINGZ(data); k++)
+		for (long int i = STARTINGY(data); i <= FINISHINGY(data); i++)
+		{
+			for (long int j = FINISHINGX(data); j >= STARTINGX(data); j--)
+			{
+				const Complex &c = A3D_ELEM(data, k, i, j);
+				if (c.real != 0. || c.imag != 0. || A3D_ELEM(weight, k, i, j) != 0.)
+				{
+					max_r2 = XMIPP_MAX(max_r2, k*k + i*i + j*j);
+					break;
+				}
+			}
+		}
+	}
+	return max_r2;
+}
+
+void MlWsumModel::getPackedRowLengths(std::vector<long int> &row_lengths, long int &row_size, unsigned long long &nr_packed)
+{
+	// The arrays are (pad_size x) pad_size x (pad_size/2+1), with their origin in the YZ-center and at the start of each row
+	long int pad_size = BPref[0].pad_size;
+	long int zdim = (BPref[0].ref_dim == 3) ? pad_size : 1;
+	row_size = pad_size / 2 + 1;
+	row_lengths.resize(zdim * pad_size);
+	nr_packed = 0;
+	for (long int kk = 0, row = 0; kk < zdim; kk++)
+	for (long int ii = 0; ii < pad_size; ii++, row++)
+	{
+		long int k = (zdim == 1) ? 0 : kk - zdim / 2;
+		long int i = ii - pad_size / 2;
+		if (pack_max_r2 < 0)
+			row_lengths[row] = row_size;
+		else if (k*k + i*i > pack_max_r2)
+			row_lengths[row] = 0;
+		else
+			row_lengths[row] = XMIPP_MIN(row_size, (long int)FLOOR(sqrt((RFLOAT)(pack_max_r2 - k*k - i*i))) + 1);
+		nr_packed += row_lengths[row];
+	}
+}
+
 void MlWsumModel::pack(MultidimArray<RFLOAT> &packed)
 {
 	unsigned long long packed_size = 0;
@@ -1823,8 +1879,12 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed)
 
 	// for all class-related stuff
 	// data is complex: multiply by two!
-	packed_size += nr_classes * nr_bodies * 2 * (unsigned long long)BPref[0].getSize();
-	packed_size += nr_classes * nr_bodies * (unsigned long long)BPref[0].getSize();
+	std::vector<long int> row_lengths;
+	long int row_size;
+	unsigned long long nr_packed;
+	getPackedRowLengths(row_lengths, row_size, nr_packed);
+	packed_size += nr_classes * nr_bodies * 2 * nr_packed;
+	packed_size += nr_classes * nr_bodies * nr_packed;
 	packed_size += nr_classes * nr_bodies * (unsigned long long)nr_directions;
 	// for pdf_class
 	packed_size += nr_classes;
@@ -1876,14 +1936,14 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed)
 	for (int iclass = 0; iclass < nr_classes * nr_bodies; iclass++)
 	{
 
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(BPref[iclass].data)
+		FOR_ALL_PACKED_ELEMENTS(row_lengths, row_size)
 		{
 			DIRECT_MULTIDIM_ELEM(packed, idx++) = (DIRECT_MULTIDIM_ELEM(BPref[iclass].data, n)).real;
 			DIRECT_MULTIDIM_ELEM(packed, idx++) = (DIRECT_MULTIDIM_ELEM(BPref[iclass].data, n)).imag;
 		}
 		BPref[iclass].data.clear();
 
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(BPref[iclass].weight)
+		FOR_ALL_PACKED_ELEMENTS(row_lengths, row_size)
 		{
 			DIRECT_MULTIDIM_ELEM(packed, idx++) = DIRECT_MULTIDIM_ELEM(BPref[iclass].weight, n);
 		}
@@ -1922,6 +1982,11 @@ void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed)
 	unsigned long long idx = 0;
 	int spectral_size = (ori_size / 2) + 1;
 
+	std::vector<long int> row_lengths;
+	long int row_size;
+	unsigned long long nr_packed;
+	getPackedRowLengths(row_lengths, row_size, nr_packed);
+
 	LL = DIRECT_MULTIDIM_ELEM(packed, idx++);
 	ave_Pmax = DIRECT_MULTIDIM_ELEM(packed, idx++);
 	sigma2_offset = DIRECT_MULTIDIM_ELEM(packed, idx++);
@@ -1958,13 +2023,17 @@ void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed)
 
 	for (int iclass = 0; iclass < nr_classes * nr_bodies; iclass++)
 	{
-		BPref[iclass].initialiseDataAndWeight(current_size);
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(BPref[iclass].data)
+		// Elements beyond pack_max_r2 were not packed: they are zero
+		if (pack_max_r2 < 0)
+			BPref[iclass].initialiseDataAndWeight(current_size);
+		else
+			BPref[iclass].initZeros(current_size);
+		FOR_ALL_PACKED_ELEMENTS(row_lengths, row_size)
 		{
 			(DIRECT_MULTIDIM_ELEM(BPref[iclass].data, n)).real = DIRECT_MULTIDIM_ELEM(packed, idx++);
 			(DIRECT_MULTIDIM_ELEM(BPref[iclass].data, n)).imag = DIRECT_MULTIDIM_ELEM(packed, idx++);
 		}
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(BPref[iclass].weight)
+		FOR_ALL_PACKED_ELEMENTS(row_lengths, row_size)
 		{
 			DIRECT_MULTIDIM_ELEM(BPref[iclass].weight, n) = DIRECT_MULTIDIM_ELEM(packed, idx++);
 		}
@@ -2018,8 +2087,12 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces
 	packed_size += 2 * nr_groups; // wsum_signal_product, wsum_reference_power
 	// for all class-related stuff
 	// data is complex: multiply by two!
-	packed_size += BPref.size() * 2 * (unsigned long long) BPref[0].getSize(); // BPref.data
-	packed_size += BPref.size() * (unsigned long long) BPref[0].getSize(); // BPref.weight
+	std::vector<long int> row_lengths;
+	long int row_size;
+	unsigned long long nr_packed;
+	getPackedRowLengths(row_lengths, row_size, nr_packed);
+	packed_size += BPref.size() * 2 * nr_packed; // BPref.data
+	packed_size += BPref.size() * nr_packed; // BPref.weight
 	packed_size += pdf_direction.size() * (unsigned long long) nr_directions; // pdf_directions
 	// for pdf_class
 	packed_size += nr_classes;
@@ -2122,7 +2195,7 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces
 
 	for (int iclass = 0; iclass < BPref.size(); iclass++)
 	{
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(BPref[iclass].data) {
+		FOR_ALL_PACKED_ELEMENTS(row_lengths, row_size) {
 			if (ori_idx >= idx_start && ori_idx < idx_stop)
 				DIRECT_MULTIDIM_ELEM(packed, idx++) = (DIRECT_MULTIDIM_ELEM(BPref[iclass].data, n)).real;
 			ori_idx++;
@@ -2134,7 +2207,7 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces
 		if (idx == ori_idx && do_clear)
 			BPref[iclass].data.clear();
 
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(BPref[iclass].weight) {
+		FOR_ALL_PACKED_ELEMENTS(row_lengths, row_size) {
 			if (ori_idx >= idx_start && ori_idx < idx_stop)
 				DIRECT_MULTIDIM_ELEM(packed, idx++) = DIRECT_MULTIDIM_ELEM(BPref[iclass].weight, n);
 			ori_idx++;
@@ -2206,6 +2279,11 @@ void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed, int piece, bool do_clear
 	}
 	unsigned long long ori_idx = 0;
 	unsigned long long idx = 0;
+
+	std::vector<long int> row_lengths;
+	long int row_size;
+	unsigned long long nr_packed;
+	getPackedRowLengths(row_lengths, row_size, nr_packed);
 #ifdef DEBUG_PACK
 	std::cerr << " UNPACK piece= " << piece << " idx_start= " << idx_start << " idx_stop= " << idx_stop << std::endl;
 #endif
@@ -2272,9 +2350,15 @@ void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed, int piece, bool do_clear
 	}
 
 	for (int iclass = 0; iclass < BPref.size(); iclass++) {
+		// Elements beyond pack_max_r2 were not packed: they are zero
 		if (idx == ori_idx)
-			BPref[iclass].initialiseDataAndWeight(current_size);
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(BPref[iclass].data) {
+		{
+			if (pack_max_r2 < 0)
+				BPref[iclass].initialiseDataAndWeight(current_size);
+			else
+				BPref[iclass].initZeros(current_size);
+		}
+		FOR_ALL_PACKED_ELEMENTS(row_lengths, row_size) {
 			if (ori_idx >= idx_start && ori_idx < idx_stop)
 				(DIRECT_MULTIDIM_ELEM(BPref[iclass].data, n)).real = DIRECT_MULTIDIM_ELEM(packed, idx++);
 			ori_idx++;
@@ -2285,7 +2369,7 @@ void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed, int piece, bool do_clear
 			//DIRECT_MULTIDIM_ELEM(BPref[iclass].data, n) = Complex(re, im);
 		}
 
-		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(BPref[iclass].weight) {
+		FOR_ALL_PACKED_ELEMENTS(row_lengths, row_size) {
 			if (ori_idx >= idx_start && ori_idx < idx_stop)
 				DIRECT_MULTIDIM_ELEM(BPref[iclass].weight, n) = DIRECT_MULTIDIM_ELEM(packed, idx++);
 			ori_idx++;
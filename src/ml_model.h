@@ -495,6 +495,10 @@ public:
 	// For each group store weighted sums of squared reference as a function of resolution
 	std::vector<RFLOAT > wsum_reference_power;
 
+	// Only pack the elements of the BPref data and weight arrays up to this squared radius (in padded Fourier pixels)
+	// All ranks that exchange packs must use the same value. Negative values pack the entire arrays.
+	long int pack_max_r2;
+
 	// Constructor
 	MlWsumModel()
 	{
@@ -516,6 +520,7 @@ public:
         sumw_ctf2.clear();
         wsum_signal_product.clear();
         wsum_reference_power.clear();
+		pack_max_r2 = -1;
 		MlModel::clear();
 	}
 
@@ -525,6 +530,10 @@ public:
 	// Initialize all weighted sums to zero (with resizing the BPrefs to current_size)
 	void initZeros();
 
+	// Largest squared radius (in padded Fourier pixels) of any non-zero element in the BPref data or weight arrays,
+	// or -1 if they are all zero. Use this to set pack_max_r2 for the shells that actually contain data.
+	long int getMaxNonZeroR2();
+
 	// Pack entire structure into one large MultidimArray<RFLOAT> for reading/writing to disc
 	// To save memory, the model itself will be cleared after packing.
 	void pack(MultidimArray<RFLOAT> &packed);
@@ -541,6 +550,10 @@ public:
 	// Fill the model again using unpack (this is the inverse operation from pack)
 	void unpack(MultidimArray<RFLOAT> &packed, int piece, bool do_clear=true);
 
+	// Number of packed elements at the start of each X-row (of row_size elements) of the BPref data and weight arrays,
+	// and the total number of packed elements per array (see pack_max_r2)
+	void getPackedRowLengths(std::vector<long int> &row_lengths, long int &row_size, unsigned long long &nr_packed);
+
 };
 
 #endif /* ML_MODEL_H_ */
@@ -39,10 +39,12 @@
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <exception>
 #include <omp.h>
 #include "src/macros.h"
 #include "src/error.h"
 #include "src/ml_optimiser.h"
+#include "src/image_prefetcher.h"
 #ifdef _CUDA_ENABLED
 #include "src/acc/cuda/cuda_ml_optimiser.h"
 #include <nvToolsExt.h>
@@ -103,7 +105,7 @@ void MlOptimiser::read(int argc, char **argv, int rank)
 	if (checkParameter(argc, argv, "--continue"))
 	{
 		// Do this before reading in the data.star file below!
-		do_preread_images   = checkParameter(argc, argv, "--preread_images");
+		do_preread_images   = checkParameter(argc, argv, "--preread_images") && !checkParameter(argc, argv, "--particle_cache");
 		do_parallel_disc_io = !checkParameter(argc, argv, "--no_parallel_disc_io");
 
 		parser.addSection("Continue options");
@@ -440,6 +442,7 @@ void MlOptimiser::parseContinue(int argc, char **argv)
 	x_pool = textToInteger(parser.getOption("--pool", "Number of images to pool for each thread task", "1"));
 	nr_threads = textToInteger(parser.getOption("--j", "Number of threads to run in parallel (only useful on multi-core machines)", "1"));
 	do_parallel_disc_io = !parser.checkOption("--no_parallel_disc_io", "Do NOT let parallel (MPI) processes access the disc simultaneously (use this option with NFS)");
+	nr_prefetch_pools = textToInteger(parser.getOption("--prefetch_pools", "Number of pools of particles whose images are read in the background while the current pool is processed (0: no prefetching; not used by MPI followers)", "1"));
 	combine_weights_thru_disc = !parser.checkOption("--dont_combine_weights_via_disc", "Send the large arrays of summed weights through the MPI network, instead of writing large files to disc");
 	do_shifts_onthefly = parser.checkOption("--onthefly_shifts", "Calculate shifted images on-the-fly, do not store precalculated ones in memory");
 	do_preread_images  = parser.checkOption("--preread_images", "Use this to let the leader process read all particles into memory. Be careful you have enough RAM for large data sets!");
@@ -447,11 +450,19 @@ void MlOptimiser::parseContinue(int argc, char **argv)
 	keep_free_scratch_Gb = textToFloat(parser.getOption("--keep_free_scratch", "Space available for copying particle stacks (in Gb)", "10"));
 	do_reuse_scratch = parser.checkOption("--reuse_scratch", "Re-use data on scratchdir, instead of wiping it and re-copying all data. This works only when ALL particles have already been cached.");
 	keep_scratch = parser.checkOption("--keep_scratch", "Don't remove scratch after convergence. Following jobs that use EXACTLY the same particles should use --reuse_scratch.");
+	fn_particle_cache = parser.getOption("--particle_cache", "If provided, all particles are packed into one memory-mapped file in this directory (preferably on a local SSD), which later jobs on the same particles re-use. This replaces --preread_images and --scratch_dir.", "");
+	if (fn_particle_cache != "")
+	{
+		do_preread_images = false;
+		fn_scratch = "";
+	}
 
 #ifdef ALTCPU
 	do_cpu = parser.checkOption("--cpu", "Use intel vectorisation implementation for CPU");
+	do_cpu_half_refs = parser.checkOption("--cpu_half_refs", "Store the references for --cpu in half precision. This halves their memory use, which allows more (or larger) classes, at a small loss of precision (relative errors of about 1e-4). Fastest on CPUs with AVX2 or AVX-512.");
 #else
         do_cpu = false;
+        do_cpu_half_refs = false;
 #endif
 
 	failsafe_threshold = textToInteger(parser.getOption("--failsafe_threshold", "Maximum number of particles permitted to be drop, due to zero sum of weights, before exiting with an error (GPU only).", "40"));
@@ -812,16 +823,25 @@ void MlOptimiser::parseInitial(int argc, char **argv)
 	combine_weights_thru_disc = !parser.checkOption("--dont_combine_weights_via_disc", "Send the large arrays of summed weights through the MPI network, instead of writing large files to disc");
 	do_shifts_onthefly = parser.checkOption("--onthefly_shifts", "Calculate shifted images on-the-fly, do not store precalculated ones in memory");
 	do_parallel_disc_io = !parser.checkOption("--no_parallel_disc_io", "Do NOT let parallel (MPI) processes access the disc simultaneously (use this option with NFS)");
+	nr_prefetch_pools = textToInteger(parser.getOption("--prefetch_pools", "Number of pools of particles whose images are read in the background while the current pool is processed (0: no prefetching; not used by MPI followers)", "1"));
 	do_preread_images  = parser.checkOption("--preread_images", "Use this to let the leader process read all particles into memory. Be careful you have enough RAM for large data sets!");
 	fn_scratch = parser.getOption("--scratch_dir", "If provided, particle stacks will be copied to this local scratch disk prior to refinement.", "");
 	keep_free_scratch_Gb = textToFloat(parser.getOption("--keep_free_scratch", "Space available for copying particle stacks (in Gb)", "10"));
 	do_reuse_scratch = parser.checkOption("--reuse_scratch", "Re-use data on scratchdir, instead of wiping it and re-copying all data.");
 	keep_scratch = parser.checkOption("--keep_scratch", "Don't remove scratch after convergence. Following jobs that use EXACTLY the same particles should use --reuse_scratch.");
+	fn_particle_cache = parser.getOption("--particle_cache", "If provided, all particles are packed into one memory-mapped file in this directory (preferably on a local SSD), which later jobs on the same particles re-use. This replaces --preread_images and --scratch_dir.", "");
+	if (fn_particle_cache != "")
+	{
+		do_preread_images = false;
+		fn_scratch = "";
+	}
 	do_fast_subsets = parser.checkOption("--fast_subsets", "Use faster optimisation by using subsets of the data in the first 15 iterations");
 #ifdef ALTCPU
 	do_cpu = parser.checkOption("--cpu", "Use intel vectorisation implementation for CPU");
+	do_cpu_half_refs = parser.checkOption("--cpu_half_refs", "Store the references for --cpu in half precision. This halves their memory use, which allows more (or larger) classes, at a small loss of precision (relative errors of about 1e-4). Fastest on CPUs with AVX2 or AVX-512.");
 #else
         do_cpu = false;
+        do_cpu_half_refs = false;
 #endif
 
 	do_gpu = parser.checkOption("--gpu", "Use available gpu resources for some calculations");
@@ -1496,7 +1516,7 @@ void MlOptimiser::initialise()
 
 	// And allow plans before expectation to run using allowed
 	// number of threads
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	initialiseGeneral();
@@ -2029,6 +2049,8 @@ void MlOptimiser::initialiseGeneral(int rank)
 		sampling.offset_range *= mymodel.pixel_size;
 		sampling.offset_step *= mymodel.pixel_size;
 	}
+	// Precalculate the oversampled orientations for all oversampling orders used in the expectation step
+	sampling.max_table_oversampling = adaptive_oversampling;
 	sampling.initialise(mymodel.ref_dim, (mymodel.data_dim == 3), do_gpu, (verb>0),
 			do_local_searches_helical, (do_helical_refine) && (!ignore_helical_symmetry),
 			helical_rise_initial, helical_twist_initial);
@@ -2280,6 +2302,10 @@ void MlOptimiser::initialiseWorkLoad()
 		}
 	}
 
+	// Or map the particle cache, which is built if this is the first job on these particles
+	if (fn_particle_cache != "")
+		mydata.openParticleCache(fn_particle_cache, true, keep_free_scratch_Gb, 1);
+
 }
 
 void MlOptimiser::initialiseSigma2Noise()
@@ -2492,7 +2518,7 @@ void MlOptimiser::calculateSumOfPowerSpectraAndAverageImage(MultidimArray<RFLOAT
 					DIRECT_MULTIDIM_ELEM(img(), n) = (RFLOAT)DIRECT_MULTIDIM_ELEM(mydata.particles[part_id].images[img_id].img, n);
 				}
 			}
-			else
+			else if (!mydata.getImageFromCache(part_id, img_id, img()))
 			{
 				if (!mydata.getImageNameOnScratch(part_id, img_id, fn_img))
 				{
@@ -2859,8 +2885,8 @@ void MlOptimiser::initialLowPassFilterReferences()
 
 void MlOptimiser::iterateSetup()
 {
-	// Set up the thread task distributors for the particles and the orientations (will be resized later on)
-	exp_ipart_ThreadTaskDistributor = new ThreadTaskDistributor(nr_threads, 1);
+	// Set up the thread task scheduler for the particles (tasks will be set later on)
+	exp_ipart_TaskScheduler = new WorkStealingTaskScheduler(nr_threads);
 
 	omp_init_lock(&global_mutex);
 	for (int i = 0; i < NR_CLASS_MUTEXES; i++)
@@ -2870,7 +2896,7 @@ void MlOptimiser::iterateWrapUp()
 {
 
 	// delete barrier, threads and task distributors
-	delete exp_ipart_ThreadTaskDistributor;
+	delete exp_ipart_TaskScheduler;
 
 	omp_destroy_lock(&global_mutex);
 	for (int i = 0; i < NR_CLASS_MUTEXES; i++)
@@ -3150,7 +3176,7 @@ void MlOptimiser::expectation()
 
 #ifdef MKLFFT
 	// Allow parallel FFTW execution
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	// Initialise some stuff
@@ -3274,6 +3300,10 @@ void MlOptimiser::expectation()
 		// Allocate Array of complex arrays for this class
 		if (posix_memalign((void **)&mdlClassComplex, MEM_ALIGN, nr_classes * sizeof (std::complex<XFLOAT> *)))
 			CRITICAL(RAMERR);
+		if (posix_memalign((void **)&mdlClassHalf, MEM_ALIGN, nr_classes * sizeof (float16 *)))
+			CRITICAL(RAMERR);
+		if (posix_memalign((void **)&mdlClassHalfScale, MEM_ALIGN, nr_classes * sizeof (XFLOAT)))
+			CRITICAL(RAMERR);
 
 		// Set up XFLOAT complex array shared by all threads for each class
 		for (int iclass = 0; iclass < nr_classes; iclass++)
@@ -3287,6 +3317,24 @@ void MlOptimiser::expectation()
 			else
 				mdlXYZ = (size_t)mdlX*(size_t)mdlY*(size_t)mdlZ;
 
+			mdlClassComplex[iclass] = NULL;
+			mdlClassHalf[iclass] = NULL;
+			mdlClassHalfScale[iclass] = 1.;
+			if (do_cpu_half_refs)
+			{
+				try
+				{
+					mdlClassHalf[iclass] = new float16[2 * mdlXYZ];
+				}
+				catch (std::bad_alloc& ba)
+				{
+					CRITICAL(RAMERR);
+				}
+
+				mdlClassHalfScale[iclass] = AccProjector::convertToHalf(mymodel.PPref[iclass].data.data, mdlXYZ, mdlClassHalf[iclass]);
+				continue;
+			}
+
 			try
 			{
 				mdlClassComplex[iclass] = new std::complex<XFLOAT>[mdlXYZ];
@@ -3318,7 +3366,7 @@ void MlOptimiser::expectation()
 
 #ifdef MKLFFT
 	// Single-threaded FFTW execution for code inside parallel processing loop
-	fftw_plan_with_nthreads(1);
+	FourierTransformer::setPlannerThreads(1);
 #endif
 
 	// Now perform real expectation over all particles
@@ -3353,6 +3401,25 @@ void MlOptimiser::expectation()
 		init_progress_bar(my_nr_particles);
 	}
 
+	// Read the images of the next pools in the background while the current pool is processed
+	// (images that are pre-read, in the particle cache, or sub-tomograms are not read in expectationSomeParticles)
+	// MPI followers get one pool at a time from the leader in MlOptimiserMpi::expectation, so they do not prefetch.
+	ImagePrefetcher image_prefetcher;
+	long int nr_particles_prefetched = 0;
+
+	// Make sure exp_image_prefetcher does not outlive image_prefetcher, also when an exception leaves this function
+	struct PrefetcherGuard
+	{
+		ImagePrefetcher *&ptr;
+		PrefetcherGuard(ImagePrefetcher *&_ptr) : ptr(_ptr) {}
+		~PrefetcherGuard() { ptr = NULL; }
+	} prefetcher_guard(exp_image_prefetcher);
+	if (exp_nr_prefetch_pools > 0 && do_parallel_disc_io && !do_preread_images && mymodel.data_dim != 3 && !mydata.particle_cache.isOpen())
+	{
+		image_prefetcher.start();
+		exp_image_prefetcher = &image_prefetcher;
+	}
+
 	// SHWS10052021: reduce frequency of abort check 10-fold
 	long int icheck= 0;
 	while (nr_particles_done < my_nr_particles)
@@ -3365,6 +3432,16 @@ void MlOptimiser::expectation()
 		long int my_pool_first_part_id = my_first_part_id + nr_particles_done;
 		long int my_pool_last_part_id = XMIPP_MIN(my_last_part_id, my_pool_first_part_id + nr_pool - 1);
 
+		// Keep this pool and the next exp_nr_prefetch_pools ones queued for reading
+		while (exp_image_prefetcher != NULL && nr_particles_prefetched < my_nr_particles &&
+		       my_first_part_id + nr_particles_prefetched <= my_pool_last_part_id + exp_nr_prefetch_pools * nr_pool)
+		{
+			long int my_prefetch_first_part_id = my_first_part_id + nr_particles_prefetched;
+			long int my_prefetch_last_part_id = XMIPP_MIN(my_last_part_id, my_prefetch_first_part_id + nr_pool - 1);
+			prefetchImageDataSubset(my_prefetch_first_part_id, my_prefetch_last_part_id);
+			nr_particles_prefetched += my_prefetch_last_part_id - my_prefetch_first_part_id + 1;
+		}
+
 		// Get the metadata for these particles
 		getMetaAndImageDataSubset(my_pool_first_part_id, my_pool_last_part_id, !do_parallel_disc_io);
 
@@ -3410,6 +3487,9 @@ void MlOptimiser::expectation()
 
 	}
 
+	image_prefetcher.stop();
+	exp_image_prefetcher = NULL;
+
 	if (verb > 0)
 		progress_bar(my_nr_particles);
 
@@ -3520,8 +3600,11 @@ void MlOptimiser::expectation()
 		for (int iclass = 0; iclass < nr_classes; iclass++)
 		{
 			delete [] mdlClassComplex[iclass];
+			delete [] mdlClassHalf[iclass];
 		}
 		free(mdlClassComplex);
+		free(mdlClassHalf);
+		free(mdlClassHalfScale);
 
 		tbbCpuOptimiser.clear();
 	}
@@ -3529,7 +3612,7 @@ void MlOptimiser::expectation()
 #ifdef  MKLFFT
 	// Allow parallel FFTW execution to continue now that we are outside the parallel
 	// portion of expectation
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	// Clean up some memory
@@ -3642,6 +3725,27 @@ void MlOptimiser::expectationSetupCheckMemory(int myverb)
 	}
 
 
+	// Bound the number of pools that are read ahead by the memory that is free now:
+	// the prefetched images may use at most a quarter of it
+	exp_nr_prefetch_pools = XMIPP_MAX(0, nr_prefetch_pools);
+	RFLOAT Gb_prefetch_pool = 0.;
+	if (exp_nr_prefetch_pools > 0)
+	{
+		int max_image_size = 0;
+		for (int optics_group = 0; optics_group < mydata.numberOfOpticsGroups(); optics_group++)
+			max_image_size = XMIPP_MAX(max_image_size, mydata.getOpticsImageSize(optics_group));
+		Gb_prefetch_pool = (RFLOAT)nr_pool * max_image_size * max_image_size * sizeof(RFLOAT) / (1024. * 1024. * 1024.);
+		RFLOAT free_Gb = (RFLOAT)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE) / (1024. * 1024. * 1024.);
+		int max_prefetch_pools = (int)(0.25 * free_Gb / Gb_prefetch_pool);
+		if (max_prefetch_pools < exp_nr_prefetch_pools)
+		{
+			if (myverb > 0)
+				std::cout << " WARNING: reading " << max_prefetch_pools << " instead of " << exp_nr_prefetch_pools
+				          << " pools of particles ahead, because there is only " << free_Gb << " Gb of free memory." << std::endl;
+			exp_nr_prefetch_pools = max_prefetch_pools;
+		}
+	}
+
 	if (myverb > 1)
 	{
 		// Check whether things will fit into memory
@@ -3670,6 +3774,9 @@ void MlOptimiser::expectationSetupCheckMemory(int myverb)
 			mem_rest += Gb * nr_pix * sampling.NrTranslationalSamplings(adaptive_oversampling);
 		}
 
+		// F. The images of the pools that are read ahead
+		mem_rest += exp_nr_prefetch_pools * Gb_prefetch_pool;
+
 		RFLOAT total_mem_Gb_exp = mem_references + nr_pool * mem_pool + mem_rest;
 		// Each reconstruction has to store 1 extra complex array (Fconv) and 4 extra RFLOAT arrays (Fweight, Fnewweight. vol_out and Mconv in convoluteBlobRealSpace),
 		// in adddition to the RFLOAT weight-array and the complex data-array of the BPref
@@ -3813,6 +3920,9 @@ void MlOptimiser::expectationSomeParticles(long int my_first_part_id, long int m
 	// Store total number of particle images in this bunch of SomeParticles, and set translations and orientations for skip_align/rotate
 	long int my_metadata_offset = 0;
 	exp_imgs.clear();
+
+	// The images of this pool may already have been read in the background
+	bool is_prefetched = (exp_image_prefetcher != NULL && exp_image_prefetcher->take(my_first_part_id, exp_imgs));
     int metadata_offset = 0;
     for (long int part_id_sorted = my_first_part_id; part_id_sorted <= my_last_part_id; part_id_sorted++)
 	{
@@ -3876,12 +3986,18 @@ void MlOptimiser::expectationSomeParticles(long int my_first_part_id, long int m
 
 		// Sjors 7 March 2016 to prevent too high disk access... Read in all pooled images simultaneously
 		// Don't do this for sub-tomograms to save RAM!
-		if (do_parallel_disc_io && !do_preread_images && mymodel.data_dim != 3)
+		if (do_parallel_disc_io && !do_preread_images && mymodel.data_dim != 3 && !is_prefetched)
 		{
 			// Read in the actual image from disc, only open/close common stacks once
 			// Read in all images, only open/close common stacks once
 			for (int img_id = 0; img_id < mydata.numberOfImagesInParticle(part_id); img_id++, my_metadata_offset++)
 			{
+				Image<RFLOAT> img;
+				if (mydata.getImageFromCache(part_id, img_id, img()))
+				{
+					exp_imgs.push_back(img());
+					continue;
+				}
 
 				// Get the filename
 				if (!mydata.getImageNameOnScratch(part_id, img_id, fn_img))
@@ -3900,7 +4016,6 @@ void MlOptimiser::expectationSomeParticles(long int my_first_part_id, long int m
 					hFile.openFile(fn_stack, WRITE_READONLY);
 					fn_open_stack = fn_stack;
 				}
-				Image<RFLOAT> img;
 #ifdef DEBUG_BODIES
 				std::cerr << " fn_img= " << fn_img << " part_id= " << part_id << std::endl;
 #endif
@@ -3922,8 +4037,7 @@ void MlOptimiser::expectationSomeParticles(long int my_first_part_id, long int m
 	{
 		// GPU and traditional CPU case - use RELION's built-in task manager to
 		// process multiple particles at once
-		exp_ipart_ThreadTaskDistributor->resize(my_last_part_id - my_first_part_id + 1, 1);
-		exp_ipart_ThreadTaskDistributor->reset();
+		exp_ipart_TaskScheduler->reset(my_last_part_id - my_first_part_id + 1);
 		#pragma omp parallel for num_threads(nr_threads)
 		for (int thread_id = 0; thread_id < nr_threads; thread_id++)
 			globalThreadExpectationSomeParticles(this, thread_id);
@@ -3979,7 +4093,7 @@ void MlOptimiser::doThreadExpectationSomeParticles(int thread_id)
 #endif
 
 	size_t first_ipart = 0, last_ipart = 0;
-	while (exp_ipart_ThreadTaskDistributor->getTasks(first_ipart, last_ipart))
+	while (exp_ipart_TaskScheduler->getTasks(thread_id, first_ipart, last_ipart))
 	{
 //#define DEBUG_EXPSOMETHR
 #ifdef DEBUG_EXPSOMETHR
@@ -4096,6 +4210,7 @@ void MlOptimiser::expectationOneParticle(long int part_id_sorted, int thread_id)
 		MultidimArray<bool> exp_Mcoarse_significant;
 		// And from storeWeightedSums
 		std::vector<RFLOAT> exp_sum_weight, exp_significant_weight, exp_max_weight;
+		std::vector<std::vector<std::pair<long int, RFLOAT> > > exp_significant_samples;
 		std::vector<Matrix1D<RFLOAT> > exp_old_offset, exp_prior;
 		std::vector<RFLOAT> exp_wsum_norm_correction;
 		std::vector<MultidimArray<RFLOAT> > exp_power_imgs;
@@ -4184,6 +4299,7 @@ void MlOptimiser::expectationOneParticle(long int part_id_sorted, int thread_id)
 
 		// Initialise significant weight to minus one, so that all coarse sampling points will be handled in the first pass
 		exp_significant_weight.resize(my_nr_images, -1.);
+		exp_significant_samples.resize(my_nr_images);
 
 		// Only perform a second pass when using adaptive oversampling
 		int nr_sampling_passes = (adaptive_oversampling > 0) ? 2 : 1;
@@ -4233,7 +4349,7 @@ void MlOptimiser::expectationOneParticle(long int part_id_sorted, int thread_id)
 			convertAllSquaredDifferencesToWeights(part_id, ibody, exp_ipass, exp_current_oversampling, metadata_offset,
 					exp_idir_min, exp_idir_max, exp_ipsi_min, exp_ipsi_max,
 					exp_itrans_min, exp_itrans_max, exp_iclass_min, exp_iclass_max,
-					exp_Mweight, exp_Mcoarse_significant, exp_significant_weight,
+					exp_Mweight, exp_Mcoarse_significant, exp_significant_weight, exp_significant_samples,
 					exp_sum_weight, exp_old_offset, exp_prior, exp_min_diff2,
 					exp_pointer_dir_nonzeroprior, exp_pointer_psi_nonzeroprior, exp_directions_prior, exp_psi_prior);
 
@@ -4304,6 +4420,10 @@ void MlOptimiser::expectationOneParticle(long int part_id_sorted, int thread_id)
 		}
 		fclose(stdout);
 //      	exit(0);
+#endif
+#ifndef RELION_TESTING
+		// From here on, only the significant weights in exp_significant_samples are needed
+		exp_Mweight.clear();
 #endif
 		// For the reconstruction step use mymodel.current_size!
 		// as of 3.1 no longer needed?? CHECK!! exp_current_image_size = mymodel.current_size;
@@ -4322,8 +4442,8 @@ void MlOptimiser::expectationOneParticle(long int part_id_sorted, int thread_id)
 				exp_idir_min, exp_idir_max, exp_ipsi_min, exp_ipsi_max,
 				exp_itrans_min, exp_itrans_max, exp_iclass_min, exp_iclass_max,
 				exp_min_diff2, exp_highres_Xi2_img, exp_Fimg, exp_Fimg_nomask, exp_Fctf,
-				exp_power_imgs, exp_old_offset, exp_prior, exp_Mweight, exp_Mcoarse_significant,
-				exp_significant_weight, exp_sum_weight, exp_max_weight,
+				exp_power_imgs, exp_old_offset, exp_prior, exp_Mcoarse_significant,
+				exp_significant_weight, exp_significant_samples, exp_sum_weight, exp_max_weight,
 				exp_pointer_dir_nonzeroprior, exp_pointer_psi_nonzeroprior, exp_directions_prior, exp_psi_prior,
 				exp_local_Fimgs_shifted, exp_local_Fimgs_shifted_nomask, exp_local_Minvsigma2, exp_local_Fctf,
 				exp_local_sqrtXi2, exp_STMulti);
@@ -4401,7 +4521,8 @@ void MlOptimiser::symmetriseReconstructions()
 					wsum_model.BPref[ith_recons].applyHelicalSymmetry(
 							mymodel.helical_nr_asu,
 							mymodel.helical_twist[ith_recons],
-							mymodel.helical_rise[ith_recons] / mymodel.pixel_size);
+							mymodel.helical_rise[ith_recons] / mymodel.pixel_size,
+							nr_threads);
 
 				if (fn_multi_sym.size() > ith_recons) // Always false if size=0
 				{
@@ -4411,7 +4532,7 @@ void MlOptimiser::symmetriseReconstructions()
 				}
 
 
-				wsum_model.BPref[ith_recons].applyPointGroupSymmetry();
+				wsum_model.BPref[ith_recons].applyPointGroupSymmetry(nr_threads);
 
 
 				if (grad_pseudo_halfsets)
@@ -4425,7 +4546,8 @@ void MlOptimiser::symmetriseReconstructions()
 						wsum_model.BPref[iclass_half].applyHelicalSymmetry(
 								mymodel.helical_nr_asu,
 								mymodel.helical_twist[ith_recons],
-								mymodel.helical_rise[ith_recons] / mymodel.pixel_size);
+								mymodel.helical_rise[ith_recons] / mymodel.pixel_size,
+								nr_threads);
 
 					if (fn_multi_sym.size() > ith_recons) // Always false if size=0
 					{
@@ -4434,7 +4556,7 @@ void MlOptimiser::symmetriseReconstructions()
 					}
 
 
-					wsum_model.BPref[iclass_half].applyPointGroupSymmetry();
+					wsum_model.BPref[iclass_half].applyPointGroupSymmetry(nr_threads);
 
 				}
 
@@ -4580,79 +4702,65 @@ void MlOptimiser::maximization()
 
     // First reconstruct the images for each class
 	// multi-body refinement will never get here, as it is only 3D auto-refine and that requires MPI!
-	for (int iclass = 0; iclass < mymodel.nr_classes * mymodel.nr_bodies; iclass++)
+	RCTIC(timer,RCT_1);
+	int nr_reconstructions = mymodel.nr_classes * mymodel.nr_bodies;
+
+	// Reconstruct different classes on different threads
+	int nr_parallel = getNrParallelReconstructions(nr_reconstructions);
+
+	if (nr_parallel > 1)
 	{
-		if (iclass == skip_class)
-			continue;
-		RCTIC(timer,RCT_1);
-		if (mymodel.pdf_class[iclass] > 0. || mymodel.nr_bodies > 1 )
+		WorkStealingTaskScheduler scheduler(nr_parallel);
+		scheduler.reset(nr_reconstructions);
+		int nr_done = 0;
+		std::exception_ptr reconstructException;
+#ifdef MKLFFT
+		// Single-threaded FFTW execution inside the parallel reconstructions
+		FourierTransformer::setPlannerThreads(1);
+#endif
+		#pragma omp parallel num_threads(nr_parallel)
 		{
-			if ((wsum_model.BPref[iclass].weight).sum() > XMIPP_EQUAL_ACCURACY)
+			size_t iclass;
+			while (scheduler.getTask(omp_get_thread_num(), iclass))
 			{
-				(wsum_model.BPref[iclass]).updateSSNRarrays(mymodel.tau2_fudge_factor,
-						mymodel.tau2_class[iclass],
-						mymodel.sigma2_class[iclass],
-						mymodel.data_vs_prior_class[iclass],
-						mymodel.fourier_coverage_class[iclass],
-						mymodel.fsc_halves_class[0],
-                        avgctf2,
-						false,
-						false,
-                        do_correct_tau2_by_avgctf2);
-
-				if (do_external_reconstruct)
+				try
 				{
-					FileName fn_ext_root;
-					if (iter > -1) fn_ext_root.compose(fn_out+"_it", iter, "", 3);
-					else fn_ext_root = fn_out;
-					fn_ext_root.compose(fn_ext_root+"_class", iclass+1, "", 3);
-					(wsum_model.BPref[iclass]).externalReconstruct(mymodel.Iref[iclass],
-							fn_ext_root,
-							mymodel.fsc_halves_class[iclass],
-							mymodel.tau2_class[iclass],
-							mymodel.sigma2_class[iclass],
-							mymodel.data_vs_prior_class[iclass],
-							mymodel.pixel_size,
-							particle_diameter,
-							(do_join_random_halves || do_always_join_random_halves),
-							mymodel.tau2_fudge_factor,
-							1); // verbose
+					maximizationReconstructClass(iclass, skip_class, avgctf2, do_correct_tau2_by_avgctf2);
 				}
-				else
+				catch (...)
 				{
-					if(do_grad) {
-						(wsum_model.BPref[iclass]).reconstructGrad(
-								mymodel.Iref[iclass],
-								mymodel.fsc_halves_class[iclass],
-								grad_current_stepsize * (1-std::exp(-(3*mymodel.nr_classes+10)*mymodel.pdf_class[iclass])),
-								mymodel.tau2_fudge_factor,
-								mymodel.getPixelFromResolution(1./grad_min_resol),
-								do_split_random_halves,
-								(iclass == 0));
-					}
-					else
-						(wsum_model.BPref[iclass]).reconstruct(mymodel.Iref[iclass],
-								gradient_refine ? 0: gridding_nr_iter,
-								do_map,
-								mymodel.tau2_class[iclass],
-								mymodel.tau2_fudge_factor,
-								wsum_model.pdf_class[iclass],
-								minres_map,
-								(iclass==0));
+					// Nothing may escape the parallel region: keep the first exception and rethrow it after the region
+					#pragma omp critical(MlOptimiser_maximization)
+					if (!reconstructException)
+						reconstructException = std::current_exception();
+				}
+
+				#pragma omp critical(MlOptimiser_maximization)
+				{
+					nr_done++;
+					if (verb > 0)
+						progress_bar(nr_done);
 				}
 			}
 		}
-		else
-		{
-			// When not doing SGD, initialise to zero, but when doing SGD just keep the previous reference
-			if (!do_grad)
-				mymodel.Iref[iclass].initZeros();
 
+#ifdef MKLFFT
+		FourierTransformer::setPlannerThreads(nr_threads);
+#endif
+
+		if (reconstructException)
+			std::rethrow_exception(reconstructException);
+	}
+	else
+	{
+		for (int iclass = 0; iclass < nr_reconstructions; iclass++)
+		{
+			maximizationReconstructClass(iclass, skip_class, avgctf2, do_correct_tau2_by_avgctf2);
+			if (verb > 0)
+				progress_bar(iclass);
 		}
-		RCTOC(timer,RCT_1);
-		if (verb > 0)
-			progress_bar(iclass);
 	}
+	RCTOC(timer,RCT_1);
 
 	RCTIC(timer,RCT_3);
 	// Then perform the update of all other model parameters
@@ -4669,6 +4777,89 @@ void MlOptimiser::maximization()
 //		std::cerr << " Class " << skip_class << " replaced due to inactivity." << std::endl;
 }
 
+int MlOptimiser::getNrParallelReconstructions(int nr_reconstructions, int nr_processes_on_node)
+{
+	// External reconstructions are run one at a time
+	int nr_parallel = XMIPP_MIN(nr_threads, nr_reconstructions);
+	if (do_external_reconstruct || nr_parallel <= 1)
+		return 1;
+
+	RFLOAT Gb_reconstruct = 4. * MULTIDIM_SIZE(wsum_model.BPref[0].data) * sizeof(Complex) / (1024. * 1024. * 1024.);
+	RFLOAT free_Gb = (RFLOAT)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE) / (1024. * 1024. * 1024.);
+	return XMIPP_MAX(1, XMIPP_MIN(nr_parallel, (int)(0.5 * free_Gb / (nr_processes_on_node * Gb_reconstruct))));
+}
+
+void MlOptimiser::maximizationReconstructClass(int iclass, int skip_class, const MultidimArray<RFLOAT> &avgctf2, bool do_correct_tau2_by_avgctf2)
+{
+	if (iclass == skip_class)
+		return;
+
+	if (mymodel.pdf_class[iclass] > 0. || mymodel.nr_bodies > 1 )
+	{
+		if ((wsum_model.BPref[iclass].weight).sum() > XMIPP_EQUAL_ACCURACY)
+		{
+			(wsum_model.BPref[iclass]).updateSSNRarrays(mymodel.tau2_fudge_factor,
+					mymodel.tau2_class[iclass],
+					mymodel.sigma2_class[iclass],
+					mymodel.data_vs_prior_class[iclass],
+					mymodel.fourier_coverage_class[iclass],
+					mymodel.fsc_halves_class[0],
+					avgctf2,
+					false,
+					false,
+					do_correct_tau2_by_avgctf2);
+
+			if (do_external_reconstruct)
+			{
+				FileName fn_ext_root;
+				if (iter > -1) fn_ext_root.compose(fn_out+"_it", iter, "", 3);
+				else fn_ext_root = fn_out;
+				fn_ext_root.compose(fn_ext_root+"_class", iclass+1, "", 3);
+				(wsum_model.BPref[iclass]).externalReconstruct(mymodel.Iref[iclass],
+						fn_ext_root,
+						mymodel.fsc_halves_class[iclass],
+						mymodel.tau2_class[iclass],
+						mymodel.sigma2_class[iclass],
+						mymodel.data_vs_prior_class[iclass],
+						mymodel.pixel_size,
+						particle_diameter,
+						(do_join_random_halves || do_always_join_random_halves),
+						mymodel.tau2_fudge_factor,
+						1); // verbose
+			}
+			else
+			{
+				if(do_grad) {
+					(wsum_model.BPref[iclass]).reconstructGrad(
+							mymodel.Iref[iclass],
+							mymodel.fsc_halves_class[iclass],
+							grad_current_stepsize * (1-std::exp(-(3*mymodel.nr_classes+10)*mymodel.pdf_class[iclass])),
+							mymodel.tau2_fudge_factor,
+							mymodel.getPixelFromResolution(1./grad_min_resol),
+							do_split_random_halves,
+							(iclass == 0));
+				}
+				else
+					(wsum_model.BPref[iclass]).reconstruct(mymodel.Iref[iclass],
+							gradient_refine ? 0: gridding_nr_iter,
+							do_map,
+							mymodel.tau2_class[iclass],
+							mymodel.tau2_fudge_factor,
+							wsum_model.pdf_class[iclass],
+							minres_map,
+							(iclass==0));
+			}
+		}
+	}
+	else
+	{
+		// When not doing SGD, initialise to zero, but when doing SGD just keep the previous reference
+		if (!do_grad)
+			mymodel.Iref[iclass].initZeros();
+
+	}
+}
+
 void MlOptimiser::centerClasses()
 {
 	// Don't do this for auto_refinement or multibody refinement
@@ -5703,15 +5894,18 @@ void MlOptimiser::getFourierTransformsAndCtfs(
 				{
 
 					// Read sub-tomograms from disc in parallel (to save RAM in exp_imgs)
-					FileName fn_img;
-					if (!mydata.getImageNameOnScratch(part_id, img_id, fn_img))
+					if (!mydata.getImageFromCache(part_id, img_id, img()))
 					{
-						std::istringstream split(exp_fn_img);
-						for (int i = 0; i <= my_metadata_offset; i++)
-							getline(split, fn_img);
+						FileName fn_img;
+						if (!mydata.getImageNameOnScratch(part_id, img_id, fn_img))
+						{
+							std::istringstream split(exp_fn_img);
+							for (int i = 0; i <= my_metadata_offset; i++)
+								getline(split, fn_img);
+						}
+						img.read(fn_img);
+						img().setXmippOrigin();
 					}
-					img.read(fn_img);
-					img().setXmippOrigin();
 				}
 				else
 				{
@@ -6759,6 +6953,7 @@ void MlOptimiser::getAllSquaredDifferences(long int part_id, int ibody,
 		{
 			// Local variables
 			std::vector< RFLOAT > oversampled_rot, oversampled_tilt, oversampled_psi;
+			std::vector< Matrix2D<RFLOAT> > oversampled_A;
 			std::vector< RFLOAT > oversampled_translations_x, oversampled_translations_y, oversampled_translations_z;
 			MultidimArray<Complex > Fimg, Fref, Frefctf, Fimg_otfshift;
 			RFLOAT *Minvsigma2;
@@ -6822,7 +7017,7 @@ void MlOptimiser::getAllSquaredDifferences(long int part_id, int ibody,
 						// Now get the oversampled (rot, tilt, psi) triplets
 						// This will be only the original (rot,tilt,psi) triplet in the first pass (exp_current_oversampling==0)
 						sampling.getOrientations(idir, ipsi, exp_current_oversampling, oversampled_rot, oversampled_tilt, oversampled_psi,
-								exp_pointer_dir_nonzeroprior, exp_directions_prior, exp_pointer_psi_nonzeroprior, exp_psi_prior);
+								exp_pointer_dir_nonzeroprior, exp_directions_prior, exp_pointer_psi_nonzeroprior, exp_psi_prior, &oversampled_A);
 						// Loop over all oversampled orientations (only a single one in the first pass)
 						for (long int iover_rot = 0; iover_rot < exp_nr_oversampled_rot; iover_rot++)
 						{
@@ -6836,9 +7031,7 @@ void MlOptimiser::getAllSquaredDifferences(long int part_id, int ibody,
 								int optics_group = mydata.getOpticsGroup(part_id, img_id);
 
 								// Get the Euler matrix
-								Euler_angles2matrix(oversampled_rot[iover_rot],
-										oversampled_tilt[iover_rot],
-										oversampled_psi[iover_rot], A, false);
+								A = oversampled_A[iover_rot];
 
 								// Project the reference map (into Fref)
 #ifdef TIMING
@@ -7281,7 +7474,9 @@ void MlOptimiser::convertAllSquaredDifferencesToWeights(long int part_id, int ib
 		int exp_idir_min, int exp_idir_max, int exp_ipsi_min, int exp_ipsi_max,
 		int exp_itrans_min, int exp_itrans_max, int exp_iclass_min, int exp_iclass_max,
 		MultidimArray<RFLOAT> &exp_Mweight, MultidimArray<bool> &exp_Mcoarse_significant,
-		std::vector<RFLOAT> &exp_significant_weight, std::vector<RFLOAT> &exp_sum_weight,
+		std::vector<RFLOAT> &exp_significant_weight,
+		std::vector<std::vector<std::pair<long int, RFLOAT> > > &exp_significant_samples,
+		std::vector<RFLOAT> &exp_sum_weight,
 		std::vector<Matrix1D<RFLOAT> > &exp_old_offset, std::vector<Matrix1D<RFLOAT> > &exp_prior, std::vector<RFLOAT> &exp_min_diff2,
 		std::vector<int> &exp_pointer_dir_nonzeroprior, std::vector<int> &exp_pointer_psi_nonzeroprior,
 		std::vector<RFLOAT> &exp_directions_prior, std::vector<RFLOAT> &exp_psi_prior)
@@ -7794,6 +7989,16 @@ void MlOptimiser::convertAllSquaredDifferencesToWeights(long int part_id, int ib
 		}
 		exp_significant_weight[img_id] = my_significant_weight;
 
+		// Store the significant weights as a list of (ihidden_over, weight), so that storeWeightedSums
+		// only visits those, and exp_Mweight can be freed before it is called
+		exp_significant_samples[img_id].clear();
+		for (long int ihidden_over = 0; ihidden_over < XSIZE(exp_Mweight); ihidden_over++)
+		{
+			RFLOAT weight = DIRECT_A2D_ELEM(exp_Mweight, img_id, ihidden_over);
+			if (weight >= my_significant_weight)
+				exp_significant_samples[img_id].push_back(std::make_pair(ihidden_over, weight));
+		}
+
 	} // end loop img_id
 
 #ifdef TIMING
@@ -7818,9 +8023,9 @@ void MlOptimiser::storeWeightedSums(long int part_id, int ibody,
 		std::vector<MultidimArray<RFLOAT> > &exp_power_img,
 		std::vector<Matrix1D<RFLOAT> > &exp_old_offset,
 		std::vector<Matrix1D<RFLOAT> > &exp_prior,
-		MultidimArray<RFLOAT> &exp_Mweight,
 		MultidimArray<bool> &exp_Mcoarse_significant,
 		std::vector<RFLOAT> &exp_significant_weight,
+		std::vector<std::vector<std::pair<long int, RFLOAT> > > &exp_significant_samples,
 		std::vector<RFLOAT> &exp_sum_weight,
 		std::vector<RFLOAT> &exp_max_weight,
 		std::vector<int> &exp_pointer_dir_nonzeroprior, std::vector<int> &exp_pointer_psi_nonzeroprior,
@@ -7907,6 +8112,7 @@ void MlOptimiser::storeWeightedSums(long int part_id, int ibody,
 	}
 
 	std::vector< RFLOAT> oversampled_rot, oversampled_tilt, oversampled_psi;
+	std::vector< Matrix2D<RFLOAT> > oversampled_A;
 	std::vector<RFLOAT> oversampled_translations_x, oversampled_translations_y, oversampled_translations_z;
 	Matrix2D<RFLOAT> A, Abody, Aori;
 	MultidimArray<Complex > Fimg, Fref, Frefctf, Fimg_otfshift, Fimg_otfshift_nomask, Fimg_store_grad;
@@ -7964,6 +8170,9 @@ void MlOptimiser::storeWeightedSums(long int part_id, int ibody,
 	// wsum_sigma2_offset is just a RFLOAT
 	thr_wsum_sigma2_offset = 0.;
 
+	// Position of each image in its list of significant sampling points
+	std::vector<long int> first_sample(exp_nr_images, 0);
+
 	// Loop from iclass_min to iclass_max to deal with seed generation in first iteration
 	for (int exp_iclass = exp_iclass_min; exp_iclass <= exp_iclass_max; exp_iclass++)
 	{
@@ -7980,7 +8189,7 @@ void MlOptimiser::storeWeightedSums(long int part_id, int ibody,
 					// Now get the oversampled (rot, tilt, psi) triplets
 					// This will be only the original (rot,tilt,psi) triplet if (adaptive_oversampling==0)
 					sampling.getOrientations(idir, ipsi, adaptive_oversampling, oversampled_rot, oversampled_tilt, oversampled_psi,
-							exp_pointer_dir_nonzeroprior, exp_directions_prior, exp_pointer_psi_nonzeroprior, exp_psi_prior);
+							exp_pointer_dir_nonzeroprior, exp_directions_prior, exp_pointer_psi_nonzeroprior, exp_psi_prior, &oversampled_A);
 
 					// The order of the looping here has changed for 3.1: different img_id have different optics_group and therefore different applyAnisoMag....
 					for (int img_id = 0; img_id < exp_nr_images; img_id++)
@@ -7991,14 +8200,35 @@ void MlOptimiser::storeWeightedSums(long int part_id, int ibody,
 						RFLOAT my_pixel_size = mydata.getImagePixelSize(part_id, img_id);
 						bool ctf_premultiplied = mydata.obsModel.getCtfPremultiplied(optics_group);
 
+						// Find the significant sampling points of this image for this orientation.
+						// They are sorted on ihidden_over, and iorientclass only increases in these loops.
+						long int ihidden_over_min = iorientclass * exp_nr_trans * exp_nr_oversampled_trans * exp_nr_oversampled_rot;
+						long int ihidden_over_max = ihidden_over_min + (exp_itrans_max - exp_itrans_min + 1) * exp_nr_oversampled_trans * exp_nr_oversampled_rot;
+						long int my_nr_samples = exp_significant_samples[img_id].size();
+						long int &my_first_sample = first_sample[img_id];
+						while (my_first_sample < my_nr_samples && exp_significant_samples[img_id][my_first_sample].first < ihidden_over_min)
+							my_first_sample++;
+						long int my_last_sample = my_first_sample;
+						while (my_last_sample < my_nr_samples && exp_significant_samples[img_id][my_last_sample].first < ihidden_over_max)
+							my_last_sample++;
+						if (my_last_sample == my_first_sample)
+							continue;
+
 						// Loop over all oversampled orientations (only a single one in the first pass)
 						for (long int iover_rot = 0; iover_rot < exp_nr_oversampled_rot; iover_rot++)
 						{
+							// Don't project and back-project oversampled orientations without any significant translation
+							bool is_significant = false;
+							for (long int iw = my_first_sample; iw < my_last_sample && !is_significant; iw++)
+								is_significant = ((exp_significant_samples[img_id][iw].first / exp_nr_oversampled_trans) % exp_nr_oversampled_rot == iover_rot);
+							if (!is_significant)
+								continue;
+
 							rot = oversampled_rot[iover_rot];
 							tilt = oversampled_tilt[iover_rot];
 							psi = oversampled_psi[iover_rot];
 							// Get the Euler matrix
-							Euler_angles2matrix(rot, tilt, psi, A, false);
+							A = oversampled_A[iover_rot];
 
 
 							// For multi-body refinements, A are only 'residual' orientations, Abody is the complete Euler matrix
@@ -8117,398 +8347,399 @@ void MlOptimiser::storeWeightedSums(long int part_id, int ibody,
 								}
 							} // end if !do_skip_maximization
 
-							long int ihidden = iorientclass * exp_nr_trans;
-							for (long int itrans = exp_itrans_min, iitrans = 0; itrans <= exp_itrans_max; itrans++, ihidden++)
+							// Only visit the significant sampling points, as listed by convertAllSquaredDifferencesToWeights
+							long int prev_itrans = -1;
+							for (long int iw = my_first_sample; iw < my_last_sample; iw++)
 							{
-								// Jun01,2015 - Shaoda & Sjors, Helical refinement
-								sampling.getTranslationsInPixel(itrans, exp_current_oversampling, my_pixel_size, oversampled_translations_x, oversampled_translations_y, oversampled_translations_z,
-										(do_helical_refine) && (!ignore_helical_symmetry));
-								for (long int iover_trans = 0; iover_trans < exp_nr_oversampled_trans; iover_trans++, iitrans++)
+								long int ihidden_over = exp_significant_samples[img_id][iw].first;
+								if ((ihidden_over / exp_nr_oversampled_trans) % exp_nr_oversampled_rot != iover_rot)
+									continue;
+								long int iover_trans = ihidden_over % exp_nr_oversampled_trans;
+								long int itrans = exp_itrans_min + ihidden_over / (exp_nr_oversampled_trans * exp_nr_oversampled_rot) - iorientclass * exp_nr_trans;
+								long int iitrans = (itrans - exp_itrans_min) * exp_nr_oversampled_trans + iover_trans;
+								if (itrans != prev_itrans)
 								{
-									// Only deal with this sampling point if its weight was significant
-									long int ihidden_over = ihidden * exp_nr_oversampled_trans * exp_nr_oversampled_rot +
-											iover_rot * exp_nr_oversampled_trans + iover_trans;
-									RFLOAT weight = DIRECT_A2D_ELEM(exp_Mweight, img_id, ihidden_over);
-									// Only sum weights for non-zero weights
-									if (weight >= exp_significant_weight[img_id])
-									{
-										// Normalise the weight (do this after the comparison with exp_significant_weight!)
-										weight /= exp_sum_weight[img_id];
+									// Jun01,2015 - Shaoda & Sjors, Helical refinement
+									sampling.getTranslationsInPixel(itrans, exp_current_oversampling, my_pixel_size, oversampled_translations_x, oversampled_translations_y, oversampled_translations_z,
+											(do_helical_refine) && (!ignore_helical_symmetry));
+									prev_itrans = itrans;
+								}
+								// Normalise the weight (the list holds the unnormalised ones, as in exp_Mweight)
+								RFLOAT weight = exp_significant_samples[img_id][iw].second;
+								weight /= exp_sum_weight[img_id];
 
-										if (!do_skip_maximization)
-										{
+								if (!do_skip_maximization)
+								{
 
 #ifdef TIMING
-											// Only time one thread, as I also only time one MPI process
-											if (part_id == mydata.sorted_idx[exp_my_first_part_id])
-												timer.tic(TIMING_WSUM_GETSHIFT);
+									// Only time one thread, as I also only time one MPI process
+									if (part_id == mydata.sorted_idx[exp_my_first_part_id])
+										timer.tic(TIMING_WSUM_GETSHIFT);
 #endif
 
-											/// Now get the shifted image
-											// Use a pointer to avoid copying the entire array again in this highly expensive loop
-											Complex *Fimg_shift, *Fimg_shift_nomask;
-											if (!do_shifts_onthefly)
-											{
-												long int ishift = img_id * exp_nr_oversampled_trans * exp_nr_trans + iitrans;
-												Fimg_shift = exp_local_Fimgs_shifted[img_id][ishift].data;
-												Fimg_shift_nomask = exp_local_Fimgs_shifted_nomask[img_id][ishift].data;
-											}
-											else
-											{
-												// Feb01,2017 - Shaoda, on-the-fly shifts in helical reconstuctions (2D and 3D)
-												if ( (do_helical_refine) && (!ignore_helical_symmetry) )
-												{
-													RFLOAT xshift = 0., yshift = 0., zshift = 0.;
-
-													xshift = oversampled_translations_x[iover_trans];
-													yshift = oversampled_translations_y[iover_trans];
-													if (mymodel.data_dim == 3)
-														zshift = oversampled_translations_z[iover_trans];
-
-													RFLOAT rot_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_ROT);
-													RFLOAT tilt_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_TILT);
-													RFLOAT psi_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_PSI);
-													transformCartesianAndHelicalCoords(
-																xshift, yshift, zshift,
-																xshift, yshift, zshift,
-																rot_deg, tilt_deg, psi_deg,
-																mymodel.data_dim,
-																HELICAL_TO_CART_COORDS);
+									/// Now get the shifted image
+									// Use a pointer to avoid copying the entire array again in this highly expensive loop
+									Complex *Fimg_shift, *Fimg_shift_nomask;
+									if (!do_shifts_onthefly)
+									{
+										long int ishift = img_id * exp_nr_oversampled_trans * exp_nr_trans + iitrans;
+										Fimg_shift = exp_local_Fimgs_shifted[img_id][ishift].data;
+										Fimg_shift_nomask = exp_local_Fimgs_shifted_nomask[img_id][ishift].data;
+									}
+									else
+									{
+										// Feb01,2017 - Shaoda, on-the-fly shifts in helical reconstuctions (2D and 3D)
+										if ( (do_helical_refine) && (!ignore_helical_symmetry) )
+										{
+											RFLOAT xshift = 0., yshift = 0., zshift = 0.;
 
-													// Fimg_shift
-													shiftImageInFourierTransformWithTabSincos(
-															exp_local_Fimgs_shifted[img_id][0],
-															Fimg_otfshift,
-															(RFLOAT)image_full_size[optics_group],
-															image_current_size[optics_group],
-															tab_sin, tab_cos,
-															xshift, yshift, zshift);
-													// Fimg_shift_nomask
-													shiftImageInFourierTransformWithTabSincos(
-															exp_local_Fimgs_shifted_nomask[img_id][0],
-															Fimg_otfshift_nomask,
-															(RFLOAT)image_full_size[optics_group],
-															image_current_size[optics_group],
-															tab_sin, tab_cos,
-															xshift, yshift, zshift);
-												}
-												else
-												{
-													Complex* myAB;
-													myAB = (adaptive_oversampling == 0 ) ? global_fftshifts_ab_current[optics_group][iitrans].data : global_fftshifts_ab2_current[optics_group][iitrans].data;
-													FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(exp_local_Fimgs_shifted[img_id][0])
-													{
-														RFLOAT a = (*(myAB + n)).real;
-														RFLOAT b = (*(myAB + n)).imag;
-														// Fimg_shift
-														RFLOAT real = a * (DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted[img_id][0], n)).real
-																- b *(DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted[img_id][0], n)).imag;
-														RFLOAT imag = a * (DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted[img_id][0], n)).imag
-																+ b *(DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted[img_id][0], n)).real;
-														DIRECT_MULTIDIM_ELEM(Fimg_otfshift, n) = Complex(real, imag);
-														// Fimg_shift_nomask
-														real = a * (DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted_nomask[img_id][0], n)).real
-																- b *(DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted_nomask[img_id][0], n)).imag;
-														imag = a * (DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted_nomask[img_id][0], n)).imag
-																+ b *(DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted_nomask[img_id][0], n)).real;
-														DIRECT_MULTIDIM_ELEM(Fimg_otfshift_nomask, n) = Complex(real, imag);
-													}
-												}
-												Fimg_shift = Fimg_otfshift.data;
-												Fimg_shift_nomask = Fimg_otfshift_nomask.data;
-											}
-#ifdef TIMING
-											// Only time one thread, as I also only time one MPI process
-											if (part_id == mydata.sorted_idx[exp_my_first_part_id])
+											xshift = oversampled_translations_x[iover_trans];
+											yshift = oversampled_translations_y[iover_trans];
+											if (mymodel.data_dim == 3)
+												zshift = oversampled_translations_z[iover_trans];
+
+											RFLOAT rot_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_ROT);
+											RFLOAT tilt_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_TILT);
+											RFLOAT psi_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_PSI);
+											transformCartesianAndHelicalCoords(
+														xshift, yshift, zshift,
+														xshift, yshift, zshift,
+														rot_deg, tilt_deg, psi_deg,
+														mymodel.data_dim,
+														HELICAL_TO_CART_COORDS);
+
+											// Fimg_shift
+											shiftImageInFourierTransformWithTabSincos(
+													exp_local_Fimgs_shifted[img_id][0],
+													Fimg_otfshift,
+													(RFLOAT)image_full_size[optics_group],
+													image_current_size[optics_group],
+													tab_sin, tab_cos,
+													xshift, yshift, zshift);
+											// Fimg_shift_nomask
+											shiftImageInFourierTransformWithTabSincos(
+													exp_local_Fimgs_shifted_nomask[img_id][0],
+													Fimg_otfshift_nomask,
+													(RFLOAT)image_full_size[optics_group],
+													image_current_size[optics_group],
+													tab_sin, tab_cos,
+													xshift, yshift, zshift);
+										}
+										else
+										{
+											Complex* myAB;
+											myAB = (adaptive_oversampling == 0 ) ? global_fftshifts_ab_current[optics_group][iitrans].data : global_fftshifts_ab2_current[optics_group][iitrans].data;
+											FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(exp_local_Fimgs_shifted[img_id][0])
 											{
-												timer.toc(TIMING_WSUM_GETSHIFT);
-												timer.tic(TIMING_WSUM_DIFF2);
+												RFLOAT a = (*(myAB + n)).real;
+												RFLOAT b = (*(myAB + n)).imag;
+												// Fimg_shift
+												RFLOAT real = a * (DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted[img_id][0], n)).real
+														- b *(DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted[img_id][0], n)).imag;
+												RFLOAT imag = a * (DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted[img_id][0], n)).imag
+														+ b *(DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted[img_id][0], n)).real;
+												DIRECT_MULTIDIM_ELEM(Fimg_otfshift, n) = Complex(real, imag);
+												// Fimg_shift_nomask
+												real = a * (DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted_nomask[img_id][0], n)).real
+														- b *(DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted_nomask[img_id][0], n)).imag;
+												imag = a * (DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted_nomask[img_id][0], n)).imag
+														+ b *(DIRECT_MULTIDIM_ELEM(exp_local_Fimgs_shifted_nomask[img_id][0], n)).real;
+												DIRECT_MULTIDIM_ELEM(Fimg_otfshift_nomask, n) = Complex(real, imag);
 											}
+										}
+										Fimg_shift = Fimg_otfshift.data;
+										Fimg_shift_nomask = Fimg_otfshift_nomask.data;
+									}
+#ifdef TIMING
+									// Only time one thread, as I also only time one MPI process
+									if (part_id == mydata.sorted_idx[exp_my_first_part_id])
+									{
+										timer.toc(TIMING_WSUM_GETSHIFT);
+										timer.tic(TIMING_WSUM_DIFF2);
+									}
 #endif
-											// Store weighted sum of squared differences for sigma2_noise estimation
-											// Suggestion Robert Sinkovitz: merge difference and scale steps to make better use of cache
-											FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Mresol_fine[optics_group])
+									// Store weighted sum of squared differences for sigma2_noise estimation
+									// Suggestion Robert Sinkovitz: merge difference and scale steps to make better use of cache
+									FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Mresol_fine[optics_group])
+									{
+										int ires = DIRECT_MULTIDIM_ELEM(Mresol_fine[optics_group], n);
+										if (ires > -1)
+										{
+											// Use FT of masked image for noise estimation!
+											RFLOAT diff_real = (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real - (*(Fimg_shift + n)).real;
+											RFLOAT diff_imag = (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag - (*(Fimg_shift + n)).imag;
+											RFLOAT wdiff2 = weight * (diff_real*diff_real + diff_imag*diff_imag);
+											// group-wise sigma2_noise
+											DIRECT_MULTIDIM_ELEM(thr_wsum_sigma2_noise[img_id], ires) += wdiff2;
+											// For norm_correction
+											exp_wsum_norm_correction[img_id] += wdiff2;
+											if (do_scale_correction  && DIRECT_A1D_ELEM(mymodel.data_vs_prior_class[exp_iclass], ires) > 3.)
 											{
-												int ires = DIRECT_MULTIDIM_ELEM(Mresol_fine[optics_group], n);
-												if (ires > -1)
-												{
-													// Use FT of masked image for noise estimation!
-													RFLOAT diff_real = (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real - (*(Fimg_shift + n)).real;
-													RFLOAT diff_imag = (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag - (*(Fimg_shift + n)).imag;
-													RFLOAT wdiff2 = weight * (diff_real*diff_real + diff_imag*diff_imag);
-													// group-wise sigma2_noise
-													DIRECT_MULTIDIM_ELEM(thr_wsum_sigma2_noise[img_id], ires) += wdiff2;
-													// For norm_correction
-													exp_wsum_norm_correction[img_id] += wdiff2;
-													if (do_scale_correction  && DIRECT_A1D_ELEM(mymodel.data_vs_prior_class[exp_iclass], ires) > 3.)
-													{
-														RFLOAT sumXA, sumA2;
-														sumXA = (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real * (*(Fimg_shift + n)).real;
-														sumXA += (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag * (*(Fimg_shift + n)).imag;
-														exp_wsum_scale_correction_XA[img_id] += weight * sumXA;
-														sumA2 = (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real * (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real;
-														sumA2 += (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag * (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag;
-														exp_wsum_scale_correction_AA[img_id] += weight * sumA2;
-													}
-												}
+												RFLOAT sumXA, sumA2;
+												sumXA = (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real * (*(Fimg_shift + n)).real;
+												sumXA += (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag * (*(Fimg_shift + n)).imag;
+												exp_wsum_scale_correction_XA[img_id] += weight * sumXA;
+												sumA2 = (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real * (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real;
+												sumA2 += (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag * (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag;
+												exp_wsum_scale_correction_AA[img_id] += weight * sumA2;
 											}
+										}
+									}
 #ifdef TIMING
-											// Only time one thread, as I also only time one MPI process
-											if (part_id == mydata.sorted_idx[exp_my_first_part_id])
-											{
-												timer.toc(TIMING_WSUM_DIFF2);
-												timer.tic(TIMING_WSUM_LOCALSUMS);
-											}
+									// Only time one thread, as I also only time one MPI process
+									if (part_id == mydata.sorted_idx[exp_my_first_part_id])
+									{
+										timer.toc(TIMING_WSUM_DIFF2);
+										timer.tic(TIMING_WSUM_LOCALSUMS);
+									}
 #endif
 
-											// Store sum of weights for this group
-											thr_sumw_group[img_id] += weight;
-											// Store weights for this class and orientation
-											thr_wsum_pdf_class[exp_iclass] += weight;
+									// Store sum of weights for this group
+									thr_sumw_group[img_id] += weight;
+									// Store weights for this class and orientation
+									thr_wsum_pdf_class[exp_iclass] += weight;
 
-											// The following goes MUCH faster than the original lines below....
-											if (mymodel.ref_dim == 2)
-											{
-												thr_wsum_prior_offsetx_class[exp_iclass] += weight * my_pixel_size * (old_offset_x + oversampled_translations_x[iover_trans]);
-												thr_wsum_prior_offsety_class[exp_iclass] += weight * my_pixel_size * (old_offset_y + oversampled_translations_y[iover_trans]);
-											}
-											// May18,2015 - Shaoda & Sjors, Helical refinement (translational searches)
-											// Calculate the vector length of myprior
-											RFLOAT mypriors_len2 = myprior_x * myprior_x + myprior_y * myprior_y;
-											if (mymodel.data_dim == 3)
-												mypriors_len2 += myprior_z * myprior_z;
-											// If it is doing helical refinement AND Cartesian vector myprior has a length > 0, transform the vector to its helical coordinates
-											if ( (do_helical_refine) && (!ignore_helical_symmetry) && (mypriors_len2 > 0.00001) )
-											{
-												RFLOAT rot_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_ROT);
-												RFLOAT tilt_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_TILT);
-												RFLOAT psi_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_PSI);
-												transformCartesianAndHelicalCoords(myprior_x, myprior_y, myprior_z, myprior_x, myprior_y, myprior_z, rot_deg, tilt_deg, psi_deg, mymodel.data_dim, CART_TO_HELICAL_COORDS);
-											}
+									// The following goes MUCH faster than the original lines below....
+									if (mymodel.ref_dim == 2)
+									{
+										thr_wsum_prior_offsetx_class[exp_iclass] += weight * my_pixel_size * (old_offset_x + oversampled_translations_x[iover_trans]);
+										thr_wsum_prior_offsety_class[exp_iclass] += weight * my_pixel_size * (old_offset_y + oversampled_translations_y[iover_trans]);
+									}
+									// May18,2015 - Shaoda & Sjors, Helical refinement (translational searches)
+									// Calculate the vector length of myprior
+									RFLOAT mypriors_len2 = myprior_x * myprior_x + myprior_y * myprior_y;
+									if (mymodel.data_dim == 3)
+										mypriors_len2 += myprior_z * myprior_z;
+									// If it is doing helical refinement AND Cartesian vector myprior has a length > 0, transform the vector to its helical coordinates
+									if ( (do_helical_refine) && (!ignore_helical_symmetry) && (mypriors_len2 > 0.00001) )
+									{
+										RFLOAT rot_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_ROT);
+										RFLOAT tilt_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_TILT);
+										RFLOAT psi_deg = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_PSI);
+										transformCartesianAndHelicalCoords(myprior_x, myprior_y, myprior_z, myprior_x, myprior_y, myprior_z, rot_deg, tilt_deg, psi_deg, mymodel.data_dim, CART_TO_HELICAL_COORDS);
+									}
 
-											if ( (!do_helical_refine) || (ignore_helical_symmetry) || (mymodel.data_dim == 3) )
-											{
-												RFLOAT diffx = myprior_x - old_offset_x - oversampled_translations_x[iover_trans];
-												thr_wsum_sigma2_offset += weight * my_pixel_size * my_pixel_size * diffx * diffx;
-											}
-											RFLOAT diffy = myprior_y - old_offset_y - oversampled_translations_y[iover_trans];
-											thr_wsum_sigma2_offset += weight * my_pixel_size * my_pixel_size * diffy * diffy;
-											if (mymodel.data_dim == 3)
-											{
-												RFLOAT diffz  = myprior_z - old_offset_z - oversampled_translations_z[iover_trans];
-												if ( (!do_helical_refine) || (ignore_helical_symmetry) )
-													thr_wsum_sigma2_offset += weight * my_pixel_size * my_pixel_size * diffz * diffz;
-											}
+									if ( (!do_helical_refine) || (ignore_helical_symmetry) || (mymodel.data_dim == 3) )
+									{
+										RFLOAT diffx = myprior_x - old_offset_x - oversampled_translations_x[iover_trans];
+										thr_wsum_sigma2_offset += weight * my_pixel_size * my_pixel_size * diffx * diffx;
+									}
+									RFLOAT diffy = myprior_y - old_offset_y - oversampled_translations_y[iover_trans];
+									thr_wsum_sigma2_offset += weight * my_pixel_size * my_pixel_size * diffy * diffy;
+									if (mymodel.data_dim == 3)
+									{
+										RFLOAT diffz  = myprior_z - old_offset_z - oversampled_translations_z[iover_trans];
+										if ( (!do_helical_refine) || (ignore_helical_symmetry) )
+											thr_wsum_sigma2_offset += weight * my_pixel_size * my_pixel_size * diffz * diffz;
+									}
 
-											// Store weight for this direction of this class
-											if (do_skip_align || do_skip_rotate )
-											{
-												//ignore pdf_direction
-											}
-											else if (mymodel.orientational_prior_mode == NOPRIOR)
-											{
-												DIRECT_MULTIDIM_ELEM(thr_wsum_pdf_direction[exp_iclass], idir) += weight;
-											}
-											else
-											{
-												// In the case of orientational priors, get the original number of the direction back
-												long int mydir = exp_pointer_dir_nonzeroprior[idir];
-												if (mymodel.nr_bodies > 1)
-													DIRECT_MULTIDIM_ELEM(thr_wsum_pdf_direction[ibody], mydir) += weight;
-												else
-													DIRECT_MULTIDIM_ELEM(thr_wsum_pdf_direction[exp_iclass], mydir) += weight;
-											}
+									// Store weight for this direction of this class
+									if (do_skip_align || do_skip_rotate )
+									{
+										//ignore pdf_direction
+									}
+									else if (mymodel.orientational_prior_mode == NOPRIOR)
+									{
+										DIRECT_MULTIDIM_ELEM(thr_wsum_pdf_direction[exp_iclass], idir) += weight;
+									}
+									else
+									{
+										// In the case of orientational priors, get the original number of the direction back
+										long int mydir = exp_pointer_dir_nonzeroprior[idir];
+										if (mymodel.nr_bodies > 1)
+											DIRECT_MULTIDIM_ELEM(thr_wsum_pdf_direction[ibody], mydir) += weight;
+										else
+											DIRECT_MULTIDIM_ELEM(thr_wsum_pdf_direction[exp_iclass], mydir) += weight;
+									}
 
 #ifdef TIMING
-											// Only time one thread, as I also only time one MPI process
-											if (part_id == mydata.sorted_idx[exp_my_first_part_id])
-											{
-												timer.toc(TIMING_WSUM_LOCALSUMS);
-												timer.tic(TIMING_WSUM_SUMSHIFT);
-											}
+									// Only time one thread, as I also only time one MPI process
+									if (part_id == mydata.sorted_idx[exp_my_first_part_id])
+									{
+										timer.toc(TIMING_WSUM_LOCALSUMS);
+										timer.tic(TIMING_WSUM_SUMSHIFT);
+									}
 #endif
 
-											Complex *Fimg_store;
-											if (do_grad)
-											{
-												FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Frefctf)
-												{
-													(DIRECT_MULTIDIM_ELEM(Fimg_store_grad, n)).real = (*(Fimg_shift_nomask + n)).real - (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real;
-													(DIRECT_MULTIDIM_ELEM(Fimg_store_grad, n)).imag = (*(Fimg_shift_nomask + n)).imag - (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag;
-												}
-												Fimg_store = Fimg_store_grad.data;
-											}
-											else
-											{
-												Fimg_store = Fimg_shift_nomask;
-											}
+									Complex *Fimg_store;
+									if (do_grad)
+									{
+										FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Frefctf)
+										{
+											(DIRECT_MULTIDIM_ELEM(Fimg_store_grad, n)).real = (*(Fimg_shift_nomask + n)).real - (DIRECT_MULTIDIM_ELEM(Frefctf, n)).real;
+											(DIRECT_MULTIDIM_ELEM(Fimg_store_grad, n)).imag = (*(Fimg_shift_nomask + n)).imag - (DIRECT_MULTIDIM_ELEM(Frefctf, n)).imag;
+										}
+										Fimg_store = Fimg_store_grad.data;
+									}
+									else
+									{
+										Fimg_store = Fimg_shift_nomask;
+									}
 //#define DEBUG_BODIES2
 #ifdef DEBUG_BODIES2
-											FourierTransformer transformer;
-											MultidimArray<Complex> Ftt(Frefctf);
-											FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Ftt)
-												DIRECT_MULTIDIM_ELEM(Ftt, n) = *(Fimg_store + n);
-
-											Image<RFLOAT> tt;
-											tt().resize(exp_current_image_size, exp_current_image_size);
-											transformer.inverseFourierTransform(Ftt, tt());
-											CenterFFT(tt(),false);
-											FileName fnt;
-											fnt= "BPimg_body"+integerToString(ibody+1,1)+"_ihidden"+integerToString(ihidden_over)+".spi";
-											tt.write(fnt);
-											Ftt = Frefctf;
-											tt().resize(exp_current_image_size, exp_current_image_size);
-											transformer.inverseFourierTransform(Ftt, tt());
-											CenterFFT(tt(),false);
-											fnt= "Fref_body"+integerToString(ibody+1,1)+"_ihidden"+integerToString(ihidden_over)+".spi";
-											tt.write(fnt);
-
-
-											std::cerr << " rot= " << rot << " tilt= " << tilt << " psi= " << psi << std::endl;
-											std::cerr << " itrans= " << itrans << " iover_trans= " << iover_trans << std::endl;
-											std::cerr << " ihidden_over= " << ihidden_over << " weight= " << weight << std::endl;
-											std::cerr << "written " << fnt <<std::endl;
-#endif
-
-											// Store sum of weight*SSNR*Fimg in data and sum of weight*SSNR in weight
-											// Use the FT of the unmasked image to back-project in order to prevent reconstruction artefacts! SS 25oct11
-											if (ctf_premultiplied)
-											{
-												// JO 5Mar2020: For both 2D and 3D data, CTF^2 will be provided if ctf_premultiplied!
-												FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Fimg)
-												{
-													RFLOAT myctf = DIRECT_MULTIDIM_ELEM(Mctf, n);
-													RFLOAT weightxinvsigma2 = weight * DIRECT_MULTIDIM_ELEM(Minvsigma2, n);
-													// now Fimg stores sum of all shifted w*Fimg
-													(DIRECT_MULTIDIM_ELEM(Fimg, n)).real += (*(Fimg_store + n)).real * weightxinvsigma2;
-													(DIRECT_MULTIDIM_ELEM(Fimg, n)).imag += (*(Fimg_store + n)).imag * weightxinvsigma2;
-													// now Fweight stores sum of all w and multiply by CTF^2
-													DIRECT_MULTIDIM_ELEM(Fweight, n) += weightxinvsigma2 * myctf;
+									FourierTransformer transformer;
+									MultidimArray<Complex> Ftt(Frefctf);
+									FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Ftt)
+										DIRECT_MULTIDIM_ELEM(Ftt, n) = *(Fimg_store + n);
+
+									Image<RFLOAT> tt;
+									tt().resize(exp_current_image_size, exp_current_image_size);
+									transformer.inverseFourierTransform(Ftt, tt());
+									CenterFFT(tt(),false);
+									FileName fnt;
+									fnt= "BPimg_body"+integerToString(ibody+1,1)+"_ihidden"+integerToString(ihidden_over)+".spi";
+									tt.write(fnt);
+									Ftt = Frefctf;
+									tt().resize(exp_current_image_size, exp_current_image_size);
+									transformer.inverseFourierTransform(Ftt, tt());
+									CenterFFT(tt(),false);
+									fnt= "Fref_body"+integerToString(ibody+1,1)+"_ihidden"+integerToString(ihidden_over)+".spi";
+									tt.write(fnt);
+
+
+									std::cerr << " rot= " << rot << " tilt= " << tilt << " psi= " << psi << std::endl;
+									std::cerr << " itrans= " << itrans << " iover_trans= " << iover_trans << std::endl;
+									std::cerr << " ihidden_over= " << ihidden_over << " weight= " << weight << std::endl;
+									std::cerr << "written " << fnt <<std::endl;
+#endif
+
+									// Store sum of weight*SSNR*Fimg in data and sum of weight*SSNR in weight
+									// Use the FT of the unmasked image to back-project in order to prevent reconstruction artefacts! SS 25oct11
+									if (ctf_premultiplied)
+									{
+										// JO 5Mar2020: For both 2D and 3D data, CTF^2 will be provided if ctf_premultiplied!
+										FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Fimg)
+										{
+											RFLOAT myctf = DIRECT_MULTIDIM_ELEM(Mctf, n);
+											RFLOAT weightxinvsigma2 = weight * DIRECT_MULTIDIM_ELEM(Minvsigma2, n);
+											// now Fimg stores sum of all shifted w*Fimg
+											(DIRECT_MULTIDIM_ELEM(Fimg, n)).real += (*(Fimg_store + n)).real * weightxinvsigma2;
+											(DIRECT_MULTIDIM_ELEM(Fimg, n)).imag += (*(Fimg_store + n)).imag * weightxinvsigma2;
+											// now Fweight stores sum of all w and multiply by CTF^2
+											DIRECT_MULTIDIM_ELEM(Fweight, n) += weightxinvsigma2 * myctf;
                                                 }
-											}
-											else
-											{
-												FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Fimg)
-												{
-													RFLOAT myctf = DIRECT_MULTIDIM_ELEM(Mctf, n);
-													RFLOAT weightxinvsigma2 = weight * myctf * DIRECT_MULTIDIM_ELEM(Minvsigma2, n);
-													// now Fimg stores sum of all shifted w*Fimg
-													(DIRECT_MULTIDIM_ELEM(Fimg, n)).real += (*(Fimg_store + n)).real * weightxinvsigma2;
-													(DIRECT_MULTIDIM_ELEM(Fimg, n)).imag += (*(Fimg_store + n)).imag * weightxinvsigma2;
-													// now Fweight stores sum of all w
-													// Note that CTF needs to be squared in Fweight, weightxinvsigma2 already contained one copy
-													DIRECT_MULTIDIM_ELEM(Fweight, n) += weightxinvsigma2 * myctf;
-												}
-											}
+									}
+									else
+									{
+										FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Fimg)
+										{
+											RFLOAT myctf = DIRECT_MULTIDIM_ELEM(Mctf, n);
+											RFLOAT weightxinvsigma2 = weight * myctf * DIRECT_MULTIDIM_ELEM(Minvsigma2, n);
+											// now Fimg stores sum of all shifted w*Fimg
+											(DIRECT_MULTIDIM_ELEM(Fimg, n)).real += (*(Fimg_store + n)).real * weightxinvsigma2;
+											(DIRECT_MULTIDIM_ELEM(Fimg, n)).imag += (*(Fimg_store + n)).imag * weightxinvsigma2;
+											// now Fweight stores sum of all w
+											// Note that CTF needs to be squared in Fweight, weightxinvsigma2 already contained one copy
+											DIRECT_MULTIDIM_ELEM(Fweight, n) += weightxinvsigma2 * myctf;
+										}
+									}
 
 #ifdef TIMING
-											// Only time one thread, as I also only time one MPI process
-											if (part_id == mydata.sorted_idx[exp_my_first_part_id])
-												timer.toc(TIMING_WSUM_SUMSHIFT);
+									// Only time one thread, as I also only time one MPI process
+									if (part_id == mydata.sorted_idx[exp_my_first_part_id])
+										timer.toc(TIMING_WSUM_SUMSHIFT);
 #endif
-										} // end if !do_skip_maximization
+								} // end if !do_skip_maximization
 
-										// Keep track of max_weight and the corresponding optimal hidden variables
-										if (weight > exp_max_weight[img_id])
-										{
-											// Store optimal image parameters
-											exp_max_weight[img_id] = weight;
-
-											//This is not necessary as rot, tilt and psi remain unchanged!
-											//Euler_matrix2angles(A, rot, tilt, psi);
-
-											int icol_rot  = (mymodel.nr_bodies == 1) ? METADATA_ROT  : 0 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
-											int icol_tilt = (mymodel.nr_bodies == 1) ? METADATA_TILT : 1 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
-											int icol_psi  = (mymodel.nr_bodies == 1) ? METADATA_PSI  : 2 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
-											int icol_xoff = (mymodel.nr_bodies == 1) ? METADATA_XOFF : 3 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
-											int icol_yoff = (mymodel.nr_bodies == 1) ? METADATA_YOFF : 4 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
-											int icol_zoff = (mymodel.nr_bodies == 1) ? METADATA_ZOFF : 5 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
-
-											RFLOAT old_rot = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_rot);
-											DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_rot) = rot;
-											RFLOAT old_tilt = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_tilt);
-											DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_tilt) = tilt;
-											RFLOAT old_psi = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_psi);
-											DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_psi) = psi;
-											Matrix1D<RFLOAT> shifts(mymodel.data_dim);
-
-											// include old_offsets for normal refinement (i.e. non multi-body)
-											XX(shifts) = XX(exp_old_offset[img_id]) + oversampled_translations_x[iover_trans];
-											YY(shifts) = YY(exp_old_offset[img_id]) + oversampled_translations_y[iover_trans];
-											if (mymodel.data_dim == 3)
-											{
-												ZZ(shifts) = ZZ(exp_old_offset[img_id]) + oversampled_translations_z[iover_trans];
-											}
+								// Keep track of max_weight and the corresponding optimal hidden variables
+								if (weight > exp_max_weight[img_id])
+								{
+									// Store optimal image parameters
+									exp_max_weight[img_id] = weight;
+
+									//This is not necessary as rot, tilt and psi remain unchanged!
+									//Euler_matrix2angles(A, rot, tilt, psi);
+
+									int icol_rot  = (mymodel.nr_bodies == 1) ? METADATA_ROT  : 0 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
+									int icol_tilt = (mymodel.nr_bodies == 1) ? METADATA_TILT : 1 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
+									int icol_psi  = (mymodel.nr_bodies == 1) ? METADATA_PSI  : 2 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
+									int icol_xoff = (mymodel.nr_bodies == 1) ? METADATA_XOFF : 3 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
+									int icol_yoff = (mymodel.nr_bodies == 1) ? METADATA_YOFF : 4 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
+									int icol_zoff = (mymodel.nr_bodies == 1) ? METADATA_ZOFF : 5 + METADATA_LINE_LENGTH_BEFORE_BODIES + (ibody) * METADATA_NR_BODY_PARAMS;
+
+									RFLOAT old_rot = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_rot);
+									DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_rot) = rot;
+									RFLOAT old_tilt = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_tilt);
+									DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_tilt) = tilt;
+									RFLOAT old_psi = DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_psi);
+									DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_psi) = psi;
+									Matrix1D<RFLOAT> shifts(mymodel.data_dim);
+
+									// include old_offsets for normal refinement (i.e. non multi-body)
+									XX(shifts) = XX(exp_old_offset[img_id]) + oversampled_translations_x[iover_trans];
+									YY(shifts) = YY(exp_old_offset[img_id]) + oversampled_translations_y[iover_trans];
+									if (mymodel.data_dim == 3)
+									{
+										ZZ(shifts) = ZZ(exp_old_offset[img_id]) + oversampled_translations_z[iover_trans];
+									}
 #ifdef DEBUG_BODIES2
-											std::cerr << ihidden_over << " weight= " << weight;
-											std::cerr << " exp_old_offset= " << exp_old_offset[img_id].transpose() << std::endl;
-											std::cerr << " SET: rot= " << rot << " tilt= " << tilt << " psi= " << psi;
-											std::cerr << " xx-old= " << XX(exp_old_offset[img_id]);
-											std::cerr << " yy-old= " << YY(exp_old_offset[img_id]);
-											std::cerr << " add-xx= " << oversampled_translations_x[iover_trans];
-											std::cerr << " add-yy= " << oversampled_translations_y[iover_trans];
-											std::cerr << " xnew= " << XX(shifts);
-											std::cerr << " ynew= " << YY(shifts) << std::endl;
+									std::cerr << ihidden_over << " weight= " << weight;
+									std::cerr << " exp_old_offset= " << exp_old_offset[img_id].transpose() << std::endl;
+									std::cerr << " SET: rot= " << rot << " tilt= " << tilt << " psi= " << psi;
+									std::cerr << " xx-old= " << XX(exp_old_offset[img_id]);
+									std::cerr << " yy-old= " << YY(exp_old_offset[img_id]);
+									std::cerr << " add-xx= " << oversampled_translations_x[iover_trans];
+									std::cerr << " add-yy= " << oversampled_translations_y[iover_trans];
+									std::cerr << " xnew= " << XX(shifts);
+									std::cerr << " ynew= " << YY(shifts) << std::endl;
 #endif
 
 #ifdef DEBUG_HELICAL_ORIENTATIONAL_SEARCH
-											std::cerr << "MlOptimiser::storeWeightedSums()" << std::endl;
-											if (mymodel.data_dim == 2)
-											{
-												std::cerr << " exp_old_offset = (" << XX(exp_old_offset[img_id]) << ", " << YY(exp_old_offset[img_id]) << ")" << std::endl;
-												std::cerr << " Oversampled trans = (" << oversampled_translations_x[iover_trans] << ", " << oversampled_translations_y[iover_trans] << ")" << std::endl;
-												std::cerr << " shifts = (" << XX(shifts) << ", " << YY(shifts) << ")" << std::endl;
-											}
-											else
-											{
-												std::cerr << " exp_old_offset = (" << XX(exp_old_offset[img_id]) << ", " << YY(exp_old_offset[img_id]) << ", " << ZZ(exp_old_offset[img_id]) << ")" << std::endl;
-												std::cerr << " Oversampled trans = (" << oversampled_translations_x[iover_trans] << ", " << oversampled_translations_y[iover_trans] << ", " << oversampled_translations_z[iover_trans] << ")" << std::endl;
-												std::cerr << " shifts = (" << XX(shifts) << ", " << YY(shifts) << ", " << ZZ(shifts) << ")" << std::endl;
-											}
+									std::cerr << "MlOptimiser::storeWeightedSums()" << std::endl;
+									if (mymodel.data_dim == 2)
+									{
+										std::cerr << " exp_old_offset = (" << XX(exp_old_offset[img_id]) << ", " << YY(exp_old_offset[img_id]) << ")" << std::endl;
+										std::cerr << " Oversampled trans = (" << oversampled_translations_x[iover_trans] << ", " << oversampled_translations_y[iover_trans] << ")" << std::endl;
+										std::cerr << " shifts = (" << XX(shifts) << ", " << YY(shifts) << ")" << std::endl;
+									}
+									else
+									{
+										std::cerr << " exp_old_offset = (" << XX(exp_old_offset[img_id]) << ", " << YY(exp_old_offset[img_id]) << ", " << ZZ(exp_old_offset[img_id]) << ")" << std::endl;
+										std::cerr << " Oversampled trans = (" << oversampled_translations_x[iover_trans] << ", " << oversampled_translations_y[iover_trans] << ", " << oversampled_translations_z[iover_trans] << ")" << std::endl;
+										std::cerr << " shifts = (" << XX(shifts) << ", " << YY(shifts) << ", " << ZZ(shifts) << ")" << std::endl;
+									}
 #endif
 
-											// Helical reconstruction: use oldpsi-angle to rotate back the XX(exp_old_offset) + oversampled_translations_x[iover_trans] and
-											if ( (do_helical_refine) && (!ignore_helical_symmetry) )
-											{
-												// Bring xshift, yshift and zshift back to cartesian coords for outputting in the STAR file
+									// Helical reconstruction: use oldpsi-angle to rotate back the XX(exp_old_offset) + oversampled_translations_x[iover_trans] and
+									if ( (do_helical_refine) && (!ignore_helical_symmetry) )
+									{
+										// Bring xshift, yshift and zshift back to cartesian coords for outputting in the STAR file
 #ifdef DEBUG_HELICAL_ORIENTATIONAL_SEARCH
-												std::cerr << "MlOptimiser::storeWeightedSums()" << std::endl;
-												std::cerr << "Bring xy(z) shifts back to Cartesian coordinates for output in the STAR file" << std::endl;
-												std::cerr << " itrans = " << itrans << ", iover_trans = " << iover_trans << std::endl;
-												if(shifts.size() == 2)
-												{
-													std::cerr << "  old_psi = " << old_psi << " degrees" << std::endl;
-													std::cerr << "  Helical offsets (r, p) = (" << XX(shifts) << ", " << YY(shifts) << ")" << std::endl;
-												}
-												else
-												{
-													std::cerr << "  old_psi = " << old_psi << " degrees, old_tilt = " << old_tilt << " degrees" << std::endl;
-													std::cerr << "  Helical offsets (p1, p2, r) = (" << XX(shifts) << ", " << YY(shifts) << ", " << ZZ(shifts) << ")" << std::endl;
-												}
+										std::cerr << "MlOptimiser::storeWeightedSums()" << std::endl;
+										std::cerr << "Bring xy(z) shifts back to Cartesian coordinates for output in the STAR file" << std::endl;
+										std::cerr << " itrans = " << itrans << ", iover_trans = " << iover_trans << std::endl;
+										if(shifts.size() == 2)
+										{
+											std::cerr << "  old_psi = " << old_psi << " degrees" << std::endl;
+											std::cerr << "  Helical offsets (r, p) = (" << XX(shifts) << ", " << YY(shifts) << ")" << std::endl;
+										}
+										else
+										{
+											std::cerr << "  old_psi = " << old_psi << " degrees, old_tilt = " << old_tilt << " degrees" << std::endl;
+											std::cerr << "  Helical offsets (p1, p2, r) = (" << XX(shifts) << ", " << YY(shifts) << ", " << ZZ(shifts) << ")" << std::endl;
+										}
 #endif
-												transformCartesianAndHelicalCoords(shifts, shifts, old_rot, old_tilt, old_psi, HELICAL_TO_CART_COORDS);
+										transformCartesianAndHelicalCoords(shifts, shifts, old_rot, old_tilt, old_psi, HELICAL_TO_CART_COORDS);
 #ifdef DEBUG_HELICAL_ORIENTATIONAL_SEARCH
-												if(shifts.size() == 2)
-													std::cerr << "  Cartesian offsets (x, y) = (" << XX(shifts) << ", " << YY(shifts) << ")" << std::endl;
-												else
-													std::cerr << "  Cartesian offsets (x, y, z) = (" << XX(shifts) << ", " << YY(shifts) << ", " << ZZ(shifts) << ")" << std::endl;
+										if(shifts.size() == 2)
+											std::cerr << "  Cartesian offsets (x, y) = (" << XX(shifts) << ", " << YY(shifts) << ")" << std::endl;
+										else
+											std::cerr << "  Cartesian offsets (x, y, z) = (" << XX(shifts) << ", " << YY(shifts) << ", " << ZZ(shifts) << ")" << std::endl;
 #endif
-											}
+									}
 
-											DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_xoff) = XX(shifts);
-											DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_yoff) = YY(shifts);
-											if (mymodel.data_dim == 3)
-												DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_zoff) = ZZ(shifts);
+									DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_xoff) = XX(shifts);
+									DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_yoff) = YY(shifts);
+									if (mymodel.data_dim == 3)
+										DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, icol_zoff) = ZZ(shifts);
 
-											if (ibody == 0)
-											{
-												DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_CLASS) = (RFLOAT)exp_iclass + 1;
-												DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_PMAX) = exp_max_weight[img_id];
-											}
-										} // end if weight > exp_max_weight[img_id]
-									} // end if weight >= exp_significant_weight
-								} // end loop iover_trans
-							} // end loop itrans
+									if (ibody == 0)
+									{
+										DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_CLASS) = (RFLOAT)exp_iclass + 1;
+										DIRECT_A2D_ELEM(exp_metadata, my_metadata_offset, METADATA_PMAX) = exp_max_weight[img_id];
+									}
+								} // end if weight > exp_max_weight[img_id]
+							} // end loop significant sampling points
 #ifdef RELION_TESTING
 							std::string fnm = std::string("cpu_out_exp_wsum_norm_correction.txt");
 							char *text = &fnm[0];
@@ -8737,17 +8968,26 @@ void MlOptimiser::storeWeightedSums(long int part_id, int ibody,
 			}
 #endif
 		}
-		for (int n = 0; n < mymodel.nr_classes * mymodel.nr_bodies; n++)
-		{
-			if (!(do_skip_align || do_skip_rotate) )
-				wsum_model.pdf_direction[n] += thr_wsum_pdf_direction[n];
-		}
 		wsum_model.sigma2_offset += thr_wsum_sigma2_offset;
 		if (do_norm_correction && mymodel.nr_bodies == 1)
 			wsum_model.avg_norm_correction += thr_avg_norm_correction;
 		wsum_model.LL += thr_sum_dLL;
 		wsum_model.ave_Pmax += thr_sum_Pmax;
 		omp_unset_lock(&global_mutex);
+
+		// The orientational pdfs are by far the largest of these sums. Add them under the class mutexes
+		// instead, so that threads finishing particles at the same time only wait for each other
+		// when they need the same class
+		if (!(do_skip_align || do_skip_rotate) )
+		{
+			for (int n = 0; n < mymodel.nr_classes * mymodel.nr_bodies; n++)
+			{
+				int my_mutex = n % NR_CLASS_MUTEXES;
+				omp_set_lock(&global_mutex2[my_mutex]);
+				wsum_model.pdf_direction[n] += thr_wsum_pdf_direction[n];
+				omp_unset_lock(&global_mutex2[my_mutex]);
+			}
+		}
 	} // end if !do_skip_maximization
 
 #ifdef TIMING
@@ -9986,7 +10226,7 @@ void MlOptimiser::getMetaAndImageDataSubset(long int first_part_id, long int las
 						DIRECT_MULTIDIM_ELEM(img(), n) = (RFLOAT)DIRECT_MULTIDIM_ELEM(mydata.particles[part_id].images[img_id].img, n);
 					}
 				}
-				else
+				else if (!mydata.getImageFromCache(part_id, img_id, img()))
 				{
 					// only open new stacks
 					fn_img.decompose(dump, fn_stack);
@@ -10200,6 +10440,25 @@ void MlOptimiser::getMetaAndImageDataSubset(long int first_part_id, long int las
 
 }
 
+void MlOptimiser::prefetchImageDataSubset(long int first_part_id, long int last_part_id)
+{
+	// Same image names as the ones getMetaAndImageDataSubset puts in exp_fn_img
+	std::vector<FileName> fn_imgs;
+	for (long int part_id_sorted = first_part_id; part_id_sorted <= last_part_id; part_id_sorted++)
+	{
+		long int part_id = mydata.sorted_idx[part_id_sorted];
+		for (int img_id = 0; img_id < mydata.numberOfImagesInParticle(part_id); img_id++)
+		{
+			FileName fn_img;
+			if (!mydata.getImageNameOnScratch(part_id, img_id, fn_img))
+				mydata.MDimg.getValue(EMDL_IMAGE_NAME, fn_img, mydata.particles[part_id].images[img_id].id);
+			fn_imgs.push_back(fn_img);
+		}
+	}
+
+	exp_image_prefetcher->push(first_part_id, fn_imgs);
+}
+
 void MlOptimiser::get3DCTFAndMulti(MultidimArray<RFLOAT> &Ictf, MultidimArray<RFLOAT> &Fctf, MultidimArray<RFLOAT> &FstMulti,
 							bool ctf_premultiplied)
 {
@@ -41,6 +41,8 @@
 #include "src/local_symmetry.h"
 #include "src/acc/settings.h"
 
+class ImagePrefetcher;
+
 #define ML_SIGNIFICANT_WEIGHT 1.e-8
 #define METADATA_LINE_LENGTH METADATA_LINE_LENGTH_ALL
 
@@ -113,6 +115,10 @@ public:
 	CpuOptimiserType   tbbCpuOptimiser;
 
 	std::complex<XFLOAT> **mdlClassComplex __attribute__((aligned(64)));
+
+	// The same in half precision (with do_cpu_half_refs), and the scale of each class
+	float16 **mdlClassHalf;
+	XFLOAT *mdlClassHalfScale;
 #endif
 
 
@@ -448,6 +454,12 @@ public:
 	// Use parallel access to disc?
 	bool do_parallel_disc_io;
 
+	// Number of pools of particles whose images are read in the background while the current pool is processed
+	int nr_prefetch_pools;
+
+	// The same, but limited by the available memory in expectationSetupCheckMemory
+	int exp_nr_prefetch_pools;
+
 	// Use gpu resources?
 	bool do_gpu;
 	bool anticipate_oom;
@@ -455,6 +467,9 @@ public:
 	// Use alternate cpu implementation
 	bool do_cpu;
 
+	// Store the references of the alternate cpu implementation in half precision
+	bool do_cpu_half_refs;
+
 	// Which GPU devices to use?
 	std::string gpu_ids;
 
@@ -464,6 +479,9 @@ public:
 	// Place on scratch disk to copy particle stacks temporarily
 	FileName fn_scratch;
 
+	// Directory for the persistent, memory-mapped particle cache (replaces fn_scratch and do_preread_images)
+	FileName fn_particle_cache;
+
 	// Amount of scratch space to be left free (in Gb)
 	RFLOAT keep_free_scratch_Gb;
 
@@ -652,8 +670,8 @@ public:
 	// Verbosity flag
 	int verb;
 
-	// Thread Managers for the expectation step: one for all (pooled) particles
-	ThreadTaskDistributor *exp_ipart_ThreadTaskDistributor;
+	// Thread Manager for the expectation step: distributes all (pooled) particles over the threads
+	WorkStealingTaskScheduler *exp_ipart_TaskScheduler;
 
 	// Number of threads to run in parallel
 	int x_pool;
@@ -666,6 +684,7 @@ public:
 	MultidimArray<RFLOAT> exp_metadata, exp_imagedata;
 	std::string exp_fn_img, exp_fn_ctf, exp_fn_recimg;
 	std::vector<MultidimArray<RFLOAT> > exp_imgs;
+	ImagePrefetcher *exp_image_prefetcher;
 	std::vector<int> exp_random_class_some_particles;
 
 	// Calculate translated images on-the-fly
@@ -774,7 +793,10 @@ public:
             x_pool(1),
             nr_threads(0),
             do_shifts_onthefly(0),
-            exp_ipart_ThreadTaskDistributor(0),
+            exp_ipart_TaskScheduler(0),
+            exp_image_prefetcher(0),
+            nr_prefetch_pools(1),
+            exp_nr_prefetch_pools(0),
             do_parallel_disc_io(0),
             sum_changes_optimal_orientations(0),
             do_solvent(0),
@@ -826,6 +848,7 @@ public:
             random_seed(0),
             do_gpu(0),
             anticipate_oom(0),
+            do_cpu_half_refs(0),
             do_helical_refine(0),
             do_preread_images(0),
             ignore_helical_symmetry(0),
@@ -879,6 +902,8 @@ public:
             skip_realspace_helical_sym(false),
 #ifdef ALTCPU
 		mdlClassComplex(NULL),
+		mdlClassHalf(NULL),
+		mdlClassHalfScale(NULL),
 #endif
             failsafe_threshold(40),
             do_trust_ref_size(0),
@@ -1015,8 +1040,15 @@ public:
 
 	/* Perform the actual reconstructions
 	 * This is officially part of the maximization, but it is separated because of parallelisation issues.
+	 * Reconstructions of different classes may run at the same time on different threads.
 	 */
-	void maximizationReconstructClass(int iclass);
+	void maximizationReconstructClass(int iclass, int skip_class, const MultidimArray<RFLOAT> &avgctf2, bool do_correct_tau2_by_avgctf2);
+
+	/* How many reconstructions to run at the same time on the threads of this process.
+	 * Each of them needs several arrays of the size of the padded Fourier-space volume, so this is limited
+	 * to what fits into half of the free memory, shared by nr_processes_on_node processes.
+	 */
+	int getNrParallelReconstructions(int nr_reconstructions, int nr_processes_on_node = 1);
 
 	/* Update gradient related parameters, returns class index that should be skipped during SOM
 	 */
@@ -1105,13 +1137,16 @@ public:
 			std::vector<MultidimArray<RFLOAT> > &exp_STweight);
 
 	// Convert all squared difference terms to weights.
-	// Also calculates exp_sum_weight and, for adaptive approach, also exp_significant_weight
+	// Also calculates exp_sum_weight and, for adaptive approach, also exp_significant_weight.
+	// The significant weights themselves are returned in exp_significant_samples, as (ihidden_over, weight) pairs
 	void convertAllSquaredDifferencesToWeights(long int part_id, int ibody, int exp_ipass,
 			int exp_current_oversampling, int metadata_offset,
 			int exp_idir_min, int exp_idir_max, int exp_ipsi_min, int exp_ipsi_max,
 			int exp_itrans_min, int exp_itrans_max, int my_iclass_min, int my_iclass_max,
 			MultidimArray<RFLOAT> &exp_Mweight, MultidimArray<bool> &exp_Mcoarse_significant,
-			std::vector<RFLOAT> &exp_significant_weight, std::vector<RFLOAT> &exp_sum_weight,
+			std::vector<RFLOAT> &exp_significant_weight,
+			std::vector<std::vector<std::pair<long int, RFLOAT> > > &exp_significant_samples,
+			std::vector<RFLOAT> &exp_sum_weight,
 			std::vector<Matrix1D<RFLOAT> > &exp_old_offset, std::vector<Matrix1D<RFLOAT> > &exp_prior, std::vector<RFLOAT> &exp_min_diff2,
 			std::vector<int> &exp_pointer_dir_nonzeroprior, std::vector<int> &exp_pointer_psi_nonzeroprior,
 			std::vector<RFLOAT> &exp_directions_prior, std::vector<RFLOAT> &exp_psi_prior);
@@ -1129,9 +1164,9 @@ public:
 			std::vector<MultidimArray<RFLOAT> > &exp_power_img,
 			std::vector<Matrix1D<RFLOAT> > &exp_old_offset,
 			std::vector<Matrix1D<RFLOAT> > &exp_prior,
-			MultidimArray<RFLOAT> &exp_Mweight,
 			MultidimArray<bool> &exp_Mcoarse_significant,
 			std::vector<RFLOAT> &exp_significant_weight,
+			std::vector<std::vector<std::pair<long int, RFLOAT> > > &exp_significant_samples,
 			std::vector<RFLOAT> &exp_sum_weight,
 			std::vector<RFLOAT> &exp_max_weight,
 			std::vector<int> &exp_pointer_dir_nonzeroprior, std::vector<int> &exp_pointer_psi_nonzeroprior,
@@ -1175,6 +1210,9 @@ public:
 	// Get metadata array of a subset of particles from the experimental model
 	void getMetaAndImageDataSubset(long int my_first_part_id, long int my_last_part_id, bool do_also_imagedata = true);
 
+	// Queue the images of a subset of particles on exp_image_prefetcher, to be read in the background
+	void prefetchImageDataSubset(long int my_first_part_id, long int my_last_part_id);
+
 	// Get the CTF (and Multiplicity weights where available) volumes from the stored files and correct them
 	void get3DCTFAndMulti(MultidimArray<RFLOAT> &Ictf, MultidimArray<RFLOAT> &Fctf, MultidimArray<RFLOAT> &FstMulti,
 			bool ctf_premultiplied);
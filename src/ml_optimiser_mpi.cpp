@@ -62,6 +62,7 @@ void MlOptimiserMpi::read(int argc, char **argv)
     int mpi_section = parser.addSection("MPI options");
     halt_all_followers_except_this = textToInteger(parser.getOption("--halt_all_followers_except", "For debugging: keep all followers except this one waiting", "-1"));
     do_keep_debug_reconstruct_files  = parser.checkOption("--keep_debug_reconstruct_files", "For debugging: keep temporary data and weight files for debug-reconstructions.");
+    do_distributed_gridding = parser.checkOption("--distributed_gridding", "Distribute the iterative gridding of each 3D reconstruction over all followers of its random half (for very large boxes)");
 
     // Don't put any output to screen for mpi followers
     ori_verb = verb;
@@ -476,6 +477,19 @@ will still yield good performance and possibly a more stable execution. \n" << s
 		fn_ref.getHalf(fn_ref, my_halfset);
 	}
 
+	// The weighted sums are combined among the followers of each random half, so give each half its own communicator
+	int halfset_color = (node->isLeader()) ? MPI_UNDEFINED : ((do_split_random_halves) ? node->myRandomSubset() : 1);
+	MPI_Comm_split(MPI_COMM_WORLD, halfset_color, node->rank, &halfsetC);
+
+	// The reconstructions in maximization run on multiple threads when they fit into the memory shared by all processes on a node
+	nr_processes_on_node = 1;
+#if MPI_VERSION >= 3
+	MPI_Comm nodeC;
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, node->rank, MPI_INFO_NULL, &nodeC);
+	MPI_Comm_size(nodeC, &nr_processes_on_node);
+	MPI_Comm_free(&nodeC);
+#endif
+
 #ifdef MKLFFT
 	// Enable multi-threaded FFTW
 	int success = fftw_init_threads();
@@ -484,7 +498,7 @@ will still yield good performance and possibly a more stable execution. \n" << s
 
 	// And allow plans before expectation to run using allowed
 	// number of threads
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	MlOptimiser::initialiseGeneral(node->rank);
@@ -688,6 +702,14 @@ void MlOptimiserMpi::initialiseWorkLoad()
 		}
 	}
 
+	// Or map the particle cache on all ranks that read images. Only one process on each node
+	// builds it if it does not exist yet; the others wait until it is there.
+	if (fn_particle_cache != "" && (do_parallel_disc_io || node->isLeader()))
+	{
+		int myverb = (node->rank == 1 || (!do_parallel_disc_io && node->isLeader())) ? ori_verb : 0;
+		mydata.openParticleCache(fn_particle_cache, true, keep_free_scratch_Gb, myverb);
+	}
+
 	MPI_Barrier(MPI_COMM_WORLD);
 
 	if(!do_split_random_halves)
@@ -731,7 +753,7 @@ void MlOptimiserMpi::expectation()
 
 #ifdef MKLFFT
 	// Allow parallel FFTW execution
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	// Initialise some stuff
@@ -990,6 +1012,10 @@ void MlOptimiserMpi::expectation()
 		// Allocate Array of complex arrays for this class
 		if (posix_memalign((void **)&mdlClassComplex, MEM_ALIGN, nr_classes * sizeof (std::complex<XFLOAT> *)))
 			CRITICAL(RAMERR);
+		if (posix_memalign((void **)&mdlClassHalf, MEM_ALIGN, nr_classes * sizeof (float16 *)))
+			CRITICAL(RAMERR);
+		if (posix_memalign((void **)&mdlClassHalfScale, MEM_ALIGN, nr_classes * sizeof (XFLOAT)))
+			CRITICAL(RAMERR);
 
 		// Set up XFLOAT complex array shared by all threads for each class
 		for (int iclass = 0; iclass < nr_classes; iclass++)
@@ -1003,6 +1029,24 @@ void MlOptimiserMpi::expectation()
 			else
 				mdlXYZ = (size_t)mdlX*(size_t)mdlY*(size_t)mdlZ;
 
+			mdlClassComplex[iclass] = NULL;
+			mdlClassHalf[iclass] = NULL;
+			mdlClassHalfScale[iclass] = 1.;
+			if (do_cpu_half_refs)
+			{
+				try
+				{
+					mdlClassHalf[iclass] = new float16[2 * mdlXYZ];
+				}
+				catch (std::bad_alloc& ba)
+				{
+					CRITICAL(RAMERR);
+				}
+
+				mdlClassHalfScale[iclass] = AccProjector::convertToHalf(mymodel.PPref[iclass].data.data, mdlXYZ, mdlClassHalf[iclass]);
+				continue;
+			}
+
 			try
 			{
 				mdlClassComplex[iclass] = new std::complex<XFLOAT>[mdlXYZ];
@@ -1034,7 +1078,7 @@ void MlOptimiserMpi::expectation()
 
 #ifdef MKLFFT
 	// Single-threaded FFTW execution for code inside parallel processing loop
-	fftw_plan_with_nthreads(1);
+	FourierTransformer::setPlannerThreads(1);
 #endif
 
 #ifdef TIMING
@@ -1510,8 +1554,11 @@ void MlOptimiserMpi::expectation()
 				for (int iclass = 0; iclass < nr_classes; iclass++)
 				{
 					delete [] mdlClassComplex[iclass];
+					delete [] mdlClassHalf[iclass];
 				}
 				free(mdlClassComplex);
+				free(mdlClassHalf);
+				free(mdlClassHalfScale);
 
 				tbbCpuOptimiser.clear();
 			}
@@ -1530,7 +1577,7 @@ void MlOptimiserMpi::expectation()
 #ifdef  MKLFFT
 	// Allow parallel FFTW execution to continue now that we are outside the parallel
 	// portion of expectation
-	fftw_plan_with_nthreads(nr_threads);
+	FourierTransformer::setPlannerThreads(nr_threads);
 #endif
 
 	// Just make sure the temporary arrays are empty...
@@ -1565,6 +1612,15 @@ void MlOptimiserMpi::expectation()
 #endif
 }
 
+void MlOptimiserMpi::setWeightedSumsPackRadius(MPI_Comm comm)
+{
+	// In early iterations, and in the corners of the arrays, many Fourier shells of the back-projections are empty.
+	// If they are all empty, still pack the origin: all ranks need packs of the same size.
+	long int max_r2 = (node->isLeader()) ? -1 : wsum_model.getMaxNonZeroR2();
+	MPI_Allreduce(MPI_IN_PLACE, &max_r2, 1, MPI_LONG, MPI_MAX, comm);
+	wsum_model.pack_max_r2 = XMIPP_MAX(max_r2, 0);
+}
+
 void MlOptimiserMpi::combineAllWeightedSumsViaFile()
 {
 
@@ -1582,9 +1638,22 @@ void MlOptimiserMpi::combineAllWeightedSumsViaFile()
 		// A. First all followers pack up their wsum_model (this is done simultaneously)
 		if (!node->isLeader())
 		{
+			setWeightedSumsPackRadius(halfsetC);
 			wsum_model.pack(Mpack); // use negative piece and nr_pieces to only make a single Mpack, i.e. do not split into multiple pieces
 		}
 
+		if (do_parallel_disc_io)
+		{
+			// With parallel disc I/O, do a reduce-scatter and allgather through the files:
+			// each follower sums one slice of the Mpacks of all followers in its subset, and then reads all summed slices.
+			combineWeightedSumsSlicesViaFile(Mpack);
+			wsum_model.pack_max_r2 = -1;
+#ifdef TIMING
+			timer.toc(TIMING_MPICOMBINEDISC);
+#endif
+			return;
+		}
+
 		// B. All followers write their Mpack to disc. Do this SEQUENTIALLY to prevent heavy load on disc I/O
 		for (int this_follower = 1; this_follower < node->size; this_follower++ )
 		{
@@ -1660,7 +1729,10 @@ void MlOptimiserMpi::combineAllWeightedSumsViaFile()
 
 		// F. Finally all followers unpack Msum into their wsum_model (do this simultaneously)
 		if (!node->isLeader())
+		{
 			wsum_model.unpack(Mpack);
+			wsum_model.pack_max_r2 = -1;
+		}
 
 	} // end if ((node->size - 1)/nr_halfsets > 1)
 #ifdef TIMING
@@ -1669,6 +1741,100 @@ void MlOptimiserMpi::combineAllWeightedSumsViaFile()
 
 }
 
+// Read elements [first, first + n) of a binary file with RFLOATs and add them to ptr
+static void readBinarySliceAndSum(const FileName &fn, RFLOAT *ptr, unsigned long first, unsigned long n)
+{
+	std::ifstream in(fn.c_str(), std::ios::in | std::ios::binary);
+	if (!in)
+		REPORT_ERROR("MlOptimiserMpi::combineWeightedSumsSlicesViaFile: File " + fn + " not found");
+	in.seekg(first * sizeof(RFLOAT), std::ios::beg);
+
+	std::vector<RFLOAT> buffer(XMIPP_MIN(n, 1024UL * 1024UL));
+	for (unsigned long done = 0; done < n; done += buffer.size())
+	{
+		unsigned long todo = XMIPP_MIN(n - done, (unsigned long)buffer.size());
+		in.read(reinterpret_cast<char *>(&buffer[0]), todo * sizeof(RFLOAT));
+		if (!in)
+			REPORT_ERROR("MlOptimiserMpi::combineWeightedSumsSlicesViaFile: File " + fn + " is too short");
+		for (unsigned long i = 0; i < todo; i++)
+			ptr[done + i] += buffer[i];
+	}
+}
+
+void MlOptimiserMpi::combineWeightedSumsSlicesViaFile(MultidimArray<RFLOAT> &Mpack)
+{
+	FileName fn_pack, fn_slice;
+	int nr_halfsets = (do_split_random_halves) ? 2 : 1;
+
+	// The followers of a subset are first_follower, first_follower + nr_halfsets, ... (in the order of their rank in halfsetC)
+	int my_index = -1, nr_members = 0, first_follower = 1;
+	if (!node->isLeader())
+	{
+		MPI_Comm_rank(halfsetC, &my_index);
+		MPI_Comm_size(halfsetC, &nr_members);
+		first_follower = (do_split_random_halves) ? node->myRandomSubset() : 1;
+	}
+	unsigned long size = MULTIDIM_SIZE(Mpack);
+	unsigned long slice = (nr_members > 0) ? (size + nr_members - 1) / nr_members : 0;
+
+	// A. All followers write their Mpack to disc simultaneously
+	if (!node->isLeader())
+	{
+		fn_pack.compose(fn_out+"_rank", node->rank, "tmp");
+		Mpack.writeBinary(fn_pack);
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	// B. Each follower sums its own slice over the Mpacks of all followers in its subset, and writes that slice to disc
+	if (!node->isLeader())
+	{
+		unsigned long first = XMIPP_MIN(size, my_index * slice);
+		unsigned long n = XMIPP_MIN(size - first, slice);
+		MultidimArray<RFLOAT> Msum(n);
+		for (int imember = 0; imember < nr_members; imember++)
+		{
+			if (imember == my_index)
+			{
+				for (unsigned long i = 0; i < n; i++)
+					DIRECT_MULTIDIM_ELEM(Msum, i) += DIRECT_MULTIDIM_ELEM(Mpack, first + i);
+			}
+			else
+			{
+				fn_pack.compose(fn_out+"_rank", first_follower + imember * nr_halfsets, "tmp");
+				readBinarySliceAndSum(fn_pack, MULTIDIM_ARRAY(Msum), first, n);
+			}
+		}
+		fn_slice.compose(fn_out+"_sum", node->rank, "tmp");
+		Msum.writeBinary(fn_slice);
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	// C. All followers read all summed slices of their subset
+	if (!node->isLeader())
+	{
+		for (int imember = 0; imember < nr_members; imember++)
+		{
+			unsigned long first = XMIPP_MIN(size, imember * slice);
+			unsigned long n = XMIPP_MIN(size - first, slice);
+			MultidimArray<RFLOAT> Msum(n);
+			fn_slice.compose(fn_out+"_sum", first_follower + imember * nr_halfsets, "tmp");
+			Msum.readBinary(fn_slice);
+			memcpy(MULTIDIM_ARRAY(Mpack) + first, MULTIDIM_ARRAY(Msum), n * sizeof(RFLOAT));
+		}
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	// D. All followers delete their own temporary files and unpack the sum into their wsum_model
+	if (!node->isLeader())
+	{
+		fn_pack.compose(fn_out+"_rank", node->rank, "tmp");
+		remove((fn_pack).c_str());
+		fn_slice.compose(fn_out+"_sum", node->rank, "tmp");
+		remove((fn_slice).c_str());
+		wsum_model.unpack(Mpack);
+	}
+}
+
 void MlOptimiserMpi::combineAllWeightedSums()
 {
 #ifdef TIMING
@@ -1676,12 +1842,10 @@ void MlOptimiserMpi::combineAllWeightedSums()
 #endif
 
 	// Pack all weighted sums in Mpack
-	MultidimArray<RFLOAT> Mpack, Msum;
-	MPI_Status status;
+	MultidimArray<RFLOAT> Mpack;
 
-	// First follower manually sums over all other followers of it's subset
-	// And then sends results back to all those followers
-	// When splitting the data into two random halves, perform two passes: one for each subset
+	// All followers of a subset sum their Mpack with an in-place allreduce on the communicator of that subset.
+	// When splitting the data into two random halves, both subsets do this at the same time on their own communicator.
 	int nr_halfsets = (do_split_random_halves) ? 2 : 1;
 #ifdef DEBUG
 	std::cerr << " starting combineAllWeightedSums..." << std::endl;
@@ -1689,121 +1853,27 @@ void MlOptimiserMpi::combineAllWeightedSums()
 	// Only combine weighted sums if there are more than one followers per subset!
 	if ((node->size - 1)/nr_halfsets > 1)
 	{
-		// Loop over possibly multiple instances of Mpack of maximum size
-		int piece = 0;
-		int nr_pieces = 1;
-		while (piece < nr_pieces)
+		if (!node->isLeader())
 		{
-			// All nodes except those who will reset nr_pieces piece will pass while loop in next pass
-			nr_pieces = 0;
+			setWeightedSumsPackRadius(halfsetC);
 
-			// First all followers pack up their wsum_model
-			if (!node->isLeader())
+			// Loop over possibly multiple instances of Mpack of maximum size
+			int piece = 0;
+			int nr_pieces = 1;
+			while (piece < nr_pieces)
 			{
 				wsum_model.pack(Mpack, piece, nr_pieces);
-				// The first follower(s) set Msum equal to Mpack, the others initialise to zero
-				if (node->rank <= nr_halfsets)
-					Msum = Mpack;
-				else
-					Msum.initZeros(Mpack);
-			}
-
-
-			// Loop through all followers: each follower sends its Msum to the next follower for its subset.
-			// Each next follower sums its own Mpack to the received Msum and sends it on to the next follower
-			for (int this_follower = 1; this_follower < node->size; this_follower++ )
-			{
-				// Find out who is the first follower in this subset
-				int first_follower;
-				if (!do_split_random_halves)
-					first_follower = 1;
-				else
-					first_follower = (this_follower % 2 == 1) ? 1 : 2;
-
-				// Find out who is the next follower in this subset
-				int other_follower = this_follower + nr_halfsets;
-
-				if (other_follower < node->size)
-				{
-					if (node->rank == this_follower)
-					{
-#ifdef DEBUG
-						std::cerr << " AA SEND node->rank= " << node->rank << " MULTIDIM_SIZE(Msum)= "<< MULTIDIM_SIZE(Msum)
-								<< " this_follower= " << this_follower << " other_follower= "<<other_follower << std::endl;
-#endif
-						node->relion_MPI_Send(MULTIDIM_ARRAY(Msum), MULTIDIM_SIZE(Msum), MY_MPI_DOUBLE, other_follower, MPITAG_PACK, MPI_COMM_WORLD);
-					}
-					else if (node->rank == other_follower)
-					{
-						node->relion_MPI_Recv(MULTIDIM_ARRAY(Msum), MULTIDIM_SIZE(Msum), MY_MPI_DOUBLE, this_follower, MPITAG_PACK, MPI_COMM_WORLD, status);
-#ifdef DEBUG
-						std::cerr << " AA RECV node->rank= " << node->rank  << " MULTIDIM_SIZE(Msum)= "<< MULTIDIM_SIZE(Msum)
-								<< " this_follower= " << this_follower << " other_follower= "<<other_follower << std::endl;
-#endif
-						// Add my own Mpack to send onwards in the next step
-						Msum += Mpack;
-					}
-				}
-				else
-				{
-					// Now this_follower has reached the last follower, which passes the final Msum to the first one (i.e. first_follower)
-					if (node->rank == this_follower)
-					{
-#ifdef DEBUG
-						std::cerr << " BB SEND node->rank= " << node->rank  << " MULTIDIM_SIZE(Msum)= "<< MULTIDIM_SIZE(Msum)
-								<< " this_follower= " << this_follower << " first_follower= "<<first_follower << std::endl;
-#endif
-						node->relion_MPI_Send(MULTIDIM_ARRAY(Msum), MULTIDIM_SIZE(Msum), MY_MPI_DOUBLE, first_follower, MPITAG_PACK, MPI_COMM_WORLD);
-					}
-					else if (node->rank == first_follower)
-					{
-						node->relion_MPI_Recv(MULTIDIM_ARRAY(Msum), MULTIDIM_SIZE(Msum), MY_MPI_DOUBLE, this_follower, MPITAG_PACK, MPI_COMM_WORLD, status);
-#ifdef DEBUG
-						std::cerr << " BB RECV node->rank= " << node->rank  << " MULTIDIM_SIZE(Msum)= "<< MULTIDIM_SIZE(Msum)
-								<< " this_follower= " << this_follower << " first_follower= "<<first_follower << std::endl;
-#endif
-					}
-				}
-			} // end for this_follower
-
-			// Now loop through all followers again to pass around the Msum
-			for (int this_follower = 1; this_follower < node->size; this_follower++ )
-			{
-				// Find out who is the next follower in this subset
-				int other_follower = this_follower + nr_halfsets;
-
-				// Do not send to the last follower, because it already had its Msum from the cycle above, therefore subtract nr_halfsets from node->size
-				if (other_follower < node->size - nr_halfsets)
-				{
-					if (node->rank == this_follower)
-					{
 #ifdef DEBUG
-						std::cerr << " CC SEND node->rank= " << node->rank << " MULTIDIM_SIZE(Msum)= "<< MULTIDIM_SIZE(Msum)
-								<< " this_follower= " << this_follower << " other_follower= "<<other_follower << std::endl;
+				std::cerr << " ALLREDUCE node->rank= " << node->rank << " MULTIDIM_SIZE(Mpack)= "<< MULTIDIM_SIZE(Mpack)
+						<< " piece= " << piece << " nr_pieces= " << nr_pieces << std::endl;
 #endif
-						node->relion_MPI_Send(MULTIDIM_ARRAY(Msum), MULTIDIM_SIZE(Msum), MY_MPI_DOUBLE, other_follower, MPITAG_PACK, MPI_COMM_WORLD);
-					}
-					else if (node->rank == other_follower)
-					{
-						node->relion_MPI_Recv(MULTIDIM_ARRAY(Msum), MULTIDIM_SIZE(Msum), MY_MPI_DOUBLE, this_follower, MPITAG_PACK, MPI_COMM_WORLD, status);
-#ifdef DEBUG
-						std::cerr << " CC RECV node->rank= " << node->rank << " MULTIDIM_SIZE(Msum)= "<< MULTIDIM_SIZE(Msum)
-								<< " this_follower= " << this_follower << " other_follower= "<<other_follower << std::endl;
-#endif
-					}
-				}
-			} // end for this_follower
+				node->relion_MPI_Allreduce(MULTIDIM_ARRAY(Mpack), MULTIDIM_SIZE(Mpack), MY_MPI_DOUBLE, MPI_SUM, halfsetC);
 
-
-			// Finally all followers unpack Msum into their wsum_model
-			if (!node->isLeader())
-			{
 				// Subtract 1 from piece because it was incremented already...
-				wsum_model.unpack(Msum, piece - 1);
-			}
-
-
-		} // end for piece
+				wsum_model.unpack(Mpack, piece - 1);
+			} // end for piece
+			wsum_model.pack_max_r2 = -1;
+		}
 
 		MPI_Barrier(MPI_COMM_WORLD);
 	}
@@ -1824,6 +1894,7 @@ void MlOptimiserMpi::combineWeightedSumsTwoRandomHalvesViaFile()
 
 	// Everyone packs up his wsum_model (simultaneously)
 	// The followers from 3 and onwards also need this in order to have the correct Mpack size to be able to read in the summed Mpack
+	setWeightedSumsPackRadius(MPI_COMM_WORLD);
 	if (!node->isLeader())
 		wsum_model.pack(Mpack);
 
@@ -1864,6 +1935,7 @@ void MlOptimiserMpi::combineWeightedSumsTwoRandomHalvesViaFile()
 	// Then everyone except the leader unpacks
 	if (!node->isLeader())
 		wsum_model.unpack(Mpack);
+	wsum_model.pack_max_r2 = -1;
 }
 
 void MlOptimiserMpi::combineWeightedSumsTwoRandomHalves()
@@ -1875,6 +1947,9 @@ void MlOptimiserMpi::combineWeightedSumsTwoRandomHalves()
 	MultidimArray<RFLOAT> Mpack, Msum;
 	MPI_Status status;
 
+	// The sum of both halves has no data beyond the largest radius in either of them
+	setWeightedSumsPackRadius(MPI_COMM_WORLD);
+
 	int piece = 0;
 	int nr_pieces = 1;
 	long int pack_size;
@@ -1937,6 +2012,7 @@ void MlOptimiserMpi::combineWeightedSumsTwoRandomHalves()
 			Mpack.clear();
 		}
 	}
+	wsum_model.pack_max_r2 = -1;
 }
 
 void MlOptimiserMpi::maximization()
@@ -1965,9 +2041,9 @@ void MlOptimiserMpi::maximization()
 		init_progress_bar(mymodel.nr_classes);
 	}
 
-	RFLOAT helical_twist_half1, helical_rise_half1, helical_twist_half2, helical_rise_half2;
-	helical_twist_half1 = helical_twist_half2 = helical_twist_initial;
-	helical_rise_half1 = helical_rise_half2 = helical_rise_initial;
+	RFLOAT helical_twist_half[2], helical_rise_half[2];
+	helical_twist_half[0] = helical_twist_half[1] = helical_twist_initial;
+	helical_rise_half[0] = helical_rise_half[1] = helical_rise_initial;
 
 	if (do_grad)
 	{
@@ -1986,308 +2062,117 @@ void MlOptimiserMpi::maximization()
     bool do_correct_tau2_by_avgctf2 = setAverageCTF2(avgctf2);
 
 	// First reconstruct all classes in parallel
-	for (int ibody = 0; ibody < mymodel.nr_bodies; ibody++)
+	// By default, each MPI-node has a different reference
+	int nr_recons = (mymodel.nr_bodies > 1) ? mymodel.nr_bodies : mymodel.nr_classes;
+	std::vector<std::vector<int> > reconstruct_ranks(2, std::vector<int>(nr_recons, 1));
+	for (int ith_recons = 0; ith_recons < nr_recons; ith_recons++)
 	{
+		if (do_split_random_halves)
+		{
+			reconstruct_ranks[0][ith_recons] = 2 * (ith_recons % ( (node->size - 1)/2 ) ) + 1;
+			reconstruct_ranks[1][ith_recons] = 2 * (ith_recons % ( (node->size - 1)/2 ) ) + 2;
+		}
+		else
+			reconstruct_ranks[0][ith_recons] = ith_recons % (node->size - 1) + 1;
+	}
 
+	std::vector<int> todo;
+	for (int ibody = 0; ibody < mymodel.nr_bodies; ibody++)
+	{
 		if (mymodel.nr_bodies > 1 && mymodel.keep_fixed_bodies[ibody] > 0)
 			continue;
 
 		for (int iclass = 0; iclass < mymodel.nr_classes; iclass++)
 		{
-			RCTIC(timer,RCT_1);
 			// either ibody or iclass can be larger than 0, never 2 at the same time!
 			int ith_recons = (mymodel.nr_bodies > 1) ? ibody : iclass;
 
-			if (wsum_model.pdf_class[iclass] > 0.)
-			{
-				// Parallelise: each MPI-node has a different reference
-				int reconstruct_rank1;
-				if (do_split_random_halves)
-					reconstruct_rank1 = 2 * (ith_recons % ( (node->size - 1)/2 ) ) + 1;
-				else
-					reconstruct_rank1 = ith_recons % (node->size - 1) + 1;
-
-				if (node->rank == reconstruct_rank1)
-				{
-
-					if ((wsum_model.BPref[ith_recons].weight).sum() > XMIPP_EQUAL_ACCURACY)
-					{
+			todo.push_back(ith_recons);
 
-						MultidimArray<RFLOAT> Iref_old;
-
-						(wsum_model.BPref[ith_recons]).updateSSNRarrays(mymodel.tau2_fudge_factor,
-								mymodel.tau2_class[ith_recons],
-								mymodel.sigma2_class[ith_recons],
-								mymodel.data_vs_prior_class[ith_recons],
-								mymodel.fourier_coverage_class[ith_recons],
-								mymodel.fsc_halves_class[ibody],
-                                avgctf2,
-								do_split_random_halves,
-								(do_join_random_halves || do_always_join_random_halves),
-                                do_correct_tau2_by_avgctf2);
+			// When not doing SGD, initialise to zero, but when doing SGD just keep the previous reference
+			if (!(wsum_model.pdf_class[iclass] > 0.) && !do_grad)
+				mymodel.Iref[ith_recons].initZeros();
+		}
+	}
 
-						if (do_external_reconstruct)
-						{
-							FileName fn_ext_root;
-							if (iter > -1) fn_ext_root.compose(fn_out+"_it", iter, "", 3);
-							else fn_ext_root = fn_out;
-							if (do_split_random_halves && !do_join_random_halves) fn_ext_root += "_half1";
-							if (mymodel.nr_bodies > 1) fn_ext_root.compose(fn_ext_root+"_body", ibody+1, "", 3);
-							else fn_ext_root.compose(fn_ext_root+"_class", iclass+1, "", 3);
-							(wsum_model.BPref[ith_recons]).externalReconstruct(mymodel.Iref[ith_recons],
-									fn_ext_root,
-									mymodel.fsc_halves_class[ith_recons],
-									mymodel.tau2_class[ith_recons],
-									mymodel.sigma2_class[ith_recons],
-									mymodel.data_vs_prior_class[ith_recons],
-									mymodel.pixel_size,
-									particle_diameter,
-									(do_join_random_halves || do_always_join_random_halves),
-									mymodel.tau2_fudge_factor,
-									node->rank==1); // only first followers is verbose
-						}
-						else
-						{
-							if(do_grad)
-							{
-								(wsum_model.BPref[ith_recons]).reconstructGrad(
-										mymodel.Iref[ith_recons],
-										mymodel.fsc_halves_class[ith_recons],
-										grad_current_stepsize,
-										mymodel.tau2_fudge_factor,
-										mymodel.getPixelFromResolution(1./grad_min_resol),
-										do_split_random_halves,
-										node->rank==1);
-							}
-							else
-							{
-								(wsum_model.BPref[ith_recons]).reconstruct(
-										mymodel.Iref[ith_recons],
-										gradient_refine ? 0: gridding_nr_iter,
-										do_map,
-										mymodel.tau2_class[ith_recons],
-										mymodel.tau2_fudge_factor,
-										wsum_model.pdf_class[iclass],
-										minres_map,
-										false);
-							}
-						}
-					}
+	RCTIC(timer,RCT_1);
+	// The gradient updates and the joining of the two halves at low resolution have changed the weighted sums only on the
+	// reconstruct ranks above, and distributed gridding needs the entire random half for every reconstruction.
+	// In all other cases, the leader hands out the reconstructions to the followers as soon as they are free.
+	if (!do_grad && !do_distributed_gridding && !do_join_random_halves && !(do_split_random_halves && low_resol_join_halves > 0.))
+	{
+		// In some cases there is not enough memory to reconstruct two random halves in parallel
+		// Therefore the following option exists to perform them sequentially
+		if (do_split_random_halves && do_sequential_halves_recons)
+		{
+			maximizationReconstructOnFreeFollowers(todo, 1, avgctf2, do_correct_tau2_by_avgctf2, reconstruct_ranks, helical_rise_half, helical_twist_half);
+			MPI_Barrier(MPI_COMM_WORLD);
+			maximizationReconstructOnFreeFollowers(todo, 2, avgctf2, do_correct_tau2_by_avgctf2, reconstruct_ranks, helical_rise_half, helical_twist_half);
+		}
+		else
+			maximizationReconstructOnFreeFollowers(todo, 0, avgctf2, do_correct_tau2_by_avgctf2, reconstruct_ranks, helical_rise_half, helical_twist_half);
+	}
+	else
+	{
+		for (int itodo = 0; itodo < todo.size(); itodo++)
+		{
+			int ith_recons = todo[itodo];
+			int iclass = (mymodel.nr_bodies > 1) ? 0 : ith_recons;
+			if (!(wsum_model.pdf_class[iclass] > 0.))
+				continue;
 
-					// Apply the body mask
-					if (mymodel.nr_bodies > 1)
-					{
-						// 19may2015 translate the reconstruction back to its C.O.M.
-						selfTranslate(mymodel.Iref[ibody], mymodel.com_bodies[ibody], DONT_WRAP);
+			int reconstruct_rank1 = reconstruct_ranks[0][ith_recons];
 
-//#define DEBUG_BODIES_SPI
-#ifdef DEBUG_BODIES_SPI
-						// Also write out unmasked body reconstruction
-						FileName fn_tmp;
-						fn_tmp.compose(fn_out + "_unmasked_half1_body", ibody+1,"spi");
-						Image<RFLOAT> Itmp;
-						Itmp()=mymodel.Iref[ibody];
-						Itmp.write(fn_tmp);
-#endif
+			// With distributed gridding, all other followers of this random half help reconstruct_rank1
+			DistributedGriddingMpi *gridding1 = NULL;
+			if (do_distributed_gridding && !node->isLeader() && (!do_split_random_halves || node->myRandomSubset() == 1))
+				gridding1 = new DistributedGriddingMpi(halfsetC, (do_split_random_halves) ? (reconstruct_rank1 - 1) / 2 : reconstruct_rank1 - 1);
 
-					}
+			if (node->rank == reconstruct_rank1)
+				maximizationReconstructHalf(ith_recons, 1, avgctf2, do_correct_tau2_by_avgctf2, gridding1, helical_rise_half[0], helical_twist_half[0]);
 
-					// Apply local symmetry according to a list of masks and their operators
-					if ( (fn_local_symmetry_masks.size() != 0) && (fn_local_symmetry_operators.size() != 0) && (!has_converged) )
-						applyLocalSymmetry(mymodel.Iref[ith_recons], fn_local_symmetry_masks, fn_local_symmetry_operators);
+			if (gridding1 != NULL)
+			{
+				if (node->rank == reconstruct_rank1)
+					gridding1->finish();
+				else
+					gridding1->help(wsum_model.BPref[ith_recons]);
+				delete gridding1;
+			}
 
-					// Shaoda Jul26,2015 - Helical symmetry local refinement
-					if ( (iter > 1) && (do_helical_refine) && (!ignore_helical_symmetry) && (do_helical_symmetry_local_refinement) && mymodel.ref_dim != 2)
-					{
-						localSearchHelicalSymmetry(
-								mymodel.Iref[ith_recons],
-								mymodel.pixel_size,
-								(particle_diameter / 2.),
-								(helical_tube_inner_diameter / 2.),
-								(helical_tube_outer_diameter / 2.),
-								helical_z_percentage,
-								mymodel.helical_rise_min,
-								mymodel.helical_rise_max,
-								mymodel.helical_rise_inistep,
-								mymodel.helical_rise[ith_recons],
-								mymodel.helical_twist_min,
-								mymodel.helical_twist_max,
-								mymodel.helical_twist_inistep,
-								mymodel.helical_twist[ith_recons]);
-					}
-					// Sjors & Shaoda Apr 2015 - Apply real space helical symmetry and real space Z axis expansion.
-					if ( (do_helical_refine) && (!ignore_helical_symmetry) && (!has_converged) && mymodel.ref_dim != 2)
-					{
-						imposeHelicalSymmetryInRealSpace(
-								mymodel.Iref[ith_recons],
-								mymodel.pixel_size,
-								(particle_diameter / 2.),
-								(helical_tube_inner_diameter / 2.),
-								(helical_tube_outer_diameter / 2.),
-								helical_z_percentage,
-								mymodel.helical_rise[ith_recons],
-								mymodel.helical_twist[ith_recons],
-								width_mask_edge);
-					}
-					helical_rise_half1 = mymodel.helical_rise[ith_recons];
-					helical_twist_half1 = mymodel.helical_twist[ith_recons];
+			// In some cases there is not enough memory to reconstruct two random halves in parallel
+			// Therefore the following option exists to perform them sequentially
+			if (do_sequential_halves_recons)
+				MPI_Barrier(MPI_COMM_WORLD);
 
-					// Also perform the unregularized reconstruction
-					if (do_auto_refine && has_converged)
-						readTemporaryDataAndWeightArraysAndReconstruct(ith_recons, 1);
+			// When splitting the data into two random halves, perform two reconstructions in parallel: one for each subset
+			if (do_split_random_halves)
+			{
+				int reconstruct_rank2 = reconstruct_ranks[1][ith_recons];
 
-				}
+				DistributedGriddingMpi *gridding2 = NULL;
+				if (do_distributed_gridding && node->myRandomSubset() == 2)
+					gridding2 = new DistributedGriddingMpi(halfsetC, (reconstruct_rank2 - 1) / 2);
 
-				// In some cases there is not enough memory to reconstruct two random halves in parallel
-				// Therefore the following option exists to perform them sequentially
-				if (do_sequential_halves_recons)
-					MPI_Barrier(MPI_COMM_WORLD);
+				if (node->rank == reconstruct_rank2)
+					maximizationReconstructHalf(ith_recons, 2, avgctf2, do_correct_tau2_by_avgctf2, gridding2, helical_rise_half[1], helical_twist_half[1]);
 
-				// When splitting the data into two random halves, perform two reconstructions in parallel: one for each subset
-				if (do_split_random_halves)
+				if (gridding2 != NULL)
 				{
-					int reconstruct_rank2 = 2 * (ith_recons % ( (node->size - 1)/2 ) ) + 2;
-
 					if (node->rank == reconstruct_rank2)
-					{
-						// Rank 2 does not need to do the joined reconstruction
-						if (!do_join_random_halves)
-						{
-							(wsum_model.BPref[ith_recons]).updateSSNRarrays(mymodel.tau2_fudge_factor,
-									mymodel.tau2_class[ith_recons],
-									mymodel.sigma2_class[ith_recons],
-									mymodel.data_vs_prior_class[ith_recons],
-									mymodel.fourier_coverage_class[ith_recons],
-									mymodel.fsc_halves_class[ibody],
-                                    avgctf2,
-									do_split_random_halves,
-									(do_join_random_halves || do_always_join_random_halves),
-                                    do_correct_tau2_by_avgctf2);
-
-							if (do_external_reconstruct)
-							{
-								FileName fn_ext_root;
-								if (iter > -1) fn_ext_root.compose(fn_out+"_it", iter, "", 3);
-								else fn_ext_root = fn_out;
-								if (do_split_random_halves && !do_join_random_halves) fn_ext_root += "_half2";
-								if (mymodel.nr_bodies > 1) fn_ext_root.compose(fn_ext_root+"_body", ibody+1, "", 3);
-								else fn_ext_root.compose(fn_ext_root+"_class", iclass+1, "", 3);
-								(wsum_model.BPref[ith_recons]).externalReconstruct(mymodel.Iref[ith_recons],
-										fn_ext_root,
-										mymodel.fsc_halves_class[ith_recons],
-										mymodel.tau2_class[ith_recons],
-										mymodel.sigma2_class[ith_recons],
-										mymodel.data_vs_prior_class[ith_recons],
-										mymodel.pixel_size,
-										particle_diameter,
-										(do_join_random_halves || do_always_join_random_halves),
-										mymodel.tau2_fudge_factor);
-							}
-							else
-							{
-								if(do_grad)
-								{
-									(wsum_model.BPref[ith_recons]).reconstructGrad(
-											mymodel.Iref[ith_recons],
-											mymodel.fsc_halves_class[ith_recons],
-											grad_current_stepsize,
-											mymodel.tau2_fudge_factor,
-											mymodel.getPixelFromResolution(1./grad_min_resol),
-											do_split_random_halves,
-											false);
-								}
-								else
-								{
-									(wsum_model.BPref[ith_recons]).reconstruct(mymodel.Iref[ith_recons],
-                                            gradient_refine ? 0: gridding_nr_iter,
-											do_map,
-											mymodel.tau2_class[ith_recons],
-											mymodel.tau2_fudge_factor,
-											wsum_model.pdf_class[iclass],
-											minres_map,
-											false);
-								}
-							}
-
-							// Apply the body mask
-							if (mymodel.nr_bodies > 1)
-							{
-								// 19may2015 translate the reconstruction back to its C.O.M.
-								selfTranslate(mymodel.Iref[ibody], mymodel.com_bodies[ibody], DONT_WRAP);
-
-#ifdef DEBUG_BODIES_SPI
-								FileName fn_tmp;
-								fn_tmp.compose(fn_out + "_unmasked_half2_body", ibody+1,"spi");
-								Image<RFLOAT> Itmp;
-								Itmp()=mymodel.Iref[ibody];
-								Itmp.write(fn_tmp);
-#endif
-							}
-
-							// Apply local symmetry according to a list of masks and their operators
-							if ( (fn_local_symmetry_masks.size() != 0) && (fn_local_symmetry_operators.size() != 0) && (!has_converged) )
-								applyLocalSymmetry(mymodel.Iref[ith_recons], fn_local_symmetry_masks, fn_local_symmetry_operators);
-
-							// Shaoda Jul26,2015 - Helical symmetry local refinement
-							if ( (iter > 1) && (do_helical_refine) && (!ignore_helical_symmetry) && (do_helical_symmetry_local_refinement) && mymodel.ref_dim != 2 )
-							{
-								localSearchHelicalSymmetry(
-										mymodel.Iref[ith_recons],
-										mymodel.pixel_size,
-										(particle_diameter / 2.),
-										(helical_tube_inner_diameter / 2.),
-										(helical_tube_outer_diameter / 2.),
-										helical_z_percentage,
-										mymodel.helical_rise_min,
-										mymodel.helical_rise_max,
-										mymodel.helical_rise_inistep,
-										mymodel.helical_rise[ith_recons],
-										mymodel.helical_twist_min,
-										mymodel.helical_twist_max,
-										mymodel.helical_twist_inistep,
-										mymodel.helical_twist[ith_recons]);
-							}
-							// Sjors & Shaoda Apr 2015 - Apply real space helical symmetry and real space Z axis expansion.
-							if( (do_helical_refine) && (!ignore_helical_symmetry) && (!has_converged) && mymodel.ref_dim != 2 )
-							{
-								imposeHelicalSymmetryInRealSpace(
-										mymodel.Iref[ith_recons],
-										mymodel.pixel_size,
-										(particle_diameter / 2.),
-										(helical_tube_inner_diameter / 2.),
-										(helical_tube_outer_diameter / 2.),
-										helical_z_percentage,
-										mymodel.helical_rise[ith_recons],
-										mymodel.helical_twist[ith_recons],
-										width_mask_edge);
-							}
-						} // end if !do_join_random_halves
-
-                        // Rank 2 still updates the estimated twist and rise
-                        helical_rise_half2 = mymodel.helical_rise[ith_recons];
-                        helical_twist_half2 = mymodel.helical_twist[ith_recons];
-
-						// But rank 2 always does the unfiltered reconstruction
-						if (do_auto_refine && has_converged)
-							readTemporaryDataAndWeightArraysAndReconstruct(ith_recons, 2);
-
-					}
+						gridding2->finish();
+					else
+						gridding2->help(wsum_model.BPref[ith_recons]);
+					delete gridding2;
 				}
-
-			} // endif pdf_class[iclass] > 0.
-			else
-			{
-				// When not doing SGD, initialise to zero, but when doing SGD just keep the previous reference
-				if (!do_grad)
-					mymodel.Iref[ith_recons].initZeros();
 			}
-			RCTOC(timer,RCT_1);
 //#define DEBUG_RECONSTRUCT
 #ifdef DEBUG_RECONSTRUCT
 			MPI_Barrier( MPI_COMM_WORLD);
 #endif
-		} // end for iclass
-	} // end for ibody
+		}
+	}
+	RCTOC(timer,RCT_1);
 
 #ifdef DEBUG
 	std::cerr << "rank= "<<node->rank<<" has reached barrier of reconstruction" << std::endl;
@@ -2323,7 +2208,7 @@ void MlOptimiserMpi::maximization()
 					{
 						if (node->myRandomSubset() == ihalfset)
 						{
-							int reconstruct_rank = 2 * (ith_recons % ( (node->size - 1)/2 ) ) + ihalfset; // first pass halfset1, second pass halfset2
+							int reconstruct_rank = reconstruct_ranks[ihalfset-1][ith_recons]; // first pass halfset1, second pass halfset2
 							int my_first_recv = node->myRandomSubset();
 
 							for (int recv_node = my_first_recv; recv_node < node->size; recv_node += nr_halfsets)
@@ -2381,7 +2266,7 @@ void MlOptimiserMpi::maximization()
 			}
 			else
 			{
-				int reconstruct_rank = (ith_recons % (node->size - 1) ) + 1;
+				int reconstruct_rank = reconstruct_ranks[0][ith_recons];
 				// Broadcast the reconstructed references to all other MPI nodes
 				node->relion_MPI_Bcast(MULTIDIM_ARRAY(mymodel.Iref[ith_recons]),
 						MULTIDIM_SIZE(mymodel.Iref[ith_recons]), MY_MPI_DOUBLE, reconstruct_rank, MPI_COMM_WORLD);
@@ -2418,20 +2303,14 @@ void MlOptimiserMpi::maximization()
 			// Aug05,2015 - Shaoda, helical symmetry refinement, broadcast refined helical parameters
 			if ( (iter > 1) && (do_helical_refine) && (!ignore_helical_symmetry) && (do_helical_symmetry_local_refinement) )
 			{
-				int reconstruct_rank1;
-				if (do_split_random_halves)
-					reconstruct_rank1 = 2 * (ith_recons % ( (node->size - 1)/2 ) ) + 1;
-				else
-					reconstruct_rank1 = ith_recons % (node->size - 1) + 1;
-				node->relion_MPI_Bcast(&helical_twist_half1, 1, MY_MPI_DOUBLE, reconstruct_rank1, MPI_COMM_WORLD);
-				node->relion_MPI_Bcast(&helical_rise_half1, 1, MY_MPI_DOUBLE, reconstruct_rank1, MPI_COMM_WORLD);
+				node->relion_MPI_Bcast(&helical_twist_half[0], 1, MY_MPI_DOUBLE, reconstruct_ranks[0][ith_recons], MPI_COMM_WORLD);
+				node->relion_MPI_Bcast(&helical_rise_half[0], 1, MY_MPI_DOUBLE, reconstruct_ranks[0][ith_recons], MPI_COMM_WORLD);
 
 				// When splitting the data into two random halves, perform two reconstructions in parallel: one for each subset
 				if (do_split_random_halves)
 				{
-					int reconstruct_rank2 = 2 * (ith_recons % ( (node->size - 1)/2 ) ) + 2;
-					node->relion_MPI_Bcast(&helical_twist_half2, 1, MY_MPI_DOUBLE, reconstruct_rank2, MPI_COMM_WORLD);
-					node->relion_MPI_Bcast(&helical_rise_half2, 1, MY_MPI_DOUBLE, reconstruct_rank2, MPI_COMM_WORLD);
+					node->relion_MPI_Bcast(&helical_twist_half[1], 1, MY_MPI_DOUBLE, reconstruct_ranks[1][ith_recons], MPI_COMM_WORLD);
+					node->relion_MPI_Bcast(&helical_rise_half[1], 1, MY_MPI_DOUBLE, reconstruct_ranks[1][ith_recons], MPI_COMM_WORLD);
 				}
 			}
 		}
@@ -2482,17 +2361,17 @@ void MlOptimiserMpi::maximization()
 				do_helical_symmetry_local_refinement,
 				mymodel.helical_rise,
 				mymodel.helical_twist,
-				helical_rise_half1,
-				helical_rise_half2,
-				helical_twist_half1,
-				helical_twist_half2,
+				helical_rise_half[0],
+				helical_rise_half[1],
+				helical_twist_half[0],
+				helical_twist_half[1],
 				do_split_random_halves, // TODO: && !join_random_halves ???
 				std::cout);
 	}
 	if ( (do_helical_refine) && (!ignore_helical_symmetry) && (do_split_random_halves))
 	{
-		mymodel.helical_rise[0] = (helical_rise_half1 + helical_rise_half2) / 2.;
-		mymodel.helical_twist[0] = (helical_twist_half1 + helical_twist_half2) / 2.;
+		mymodel.helical_rise[0] = (helical_rise_half[0] + helical_rise_half[1]) / 2.;
+		mymodel.helical_twist[0] = (helical_twist_half[0] + helical_twist_half[1]) / 2.;
 	}
 
 #ifdef DEBUG
@@ -2500,6 +2379,281 @@ void MlOptimiserMpi::maximization()
 #endif
 }
 
+void MlOptimiserMpi::maximizationReconstructHalf(int ith_recons, int ihalf, const MultidimArray<RFLOAT> &avgctf2, bool do_correct_tau2_by_avgctf2,
+		GriddingReconstructor *gridder, RFLOAT &helical_rise_half, RFLOAT &helical_twist_half)
+{
+	// either ibody or iclass can be larger than 0, never 2 at the same time!
+	int ibody = (mymodel.nr_bodies > 1) ? ith_recons : 0;
+	int iclass = (mymodel.nr_bodies > 1) ? 0 : ith_recons;
+
+	// The follower of the second half does not need to do the joined reconstruction
+	if (ihalf == 1 || !do_join_random_halves)
+	{
+		if (ihalf == 2 || (wsum_model.BPref[ith_recons].weight).sum() > XMIPP_EQUAL_ACCURACY)
+		{
+			(wsum_model.BPref[ith_recons]).updateSSNRarrays(mymodel.tau2_fudge_factor,
+					mymodel.tau2_class[ith_recons],
+					mymodel.sigma2_class[ith_recons],
+					mymodel.data_vs_prior_class[ith_recons],
+					mymodel.fourier_coverage_class[ith_recons],
+					mymodel.fsc_halves_class[ibody],
+					avgctf2,
+					do_split_random_halves,
+					(do_join_random_halves || do_always_join_random_halves),
+					do_correct_tau2_by_avgctf2);
+
+			if (do_external_reconstruct)
+			{
+				FileName fn_ext_root;
+				if (iter > -1) fn_ext_root.compose(fn_out+"_it", iter, "", 3);
+				else fn_ext_root = fn_out;
+				if (do_split_random_halves && !do_join_random_halves) fn_ext_root += "_half" + integerToString(ihalf);
+				if (mymodel.nr_bodies > 1) fn_ext_root.compose(fn_ext_root+"_body", ibody+1, "", 3);
+				else fn_ext_root.compose(fn_ext_root+"_class", iclass+1, "", 3);
+				(wsum_model.BPref[ith_recons]).externalReconstruct(mymodel.Iref[ith_recons],
+						fn_ext_root,
+						mymodel.fsc_halves_class[ith_recons],
+						mymodel.tau2_class[ith_recons],
+						mymodel.sigma2_class[ith_recons],
+						mymodel.data_vs_prior_class[ith_recons],
+						mymodel.pixel_size,
+						particle_diameter,
+						(do_join_random_halves || do_always_join_random_halves),
+						mymodel.tau2_fudge_factor,
+						node->rank==1); // only first followers is verbose
+			}
+			else
+			{
+				if(do_grad)
+				{
+					(wsum_model.BPref[ith_recons]).reconstructGrad(
+							mymodel.Iref[ith_recons],
+							mymodel.fsc_halves_class[ith_recons],
+							grad_current_stepsize,
+							mymodel.tau2_fudge_factor,
+							mymodel.getPixelFromResolution(1./grad_min_resol),
+							do_split_random_halves,
+							node->rank==1);
+				}
+				else
+				{
+					(wsum_model.BPref[ith_recons]).reconstruct(
+							mymodel.Iref[ith_recons],
+							gradient_refine ? 0: gridding_nr_iter,
+							do_map,
+							mymodel.tau2_class[ith_recons],
+							mymodel.tau2_fudge_factor,
+							wsum_model.pdf_class[iclass],
+							minres_map,
+							false,
+							0,
+							gridder);
+				}
+			}
+		}
+
+		// Apply the body mask
+		if (mymodel.nr_bodies > 1)
+		{
+			// 19may2015 translate the reconstruction back to its C.O.M.
+			selfTranslate(mymodel.Iref[ibody], mymodel.com_bodies[ibody], DONT_WRAP);
+
+//#define DEBUG_BODIES_SPI
+#ifdef DEBUG_BODIES_SPI
+			// Also write out unmasked body reconstruction
+			FileName fn_tmp;
+			fn_tmp.compose(fn_out + "_unmasked_half" + integerToString(ihalf) + "_body", ibody+1,"spi");
+			Image<RFLOAT> Itmp;
+			Itmp()=mymodel.Iref[ibody];
+			Itmp.write(fn_tmp);
+#endif
+
+		}
+
+		// Apply local symmetry according to a list of masks and their operators
+		if ( (fn_local_symmetry_masks.size() != 0) && (fn_local_symmetry_operators.size() != 0) && (!has_converged) )
+			applyLocalSymmetry(mymodel.Iref[ith_recons], fn_local_symmetry_masks, fn_local_symmetry_operators);
+
+		// Shaoda Jul26,2015 - Helical symmetry local refinement
+		if ( (iter > 1) && (do_helical_refine) && (!ignore_helical_symmetry) && (do_helical_symmetry_local_refinement) && mymodel.ref_dim != 2)
+		{
+			localSearchHelicalSymmetry(
+					mymodel.Iref[ith_recons],
+					mymodel.pixel_size,
+					(particle_diameter / 2.),
+					(helical_tube_inner_diameter / 2.),
+					(helical_tube_outer_diameter / 2.),
+					helical_z_percentage,
+					mymodel.helical_rise_min,
+					mymodel.helical_rise_max,
+					mymodel.helical_rise_inistep,
+					mymodel.helical_rise[ith_recons],
+					mymodel.helical_twist_min,
+					mymodel.helical_twist_max,
+					mymodel.helical_twist_inistep,
+					mymodel.helical_twist[ith_recons]);
+		}
+		// Sjors & Shaoda Apr 2015 - Apply real space helical symmetry and real space Z axis expansion.
+		if ( (do_helical_refine) && (!ignore_helical_symmetry) && (!has_converged) && mymodel.ref_dim != 2)
+		{
+			imposeHelicalSymmetryInRealSpace(
+					mymodel.Iref[ith_recons],
+					mymodel.pixel_size,
+					(particle_diameter / 2.),
+					(helical_tube_inner_diameter / 2.),
+					(helical_tube_outer_diameter / 2.),
+					helical_z_percentage,
+					mymodel.helical_rise[ith_recons],
+					mymodel.helical_twist[ith_recons],
+					width_mask_edge);
+		}
+	}
+
+	// The second half still updates the estimated twist and rise
+	#pragma omp critical(MlOptimiserMpi_maximization)
+	{
+		helical_rise_half = mymodel.helical_rise[ith_recons];
+		helical_twist_half = mymodel.helical_twist[ith_recons];
+	}
+
+	// Also perform the unregularized reconstruction (the second half always does this)
+	if (do_auto_refine && has_converged)
+		readTemporaryDataAndWeightArraysAndReconstruct(ith_recons, ihalf, gridder);
+}
+
+int MlOptimiserMpi::handOutTasksToFreeFollowers(const std::vector<int> &todo, int only_half, std::vector<std::vector<int> > &task_ranks)
+{
+	MPI_Status status;
+	int nr_halfsets = (do_split_random_halves) ? 2 : 1;
+
+	// Odd followers belong to the first random half, even ones to the second
+	std::vector<int> nr_followers(nr_halfsets, 0), next_todo(nr_halfsets, 0);
+	for (int rank = 1; rank < node->size; rank++)
+		nr_followers[(do_split_random_halves && rank % 2 == 0) ? 1 : 0]++;
+	int nr_working = 0;
+	for (int ihalf = 1; ihalf <= nr_halfsets; ihalf++)
+		if (only_half == 0 || only_half == ihalf)
+			nr_working += nr_followers[ihalf-1];
+
+	// Followers ask for up to request[1] tasks of their random half request[0] whenever they are free
+	// Give each of them at most its share of what is left, so that the last ones are spread over all free followers
+	// A reply without any tasks tells a follower it is done. Once a follower reports a failure (in request[2]),
+	// no more tasks are given out, and the last element of each reply tells the followers which one failed.
+	int request[3];
+	int failed_rank = -1;
+	std::vector<int> reply;
+	while (nr_working > 0)
+	{
+		node->relion_MPI_Recv(request, 3, MPI_INT, MPI_ANY_SOURCE, MPITAG_JOB_REQUEST, MPI_COMM_WORLD, status);
+		if (request[2] > 0 && failed_rank < 0)
+			failed_rank = status.MPI_SOURCE;
+		int ihalf = request[0];
+		int nr_left = (failed_rank < 0) ? todo.size() - next_todo[ihalf-1] : 0;
+		int nr_given = XMIPP_MIN(request[1], (nr_left + nr_followers[ihalf-1] - 1) / nr_followers[ihalf-1]);
+		reply.assign(request[1] + 1, -1);
+		for (int i = 0; i < nr_given; i++)
+		{
+			reply[i] = todo[next_todo[ihalf-1]++];
+			task_ranks[ihalf-1][reply[i]] = status.MPI_SOURCE;
+		}
+		reply[request[1]] = failed_rank;
+		if (nr_given == 0)
+			nr_working--;
+		node->relion_MPI_Send(&reply[0], request[1] + 1, MPI_INT, status.MPI_SOURCE, MPITAG_JOB_REPLY, MPI_COMM_WORLD);
+	}
+
+	return failed_rank;
+}
+
+int MlOptimiserMpi::askLeaderForTasks(int max_tasks, bool has_failed, std::vector<int> &mytodo)
+{
+	MPI_Status status;
+	int request[3];
+	request[0] = (do_split_random_halves) ? node->myRandomSubset() : 1;
+	request[1] = max_tasks;
+	request[2] = (has_failed) ? 1 : 0;
+	mytodo.resize(max_tasks + 1);
+	node->relion_MPI_Send(request, 3, MPI_INT, 0, MPITAG_JOB_REQUEST, MPI_COMM_WORLD);
+	node->relion_MPI_Recv(&mytodo[0], max_tasks + 1, MPI_INT, 0, MPITAG_JOB_REPLY, MPI_COMM_WORLD, status);
+
+	int nr_mytodo = 0;
+	while (nr_mytodo < max_tasks && mytodo[nr_mytodo] >= 0)
+		nr_mytodo++;
+	return nr_mytodo;
+}
+
+void MlOptimiserMpi::finishTaskQueue(int only_half, std::vector<std::vector<int> > &task_ranks, int failed_rank, std::exception_ptr error)
+{
+	int nr_halfsets = (do_split_random_halves) ? 2 : 1;
+
+	// Everyone needs to know where each task was done, and whether any of them failed
+	for (int ihalf = 1; ihalf <= nr_halfsets; ihalf++)
+		if (only_half == 0 || only_half == ihalf)
+			node->relion_MPI_Bcast(&task_ranks[ihalf-1][0], task_ranks[ihalf-1].size(), MPI_INT, 0, MPI_COMM_WORLD);
+	node->relion_MPI_Bcast(&failed_rank, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+	if (error)
+		std::rethrow_exception(error);
+	if (failed_rank > 0)
+		REPORT_ERROR("Maximization failed on follower " + integerToString(failed_rank) + ", see its error message.");
+}
+
+void MlOptimiserMpi::maximizationReconstructOnFreeFollowers(const std::vector<int> &todo, int only_half,
+		const MultidimArray<RFLOAT> &avgctf2, bool do_correct_tau2_by_avgctf2,
+		std::vector<std::vector<int> > &reconstruct_ranks, RFLOAT *helical_rise_half, RFLOAT *helical_twist_half)
+{
+	int failed_rank = -1;
+	std::exception_ptr reconstructException;
+
+	if (node->isLeader())
+		failed_rank = handOutTasksToFreeFollowers(todo, only_half, reconstruct_ranks);
+	else if (only_half == 0 || node->myRandomSubset() == only_half)
+	{
+		int ihalf = (do_split_random_halves) ? node->myRandomSubset() : 1;
+		int max_todo = getNrParallelReconstructions(todo.size(), nr_processes_on_node);
+		std::vector<int> mytodo;
+		RFLOAT &my_helical_rise = helical_rise_half[ihalf-1];
+		RFLOAT &my_helical_twist = helical_twist_half[ihalf-1];
+		while (true)
+		{
+			// After a failure, keep asking until the leader has told everyone to stop
+			int nr_mytodo = askLeaderForTasks(max_todo, (bool)reconstructException, mytodo);
+			if (nr_mytodo == 0)
+				break;
+
+			// Reconstruct different classes or bodies on different threads
+#ifdef MKLFFT
+			// Single-threaded FFTW execution inside the parallel reconstructions
+			if (nr_mytodo > 1)
+				FourierTransformer::setPlannerThreads(1);
+#endif
+			#pragma omp parallel for num_threads(nr_mytodo) schedule(dynamic)
+			for (int i = 0; i < nr_mytodo; i++)
+			{
+				int iclass = (mymodel.nr_bodies > 1) ? 0 : mytodo[i];
+				if (!(wsum_model.pdf_class[iclass] > 0.))
+					continue;
+				try
+				{
+					maximizationReconstructHalf(mytodo[i], ihalf, avgctf2, do_correct_tau2_by_avgctf2, NULL, my_helical_rise, my_helical_twist);
+				}
+				catch (...)
+				{
+					// Keep any exception (not only RelionErrors), so that the leader always hears about the failure
+					#pragma omp critical(MlOptimiserMpi_maximization)
+					if (!reconstructException)
+						reconstructException = std::current_exception();
+				}
+			}
+#ifdef MKLFFT
+			FourierTransformer::setPlannerThreads(nr_threads);
+#endif
+		}
+	}
+
+	finishTaskQueue(only_half, reconstruct_ranks, failed_rank, reconstructException);
+}
+
 void MlOptimiserMpi::maximizationSyncGradientParameters()
 {
 	MPI_Status status;
@@ -2790,181 +2944,227 @@ void MlOptimiserMpi::reconstructUnregularisedMapAndCalculateSolventCorrectedFSC(
 	if (fn_mask == "")
 		return;
 
-	for (int ibody = 0; ibody< mymodel.nr_bodies; ibody++ )
-	{
-
-		if (mymodel.nr_bodies > 1 && mymodel.keep_fixed_bodies[ibody] > 0)
-			continue;
+	std::vector<int> todo;
+	for (int ibody = 0; ibody < mymodel.nr_bodies; ibody++)
+		if (!(mymodel.nr_bodies > 1 && mymodel.keep_fixed_bodies[ibody] > 0))
+			todo.push_back(ibody);
 
-		int reconstruct_rank1 = 2 * (ibody % ( (node->size - 1)/2 ) ) + 1;
-		int reconstruct_rank2 = 2 * (ibody % ( (node->size - 1)/2 ) ) + 2;
-		if (mymodel.ref_dim == 3 && (node->rank == reconstruct_rank1 || (do_split_random_halves && node->rank == reconstruct_rank2) ) )
+	// The first follower also sends the current_size to the leader, so that it is the same on all ranks
+	MPI_Status status;
+	if (node->rank == 1)
+		node->relion_MPI_Send(&mymodel.current_size, 1, MPI_INT, 0, MPITAG_INT, MPI_COMM_WORLD);
+	if (node->rank == 0)
+		node->relion_MPI_Recv(&mymodel.current_size, 1, MPI_INT, 1, MPITAG_INT, MPI_COMM_WORLD, status);
+
+	// All followers of a random half have its weighted sums, so the leader hands out the unregularised reconstructions
+	// of the bodies to whichever follower of that half is free. One at a time, as these are full-size reconstructions.
+	std::vector<std::vector<int> > task_ranks(2, std::vector<int>(mymodel.nr_bodies, -1));
+	int failed_rank = -1;
+	std::exception_ptr taskException;
+	if (mymodel.ref_dim == 3)
+	{
+		if (node->isLeader())
+			failed_rank = handOutTasksToFreeFollowers(todo, 0, task_ranks);
+		else
 		{
-			Image<RFLOAT> Iunreg;
-			MultidimArray<RFLOAT> dummy;
-			FileName fn_root;
-			if (iter > -1)
-				fn_root.compose(fn_out+"_it", iter, "", 3);
-			else
-				fn_root = fn_out;
-			int random_halfset = (node->rank % 2 == 1) ? 1 : 2;
-			fn_root += "_half" + integerToString(random_halfset);;
-			if (mymodel.nr_bodies > 1)
-				fn_root.compose(fn_root+"_body", ibody+1, "", 3);
-			else
-				fn_root.compose(fn_root+"_class", 1, "", 3);
-
-			if (do_grad) {
-				Iunreg() = mymodel.Iref[ibody];
-			}
-			else {
-				BackProjector BPextra(wsum_model.BPref[ibody]);
-				BPextra.reconstruct(Iunreg(), gridding_nr_iter, false, dummy);
-			}
-
-			if (mymodel.nr_bodies > 1)
+			std::vector<int> mytodo;
+			while (askLeaderForTasks(1, (bool)taskException, mytodo) > 0)
 			{
-				// 19may2015 translate the reconstruction back to its C.O.M.
-				selfTranslate(Iunreg(), mymodel.com_bodies[ibody], DONT_WRAP);
+				try
+				{
+					reconstructUnregularisedMap(mytodo[0], node->myRandomSubset());
+				}
+				catch (...)
+				{
+					taskException = std::current_exception();
+				}
 			}
-
-			// Update header information
-			Iunreg().setXmippOrigin();
-			Iunreg.setStatisticsInHeader();
-			Iunreg.setSamplingRateInHeader(mymodel.pixel_size);
-			// And write the resulting model to disc
-			Iunreg.write(fn_root+"_unfil.mrc");
 		}
+		finishTaskQueue(0, task_ranks, failed_rank, taskException);
+	}
 
-		// reconstruct_rank1 also sends the current_size to the leader, so that it knows where to cut the FSC to zero
-		MPI_Status status;
-		if (node->rank == reconstruct_rank1)
-			node->relion_MPI_Send(&mymodel.current_size, 1, MPI_INT, 0, MPITAG_INT, MPI_COMM_WORLD);
-		if (node->rank == 0)
-			node->relion_MPI_Recv(&mymodel.current_size, 1, MPI_INT, reconstruct_rank1, MPITAG_INT, MPI_COMM_WORLD, status);
-
-		MPI_Barrier(MPI_COMM_WORLD);
-
-		if (node->rank == 0) // Let's do this on the leader (hopefully it has more memory)
+	// Then the followers of the first half calculate the FSCs of the bodies, also as soon as they are free
+	failed_rank = -1;
+	if (node->isLeader())
+		failed_rank = handOutTasksToFreeFollowers(todo, 1, task_ranks);
+	else if (node->myRandomSubset() == 1)
+	{
+		std::vector<int> mytodo;
+		while (askLeaderForTasks(1, (bool)taskException, mytodo) > 0)
 		{
-			if (mymodel.nr_bodies > 1)
-				std::cout << " Calculating solvent-corrected gold-standard FSC for " << ibody+1 << "th body ..."<< std::endl;
-			else
-				std::cout << " Calculating solvent-corrected gold-standard FSC ..."<< std::endl;
-
-			// Read in the half-reconstruction from rank2 and perform the postprocessing-like FSC correction
-			Image<RFLOAT> Iunreg1, Iunreg2;
-			FileName fn_root1, fn_root2;
-			if (iter > -1)
-				fn_root1.compose(fn_out+"_it", iter, "", 3);
-			else
-				fn_root1 = fn_out;
-			if (mymodel.nr_bodies > 1)
+			try
 			{
-				fn_root2.compose(fn_root1+"_half2_body", ibody+1, "", 3);
-				fn_root1.compose(fn_root1+"_half1_body", ibody+1, "", 3);
+				calculateSolventCorrectedFSC(mytodo[0]);
 			}
-			else
+			catch (...)
 			{
-				fn_root2.compose(fn_root1+"_half2_class", 1, "", 3);
-				fn_root1.compose(fn_root1+"_half1_class", 1, "", 3);
+				taskException = std::current_exception();
 			}
-			fn_root1 += "_unfil.mrc";
-			fn_root2 += "_unfil.mrc";
-			Iunreg1.read(fn_root1);
-			Iunreg2.read(fn_root2);
-			Iunreg1().setXmippOrigin();
-			Iunreg2().setXmippOrigin();
+		}
+	}
+	finishTaskQueue(1, task_ranks, failed_rank, taskException);
 
-			// Now do phase-randomisation FSC-correction for the solvent mask
-			MultidimArray<RFLOAT> fsc_unmasked, fsc_masked, fsc_random_masked, fsc_true;
+	// Now the followers that calculated the fsc curves send them to everyone else
+	for (int itodo = 0; itodo < todo.size(); itodo++)
+	{
+		int ibody = todo[itodo];
+		node->relion_MPI_Bcast(MULTIDIM_ARRAY(mymodel.fsc_halves_class[ibody]), MULTIDIM_SIZE(mymodel.fsc_halves_class[ibody]), MY_MPI_DOUBLE, task_ranks[0][ibody], MPI_COMM_WORLD);
+	}
+}
 
-			// Calculate FSC of the unmasked maps
-			getFSC(Iunreg1(), Iunreg2(), fsc_unmasked);
+void MlOptimiserMpi::reconstructUnregularisedMap(int ibody, int ihalf)
+{
+	Image<RFLOAT> Iunreg;
+	MultidimArray<RFLOAT> dummy;
+	FileName fn_root;
+	if (iter > -1)
+		fn_root.compose(fn_out+"_it", iter, "", 3);
+	else
+		fn_root = fn_out;
+	fn_root += "_half" + integerToString(ihalf);
+	if (mymodel.nr_bodies > 1)
+		fn_root.compose(fn_root+"_body", ibody+1, "", 3);
+	else
+		fn_root.compose(fn_root+"_class", 1, "", 3);
 
-			Image<RFLOAT> Imask;
-			if (mymodel.nr_bodies > 1)
-			{
-				Imask() = mymodel.masks_bodies[ibody];
-			}
-			else
-			{
-				Imask.read(fn_mask);
-			}
-			Imask().setXmippOrigin();
-			Iunreg1() *= Imask();
-			Iunreg2() *= Imask();
-			getFSC(Iunreg1(), Iunreg2(), fsc_masked);
+	if (do_grad) {
+		Iunreg() = mymodel.Iref[ibody];
+	}
+	else {
+		BackProjector BPextra(wsum_model.BPref[ibody]);
+		BPextra.reconstruct(Iunreg(), gridding_nr_iter, false, dummy);
+	}
 
-			// To save memory re-read the same input maps again and randomize phases before masking
-			Iunreg1.read(fn_root1);
-			Iunreg2.read(fn_root2);
-			Iunreg1().setXmippOrigin();
-			Iunreg2().setXmippOrigin();
+	if (mymodel.nr_bodies > 1)
+	{
+		// 19may2015 translate the reconstruction back to its C.O.M.
+		selfTranslate(Iunreg(), mymodel.com_bodies[ibody], DONT_WRAP);
+	}
 
-			// Check at which resolution shell the FSC drops below 0.8
-			int randomize_at = -1;
-			FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(fsc_unmasked)
-			{
-				if (i > 0 && DIRECT_A1D_ELEM(fsc_unmasked, i) < 0.8)
-				{
-					randomize_at = i;
-					break;
-				}
-			}
-			if (randomize_at > 0)
+	// Update header information
+	Iunreg().setXmippOrigin();
+	Iunreg.setStatisticsInHeader();
+	Iunreg.setSamplingRateInHeader(mymodel.pixel_size);
+	// And write the resulting model to disc
+	Iunreg.write(fn_root+"_unfil.mrc");
+}
+
+void MlOptimiserMpi::calculateSolventCorrectedFSC(int ibody)
+{
+	if (ori_verb > 0)
+	{
+		if (mymodel.nr_bodies > 1)
+			std::cout << " Calculating solvent-corrected gold-standard FSC for " << ibody+1 << "th body ..."<< std::endl;
+		else
+			std::cout << " Calculating solvent-corrected gold-standard FSC ..."<< std::endl;
+	}
+
+	// Read in the half-reconstructions of both random halves and perform the postprocessing-like FSC correction
+	Image<RFLOAT> Iunreg1, Iunreg2;
+	FileName fn_root1, fn_root2;
+	if (iter > -1)
+		fn_root1.compose(fn_out+"_it", iter, "", 3);
+	else
+		fn_root1 = fn_out;
+	if (mymodel.nr_bodies > 1)
+	{
+		fn_root2.compose(fn_root1+"_half2_body", ibody+1, "", 3);
+		fn_root1.compose(fn_root1+"_half1_body", ibody+1, "", 3);
+	}
+	else
+	{
+		fn_root2.compose(fn_root1+"_half2_class", 1, "", 3);
+		fn_root1.compose(fn_root1+"_half1_class", 1, "", 3);
+	}
+	fn_root1 += "_unfil.mrc";
+	fn_root2 += "_unfil.mrc";
+	Iunreg1.read(fn_root1);
+	Iunreg2.read(fn_root2);
+	Iunreg1().setXmippOrigin();
+	Iunreg2().setXmippOrigin();
+
+	// Now do phase-randomisation FSC-correction for the solvent mask
+	MultidimArray<RFLOAT> fsc_unmasked, fsc_masked, fsc_random_masked, fsc_true;
+
+	// Calculate FSC of the unmasked maps
+	getFSC(Iunreg1(), Iunreg2(), fsc_unmasked);
+
+	Image<RFLOAT> Imask;
+	if (mymodel.nr_bodies > 1)
+	{
+		Imask() = mymodel.masks_bodies[ibody];
+	}
+	else
+	{
+		Imask.read(fn_mask);
+	}
+	Imask().setXmippOrigin();
+	Iunreg1() *= Imask();
+	Iunreg2() *= Imask();
+	getFSC(Iunreg1(), Iunreg2(), fsc_masked);
+
+	// To save memory re-read the same input maps again and randomize phases before masking
+	Iunreg1.read(fn_root1);
+	Iunreg2.read(fn_root2);
+	Iunreg1().setXmippOrigin();
+	Iunreg2().setXmippOrigin();
+
+	// Check at which resolution shell the FSC drops below 0.8
+	int randomize_at = -1;
+	FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(fsc_unmasked)
+	{
+		if (i > 0 && DIRECT_A1D_ELEM(fsc_unmasked, i) < 0.8)
+		{
+			randomize_at = i;
+			break;
+		}
+	}
+	if (randomize_at > 0)
+	{
+		if (ori_verb > 0)
+		{
+			std::cout.width(35); std::cout << std::left << "  + randomize phases beyond: "; std::cout << XSIZE(Iunreg1())* mymodel.pixel_size / randomize_at << " Angstroms" << std::endl;
+		}
+		randomizePhasesBeyond(Iunreg1(), randomize_at);
+		randomizePhasesBeyond(Iunreg2(), randomize_at);
+		// Mask randomized phases maps and calculated fsc_random_masked
+		Iunreg1() *= Imask();
+		Iunreg2() *= Imask();
+		getFSC(Iunreg1(), Iunreg2(), fsc_random_masked);
+
+		// Now that we have fsc_masked and fsc_random_masked, calculate fsc_true according to Richard's formula
+		// FSC_true = FSC_t - FSC_n / ( )
+		fsc_true.resize(fsc_masked);
+		FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(fsc_true)
+		{
+			// 29jan2015: let's move this 2 shells upwards, because of small artefacts near the resolution of randomisation!
+			if (i < randomize_at + 2)
 			{
-				if (verb > 0)
-				{
-					std::cout.width(35); std::cout << std::left << "  + randomize phases beyond: "; std::cout << XSIZE(Iunreg1())* mymodel.pixel_size / randomize_at << " Angstroms" << std::endl;
-				}
-				randomizePhasesBeyond(Iunreg1(), randomize_at);
-				randomizePhasesBeyond(Iunreg2(), randomize_at);
-				// Mask randomized phases maps and calculated fsc_random_masked
-				Iunreg1() *= Imask();
-				Iunreg2() *= Imask();
-				getFSC(Iunreg1(), Iunreg2(), fsc_random_masked);
-
-				// Now that we have fsc_masked and fsc_random_masked, calculate fsc_true according to Richard's formula
-				// FSC_true = FSC_t - FSC_n / ( )
-				fsc_true.resize(fsc_masked);
-				FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(fsc_true)
-				{
-					// 29jan2015: let's move this 2 shells upwards, because of small artefacts near the resolution of randomisation!
-					if (i < randomize_at + 2)
-					{
-						DIRECT_A1D_ELEM(fsc_true, i) = DIRECT_A1D_ELEM(fsc_masked, i);
-					}
-					else
-					{
-						RFLOAT fsct = DIRECT_A1D_ELEM(fsc_masked, i);
-						RFLOAT fscn = DIRECT_A1D_ELEM(fsc_random_masked, i);
-						if (fscn > fsct)
-							DIRECT_A1D_ELEM(fsc_true, i) = 0.;
-						else
-							DIRECT_A1D_ELEM(fsc_true, i) = (fsct - fscn) / (1. - fscn);
-					}
-				}
-				mymodel.fsc_halves_class[ibody] = fsc_true;
+				DIRECT_A1D_ELEM(fsc_true, i) = DIRECT_A1D_ELEM(fsc_masked, i);
 			}
 			else
 			{
-				std::cerr << " WARNING: FSC curve between unmasked maps never drops below 0.8. Using unmasked FSC as FSC_true... "<<std::endl;
-				std::cerr << " WARNING: This message should go away during the later stages of refinement!" << std::endl;
-
-				mymodel.fsc_halves_class[ibody] = fsc_unmasked;
+				RFLOAT fsct = DIRECT_A1D_ELEM(fsc_masked, i);
+				RFLOAT fscn = DIRECT_A1D_ELEM(fsc_random_masked, i);
+				if (fscn > fsct)
+					DIRECT_A1D_ELEM(fsc_true, i) = 0.;
+				else
+					DIRECT_A1D_ELEM(fsc_true, i) = (fsct - fscn) / (1. - fscn);
 			}
-
-			// Set fsc_halves_class explicitly to zero beyond the current_size
-			for (int idx = mymodel.current_size / 2 + 1; idx < MULTIDIM_SIZE(mymodel.fsc_halves_class[ibody]); idx++)
-				DIRECT_A1D_ELEM(mymodel.fsc_halves_class[ibody], idx) = 0.;
-
 		}
+		mymodel.fsc_halves_class[ibody] = fsc_true;
+	}
+	else
+	{
+		std::cerr << " WARNING: FSC curve between unmasked maps never drops below 0.8. Using unmasked FSC as FSC_true... "<<std::endl;
+		std::cerr << " WARNING: This message should go away during the later stages of refinement!" << std::endl;
 
-		// Now the leader sends the fsc curve to everyone else
-		node->relion_MPI_Bcast(MULTIDIM_ARRAY(mymodel.fsc_halves_class[ibody]), MULTIDIM_SIZE(mymodel.fsc_halves_class[ibody]), MY_MPI_DOUBLE, 0, MPI_COMM_WORLD);
+		mymodel.fsc_halves_class[ibody] = fsc_unmasked;
+	}
 
-	} // end loop over all bodies
+	// Set fsc_halves_class explicitly to zero beyond the current_size
+	for (int idx = mymodel.current_size / 2 + 1; idx < MULTIDIM_SIZE(mymodel.fsc_halves_class[ibody]); idx++)
+		DIRECT_A1D_ELEM(mymodel.fsc_halves_class[ibody], idx) = 0.;
 }
 
 void MlOptimiserMpi::writeTemporaryDataAndWeightArrays()
@@ -3014,7 +3214,7 @@ void MlOptimiserMpi::writeTemporaryDataAndWeightArrays()
 	MPI_Barrier(MPI_COMM_WORLD);
 }
 
-void MlOptimiserMpi::readTemporaryDataAndWeightArraysAndReconstruct(int iclass, int ihalf)
+void MlOptimiserMpi::readTemporaryDataAndWeightArraysAndReconstruct(int iclass, int ihalf, GriddingReconstructor *gridder)
 {
 	MultidimArray<RFLOAT> dummy;
 	Image<RFLOAT> Iunreg, Itmp;
@@ -3073,7 +3273,7 @@ void MlOptimiserMpi::readTemporaryDataAndWeightArraysAndReconstruct(int iclass,
 	}
 
 	// Now perform the unregularized reconstruction
-	wsum_model.BPref[iclass].reconstruct(Iunreg(), gridding_nr_iter, false, dummy);
+	wsum_model.BPref[iclass].reconstruct(Iunreg(), gridding_nr_iter, false, dummy, 1., 1., -1, false, 0, gridder);
 
 	if (mymodel.nr_bodies > 1)
 	{
@@ -3826,4 +4026,8 @@ void MlOptimiserMpi::iterate()
 	// delete threads etc.
 	MlOptimiser::iterateWrapUp();
 	MPI_Barrier(MPI_COMM_WORLD);
+
+	// The random-half communicator is only used during the iterations
+	if (halfsetC != MPI_COMM_NULL)
+		MPI_Comm_free(&halfsetC);
 }
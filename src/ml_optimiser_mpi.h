@@ -20,8 +20,10 @@
 
 #ifndef ML_OPTIMISER_MPI_H_
 #define ML_OPTIMISER_MPI_H_
+#include <exception>
 #include "src/mpi.h"
 #include "src/ml_optimiser.h"
+#include "src/backprojector_mpi.h"
 
 // definition of MPITAG has been moved to header mpi.h
 
@@ -32,6 +34,12 @@ class MlOptimiserMpi: public MlOptimiser
 public:
 	MpiNode *node;
 
+	// Communicator of all followers in the same random half (MPI_COMM_NULL on the leader)
+	MPI_Comm halfsetC;
+
+	// Number of processes on the node of this one, which share its memory
+	int nr_processes_on_node;
+
 #ifdef TIMINGMPI
     int MPIR_PACK, MPIR_ALLREDUCE, MPIR_UNPACK, MPIR_EXP, MPIR_MAX, MPIR_BCAST;
 #endif
@@ -39,6 +47,9 @@ public:
     // For debugging: keep temporary/debug weight and data mrc files
     bool do_keep_debug_reconstruct_files;
 
+    // Distribute the gridding of each 3D reconstruction over all followers of its random half
+    bool do_distributed_gridding;
+
     // For debugging: halt all followers except this one
     int halt_all_followers_except_this;
 
@@ -73,11 +84,21 @@ public:
      */
     void expectation();
 
+    /** Only pack the Fourier shells of the weighted sums that contain data on any of the ranks in comm
+     *  (collective on comm, see MlWsumModel::pack_max_r2)
+     */
+    void setWeightedSumsPackRadius(MPI_Comm comm);
+
     /** After expectation combine all weighted sum arrays across all nodes
      *  Use read/write to temporary files instead of MPI
      */
     void combineAllWeightedSumsViaFile();
 
+    /** Sum the packed weighted sums of all followers in each subset with a reduce-scatter and allgather through files
+     *  (used by combineAllWeightedSumsViaFile when all followers may access the disc at the same time)
+     */
+    void combineWeightedSumsSlicesViaFile(MultidimArray<RFLOAT> &Mpack);
+
     /** Join the sums from two random halves
      *  Use read/write to temporary files instead of MPI
      */
@@ -96,14 +117,53 @@ public:
      */
     void maximization();
 
+    /** Reconstruct reference ith_recons from the weighted sums of random half ihalf (1 when not splitting the data)
+     *  on this follower, and store the refined helical symmetry in helical_rise_half and helical_twist_half.
+     *  If gridder is given, it does the gridding of the reconstruction (see --distributed_gridding).
+     */
+    void maximizationReconstructHalf(int ith_recons, int ihalf, const MultidimArray<RFLOAT> &avgctf2, bool do_correct_tau2_by_avgctf2,
+    		GriddingReconstructor *gridder, RFLOAT &helical_rise_half, RFLOAT &helical_twist_half);
+
+    /** Let the leader hand out the reconstructions in todo to the followers of only_half (or of both halves if only_half == 0)
+     *  as soon as they become free. Followers with multiple threads take several reconstructions at a time.
+     *  On return, reconstruct_ranks[ihalf-1][ith_recons] holds the rank that did each reconstruction on all ranks.
+     *  If a reconstruction fails on any follower, this throws on all ranks.
+     */
+    void maximizationReconstructOnFreeFollowers(const std::vector<int> &todo, int only_half,
+    		const MultidimArray<RFLOAT> &avgctf2, bool do_correct_tau2_by_avgctf2,
+    		std::vector<std::vector<int> > &reconstruct_ranks, RFLOAT *helical_rise_half, RFLOAT *helical_twist_half);
+
+    /** The leader side of the task queue of maximizationReconstructOnFreeFollowers: hand out the tasks in todo to the
+     *  followers of only_half (or of both halves if only_half == 0) whenever they ask for them, and store in
+     *  task_ranks[ihalf-1][task] the follower that got each task. Returns the rank of a follower that failed, or -1.
+     */
+    int handOutTasksToFreeFollowers(const std::vector<int> &todo, int only_half, std::vector<std::vector<int> > &task_ranks);
+
+    /** The follower side: ask the leader for up to max_tasks tasks, and tell it whether this follower has failed.
+     *  Returns the number of tasks put in mytodo; 0 when there is nothing left to do.
+     */
+    int askLeaderForTasks(int max_tasks, bool has_failed, std::vector<int> &mytodo);
+
+    /** Let everyone know task_ranks and failed_rank (as known on the leader) and throw if any follower failed.
+     *  A follower that failed passes its exception, which is rethrown here.
+     */
+    void finishTaskQueue(int only_half, std::vector<std::vector<int> > &task_ranks, int failed_rank, std::exception_ptr error);
+
     void maximizationSyncGradientParameters();
 	void maximizationGradientParametersRandomHalves();
 
     /** Perform unregularized reconstruction
       * With the aim of performing solvent mask corrected FSC inside the auto-refine
+      * The reconstructions and FSCs of the bodies are handed out to the followers as they become free.
       */
     void reconstructUnregularisedMapAndCalculateSolventCorrectedFSC();
 
+    /** Write the unregularised reconstruction of ibody for random half ihalf (on a follower of that half) */
+    void reconstructUnregularisedMap(int ibody, int ihalf);
+
+    /** Calculate the solvent-corrected FSC of ibody from the unregularised maps of both halves */
+    void calculateSolventCorrectedFSC(int ibody);
+
     /**
      *  Write temporary data and weight arrays from the backprojector to disc to allow unregularized reconstructions
      */
@@ -112,8 +172,9 @@ public:
     /**
      *  Read temporary data and weight arrays from disc and perform unregularized reconstructions
      *  Also write the unregularized reconstructions to disc.
+     *  If gridder is given, it does the gridding of the reconstruction (see --distributed_gridding).
      */
-    void readTemporaryDataAndWeightArraysAndReconstruct(int iclass, int ihalf);
+    void readTemporaryDataAndWeightArraysAndReconstruct(int iclass, int ihalf, GriddingReconstructor *gridder = NULL);
 
     /**
      * Join two independent reconstructions ate the lowest frequencies to avoid convergence in distinct orientations
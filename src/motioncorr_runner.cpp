@@ -18,6 +18,7 @@
  * author citations must be preserved.
  ***************************************************************************/
 #include <omp.h>
+#include <unistd.h>
 
 #include "src/motioncorr_runner.h"
 #ifdef _CUDA_ENABLED
@@ -122,6 +123,7 @@ void MotioncorrRunner::read(int argc, char **argv, int rank)
 	write_float16  = parser.checkOption("--float16", "Write in half-precision 16 bit floating point numbers (MRC mode 12), instead of 32 bit (MRC mode 0).");
 	skip_defect = parser.checkOption("--skip_defect", "Skip hot pixel detection");
 	save_noDW = parser.checkOption("--save_noDW", "Save aligned but non dose weighted micrograph");
+	do_read_ahead = !parser.checkOption("--no_read_ahead", "Do not read the next movie while the current one is being aligned (this is only done when there is enough free memory anyway)");
 	max_iter = textToInteger(parser.getOption("--max_iter", "Maximum number of iterations for alignment. Only valid with --use_own", "5"));
 	if (max_iter != 5 && !do_own)
 		REPORT_ERROR("--max_iter is valid only with --do_own");
@@ -471,7 +473,10 @@ void MotioncorrRunner::run()
 
 		bool result = false;
 		if (do_own)
+		{
+			fn_read_ahead_next = (imic + 1 < fn_micrographs.size()) ? fn_micrographs[imic + 1] : "";
 			result = executeOwnMotionCorrection(mic);
+		}
 		else if (do_motioncor2)
 			result = executeMotioncor2(mic);
 		else
@@ -994,6 +999,163 @@ void MotioncorrRunner::generateLogFilePDFAndWriteStarFiles()
 	}
 }
 
+void MotioncorrRunner::readMovie(FileName fn_mic, int n_io_threads, int n_gain_threads, int &nx, int &ny, int &nn,
+                                 std::vector<int> &frames, std::vector<Image<float> > &Iframes, Image<float> &Igain)
+{
+	// EER and compressed MRC related things
+	// TODO: will be refactored
+	EERRenderer renderer;
+	const bool isEER = EERRenderer::isEER(fn_mic);
+	CompressedMRCReader compressedMRCreader;
+	const bool isCompressedMRC = compressedMRCreader.isCompressedMRC(fn_mic);
+	Image<float> Ihead;
+
+	// Check image size
+	if (isEER)
+	{
+		renderer.read(fn_mic, eer_upsampling);
+		nx = renderer.getWidth(); ny = renderer.getHeight();
+		nn = renderer.getNFrames() / eer_grouping; // remaining frames are truncated
+	}
+	else if (isCompressedMRC)
+	{
+		compressedMRCreader.read(fn_mic, n_io_threads);
+		nx = XSIZE(compressedMRCreader.Ihead()); ny = YSIZE(compressedMRCreader.Ihead());
+		nn = NSIZE(compressedMRCreader.Ihead());
+	}
+	else
+	{
+		Ihead.read(fn_mic, false, -1, false, true); // select_img -1, mmap false, is_2D true
+		nx = XSIZE(Ihead()); ny = YSIZE(Ihead()); nn = NSIZE(Ihead());
+	}
+
+	// Which frame to use?
+	frames.clear();
+	for (int i = 0; i < nn; i++) {
+		// For users, all numbers are 1-indexed. Internally they are 0-indexed.
+		int frame = i + 1;
+		if (frame < first_frame_sum) continue;
+		if (last_frame_sum > 0 && frame > last_frame_sum) continue;
+		frames.push_back(i);
+	}
+
+	// Do not bother reading movies that will be skipped
+	Iframes.clear();
+	const int n_frames = frames.size();
+	if (n_frames / group < 3)
+		return;
+	Iframes.resize(n_frames);
+
+	// Read gain reference
+	RCTIC(TIMING_READ_GAIN);
+	if (fn_gain_reference != "") {
+		if (isEER)
+			EERRenderer::loadEERGain(fn_gain_reference, Igain(), eer_upsampling);
+		else
+			Igain.read(fn_gain_reference);
+
+		if (XSIZE(Igain()) != nx || YSIZE(Igain()) != ny) {
+			std::cerr << "fn_mic: " << fn_mic << " nx = " << nx << " ny = " << ny << " gain nx = " << XSIZE(Igain()) << " gain ny = " << YSIZE(Igain()) <<  std::endl;
+			REPORT_ERROR("The size of the image and the size of the gain reference do not match. Make sure the gain reference has been rotated if necessary.");
+		}
+	}
+	RCTOC(TIMING_READ_GAIN);
+
+	// Read images
+	#pragma omp parallel for num_threads(isCompressedMRC ? 1 : n_io_threads)
+	for (int iframe = 0; iframe < n_frames; iframe++) {
+		if (isEER)
+			renderer.renderFrames(frames[iframe] * eer_grouping + 1, (frames[iframe] + 1) * eer_grouping, Iframes[iframe]());
+		else if (isCompressedMRC)
+			compressedMRCreader.readFrameInto(Iframes[iframe], frames[iframe]);
+		else
+			Iframes[iframe].read(fn_mic, true, frames[iframe], false, true); // mmap false, is_2D true
+	}
+
+	// Apply gain
+	RCTIC(TIMING_APPLY_GAIN);
+	if (fn_gain_reference != "") {
+		#pragma omp parallel for num_threads(n_gain_threads)
+		for (int iframe = 0; iframe < n_frames; iframe++) {
+			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Igain()) {
+				DIRECT_MULTIDIM_ELEM(Iframes[iframe](), n) *= DIRECT_MULTIDIM_ELEM(Igain(), n);
+			}
+		}
+	}
+	RCTOC(TIMING_APPLY_GAIN);
+}
+
+void MotioncorrRunner::startReadAhead(FileName fn_mic, int n_io_threads, const std::vector<Image<float> > &Iframes, std::ostream &logfile)
+{
+	if (fn_mic == "")
+		return;
+
+	// The next movie is kept in memory next to the current one and its Fourier transforms.
+	// Only read it ahead if that still fits, assuming it has the same size as the current movie.
+	RFLOAT movie_Gb = 0;
+	for (int iframe = 0; iframe < Iframes.size(); iframe++)
+		movie_Gb += (RFLOAT)MULTIDIM_SIZE(Iframes[iframe]()) * sizeof(float) / (1024. * 1024. * 1024.);
+	RFLOAT free_Gb = (RFLOAT)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE) / (1024. * 1024. * 1024.);
+	if (free_Gb < 2 * movie_Gb)
+	{
+		logfile << "Not reading " << fn_mic << " ahead, as only " << free_Gb << " Gb of memory is free." << std::endl;
+		return;
+	}
+
+	if (read_ahead.worker.joinable())
+		read_ahead.worker.join();
+
+	read_ahead.fn_mic = fn_mic;
+	read_ahead.error = std::exception_ptr();
+	read_ahead.worker = std::thread([this, fn_mic, n_io_threads]()
+	{
+		// The alignment of the current movie keeps all n_threads busy, so only use the IO threads here.
+		// Nothing may escape this thread (that would terminate the program): keep it for takeReadAhead.
+		try
+		{
+			readMovie(fn_mic, n_io_threads, n_io_threads, read_ahead.nx, read_ahead.ny, read_ahead.nn,
+			          read_ahead.frames, read_ahead.Iframes, read_ahead.Igain);
+		}
+		catch (...)
+		{
+			read_ahead.error = std::current_exception();
+		}
+	});
+}
+
+bool MotioncorrRunner::takeReadAhead(FileName fn_mic, int &nx, int &ny, int &nn,
+                                     std::vector<int> &frames, std::vector<Image<float> > &Iframes, Image<float> &Igain)
+{
+	if (!read_ahead.worker.joinable())
+		return false;
+
+	read_ahead.worker.join();
+	if (read_ahead.fn_mic != fn_mic)
+	{
+		read_ahead.Iframes.clear();
+		read_ahead.Igain.clear();
+		return false;
+	}
+
+	if (read_ahead.error)
+	{
+		std::exception_ptr error = read_ahead.error;
+		read_ahead.error = std::exception_ptr();
+		read_ahead.Iframes.clear();
+		read_ahead.Igain.clear();
+		std::rethrow_exception(error);
+	}
+
+	nx = read_ahead.nx; ny = read_ahead.ny; nn = read_ahead.nn;
+	frames.swap(read_ahead.frames);
+	Iframes.swap(read_ahead.Iframes);
+	Igain = read_ahead.Igain;
+	read_ahead.Iframes.clear();
+	read_ahead.Igain.clear();
+
+	return true;
+}
+
 bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
 	FileName fn_mic = mic.getMovieFilename();
 	FileName fn_avg = getOutputFileNames(fn_mic);
@@ -1003,12 +1165,7 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
 	std::ofstream logfile;
 	logfile.open(fn_log);
 
-	// EER and compressed MRC related things
-	// TODO: will be refactored
-	EERRenderer renderer;
 	const bool isEER = EERRenderer::isEER(fn_mic);
-	CompressedMRCReader compressedMRCreader;
-	const bool isCompressedMRC = compressedMRCreader.isCompressedMRC(fn_mic);
 
 	int n_io_threads = n_threads;
 	logfile << "Working on " << fn_mic << " with " << n_threads << " thread(s)." << std::endl << std::endl;
@@ -1018,7 +1175,7 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
 		logfile << "Limitted the number of IO threads per movie to " << n_io_threads << " thread(s)." << std::endl;
 	}
 
-	Image<float> Ihead, Igain, Iref;
+	Image<float> Igain, Iref;
 	std::vector<MultidimArray<fComplex> > Fframes;
 	std::vector<Image<float> > Iframes;
 	std::vector<int> frames; // 0-indexed
@@ -1030,40 +1187,24 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
 	const int fit_rmsd_threshold = 10; // px
 	int nx, ny, nn;
 
-	// Check image size
-	if (isEER)
-	{
-		renderer.read(fn_mic, eer_upsampling);
-		nx = renderer.getWidth(); ny = renderer.getHeight();
-		nn = renderer.getNFrames() / eer_grouping; // remaining frames are truncated
-	}
-	else if (isCompressedMRC)
-	{
-		compressedMRCreader.read(fn_mic, n_io_threads);
-		nx = XSIZE(compressedMRCreader.Ihead()); ny = YSIZE(compressedMRCreader.Ihead());
-		nn = NSIZE(compressedMRCreader.Ihead());
-	}
+	// Read the movie, unless it has already been read while the previous one was being processed
+	RCTIC(TIMING_READ_MOVIE);
+	if (takeReadAhead(fn_mic, nx, ny, nn, frames, Iframes, Igain))
+		logfile << "The movie has been read ahead while the previous one was being processed." << std::endl;
 	else
-	{
-		Ihead.read(fn_mic, false, -1, false, true); // select_img -1, mmap false, is_2D true
-		nx = XSIZE(Ihead()); ny = YSIZE(Ihead()); nn = NSIZE(Ihead());
-	}
+		readMovie(fn_mic, n_io_threads, n_threads, nx, ny, nn, frames, Iframes, Igain);
+	RCTOC(TIMING_READ_MOVIE);
+	if (do_read_ahead)
+		startReadAhead(fn_read_ahead_next, n_io_threads, Iframes, logfile);
 
 	// Which frame to use?
 	logfile << "Movie size: X = " << nx << " Y = " << ny << " N = " << nn << std::endl;
 	logfile << "Frames to be used:";
-	for (int i = 0; i < nn; i++) {
-		// For users, all numbers are 1-indexed. Internally they are 0-indexed.
-		int frame = i + 1;
-		if (frame < first_frame_sum) continue;
-		if (last_frame_sum > 0 && frame > last_frame_sum) continue;
-		frames.push_back(i);
-		logfile << " " << frame;
-	}
+	for (int i = 0; i < frames.size(); i++)
+		logfile << " " << frames[i] + 1; // For users, all numbers are 1-indexed. Internally they are 0-indexed.
 	logfile << std::endl;
 
 	const int n_frames = frames.size();
-	Iframes.resize(n_frames);
 	Fframes.resize(n_frames);
 
 	std::vector<RFLOAT> xshifts(n_frames), yshifts(n_frames);
@@ -1104,46 +1245,6 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
 	logfile << "interpolate_shifts = " << interpolate_shifts << std::endl;
 	logfile << std::endl;
 
-	// Read gain reference
-	RCTIC(TIMING_READ_GAIN);
-	if (fn_gain_reference != "") {
-		if (isEER)
-			EERRenderer::loadEERGain(fn_gain_reference, Igain(), eer_upsampling);
-		else
-			Igain.read(fn_gain_reference);
-
-		if (XSIZE(Igain()) != nx || YSIZE(Igain()) != ny) {
-			std::cerr << "fn_mic: " << fn_mic << " nx = " << nx << " ny = " << ny << " gain nx = " << XSIZE(Igain()) << " gain ny = " << YSIZE(Igain()) <<  std::endl;
-			REPORT_ERROR("The size of the image and the size of the gain reference do not match. Make sure the gain reference has been rotated if necessary.");
-		}
-	}
-	RCTOC(TIMING_READ_GAIN);
-
-	// Read images
-	RCTIC(TIMING_READ_MOVIE);
-	#pragma omp parallel for num_threads(isCompressedMRC ? 1 : n_io_threads)
-	for (int iframe = 0; iframe < n_frames; iframe++) {
-		if (isEER)
-			renderer.renderFrames(frames[iframe] * eer_grouping + 1, (frames[iframe] + 1) * eer_grouping, Iframes[iframe]());
-		else if (isCompressedMRC)
-			compressedMRCreader.readFrameInto(Iframes[iframe], frames[iframe]);
-		else
-			Iframes[iframe].read(fn_mic, true, frames[iframe], false, true); // mmap false, is_2D true
-	}
-	RCTOC(TIMING_READ_MOVIE);
-
-	// Apply gain
-	RCTIC(TIMING_APPLY_GAIN);
-	if (fn_gain_reference != "") {
-		#pragma omp parallel for num_threads(n_threads)
-		for (int iframe = 0; iframe < n_frames; iframe++) {
-			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Igain()) {
-				DIRECT_MULTIDIM_ELEM(Iframes[iframe](), n) *= DIRECT_MULTIDIM_ELEM(Igain(), n);
-			}
-		}
-	}
-	RCTOC(TIMING_APPLY_GAIN);
-
 	MultidimArray<float> Isum(ny, nx);
 	Isum.initZeros();
 	// First sum unaligned frames
@@ -27,6 +27,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <algorithm>
+#include <thread>
+#include <exception>
 #include <src/time.h>
 #include "src/metadata_table.h"
 #include "src/image.h"
@@ -69,6 +71,12 @@ public:
 	// Write in float16 (MRC mode 12)?
 	bool write_float16;
 
+	// Read the next movie in the background while the current one is being aligned
+	bool do_read_ahead;
+
+	// The movie to be read ahead once the current one has been read ("" for none)
+	FileName fn_read_ahead_next;
+
 	// Maximum number of iterations
 	int max_iter;
 
@@ -152,6 +160,12 @@ public:
 	std::string gpu_ids;
 	std::vector < std::vector < std::string > > allThreadIDs;
 
+	~MotioncorrRunner()
+	{
+		if (read_ahead.worker.joinable())
+			read_ahead.worker.join();
+	}
+
 	// Read command line arguments
 	void read(int argc, char **argv, int rank = 0);
 
@@ -197,6 +211,32 @@ public:
 	static bool detectSerialEMDefectText(FileName fn_defect);
 
 private:
+	// A movie that is being read (or has been read) on a background thread
+	struct MovieReadAhead
+	{
+		FileName fn_mic;
+		int nx, ny, nn;
+		std::vector<int> frames;
+		std::vector<Image<float> > Iframes;
+		Image<float> Igain;
+		std::exception_ptr error; // whatever the worker threw, rethrown by takeReadAhead
+		std::thread worker;
+	};
+	MovieReadAhead read_ahead;
+
+	// Read the size of a movie, select the frames to be used (0-indexed) and read these with the gain (in Igain) applied.
+	// The frames themselves are not read if there are too few of them to be aligned.
+	// The gain is applied with n_gain_threads.
+	void readMovie(FileName fn_mic, int n_io_threads, int n_gain_threads, int &nx, int &ny, int &nn,
+	               std::vector<int> &frames, std::vector<Image<float> > &Iframes, Image<float> &Igain);
+
+	// Start reading fn_mic in the background, if there is enough free memory to keep it next to the current movie
+	void startReadAhead(FileName fn_mic, int n_io_threads, const std::vector<Image<float> > &Iframes, std::ostream &logfile);
+
+	// Wait for the movie that is being read ahead. Returns false if that was not fn_mic.
+	bool takeReadAhead(FileName fn_mic, int &nx, int &ny, int &nn,
+	                   std::vector<int> &frames, std::vector<Image<float> > &Iframes, Image<float> &Igain);
+
 	// shiftx, shifty is relative to the (real space) image size
 	void shiftNonSquareImageInFourierTransform(MultidimArray<fComplex> &frame, RFLOAT shiftx, RFLOAT shifty);
 
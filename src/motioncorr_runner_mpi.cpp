@@ -75,7 +75,10 @@ void MotioncorrRunnerMpi::run()
 
 		bool result;
 		if (do_own)
+		{
+			fn_read_ahead_next = (imic < my_last_micrograph) ? fn_micrographs[imic + 1] : "";
 			result = executeOwnMotionCorrection(mic);
+		}
 		else if (do_motioncor2)
 			result = executeMotioncor2(mic, node->rank);
 		else
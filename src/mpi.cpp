@@ -44,11 +44,15 @@
  ***************************************************************************/
 
 #include "src/mpi.h"
+#include <vector>
 
 // maximum amount of data that can be sent in MPI
 // 512 MB is already on a safe side. If this still causes OpenMPI crash,
 // please try "mpirun --mca pml ob1".
 const int RELION_MPI_MAX_SIZE = 512 * 1024 * 1024;
+// Segment size and number of segments in flight for relion_MPI_Allreduce
+const int RELION_MPI_ALLREDUCE_SEGMENT = 32 * 1024 * 1024;
+const int RELION_MPI_ALLREDUCE_WINDOW = 4;
 
 //#define MPI_DEBUG
 
@@ -286,6 +290,62 @@ int MpiNode::relion_MPI_Bcast(void *buffer, long int count, MPI_Datatype datatyp
 	return result;
 }
 
+int MpiNode::relion_MPI_Allreduce(void *buffer, long int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+	int result = MPI_SUCCESS;
+	int unitsize(0);
+	MPI_Type_size(datatype, &unitsize);
+
+#ifdef MPI_DEBUG
+	std::cout << "relion_MPI_Allreduce: rank = " << rank << " count = " << count << " comm = " << comm << std::endl;
+#endif
+	if (count < 0)
+		report_MPI_ERROR(MPI_ERR_COUNT);  // overflow
+	if (count == 0)
+		return result;
+
+	const long segment = XMIPP_MAX(1, RELION_MPI_ALLREDUCE_SEGMENT / unitsize);
+	const long nr_segments = (count + segment - 1) / segment;
+	char *ptr = static_cast<char *>(buffer);
+
+#if MPI_VERSION >= 3
+	// Keep a window of segments in flight: MPI implementations internally use reduce-scatter/allgather
+	// (or ring) algorithms for large messages, and this lets the summation of one segment overlap with
+	// the transfer of the next, without requiring any temporary buffers of the size of the whole array.
+	std::vector<MPI_Request> requests(XMIPP_MIN(nr_segments, (long)RELION_MPI_ALLREDUCE_WINDOW), MPI_REQUEST_NULL);
+	for (long iseg = 0; iseg < nr_segments; iseg++)
+	{
+		MPI_Request &request = requests[iseg % requests.size()];
+		if (request != MPI_REQUEST_NULL)
+		{
+			result = MPI_Wait(&request, MPI_STATUS_IGNORE);
+			if (result != MPI_SUCCESS)
+				report_MPI_ERROR(result);
+		}
+
+		long first = iseg * segment;
+		int n = static_cast<int>(XMIPP_MIN(segment, count - first));
+		result = MPI_Iallreduce(MPI_IN_PLACE, ptr + first * unitsize, n, datatype, op, comm, &request);
+		if (result != MPI_SUCCESS)
+			report_MPI_ERROR(result);
+	}
+	result = MPI_Waitall(requests.size(), &requests[0], MPI_STATUSES_IGNORE);
+	if (result != MPI_SUCCESS)
+		report_MPI_ERROR(result);
+#else
+	for (long iseg = 0; iseg < nr_segments; iseg++)
+	{
+		long first = iseg * segment;
+		int n = static_cast<int>(XMIPP_MIN(segment, count - first));
+		result = MPI_Allreduce(MPI_IN_PLACE, ptr + first * unitsize, n, datatype, op, comm);
+		if (result != MPI_SUCCESS)
+			report_MPI_ERROR(result);
+	}
+#endif
+
+	return result;
+}
+
 void MpiNode::report_MPI_ERROR(int error_code)
 {
 	char error_string[200];
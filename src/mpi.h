@@ -103,6 +103,12 @@ public:
 
 	int relion_MPI_Bcast(void *buffer, long int count, MPI_Datatype datatype, int root, MPI_Comm comm);
 
+	/** In-place allreduce of a (possibly very large) buffer over all ranks in comm.
+	 *  The buffer is cut into segments that are reduced with non-blocking collectives, so that
+	 *  the reduction of one segment overlaps with the communication of the next ones.
+	 */
+	int relion_MPI_Allreduce(void *buffer, long int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
+
 	/* Better error handling of MPI error messages */
 	void report_MPI_ERROR(int error_code);
 
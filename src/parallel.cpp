@@ -152,6 +152,105 @@ bool ThreadTaskDistributor::distribute(size_t &first, size_t &last)
     return result;
 }
 
+static inline uint64_t packRange(uint64_t begin, uint64_t end)
+{
+    return (begin << 32) | end;
+}
+
+static inline uint64_t rangeBegin(uint64_t range)
+{
+    return range >> 32;
+}
+
+static inline uint64_t rangeEnd(uint64_t range)
+{
+    return range & 0xffffffffULL;
+}
+
+WorkStealingTaskScheduler::WorkStealingTaskScheduler(int nThreads)
+{
+    if (nThreads < 1)
+        REPORT_ERROR("WorkStealingTaskScheduler: the number of threads should be > 0");
+
+    numberOfThreads = nThreads;
+    slots = new Slot[numberOfThreads];
+    reset(0);
+}
+
+WorkStealingTaskScheduler::~WorkStealingTaskScheduler()
+{
+    delete [] slots;
+}
+
+void WorkStealingTaskScheduler::reset(size_t nTasks)
+{
+    if (nTasks > 0xffffffffULL)
+        REPORT_ERROR("WorkStealingTaskScheduler: too many tasks");
+
+    for (int thread_id = 0; thread_id < numberOfThreads; thread_id++)
+    {
+        long int first, last;
+        divide_equally(nTasks, numberOfThreads, thread_id, first, last);
+        slots[thread_id].range.store(packRange(first, last + 1));
+    }
+}
+
+bool WorkStealingTaskScheduler::getTask(int thread_id, size_t &task)
+{
+    // Take from the front of my own range. Thieves only ever shrink it from the back,
+    // so the compare-exchange only fails when one of them got in between.
+    std::atomic<uint64_t> &mine = slots[thread_id].range;
+    uint64_t range = mine.load();
+    while (rangeBegin(range) < rangeEnd(range))
+    {
+        if (mine.compare_exchange_weak(range, packRange(rangeBegin(range) + 1, rangeEnd(range))))
+        {
+            task = rangeBegin(range);
+            return true;
+        }
+    }
+
+    return steal(thread_id, task);
+}
+
+bool WorkStealingTaskScheduler::steal(int thread_id, size_t &task)
+{
+    std::atomic<uint64_t> &mine = slots[thread_id].range;
+    while (true)
+    {
+        // Find the thread with most tasks left
+        int victim = -1;
+        uint64_t victim_range = 0, victim_size = 0;
+        for (int i = 1; i < numberOfThreads; i++)
+        {
+            int other = (thread_id + i) % numberOfThreads;
+            uint64_t range = slots[other].range.load();
+            if (rangeEnd(range) > rangeBegin(range) && rangeEnd(range) - rangeBegin(range) > victim_size)
+            {
+                victim = other;
+                victim_range = range;
+                victim_size = rangeEnd(range) - rangeBegin(range);
+            }
+        }
+
+        // Tasks that are being stolen by another thread are out of all ranges for a moment,
+        // but that thread will do them, so there is nothing left for me.
+        if (victim < 0)
+            return false;
+
+        // Steal the back half (or the last task) of its range. If it changed meanwhile, look again.
+        uint64_t nr_stolen = (victim_size + 1) / 2;
+        uint64_t first = rangeEnd(victim_range) - nr_stolen;
+        if (slots[victim].range.compare_exchange_strong(victim_range, packRange(rangeBegin(victim_range), first)))
+        {
+            // My own range is empty, and nobody steals from an empty range
+            mine.store(packRange(first + 1, first + nr_stolen));
+            task = first;
+            return true;
+        }
+    }
+}
+
 /** Divides a number into most equally groups */
 long int divide_equally(long int N, int size, int rank, long int &first, long int &last)
 {
@@ -47,6 +47,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <omp.h>
+#include <stdint.h>
+#include <atomic>
 #include "src/error.h"
 
 // This code was copied from a developmental version of Xmipp-3.0
@@ -197,6 +199,78 @@ protected:
     virtual bool distribute(size_t &first, size_t &last);
 };//end of class ThreadTaskDistributor
 
+/** This class distributes N tasks between a fixed number of threads by work stealing.
+ * Unlike ThreadTaskDistributor, which hands out blocks from a single counter behind a mutex,
+ * every thread starts with its own contiguous range of tasks (as divided by divide_equally).
+ * A thread takes tasks one at a time from the front of its own range; when that is empty,
+ * it steals the back half of the largest range that is left on any of the other threads.
+ * Each range is a single atomic word, so neither taking nor stealing ever locks, and every
+ * thread keeps working on consecutive tasks for as long as the load is balanced.
+ *  Example:
+ *  @code
+ *  WorkStealingTaskScheduler ts(nr_threads);
+ *  ts.reset(nr_images);
+ *  #pragma omp parallel num_threads(nr_threads)
+ *  {
+ *      size_t image;
+ *      while (ts.getTask(omp_get_thread_num(), image))
+ *          processOneImage(image);
+ *  }
+ *  @endcode
+ */
+class WorkStealingTaskScheduler
+{
+public:
+    /** Constructor for nThreads threads, without any tasks */
+    WorkStealingTaskScheduler(int nThreads);
+
+    /** Destructor */
+    ~WorkStealingTaskScheduler();
+
+    /** Number of threads the tasks are distributed over */
+    int getNumberOfThreads() const
+    {
+        return numberOfThreads;
+    }
+
+    /** Distribute tasks 0 to nTasks-1 again over all threads.
+     * This method should only be called in the main thread,
+     * while none of the workers is asking for tasks.
+     */
+    void reset(size_t nTasks);
+
+    /** Get the next task for thread thread_id.
+     * Returns false when no tasks are left on any of the threads.
+     */
+    bool getTask(int thread_id, size_t &task);
+
+    /** Same as getTask, in the form of ParallelTaskDistributor::getTasks (i.e. always first == last) */
+    bool getTasks(int thread_id, size_t &first, size_t &last)
+    {
+        bool result = getTask(thread_id, first);
+        last = first;
+        return result;
+    }
+
+private:
+    // Range [begin, end) of a thread, stored as (begin << 32) | end.
+    // Padded to its own cache line, so that threads taking from their own ranges do not interfere.
+    struct Slot
+    {
+        std::atomic<uint64_t> range;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    int numberOfThreads;
+    Slot *slots;
+
+    bool steal(int thread_id, size_t &task);
+
+    // Not copyable
+    WorkStealingTaskScheduler(const WorkStealingTaskScheduler&);
+    WorkStealingTaskScheduler& operator=(const WorkStealingTaskScheduler&);
+};//end of class WorkStealingTaskScheduler
+
 /// @name Miscellaneous functions
 //@{
 /** Divides a number into most equally groups
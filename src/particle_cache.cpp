@@ -0,0 +1,504 @@
+/***************************************************************************
+ *
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <time.h>
+#include "src/particle_cache.h"
+#include "src/image.h"
+#include "src/time.h"
+
+/*
+ * Layout of a cache file (all integers little-endian as written by this machine):
+ *
+ *   header (64 bytes): magic, version, byte order mark, key, number of images,
+ *                      offset of the index, offset of the first image, file size
+ *   index:             per image: uint64 offset, uint32 xdim, ydim, zdim, padding
+ *   data:              per image: xdim*ydim*zdim floats, starting on a 64-byte boundary
+ */
+#define PARTICLE_CACHE_MAGIC "RLNPCACH"
+#define PARTICLE_CACHE_VERSION 1
+#define PARTICLE_CACHE_BYTE_ORDER_MARK 0x01020304
+#define PARTICLE_CACHE_HEADER_SIZE 64
+#define PARTICLE_CACHE_ALIGNMENT 64
+#define PARTICLE_CACHE_PAGE 4096
+
+// A lock that was not touched for this many seconds belongs to a builder that died
+#define PARTICLE_CACHE_STALE_LOCK_SEC 600
+
+struct ParticleCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order_mark;
+	uint64_t key;
+	uint64_t nr_images;
+	uint64_t index_offset;
+	uint64_t data_offset;
+	uint64_t file_size;
+	uint64_t padding;
+};
+
+struct ParticleCacheEntry
+{
+	uint64_t offset;
+	uint32_t xdim, ydim, zdim;
+	uint32_t padding;
+};
+
+static uint64_t alignUp(uint64_t n, uint64_t alignment)
+{
+	return (n + alignment - 1) / alignment * alignment;
+}
+
+static void hashBytes(uint64_t &hash, const void *data, size_t size)
+{
+	// 64-bit FNV-1a
+	const unsigned char *ptr = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= ptr[i];
+		hash *= 1099511628211ULL;
+	}
+}
+
+// All distinct stacks in fn_imgs, in order of first appearance
+static void getStackNames(const std::vector<FileName> &fn_imgs, std::vector<FileName> &fn_stacks, std::vector<long int> &stack_of_image)
+{
+	std::map<std::string, long int> stack_index;
+	FileName fn_stack, fn_prev_stack = "";
+	long int prev_index = -1, dump;
+
+	fn_stacks.clear();
+	stack_of_image.resize(fn_imgs.size());
+	for (size_t i = 0; i < fn_imgs.size(); i++)
+	{
+		fn_imgs[i].decompose(dump, fn_stack);
+		if (fn_stack != fn_prev_stack)
+		{
+			std::map<std::string, long int>::iterator it = stack_index.find(fn_stack);
+			if (it == stack_index.end())
+			{
+				prev_index = fn_stacks.size();
+				stack_index[fn_stack] = prev_index;
+				fn_stacks.push_back(fn_stack);
+			}
+			else
+			{
+				prev_index = it->second;
+			}
+			fn_prev_stack = fn_stack;
+		}
+		stack_of_image[i] = prev_index;
+	}
+}
+
+static uint64_t getKey(const std::vector<FileName> &fn_imgs)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	uint64_t nr_images = fn_imgs.size();
+	uint32_t version = PARTICLE_CACHE_VERSION;
+	hashBytes(hash, &version, sizeof(version));
+	hashBytes(hash, &nr_images, sizeof(nr_images));
+	for (size_t i = 0; i < fn_imgs.size(); i++)
+		hashBytes(hash, fn_imgs[i].c_str(), fn_imgs[i].length() + 1);
+
+	std::vector<FileName> fn_stacks;
+	std::vector<long int> stack_of_image;
+	getStackNames(fn_imgs, fn_stacks, stack_of_image);
+	for (size_t i = 0; i < fn_stacks.size(); i++)
+	{
+		struct stat st;
+		if (stat(fn_stacks[i].removeFileFormat().c_str(), &st) != 0)
+			REPORT_ERROR("ParticleCache ERROR: cannot stat particle stack " + fn_stacks[i]);
+
+		int64_t values[3] = {(int64_t)st.st_size, (int64_t)st.st_mtim.tv_sec, (int64_t)st.st_mtim.tv_nsec};
+		hashBytes(hash, values, sizeof(values));
+	}
+
+	return hash;
+}
+
+class ParticleCache::Mapping
+{
+public:
+
+	Mapping() : data(NULL), size(0), nr_images(0), index(NULL) {}
+
+	~Mapping()
+	{
+		if (data != NULL) munmap((void*)data, size);
+	}
+
+	bool open(const FileName &fn, uint64_t key, uint64_t expected_nr_images)
+	{
+		int fd = ::open(fn.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < PARTICLE_CACHE_HEADER_SIZE)
+		{
+			::close(fd);
+			return false;
+		}
+		size = st.st_size;
+
+		void *ptr = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (ptr == MAP_FAILED) return false;
+		data = (const char*)ptr;
+
+		ParticleCacheHeader header;
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header.magic, PARTICLE_CACHE_MAGIC, 8) != 0 ||
+		    header.version != PARTICLE_CACHE_VERSION ||
+		    header.byte_order_mark != PARTICLE_CACHE_BYTE_ORDER_MARK ||
+		    header.key != key || header.nr_images != expected_nr_images ||
+		    header.file_size != size ||
+		    header.index_offset + header.nr_images * sizeof(ParticleCacheEntry) > size)
+			return false;
+
+		nr_images = header.nr_images;
+		index = (const ParticleCacheEntry*)(data + header.index_offset);
+		for (uint64_t i = 0; i < nr_images; i++)
+		{
+			const ParticleCacheEntry &entry = index[i];
+			uint64_t nr_bytes = (uint64_t)entry.xdim * entry.ydim * entry.zdim * sizeof(float);
+			if (entry.offset % PARTICLE_CACHE_ALIGNMENT != 0 || entry.offset < header.data_offset ||
+			    entry.offset + nr_bytes > size)
+				return false;
+		}
+
+		return true;
+	}
+
+	const char *data;
+	size_t size;
+	uint64_t nr_images;
+	const ParticleCacheEntry *index;
+};
+
+long int ParticleCache::size() const
+{
+	return (mapping) ? mapping->nr_images : 0;
+}
+
+static FileName getCacheName(const FileName &fn_dir, uint64_t key)
+{
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+
+	FileName fn_cache = fn_dir;
+	if (fn_cache[fn_cache.length()-1] != '/')
+		fn_cache += '/';
+	return fn_cache + "relion_particles_" + std::string(hex) + ".cache";
+}
+
+FileName ParticleCache::getName(const FileName &fn_dir, const std::vector<FileName> &fn_imgs)
+{
+	return getCacheName(fn_dir, getKey(fn_imgs));
+}
+
+bool ParticleCache::open(const FileName &fn_dir, const std::vector<FileName> &fn_imgs, bool do_build, RFLOAT keep_free_Gb, int verb)
+{
+	close();
+	if (fn_imgs.size() == 0)
+		return false;
+
+	const uint64_t key = getKey(fn_imgs);
+	const FileName fn_cache = getCacheName(fn_dir, key);
+	const FileName fn_lock = fn_cache + ".lock";
+	bool have_waited = false;
+
+	if (do_build && mktree(fn_dir) != 0 && !exists(fn_dir))
+	{
+		std::cerr << " Warning: cannot create particle cache directory " << fn_dir << "; reading particles from where they are." << std::endl;
+		return false;
+	}
+
+	while (true)
+	{
+		std::shared_ptr<Mapping> map(new Mapping());
+		if (map->open(fn_cache, key, fn_imgs.size()))
+		{
+			// Mark as recently used, so it is the last to be removed when space is needed
+			utimes(fn_cache.c_str(), NULL);
+			mapping = map;
+			if (verb > 0)
+				std::cout << " Using particle cache: " << fn_cache << std::endl;
+			return true;
+		}
+		map.reset();
+
+		if (!do_build)
+			return false;
+
+		int fd = ::open(fn_lock.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0666);
+		if (fd >= 0)
+		{
+			::close(fd);
+			bool is_built = false;
+			try
+			{
+				is_built = build(fn_cache, key, fn_imgs, keep_free_Gb, verb);
+			}
+			catch (...)
+			{
+				::remove(fn_lock.c_str());
+				throw;
+			}
+			::remove(fn_lock.c_str());
+			if (!is_built)
+				return false;
+			continue;
+		}
+		else if (errno != EEXIST)
+		{
+			std::cerr << " Warning: cannot create " << fn_lock << "; reading particles from where they are." << std::endl;
+			return false;
+		}
+
+		// Someone else is building this cache: wait for it, unless the builder has died
+		struct stat st;
+		if (stat(fn_lock.c_str(), &st) == 0 && time(NULL) - st.st_mtime > PARTICLE_CACHE_STALE_LOCK_SEC)
+		{
+			std::cerr << " Warning: removing stale particle cache lock " << fn_lock << std::endl;
+			::remove(fn_lock.c_str());
+			continue;
+		}
+
+		if (verb > 0 && !have_waited)
+			std::cout << " Waiting for another process to build particle cache: " << fn_cache << std::endl;
+		have_waited = true;
+		sleep(1);
+	}
+}
+
+void ParticleCache::close()
+{
+	mapping.reset();
+}
+
+void ParticleCache::getImagePointer(long int ori_img_id, const float *&ptr, int &xdim, int &ydim, int &zdim) const
+{
+	if (!mapping || ori_img_id < 0 || ori_img_id >= mapping->nr_images)
+		REPORT_ERROR("BUG: ParticleCache::getImage: image " + integerToString(ori_img_id) + " is not in the cache");
+
+	const ParticleCacheEntry &entry = mapping->index[ori_img_id];
+	ptr = (const float*)(mapping->data + entry.offset);
+	xdim = entry.xdim;
+	ydim = entry.ydim;
+	zdim = entry.zdim;
+}
+
+bool ParticleCache::makeSpace(const FileName &fn_dir, const FileName &fn_cache, uint64_t nr_bytes, RFLOAT keep_free_Gb)
+{
+	const uint64_t keep_free = (uint64_t)(keep_free_Gb * 1024 * 1024 * 1024);
+
+	struct statvfs vfs;
+	if (statvfs(fn_dir.c_str(), &vfs) != 0)
+		return false;
+	uint64_t free_bytes = (uint64_t)vfs.f_frsize * vfs.f_bavail;
+	if (free_bytes >= nr_bytes + keep_free)
+		return true;
+
+	// Remove the least recently used caches of other particle sets until there is enough space
+	std::vector<FileName> fn_all;
+	FileName fn_glob = fn_cache.beforeLastOf("/") + "/relion_particles_*.cache";
+	fn_glob.globFiles(fn_all, true);
+
+	std::vector<std::pair<time_t, FileName> > candidates;
+	for (size_t i = 0; i < fn_all.size(); i++)
+	{
+		struct stat st;
+		if (fn_all[i] != fn_cache && stat(fn_all[i].c_str(), &st) == 0 && !exists(fn_all[i] + ".lock"))
+			candidates.push_back(std::make_pair(st.st_mtime, fn_all[i]));
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	for (size_t i = 0; i < candidates.size() && free_bytes < nr_bytes + keep_free; i++)
+	{
+		std::cout << " Removing least recently used particle cache " << candidates[i].second << std::endl;
+		::remove(candidates[i].second.c_str());
+		if (statvfs(fn_dir.c_str(), &vfs) != 0)
+			return false;
+		free_bytes = (uint64_t)vfs.f_frsize * vfs.f_bavail;
+	}
+
+	return (free_bytes >= nr_bytes + keep_free);
+}
+
+bool ParticleCache::build(const FileName &fn_cache, uint64_t key, const std::vector<FileName> &fn_imgs, RFLOAT keep_free_Gb, int verb)
+{
+	const FileName fn_dir = fn_cache.beforeLastOf("/");
+	const FileName fn_lock = fn_cache + ".lock";
+	const uint64_t nr_images = fn_imgs.size();
+
+	// All images in one stack have the same size, so only read one header per stack
+	std::vector<FileName> fn_stacks;
+	std::vector<long int> stack_of_image;
+	getStackNames(fn_imgs, fn_stacks, stack_of_image);
+	std::vector<long int> first_image_of_stack(fn_stacks.size(), -1);
+	for (long int i = nr_images - 1; i >= 0; i--)
+		first_image_of_stack[stack_of_image[i]] = i;
+
+	std::vector<ParticleCacheEntry> stack_dims(fn_stacks.size());
+	for (size_t istack = 0; istack < fn_stacks.size(); istack++)
+	{
+		Image<float> tmp;
+		tmp.read(fn_imgs[first_image_of_stack[istack]], false); // false means: only read the header!
+		stack_dims[istack].xdim = XSIZE(tmp());
+		stack_dims[istack].ydim = YSIZE(tmp());
+		stack_dims[istack].zdim = ZSIZE(tmp());
+	}
+
+	ParticleCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PARTICLE_CACHE_MAGIC, 8);
+	header.version = PARTICLE_CACHE_VERSION;
+	header.byte_order_mark = PARTICLE_CACHE_BYTE_ORDER_MARK;
+	header.key = key;
+	header.nr_images = nr_images;
+	header.index_offset = PARTICLE_CACHE_HEADER_SIZE;
+	header.data_offset = alignUp(header.index_offset + nr_images * sizeof(ParticleCacheEntry), PARTICLE_CACHE_PAGE);
+
+	std::vector<ParticleCacheEntry> index(nr_images);
+	uint64_t offset = header.data_offset;
+	for (uint64_t i = 0; i < nr_images; i++)
+	{
+		index[i] = stack_dims[stack_of_image[i]];
+		index[i].offset = offset;
+		index[i].padding = 0;
+		offset = alignUp(offset + (uint64_t)index[i].xdim * index[i].ydim * index[i].zdim * sizeof(float), PARTICLE_CACHE_ALIGNMENT);
+	}
+	header.file_size = offset;
+
+	if (!makeSpace(fn_dir, fn_cache, header.file_size, keep_free_Gb))
+	{
+		std::cerr << " Warning: not enough space in " << fn_dir << " for a particle cache of "
+		          << header.file_size / (1024. * 1024. * 1024.) << " Gb; reading particles from where they are." << std::endl;
+		return false;
+	}
+
+	// After a stale lock has been taken over, its original builder may still be writing: so each builder
+	// writes its own temporary file, and only a complete one is renamed into place
+	std::vector<char> fn_tmp_buf(fn_cache.begin(), fn_cache.end());
+	const char tmp_suffix[] = ".tmp.XXXXXX";
+	fn_tmp_buf.insert(fn_tmp_buf.end(), tmp_suffix, tmp_suffix + sizeof(tmp_suffix));
+	int fd = mkstemp(&fn_tmp_buf[0]);
+	const FileName fn_tmp = &fn_tmp_buf[0];
+	FILE *fh = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+	if (fh == NULL)
+	{
+		if (fd >= 0)
+		{
+			::close(fd);
+			::remove(fn_tmp.c_str());
+		}
+		std::cerr << " Warning: cannot write a temporary file in " << fn_dir << "; reading particles from where they are." << std::endl;
+		return false;
+	}
+	fchmod(fd, 0666);
+
+	std::vector<char> zeros(PARTICLE_CACHE_PAGE, 0);
+	fwrite(&header, sizeof(header), 1, fh);
+	fwrite(&index[0], sizeof(ParticleCacheEntry), nr_images, fh);
+	fwrite(&zeros[0], 1, header.data_offset - header.index_offset - nr_images * sizeof(ParticleCacheEntry), fh);
+
+	int barstep = XMIPP_MAX(1, nr_images / 60);
+	if (verb > 0)
+	{
+		std::cout << " Building particle cache: " << fn_cache << std::endl;
+		init_progress_bar(nr_images);
+	}
+
+	FileName fn_stack, fn_open_stack = "";
+	fImageHandler hFile;
+	long int dump;
+	uint64_t written = header.data_offset;
+	for (uint64_t i = 0; i < nr_images; i++)
+	{
+		Image<float> img;
+		try
+		{
+			fn_imgs[i].decompose(dump, fn_stack);
+			if (fn_stack != fn_open_stack)
+			{
+				hFile.openFile(fn_stack, WRITE_READONLY);
+				fn_open_stack = fn_stack;
+			}
+			img.readFromOpenFile(fn_imgs[i], hFile, -1, false);
+		}
+		catch (...)
+		{
+			// Do not leave the temporary file behind
+			fclose(fh);
+			::remove(fn_tmp.c_str());
+			throw;
+		}
+
+		if (XSIZE(img()) != index[i].xdim || YSIZE(img()) != index[i].ydim || ZSIZE(img()) != index[i].zdim)
+		{
+			fclose(fh);
+			::remove(fn_tmp.c_str());
+			REPORT_ERROR("ParticleCache ERROR: " + fn_imgs[i] + " does not have the same size as the other images in its stack");
+		}
+
+		fwrite(&zeros[0], 1, index[i].offset - written, fh);
+		written = index[i].offset + NZYXSIZE(img()) * sizeof(float);
+		if (fwrite(MULTIDIM_ARRAY(img()), sizeof(float), NZYXSIZE(img()), fh) != NZYXSIZE(img()))
+		{
+			fclose(fh);
+			::remove(fn_tmp.c_str());
+			std::cerr << " Warning: failed to write " << fn_tmp << "; reading particles from where they are." << std::endl;
+			return false;
+		}
+
+		// Show waiting processes that the builder is still alive
+		if (i % 1000 == 0)
+			utimes(fn_lock.c_str(), NULL);
+
+		if (verb > 0 && i % barstep == 0)
+			progress_bar(i);
+	}
+	fwrite(&zeros[0], 1, header.file_size - written, fh);
+
+	if (fclose(fh) != 0 || rename(fn_tmp.c_str(), fn_cache.c_str()) != 0)
+	{
+		::remove(fn_tmp.c_str());
+		std::cerr << " Warning: failed to write " << fn_cache << "; reading particles from where they are." << std::endl;
+		return false;
+	}
+
+	if (verb > 0)
+		progress_bar(nr_images);
+
+	return true;
+}
@@ -0,0 +1,102 @@
+/***************************************************************************
+ *
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef PARTICLE_CACHE_H
+#define PARTICLE_CACHE_H
+
+#include <vector>
+#include <stdint.h>
+#include <memory>
+#include "src/filename.h"
+#include "src/multidim_array.h"
+
+/*	class ParticleCache:
+ *
+ *	Persistent, memory-mapped copy of all particle images of a data set on a
+ *	(preferably local and fast) disk. All images are packed as floats into a
+ *	single file, in the order of the rows of the particle STAR file, with every
+ *	image starting on a 64-byte boundary.
+ *
+ *	The file is called "relion_particles_<key>.cache", where the key is a hash of
+ *	the ordered list of image names and of the size and modification time of every
+ *	stack they come from. A job that uses the same particle STAR file as an
+ *	earlier one (e.g. Class3D after Refine3D, or Subtract after either of them)
+ *	therefore finds the cache of the earlier job and uses it without copying
+ *	anything, while touching or overwriting any of the stacks makes a new key and
+ *	thus a fresh cache.
+ *
+ *	The file is mapped read-only and shared, so all MPI ranks on one node use the
+ *	same pages of the page cache. Only one process builds a given cache: the others
+ *	wait on "<cache>.lock" for it to appear. Caches that are not used for a while
+ *	are removed when space is needed for a new one.
+ */
+class ParticleCache
+{
+public:
+
+	ParticleCache() {}
+
+	// Is a cache file mapped?
+	bool isOpen() const
+	{
+		return (bool)mapping;
+	}
+
+	// Number of images in the cache
+	long int size() const;
+
+	/* Map the cache for the images in fn_imgs (in MDimg order) from directory fn_dir.
+	 * If it does not exist yet and do_build, build it, unless fewer than keep_free_Gb
+	 * would remain free on that disk. Otherwise wait for another process that is building it.
+	 * Returns false (and leaves the cache closed) if no cache could be used. */
+	bool open(const FileName &fn_dir, const std::vector<FileName> &fn_imgs,
+	          bool do_build = true, RFLOAT keep_free_Gb = 10, int verb = 0);
+
+	// Unmap the cache
+	void close();
+
+	// Copy image ori_img_id into img (which gets the image's size and its Xmipp origin)
+	template <typename T>
+	void getImage(long int ori_img_id, MultidimArray<T> &img) const
+	{
+		const float *ptr;
+		int xdim, ydim, zdim;
+		getImagePointer(ori_img_id, ptr, xdim, ydim, zdim);
+
+		img.resizeNoCp(1, zdim, ydim, xdim);
+		for (long int n = 0; n < NZYXSIZE(img); n++)
+			DIRECT_MULTIDIM_ELEM(img, n) = (T)ptr[n];
+		img.setXmippOrigin();
+	}
+
+	// Name of the cache file for these images in fn_dir
+	static FileName getName(const FileName &fn_dir, const std::vector<FileName> &fn_imgs);
+
+private:
+
+	class Mapping;
+	std::shared_ptr<Mapping> mapping;
+
+	void getImagePointer(long int ori_img_id, const float *&ptr, int &xdim, int &ydim, int &zdim) const;
+
+	static bool build(const FileName &fn_cache, uint64_t key, const std::vector<FileName> &fn_imgs, RFLOAT keep_free_Gb, int verb);
+	static bool makeSpace(const FileName &fn_dir, const FileName &fn_cache, uint64_t nr_bytes, RFLOAT keep_free_Gb);
+};
+
+#endif
@@ -18,6 +18,7 @@
  * author citations must be preserved.
  ***************************************************************************/
 
+#include <exception>
 #include "src/particle_subtractor.h"
 
 void ParticleSubtractor::read(int argc, char **argv)
@@ -32,6 +33,8 @@ void ParticleSubtractor::read(int argc, char **argv)
 	fn_revert = parser.getOption("--revert", "Name of particle STAR file to revert. When this is provided, all other options are ignored.", "");
 	do_ssnr = parser.checkOption("--ssnr", "Don't subtract, only calculate average spectral SNR in the images");
 	write_float16  = parser.checkOption("--float16", "Write in half-precision 16 bit floating point numbers (MRC mode 12), instead of 32 bit (MRC mode 0).");
+	nr_threads = textToInteger(parser.getOption("--j", "Number of threads to subtract particles in parallel", "1"));
+	fn_particle_cache = parser.getOption("--particle_cache", "Directory with the particle cache of an earlier refinement or classification of the same particles (its --particle_cache)", "");
 
 	int center_section = parser.addSection("Centering options");
 	do_recenter_on_mask = parser.checkOption("--recenter_on_mask", "Use this flag to center the subtracted particles on projections of the centre-of-mass of the input mask");
@@ -104,9 +107,31 @@ void ParticleSubtractor::initialise(int _rank, int _size)
 	{
 		opt.mydata.clear();
 		bool is_helical_segment = (opt.do_helical_refine) || ((opt.mymodel.ref_dim == 2) && (opt.helical_tube_outer_diameter > 0.));
-		opt.mydata.read(fn_sel, false, false, false, is_helical_segment);
+		if (do_ssnr)
+		{
+			// No particles STAR file is written for the SSNR, so only read the columns that Experiment::read and subtractOneParticle use
+			const EMDLabel ssnr_labels[] = {
+				EMDL_IMAGE_NAME, EMDL_IMAGE_OPTICS_GROUP, EMDL_IMAGE_NORM_CORRECTION, EMDL_IMAGE_COORD_Z,
+				EMDL_MICROGRAPH_NAME, EMDL_TOMO_NAME, EMDL_PARTICLE_NAME, EMDL_PARTICLE_CLASS,
+				EMDL_PARTICLE_RANDOM_SUBSET, EMDL_PARTICLE_HELICAL_TUBE_ID, EMDL_MLMODEL_GROUP_NAME, EMDL_MLMODEL_GROUP_NO,
+				EMDL_ORIENT_ROT, EMDL_ORIENT_TILT, EMDL_ORIENT_PSI, EMDL_ORIENT_TILT_PRIOR, EMDL_ORIENT_PSI_PRIOR,
+				EMDL_ORIENT_ORIGIN_X_ANGSTROM, EMDL_ORIENT_ORIGIN_Y_ANGSTROM, EMDL_ORIENT_ORIGIN_Z_ANGSTROM,
+				EMDL_CTF_IMAGE, EMDL_CTF_VOLTAGE, EMDL_CTF_DEFOCUSU, EMDL_CTF_DEFOCUSV, EMDL_CTF_DEFOCUS_ANGLE,
+				EMDL_CTF_CS, EMDL_CTF_BFACTOR, EMDL_CTF_SCALEFACTOR, EMDL_CTF_Q0, EMDL_CTF_PHASESHIFT};
+			std::vector<EMDLabel> desired_labels(ssnr_labels, ssnr_labels + sizeof(ssnr_labels) / sizeof(EMDLabel));
+			opt.mydata.read(fn_sel, false, false, false, is_helical_segment, 0, &desired_labels);
+		}
+		else
+		{
+			// All columns are needed, as they are copied into the output STAR file
+			opt.mydata.read(fn_sel, false, false, false, is_helical_segment);
+		}
 	}
 
+	// Read particles from the cache of an earlier job, if there is one for exactly these particles
+	if (fn_particle_cache != "" && !opt.mydata.openParticleCache(fn_particle_cache, false, 0., verb) && verb > 0)
+		std::cout << " + No particle cache for these particles in " << fn_particle_cache << "; reading them from where they are." << std::endl;
+
 	divideLabour(rank, size, my_first_part_id, my_last_part_id);
 
 	Image<RFLOAT> Imask;
@@ -310,22 +335,84 @@ void ParticleSubtractor::run()
 		init_progress_bar(nr_parts);
 	}
 
+	// Subtract all particles of one optics group before the next one, so that each output stack is written from start to end.
+	// Within an optics group, the particles keep their order, so that they are still read in the order of their input stacks.
+	// The order of the output STAR file is restored from EMDL_IMAGE_ID in combineStarFile.
+	std::vector<std::pair<int, long int> > group_and_part;
+	for (long int part_id_sorted = my_first_part_id; part_id_sorted <= my_last_part_id; part_id_sorted++)
+	{
+		long int part_id = opt.mydata.sorted_idx[part_id_sorted];
+		group_and_part.push_back(std::make_pair(opt.mydata.getOpticsGroup(part_id, 0), part_id_sorted));
+	}
+	std::sort(group_and_part.begin(), group_and_part.end());
+
+	// Particles are subtracted in batches by all threads, and then written one after the other in the same order
+	long int batch_size = XMIPP_MAX(1, nr_threads) * 8;
+	std::vector<SubtractedParticle> batch(batch_size);
+
 	MDimg_out.clear();
-	//for (long int part_id_sorted = my_first_part_id, cc = 0; part_id_sorted <= my_last_part_id; part_id_sorted++, cc++)
-	for (long int part_id_sorted = my_first_part_id, cc = 0; part_id_sorted <= my_last_part_id; part_id_sorted++, cc++)
+	for (long int first = 0, cc = 0; first < nr_parts; first += batch_size)
 	{
+		long int last = XMIPP_MIN(nr_parts, first + batch_size) - 1;
+
+		if (pipeline_control_check_abort_job())
+			exit(RELION_EXIT_ABORTED);
 
-		//long int part_id = opt.mydata.sorted_idx[part_id_sorted];
-		if (cc % barstep == 0)
+		std::exception_ptr thread_error;
+		#pragma omp parallel num_threads(nr_threads)
 		{
-			if (pipeline_control_check_abort_job())
-				exit(RELION_EXIT_ABORTED);
+			// The references in opt.mymodel.PPref are shared by all threads, only the sums for the SSNR are per thread
+			MultidimArray<RFLOAT> my_sum_S2, my_sum_N2, my_sum_count;
+			if (do_ssnr)
+			{
+				my_sum_S2.initZeros(sum_S2);
+				my_sum_N2.initZeros(sum_N2);
+				my_sum_count.initZeros(sum_count);
+			}
+
+			#pragma omp for schedule(dynamic)
+			for (long int ipart = first; ipart <= last; ipart++)
+			{
+				try
+				{
+					long int part_id = opt.mydata.sorted_idx[group_and_part[ipart].second];
+					subtractOneParticle(part_id, 0, batch[ipart - first], my_sum_S2, my_sum_N2, my_sum_count);
+				}
+				catch (...)
+				{
+					// Nothing may escape the parallel region: keep the first exception and rethrow it after the region
+					#pragma omp critical(ParticleSubtractor_error)
+					{
+						if (!thread_error)
+							thread_error = std::current_exception();
+					}
+				}
+			}
+
+			if (do_ssnr)
+			{
+				#pragma omp critical(ParticleSubtractor_ssnr)
+				{
+					sum_S2 += my_sum_S2;
+					sum_N2 += my_sum_N2;
+					sum_count += my_sum_count;
+				}
+			}
 		}
 
-		long int part_id = opt.mydata.sorted_idx[part_id_sorted];
-		subtractOneParticle(part_id, 0, cc);
+		if (thread_error)
+			std::rethrow_exception(thread_error);
 
-		if (cc % barstep == 0 && verb > 0) progress_bar(cc);
+		for (long int ipart = first; ipart <= last; ipart++, cc++)
+		{
+			if (!do_ssnr)
+			{
+				long int part_id = opt.mydata.sorted_idx[group_and_part[ipart].second];
+				writeOneParticle(part_id, 0, batch[ipart - first], cc);
+			}
+
+			if (cc % barstep == 0 && verb > 0) progress_bar(cc);
+		}
 	}
 
 	if (verb > 0) progress_bar(nr_parts);
@@ -460,14 +547,20 @@ FileName ParticleSubtractor::getParticleName(long int imgno, int myrank, int opt
 	return fn_img;
 }
 
-void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, long int counter)
+void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, SubtractedParticle &sub,
+		MultidimArray<RFLOAT> &my_sum_S2, MultidimArray<RFLOAT> &my_sum_N2, MultidimArray<RFLOAT> &my_sum_count)
 {
 	// Read the particle image
-	Image<RFLOAT> img;
+	Image<RFLOAT> &img = sub.img;
 	long int ori_img_id = opt.mydata.particles[part_id].images[imgno].id;
 	int optics_group = opt.mydata.getOpticsGroup(part_id, 0);
-	img.read(opt.mydata.particles[part_id].images[0].name);
-	img().setXmippOrigin();
+	sub.optics_group = optics_group;
+	sub.has_new_angles = sub.has_new_offset = false;
+	if (!opt.mydata.getImageFromCache(part_id, 0, img()))
+	{
+		img.read(opt.mydata.particles[part_id].images[0].name);
+		img().setXmippOrigin();
+	}
 
 	// Make sure gold-standard is adhered to!
 	int my_subset = (rank % 2 == 1) ? 1 : 2;
@@ -479,6 +572,7 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 
 	// Get the consensus class, orientational parameters and norm (if present)
 	RFLOAT my_pixel_size = opt.mydata.getImagePixelSize(part_id, 0);
+	sub.pixel_size = my_pixel_size;
 	RFLOAT remap_image_sizes = (opt.mymodel.ori_size * opt.mymodel.pixel_size) / (XSIZE(img()) * my_pixel_size);
 	Matrix1D<RFLOAT> my_old_offset(3), my_residual_offset(3), centering_offset(3);
 	Matrix2D<RFLOAT> Aori;
@@ -680,10 +774,11 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 		Abody = Aori * (opt.mymodel.orient_bodies[subtract_body]).transpose() * A_rot90 * Aresi_subtract * opt.mymodel.orient_bodies[subtract_body];
 		Euler_matrix2angles(Abody, rot, tilt, psi);
 
-		// Store the optimal orientations in the MDimg table
-		opt.mydata.MDimg.setValue(EMDL_ORIENT_ROT, rot, ori_img_id);
-		opt.mydata.MDimg.setValue(EMDL_ORIENT_TILT, tilt, ori_img_id);
-		opt.mydata.MDimg.setValue(EMDL_ORIENT_PSI, psi, ori_img_id);
+		// Store the optimal orientations in the MDimg table (in writeOneParticle)
+		sub.has_new_angles = true;
+		sub.rot = rot;
+		sub.tilt = tilt;
+		sub.psi = psi;
 
 		// Also get refined offset for this body
 		opt.mydata.MDbodies[subtract_body].getValue(EMDL_ORIENT_ORIGIN_X_ANGSTROM, XX(my_refined_ibody_offset), ori_img_id);
@@ -763,9 +858,9 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 				RFLOAT N2 = norm( dAkij(Fimg, k, i, j) );
 				// division by two keeps the numbers similar to tau2 and sigma2_noise,
 				// which are per real/imaginary component
-				sum_S2(idx_remapped) += S2 / 2.;
-				sum_N2(idx_remapped) += N2 / 2.;
-				sum_count(idx_remapped) += 1.;
+				my_sum_S2(idx_remapped) += S2 / 2.;
+				my_sum_N2(idx_remapped) += N2 / 2.;
+				my_sum_count(idx_remapped) += 1.;
 			}
 		}
 	}
@@ -783,13 +878,9 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 			my_residual_offset -= centering_offset;
 			selfTranslate(img(), centering_offset, WRAP);
 
-			// Set the non-integer difference between the rounded centering offset and the actual offsets in the STAR file
-			opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_X_ANGSTROM, my_pixel_size * XX(my_residual_offset), ori_img_id);
-			opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_Y_ANGSTROM, my_pixel_size * YY(my_residual_offset), ori_img_id);
-			if (opt.mymodel.data_dim == 3)
-			{
-				opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_Z_ANGSTROM, my_pixel_size * ZZ(my_residual_offset), ori_img_id);
-			}
+			// Set the non-integer difference between the rounded centering offset and the actual offsets in the STAR file (in writeOneParticle)
+			sub.has_new_offset = true;
+			sub.residual_offset = my_residual_offset;
 		}
 
 		// Rebox the image
@@ -806,28 +897,53 @@ void ParticleSubtractor::subtractOneParticle(long int part_id, long int imgno, l
 						   LAST_XMIPP_INDEX(boxsize),  LAST_XMIPP_INDEX(boxsize),  LAST_XMIPP_INDEX(boxsize));
 			}
 		}
+	}
+}
+
+void ParticleSubtractor::writeOneParticle(long int part_id, long int imgno, SubtractedParticle &sub, long int counter)
+{
+	Image<RFLOAT> &img = sub.img;
+	long int ori_img_id = opt.mydata.particles[part_id].images[imgno].id;
+	int optics_group = sub.optics_group;
+	RFLOAT my_pixel_size = sub.pixel_size;
+
+	if (sub.has_new_angles)
+	{
+		opt.mydata.MDimg.setValue(EMDL_ORIENT_ROT, sub.rot, ori_img_id);
+		opt.mydata.MDimg.setValue(EMDL_ORIENT_TILT, sub.tilt, ori_img_id);
+		opt.mydata.MDimg.setValue(EMDL_ORIENT_PSI, sub.psi, ori_img_id);
+	}
 
-		// Now write out the image & set filenames in output metadatatable
-		FileName fn_img = getParticleName(counter, rank, optics_group);
-		opt.mydata.MDimg.setValue(EMDL_IMAGE_NAME, fn_img, ori_img_id);
-		opt.mydata.MDimg.setValue(EMDL_IMAGE_ORI_NAME, opt.mydata.particles[part_id].images[0].name, ori_img_id);
-		//Also set the original order in the input STAR file for later combination
-		opt.mydata.MDimg.setValue(EMDL_IMAGE_ID, ori_img_id, ori_img_id);
-		MDimg_out.addObject();
-		MDimg_out.setObject(opt.mydata.MDimg.getObject(ori_img_id));
-
-		//printf("Writing: fn_orig = %s counter = %ld rank = %d optics_group = %d fn_img = %s SIZE = %d nr_particles_in_optics_group[optics_group] = %d\n", fn_orig.c_str(), counter, rank, optics_group+1, fn_img.c_str(), XSIZE(img()), nr_particles_in_optics_group[optics_group]);
-		img.setSamplingRateInHeader(my_pixel_size);
+	if (sub.has_new_offset)
+	{
+		opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_X_ANGSTROM, my_pixel_size * XX(sub.residual_offset), ori_img_id);
+		opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_Y_ANGSTROM, my_pixel_size * YY(sub.residual_offset), ori_img_id);
 		if (opt.mymodel.data_dim == 3)
 		{
-			img.write(fn_img, -1, false, WRITE_OVERWRITE, write_float16 ? Float16: Float);
+			opt.mydata.MDimg.setValue(EMDL_ORIENT_ORIGIN_Z_ANGSTROM, my_pixel_size * ZZ(sub.residual_offset), ori_img_id);
 		}
+	}
+
+	// Now write out the image & set filenames in output metadatatable
+	FileName fn_img = getParticleName(counter, rank, optics_group);
+	opt.mydata.MDimg.setValue(EMDL_IMAGE_NAME, fn_img, ori_img_id);
+	opt.mydata.MDimg.setValue(EMDL_IMAGE_ORI_NAME, opt.mydata.particles[part_id].images[0].name, ori_img_id);
+	//Also set the original order in the input STAR file for later combination
+	opt.mydata.MDimg.setValue(EMDL_IMAGE_ID, ori_img_id, ori_img_id);
+	MDimg_out.addObject();
+	MDimg_out.setObject(opt.mydata.MDimg.getObject(ori_img_id));
+
+	//printf("Writing: fn_orig = %s counter = %ld rank = %d optics_group = %d fn_img = %s SIZE = %d nr_particles_in_optics_group[optics_group] = %d\n", fn_orig.c_str(), counter, rank, optics_group+1, fn_img.c_str(), XSIZE(img()), nr_particles_in_optics_group[optics_group]);
+	img.setSamplingRateInHeader(my_pixel_size);
+	if (opt.mymodel.data_dim == 3)
+	{
+		img.write(fn_img, -1, false, WRITE_OVERWRITE, write_float16 ? Float16: Float);
+	}
+	else
+	{
+		if (nr_particles_in_optics_group[optics_group] == 0)
+			img.write(fn_img, -1, false, WRITE_OVERWRITE, write_float16 ? Float16: Float);
 		else
-		{
-			if (nr_particles_in_optics_group[optics_group] == 0)
-				img.write(fn_img, -1, false, WRITE_OVERWRITE, write_float16 ? Float16: Float);
-			else
-				img.write(fn_img, -1, false, WRITE_APPEND, write_float16 ? Float16: Float);
-		}
+			img.write(fn_img, -1, false, WRITE_APPEND, write_float16 ? Float16: Float);
 	}
 }
@@ -38,7 +38,7 @@ public:
 	MlOptimiser opt;
 
 	// FileName for the optimiser.star file, a possibly more restricted particle subset, mask and output files
-	FileName fn_opt, fn_sel, fn_msk, fn_out, fn_revert;
+	FileName fn_opt, fn_sel, fn_msk, fn_out, fn_revert, fn_particle_cache;
 
 	//Output metadatatable for each rank
 	MetaDataTable MDimg_out;
@@ -52,6 +52,9 @@ public:
 	// Write in half-precision 16 bit floating point numbers (MRC mode 12)
 	bool write_float16;
 
+	// Number of threads to subtract particles in parallel
+	int nr_threads;
+
 	// Running sums of power of signal and noise for SSNR calculation (keep public for MPI access)
 	MultidimArray<RFLOAT> sum_count, sum_S2, sum_N2;
 
@@ -86,8 +89,27 @@ public:
 	// Get name of a single subtracted particle
 	FileName getParticleName(long int imgno, int myrank, int optics_group=-1);
 
-	// subtract one particle
-	void subtractOneParticle(long int part_id, long int imgno, long int counter);
+	// A subtracted particle, with the changes to its metadata that still have to be stored in the output STAR file
+	struct SubtractedParticle
+	{
+		Image<RFLOAT> img;
+		int optics_group;
+		RFLOAT pixel_size;
+		// Multi-body: orientation of the subtracted body in the original coordinate system
+		bool has_new_angles;
+		RFLOAT rot, tilt, psi;
+		// Re-centered particles: remaining non-integer offsets (in pixels)
+		bool has_new_offset;
+		Matrix1D<RFLOAT> residual_offset;
+	};
+
+	// subtract one particle. This does not change any shared data, so that many particles can be subtracted in parallel.
+	// With do_ssnr, the power of the signal and the noise are added to my_sum_S2, my_sum_N2 and my_sum_count instead.
+	void subtractOneParticle(long int part_id, long int imgno, SubtractedParticle &sub,
+			MultidimArray<RFLOAT> &my_sum_S2, MultidimArray<RFLOAT> &my_sum_N2, MultidimArray<RFLOAT> &my_sum_count);
+
+	// Store the metadata of a subtracted particle in MDimg_out and append it to the stack of its optics group
+	void writeOneParticle(long int part_id, long int imgno, SubtractedParticle &sub, long int counter);
 
 private:
 	// Pre-calculated rotation matrix for (0,90,0) rotation, and its transpose, for multi-body orientations
@@ -787,13 +787,13 @@ void RelionJob::initialise(int _job_type)
 	else if (type == PROC_AUTOPICK)
 	{
 		has_mpi = true;
-		has_thread = false;
+		has_thread = true;
 		initialiseAutopickJob();
 	}
 	else if (type == PROC_EXTRACT)
 	{
 		has_mpi = true;
-		has_thread = false;
+		has_thread = true;
 		initialiseExtractJob();
 	}
 	else if (type == PROC_CLASSSELECT)
@@ -840,7 +840,7 @@ void RelionJob::initialise(int _job_type)
 	else if (type == PROC_SUBTRACT)
 	{
 		has_mpi = true;
-		has_thread = false;
+		has_thread = true;
 		initialiseSubtractJob();
 	}
 	else if (type == PROC_POST)
@@ -2304,6 +2304,9 @@ bool RelionJob::getCommandsAutopickJob(std::string &outputname, std::vector<std:
 			if (is_continue)
 				command += " --only_do_unfinished ";
 		}
+
+		// Running stuff
+		command += " --j " + joboptions["nr_threads"].getString();
 	}
 
 	// Other arguments
@@ -2531,6 +2534,8 @@ bool RelionJob::getCommandsExtractJob(std::string &outputname, std::vector<std::
 	if (is_continue)
 		command += " --only_do_unfinished ";
 
+	// Running stuff
+	command += " --j " + joboptions["nr_threads"].getString();
 
 	// Other arguments for extraction
 	command += " " + joboptions["other_args"].getString();
@@ -5038,6 +5043,8 @@ bool RelionJob::getCommandsSubtractJob(std::string &outputname, std::vector<std:
 		}
 		if (error_message != "") return false;
 
+		// Running stuff
+		command += " --j " + joboptions["nr_threads"].getString();
 	}
 
 	// Other arguments
@@ -17,7 +17,9 @@
  * source code. Additional authorship citations may be added, but existing
  * author citations must be preserved.
  ***************************************************************************/
+#include <exception>
 #include "src/preprocessing.h"
+#include "src/metadata_sidecar.h"
 
 //#define PREP_TIMING
 #ifdef PREP_TIMING
@@ -75,6 +77,7 @@ void Preprocessing::read(int argc, char **argv, int rank)
 	do_phase_flip = parser.checkOption("--phase_flip", "Flip CTF-phases in the micrograph/frame prior to particle extraction");
 	extract_bias_x  = textToInteger(parser.getOption("--extract_bias_x", "Bias in X-direction of picked particles (this value in pixels will be added to the coords)", "0"));
 	extract_bias_y  = textToInteger(parser.getOption("--extract_bias_y", "Bias in Y-direction of picked particles (this value in pixels will be added to the coords)", "0"));
+	nr_threads = textToInteger(parser.getOption("--j", "Number of threads (for extracting the particles of one micrograph in parallel)", "1"));
 	only_extract_unfinished = parser.checkOption("--only_do_unfinished", "Extract only particles if the STAR file for that micrograph does not yet exist.");
 	extract_minimum_fom = textToFloat(parser.getOption("--minimum_pick_fom", "Minimum value for rlnAutopickFigureOfMerit for particle extraction","-999."));
 
@@ -320,6 +323,15 @@ void Preprocessing::joinAllStarFiles()
 	int og;
 	std::cout <<std::endl << " Joining metadata of all particles from " << MDmics.numberOfObjects() << " micrographs in one STAR file..." << std::endl;
 
+	// The particles are joined in two passes over the per-micrograph STAR files, so that
+	// the joined table never needs to be held in memory: the first pass collects the
+	// labels and optics groups, the second one streams the rows to the output file.
+	ObservationModel *myOutObsModel;
+	myOutObsModel = (fn_data == "" || keep_ctf_from_micrographs) ? &obsModelMic : &obsModelPart;
+	std::set<std::string> isOgPresent;
+	std::vector<FileName> fn_stars;
+	long int nr_parts = 0;
+
 	long int imic = 0, ibatch = 0;
 	MetaDataTable MDout, MDmicnames, MDbatch, MDpick;
 	for (long int current_object1 = MDmics.firstObject();
@@ -347,13 +359,30 @@ void Preprocessing::joinAllStarFiles()
 				MetaDataTable MDonestack;
 				MDonestack.read(fn_star);
 
-				if (MDout.numberOfObjects() > 0 && !MetaDataTable::compareLabels(MDout, MDonestack))
+				// MDout only collects the labels
+				if (nr_parts == 0)
+				{
+					MDout.addMissingLabels(&MDonestack);
+				}
+				else if (!MetaDataTable::compareLabels(MDout, MDonestack))
 				{
 					std::cout << "The STAR file " << fn_star << " contains a column not present in others. Missing values will be filled by default values (0 or empty string)" << std::endl;
 					MDout.addMissingLabels(&MDonestack);
-					MDonestack.addMissingLabels(&MDout);
 				}
-				MDout.append(MDonestack);
+
+				std::string optgroup_name;
+				FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDonestack)
+				{
+					og = myOutObsModel->getOpticsGroup(MDonestack);
+					myOutObsModel->opticsMdt.getValue(EMDL_IMAGE_OPTICS_GROUP_NAME, optgroup_name, og);
+					isOgPresent.insert(optgroup_name);
+				}
+
+				if (MDonestack.numberOfObjects() > 0)
+				{
+					fn_stars.push_back(fn_star);
+					nr_parts += MDonestack.numberOfObjects();
+				}
 			}
 		}
 
@@ -386,19 +415,9 @@ void Preprocessing::joinAllStarFiles()
 			}
 		}
 
-		ObservationModel *myOutObsModel;
-		myOutObsModel = (fn_data == "" || keep_ctf_from_micrographs) ? &obsModelMic : &obsModelPart;
 		RFLOAT my_angpix;
 		std::string optgroup_name;
 
-		std::set<std::string> isOgPresent;
-		FOR_ALL_OBJECTS_IN_METADATA_TABLE(MDout)
-		{
-			og = myOutObsModel->getOpticsGroup(MDout);
-			myOutObsModel->opticsMdt.getValue(EMDL_IMAGE_OPTICS_GROUP_NAME, optgroup_name, og);
-			isOgPresent.insert(optgroup_name);
-		}
-
 		// Set the (possibly rescale output_angpix and the output image size in the opticsMdt
 		FOR_ALL_OBJECTS_IN_METADATA_TABLE(myOutObsModel->opticsMdt)
 		{
@@ -473,9 +492,42 @@ void Preprocessing::joinAllStarFiles()
 
         // Don't drag the new rlnParticleSelectionType along the entire processing workflow...
         MDout.deactivateLabel(EMDL_PARTICLE_SELECTION_TYPE);
+		MDout.setName("particles");
 
-		ObservationModel::saveNew(MDout, myOutObsModel->opticsMdt, fn_part_star, "particles");
-		std::cout << " Written out STAR file with " << MDout.numberOfObjects() << " particles in " << fn_part_star<< std::endl;
+		// Same output as ObservationModel::saveNew, but the particles are streamed one micrograph at a time
+		FileName fn_tmp = fn_part_star + ".tmp";
+		std::ofstream fh(fn_tmp.c_str(), std::ios::out);
+		if (!fh)
+			REPORT_ERROR("Preprocessing::joinAllStarFiles: cannot write to file: " + fn_part_star);
+
+		myOutObsModel->opticsMdt.setName("optics");
+		myOutObsModel->opticsMdt.write(fh);
+
+		if (nr_parts > 0)
+		{
+			MDout.writeLoopHeader(fh);
+			for (long int istar = 0; istar < fn_stars.size(); istar++)
+			{
+				MetaDataTable MDonestack;
+				MDonestack.read(fn_stars[istar]);
+				MDonestack.addMissingLabels(&MDout);
+				if (MDonestack.containsLabel(EMDL_PARTICLE_SELECTION_TYPE))
+					MDonestack.deactivateLabel(EMDL_PARTICLE_SELECTION_TYPE);
+
+				// Put the columns in the same order as in the header
+				MDbatch = MDout;
+				MDbatch.append(MDonestack);
+				MDbatch.writeLoopRows(fh);
+			}
+			MetaDataTable::writeLoopFooter(fh);
+		}
+		fh.close();
+
+		std::rename(fn_tmp.c_str(), fn_part_star.c_str());
+		// The joined table was never in memory as a whole, so there is no binary sidecar for it
+		MetaDataSidecar::remove(fn_part_star);
+
+		std::cout << " Written out STAR file with " << nr_parts << " particles in " << fn_part_star<< std::endl;
 	}
 }
 
@@ -830,14 +882,14 @@ void Preprocessing::extractParticlesFromOneMicrograph(MetaDataTable &MD,
 		FileName fn_output_img_root, FileName fn_oristack, long int &my_current_nr_images, long int my_total_nr_images,
 		RFLOAT &all_avg, RFLOAT &all_stddev, RFLOAT &all_minval, RFLOAT &all_maxval)
 {
-	Image<RFLOAT> Ipart, Imic, Itmp;
+	Image<RFLOAT> Imic;
 
 	bool MDin_has_optics_group = MD.containsLabel(EMDL_IMAGE_OPTICS_GROUP); // i.e. re-extracting
 	bool MDin_has_beamtilt = (MD.containsLabel(EMDL_IMAGE_BEAMTILT_X) || MD.containsLabel(EMDL_IMAGE_BEAMTILT_Y));
 	bool MDin_has_ctf = MD.containsLabel(EMDL_CTF_DEFOCUSU);
 	bool MDin_has_tiltgroup = MD.containsLabel(EMDL_PARTICLE_BEAM_TILT_CLASS);
 	int my_extract_size = (do_phase_flip || do_premultiply_ctf) ? premultiply_ctf_extract_size : extract_size;
-	RFLOAT my_angpix;
+	RFLOAT my_angpix = angpix; // replaced by the pixel size of the optics group of the micrograph, if it has one
 
 	TIMING_TIC(TIMING_READ_IMG);
 
@@ -860,31 +912,31 @@ void Preprocessing::extractParticlesFromOneMicrograph(MetaDataTable &MD,
 		obsModelMic.opticsMdt.getValue(EMDL_MICROGRAPH_PIXEL_SIZE, my_angpix, optics_group);
 	}
 
-	// Now window all particles from the micrograph
-	// Now do the actual phase flipping or CTF-multiplication
-	MultidimArray<Complex> FT;
-	FourierTransformer transformer;
+	// First collect the positions, CTFs and helical priors of all particles, as the MetaDataTable cannot be iterated over in parallel
+	long int npos = MD.numberOfObjects();
+	std::vector<long int> xpos(npos), ypos(npos), zpos(npos, 0);
+	std::vector<CTF> ctfs(npos, ctf);
+	std::vector<RFLOAT> angpixs(npos, my_angpix), tilts(npos, 0.), psis(npos, 0.);
 	int ipos = 0;
 	FOR_ALL_OBJECTS_IN_METADATA_TABLE(MD)
 	{
 		RFLOAT dxpos, dypos, dzpos;
-		long int xpos, ypos, zpos;
 		long int x0, xF, y0, yF, z0, zF;
 		MD.getValue(EMDL_IMAGE_COORD_X, dxpos);
 		MD.getValue(EMDL_IMAGE_COORD_Y, dypos);
-		xpos = (long int)dxpos;
-		ypos = (long int)dypos;
+		xpos[ipos] = (long int)dxpos;
+		ypos[ipos] = (long int)dypos;
 
-		x0 = xpos + FIRST_XMIPP_INDEX(my_extract_size);
-		xF = xpos + LAST_XMIPP_INDEX(my_extract_size);
-		y0 = ypos + FIRST_XMIPP_INDEX(my_extract_size);
-		yF = ypos + LAST_XMIPP_INDEX(my_extract_size);
+		x0 = xpos[ipos] + FIRST_XMIPP_INDEX(my_extract_size);
+		xF = xpos[ipos] + LAST_XMIPP_INDEX(my_extract_size);
+		y0 = ypos[ipos] + FIRST_XMIPP_INDEX(my_extract_size);
+		yF = ypos[ipos] + LAST_XMIPP_INDEX(my_extract_size);
 		if (dimensionality == 3)
 		{
 			MD.getValue(EMDL_IMAGE_COORD_Z, dzpos);
-			zpos = (long int)dzpos;
-			z0 = zpos + FIRST_XMIPP_INDEX(extract_size);
-			zF = zpos + LAST_XMIPP_INDEX(extract_size);
+			zpos[ipos] = (long int)dzpos;
+			z0 = zpos[ipos] + FIRST_XMIPP_INDEX(extract_size);
+			zF = zpos[ipos] + LAST_XMIPP_INDEX(extract_size);
 		}
 
 		// Discard particles that are completely outside the micrograph and print a warning
@@ -892,9 +944,9 @@ void Preprocessing::extractParticlesFromOneMicrograph(MetaDataTable &MD,
 				(dimensionality==3 && (zF < 0 || z0 >= ZSIZE(Imic())) ) )
 		{
 			std::cerr << " micrograph x,y,z,n-size= " << XSIZE(Imic()) << " , " << YSIZE(Imic()) << " , " << ZSIZE(Imic()) << " , " << NSIZE(Imic()) << std::endl;
-			std::cerr << " particle position= " << xpos << " , " << ypos;
+			std::cerr << " particle position= " << xpos[ipos] << " , " << ypos[ipos];
 			if (dimensionality == 3)
-				std::cerr << " , " << zpos;
+				std::cerr << " , " << zpos[ipos];
 			std::cerr << std::endl;
 			REPORT_ERROR("Preprocessing::extractParticlesFromOneFrame ERROR: particle" + integerToString(ipos+1) + " lies completely outside micrograph " + fn_mic);
 		}
@@ -902,127 +954,226 @@ void Preprocessing::extractParticlesFromOneMicrograph(MetaDataTable &MD,
 		// Read per-particle CTF
 		if (MDin_has_ctf && !keep_ctf_from_micrographs)
 		{
-			ctf.readByGroup(MD, &obsModelPart);
+			ctfs[ipos].readByGroup(MD, &obsModelPart);
 			optics_group = obsModelPart.getOpticsGroup(MD);
 			if (obsModelPart.getBoxSize(optics_group) != my_extract_size)
 				obsModelPart.setBoxSize(optics_group, my_extract_size);
-			obsModelPart.opticsMdt.getValue(EMDL_MICROGRAPH_PIXEL_SIZE, my_angpix, optics_group);
+			obsModelPart.opticsMdt.getValue(EMDL_MICROGRAPH_PIXEL_SIZE, angpixs[ipos], optics_group);
 		}
 
-		TIMING_TIC(TIMING_WINDOW);
-		// extract one particle in Ipart
-		if (dimensionality == 3)
-			Imic().window(Ipart(), z0, y0, x0, zF, yF, xF);
-		else
-			Imic().window(Ipart(), y0, x0, yF, xF, mic_avg);
-		Ipart().setXmippOrigin();
-		TIMING_TOC(TIMING_WINDOW);
-
-		// Premultiply the CTF of each particle, possibly in a bigger box (premultiply_ctf_extract_size)
-		if (do_phase_flip || do_premultiply_ctf)
+		// Jun24,2015 - Shaoda, extract helical segments
+		if (do_extract_helix) // If priors do not exist, errors will occur in 'readHelicalCoordinates()'.
 		{
-			transformer.FourierTransform(Ipart(), FT, false);
-
-			MultidimArray<RFLOAT> Fctf;
-			Fctf.resize(YSIZE(FT), XSIZE(FT));
-			// do_abs, phase_flip, intact_first_peak, damping, padding
-			// 190802 TAKANORI: The original code using getCTF was do_damping=false, but for consistency with Polishing, I changed it.
-			// The boxsize in ObsModel has been updated above.
-			// In contrast to Polish, we premultiply particle BEFORE down-sampling, so PixelSize in ObsModel is OK.
-			// But we are doing this after extraction, so there is not much merit...
-			ctf.getFftwImage(Fctf, my_extract_size, my_extract_size, my_angpix, false, do_phase_flip, do_ctf_intact_first_peak, true, false);
-
-			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(FT)
-			{
-				DIRECT_MULTIDIM_ELEM(FT, n) *= DIRECT_MULTIDIM_ELEM(Fctf, n);
-			}
+			MD.getValue(EMDL_ORIENT_TILT_PRIOR, tilts[ipos]);
+			MD.getValue(EMDL_ORIENT_PSI_PRIOR, psis[ipos]);
+		}
 
-			transformer.inverseFourierTransform(FT, Ipart());
+		ipos++;
+	}
 
-			if (extract_size != premultiply_ctf_extract_size)
-			{
-				Ipart().window(FIRST_XMIPP_INDEX(extract_size), FIRST_XMIPP_INDEX(extract_size),
-				               LAST_XMIPP_INDEX(extract_size),  LAST_XMIPP_INDEX(extract_size));
-			}
-		}
+	// 2D particles are all kept in memory and written to their stack in one go at the end
+	bool is_stack = (dimensionality == 2 || do_project_3d);
+	Image<float> Istack;
+	std::vector<RFLOAT> avgs(npos), stddevs(npos), minvals(npos), maxvals(npos);
+	if (is_stack)
+	{
+		int my_final_size = (do_rewindow) ? window : ((do_rescale) ? scale : extract_size);
+		Istack().resize(npos, 1, my_final_size, my_final_size);
+	}
 
-		TIMING_TIC(TIMING_BOUNDARY);
-		// Check boundaries: fill pixels outside the boundary with the nearest ones inside
-		// This will create lines at the edges, rather than zeros
-		Ipart().setXmippOrigin();
+	// Dust removal draws from the global random number generator, so only keep results reproducible with a single thread
+	int my_nr_threads = (do_normalise && (white_dust_stddev > 0. || black_dust_stddev > 0.)) ? 1 : nr_threads;
 
-		// X-boundaries
-		if (x0 < 0 || xF >= XSIZE(Imic()) )
-		{
-			FOR_ALL_ELEMENTS_IN_ARRAY3D(Ipart())
-			{
-				if (j + xpos < 0)
-					A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), k, i, -xpos);
-				else if (j + xpos >= XSIZE(Imic()))
-					A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), k, i, XSIZE(Imic()) - xpos - 1);
-			}
-		}
+	// Now window all particles from the micrograph
+	// Now do the actual phase flipping or CTF-multiplication
+	TIMING_TIC(TIMING_WINDOW);
+	std::exception_ptr thread_error;
+	#pragma omp parallel num_threads(my_nr_threads)
+	{
+		// Each thread has its own transformer; their plans are shared through the plan cache of FourierTransformer
+		Image<RFLOAT> Ipart;
+		MultidimArray<Complex> FT;
+		FourierTransformer transformer;
 
-		// Y-boundaries
-		if (y0 < 0 || yF >= YSIZE(Imic()))
+		#pragma omp for schedule(dynamic)
+		for (long int ipos = 0; ipos < npos; ipos++)
 		{
-			FOR_ALL_ELEMENTS_IN_ARRAY3D(Ipart())
+			try
 			{
-				if (i + ypos < 0)
-					A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), k, -ypos, j);
-				else if (i + ypos >= YSIZE(Imic()))
-					A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), k, YSIZE(Imic()) - ypos - 1, j);
-			}
-		}
+				long int x0, xF, y0, yF, z0, zF;
+				x0 = xpos[ipos] + FIRST_XMIPP_INDEX(my_extract_size);
+				xF = xpos[ipos] + LAST_XMIPP_INDEX(my_extract_size);
+				y0 = ypos[ipos] + FIRST_XMIPP_INDEX(my_extract_size);
+				yF = ypos[ipos] + LAST_XMIPP_INDEX(my_extract_size);
+				z0 = zpos[ipos] + FIRST_XMIPP_INDEX(extract_size);
+				zF = zpos[ipos] + LAST_XMIPP_INDEX(extract_size);
+
+				// extract one particle in Ipart
+				if (dimensionality == 3)
+					Imic().window(Ipart(), z0, y0, x0, zF, yF, xF);
+				else
+					Imic().window(Ipart(), y0, x0, yF, xF, mic_avg);
+				Ipart().setXmippOrigin();
 
-		if (dimensionality == 3)
-		{
-			// Z-boundaries
-			if (z0 < 0 || zF >= ZSIZE(Imic()))
+				// Premultiply the CTF of each particle, possibly in a bigger box (premultiply_ctf_extract_size)
+				if (do_phase_flip || do_premultiply_ctf)
+				{
+					transformer.FourierTransform(Ipart(), FT, false);
+
+					MultidimArray<RFLOAT> Fctf;
+					Fctf.resize(YSIZE(FT), XSIZE(FT));
+					// do_abs, phase_flip, intact_first_peak, damping, padding
+					// 190802 TAKANORI: The original code using getCTF was do_damping=false, but for consistency with Polishing, I changed it.
+					// The boxsize in ObsModel has been updated above.
+					// In contrast to Polish, we premultiply particle BEFORE down-sampling, so PixelSize in ObsModel is OK.
+					// But we are doing this after extraction, so there is not much merit...
+					// The observation model guards its own caches, so this can run on all threads at once
+					ctfs[ipos].getFftwImage(Fctf, my_extract_size, my_extract_size, angpixs[ipos], false, do_phase_flip, do_ctf_intact_first_peak, true, false);
+
+					FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(FT)
+					{
+						DIRECT_MULTIDIM_ELEM(FT, n) *= DIRECT_MULTIDIM_ELEM(Fctf, n);
+					}
+
+					transformer.inverseFourierTransform(FT, Ipart());
+
+					if (extract_size != premultiply_ctf_extract_size)
+					{
+						Ipart().window(FIRST_XMIPP_INDEX(extract_size), FIRST_XMIPP_INDEX(extract_size),
+						               LAST_XMIPP_INDEX(extract_size),  LAST_XMIPP_INDEX(extract_size));
+					}
+				}
+
+				// Check boundaries: fill pixels outside the boundary with the nearest ones inside
+				// This will create lines at the edges, rather than zeros
+				Ipart().setXmippOrigin();
+
+				// X-boundaries
+				if (x0 < 0 || xF >= XSIZE(Imic()) )
+				{
+					FOR_ALL_ELEMENTS_IN_ARRAY3D(Ipart())
+					{
+						if (j + xpos[ipos] < 0)
+							A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), k, i, -xpos[ipos]);
+						else if (j + xpos[ipos] >= XSIZE(Imic()))
+							A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), k, i, XSIZE(Imic()) - xpos[ipos] - 1);
+					}
+				}
+
+				// Y-boundaries
+				if (y0 < 0 || yF >= YSIZE(Imic()))
+				{
+					FOR_ALL_ELEMENTS_IN_ARRAY3D(Ipart())
+					{
+						if (i + ypos[ipos] < 0)
+							A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), k, -ypos[ipos], j);
+						else if (i + ypos[ipos] >= YSIZE(Imic()))
+							A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), k, YSIZE(Imic()) - ypos[ipos] - 1, j);
+					}
+				}
+
+				if (dimensionality == 3)
+				{
+					// Z-boundaries
+					if (z0 < 0 || zF >= ZSIZE(Imic()))
+					{
+						FOR_ALL_ELEMENTS_IN_ARRAY3D(Ipart())
+						{
+							if (k + zpos[ipos] < 0)
+								A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), -zpos[ipos], i, j);
+							else if (k + zpos[ipos] >= ZSIZE(Imic()))
+								A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), ZSIZE(Imic()) - zpos[ipos] - 1, i, j);
+						}
+					}
+				}
+
+				// 2D projection of 3D sub-tomograms
+				if (dimensionality == 3 && do_project_3d)
+				{
+					// Project the 3D sub-tomogram into a 2D particle again
+					Image<RFLOAT> Iproj(YSIZE(Ipart()), XSIZE(Ipart()));
+					Iproj().setXmippOrigin();
+					FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY3D(Ipart())
+					{
+						DIRECT_A2D_ELEM(Iproj(), i, j) += DIRECT_A3D_ELEM(Ipart(), k, i, j);
+					}
+					Ipart = Iproj;
+				}
+
+				if (is_stack)
+				{
+					applyPerImageOperations(Ipart, tilts[ipos], psis[ipos], avgs[ipos], stddevs[ipos], minvals[ipos], maxvals[ipos]);
+					if (XSIZE(Ipart()) != XSIZE(Istack()) || YSIZE(Ipart()) != YSIZE(Istack()))
+						REPORT_ERROR("Preprocessing::extractParticlesFromOneMicrograph BUG: particle does not have the size of the output stack");
+
+					float *dest = MULTIDIM_ARRAY(Istack()) + ipos * YXSIZE(Istack());
+					FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Ipart())
+					{
+						dest[n] = (float)DIRECT_MULTIDIM_ELEM(Ipart(), n);
+					}
+				}
+				else
+				{
+					// performPerImageOperations writes one mrc file for every subtomogram
+					RFLOAT dummy_avg, dummy_stddev, dummy_minval, dummy_maxval;
+					performPerImageOperations(Ipart, fn_output_img_root, my_current_nr_images + ipos, my_total_nr_images,
+					                          tilts[ipos], psis[ipos], dummy_avg, dummy_stddev, dummy_minval, dummy_maxval);
+				}
+			}
+			catch (...)
 			{
-				FOR_ALL_ELEMENTS_IN_ARRAY3D(Ipart())
+				// Nothing may escape the parallel region: keep the first exception and rethrow it after the region
+				#pragma omp critical(Preprocessing_error)
 				{
-					if (k + zpos < 0)
-						A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), -zpos, i, j);
-					else if (k + zpos >= ZSIZE(Imic()))
-						A3D_ELEM(Ipart(), k, i, j) = A3D_ELEM(Ipart(), ZSIZE(Imic()) - zpos - 1, i, j);
+					if (!thread_error)
+						thread_error = std::current_exception();
 				}
 			}
 		}
+	}
+	TIMING_TOC(TIMING_WINDOW);
+
+	if (thread_error)
+		std::rethrow_exception(thread_error);
 
-		// 2D projection of 3D sub-tomograms
-		if (dimensionality == 3 && do_project_3d)
+	if (is_stack)
+	{
+		// Keep track of overall statistics, in the same order as one particle at a time
+		for (long int ipos = 0; ipos < npos; ipos++)
 		{
-			// Project the 3D sub-tomogram into a 2D particle again
-			Image<RFLOAT> Iproj(YSIZE(Ipart()), XSIZE(Ipart()));
-			Iproj().setXmippOrigin();
-			FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY3D(Ipart())
-			{
-				DIRECT_A2D_ELEM(Iproj(), i, j) += DIRECT_A3D_ELEM(Ipart(), k, i, j);
-			}
-			Ipart = Iproj;
+			all_minval = XMIPP_MIN(minvals[ipos], all_minval);
+			all_maxval = XMIPP_MAX(maxvals[ipos], all_maxval);
+			all_avg	+= avgs[ipos];
+			all_stddev += stddevs[ipos]*stddevs[ipos];
 		}
-		TIMING_TOC(TIMING_BOUNDARY);
 
-		// performPerImageOperations will also append the particle to the output stack in fn_stack
-		// Jun24,2015 - Shaoda, extract helical segments
-		RFLOAT tilt_deg, psi_deg;
-		tilt_deg = psi_deg = 0.;
-		if (do_extract_helix) // If priors do not exist, errors will occur in 'readHelicalCoordinates()'.
+		// This micrograph completes the stack: set the min, max, avg and stddev values in the main header
+		if (my_current_nr_images + npos == my_total_nr_images)
 		{
-			MD.getValue(EMDL_ORIENT_TILT_PRIOR, tilt_deg);
-			MD.getValue(EMDL_ORIENT_PSI_PRIOR, psi_deg);
+			all_avg /= my_total_nr_images;
+			all_stddev = sqrt(all_stddev/my_total_nr_images);
+			Istack.MDMainHeader.setValue(EMDL_IMAGE_STATS_MIN, all_minval);
+			Istack.MDMainHeader.setValue(EMDL_IMAGE_STATS_MAX, all_maxval);
+			Istack.MDMainHeader.setValue(EMDL_IMAGE_STATS_AVG, all_avg);
+			Istack.MDMainHeader.setValue(EMDL_IMAGE_STATS_STDDEV, all_stddev);
 		}
+		Istack.setSamplingRateInHeader(output_angpix);
 
-		TIMING_TIC(TIMING_PRE_IMG_OPS);
-		performPerImageOperations(Ipart, fn_output_img_root, my_current_nr_images + ipos, my_total_nr_images,
-		                          tilt_deg, psi_deg, all_avg, all_stddev, all_minval, all_maxval);
-		TIMING_TOC(TIMING_PRE_IMG_OPS);
+		TIMING_TIC(TIMING_PER_IMG_OP_WRITE);
+		// Write the whole stack at once, instead of appending it one particle at a time
+		if (my_current_nr_images != 0)
+			REPORT_ERROR("Preprocessing::extractParticlesFromOneMicrograph BUG: the particles of one micrograph should start a new stack");
+		Istack.write(fn_output_img_root+".mrcs", -1, (my_total_nr_images > 1), WRITE_OVERWRITE, write_float16 ? Float16: Float);
+		TIMING_TOC(TIMING_PER_IMG_OP_WRITE);
+	}
 
+	ipos = 0;
+	FOR_ALL_OBJECTS_IN_METADATA_TABLE(MD)
+	{
 		TIMING_TIC(TIMING_REST);
 		// Also store all the particles information in the STAR file
 		FileName fn_img;
-		if (Ipart().getDim() == 3)
+		if (!is_stack)
 			fn_img.compose(fn_output_img_root, my_current_nr_images + ipos + 1, "mrc");
 		else
 			fn_img.compose(my_current_nr_images + ipos + 1, fn_output_img_root + ".mrcs"); // start image counting in stacks at 1!
@@ -1135,17 +1286,14 @@ void Preprocessing::runOperateOnInputFile()
 	std::cout << " Done writing to " << fn_operate_out << std::endl;
 }
 
-void Preprocessing::performPerImageOperations(
+void Preprocessing::applyPerImageOperations(
 		Image<RFLOAT> &Ipart,
-		FileName fn_output_img_root,
-		long int image_nr,
-		long int nr_of_images,
 		RFLOAT tilt_deg,
 		RFLOAT psi_deg,
-		RFLOAT &all_avg,
-		RFLOAT &all_stddev,
-		RFLOAT &all_minval,
-		RFLOAT &all_maxval)
+		RFLOAT &avg,
+		RFLOAT &stddev,
+		RFLOAT &minval,
+		RFLOAT &maxval)
 {
 
 	Ipart().setXmippOrigin();
@@ -1173,10 +1321,25 @@ void Preprocessing::performPerImageOperations(
 	TIMING_TOC(TIMING_INV_CONT);
 
 	// Calculate mean, stddev, min and max
-	RFLOAT avg, stddev, minval, maxval;
 	TIMING_TIC(TIMING_COMP_STATS);
 	Ipart().computeStats(avg, stddev, minval, maxval);
 	TIMING_TOC(TIMING_COMP_STATS);
+}
+
+void Preprocessing::performPerImageOperations(
+		Image<RFLOAT> &Ipart,
+		FileName fn_output_img_root,
+		long int image_nr,
+		long int nr_of_images,
+		RFLOAT tilt_deg,
+		RFLOAT psi_deg,
+		RFLOAT &all_avg,
+		RFLOAT &all_stddev,
+		RFLOAT &all_minval,
+		RFLOAT &all_maxval)
+{
+	RFLOAT avg, stddev, minval, maxval;
+	applyPerImageOperations(Ipart, tilt_deg, psi_deg, avg, stddev, minval, maxval);
 
 	if (Ipart().getDim() == 3)
 	{
@@ -125,6 +125,9 @@ public:
 	// Box size to extract the particles in
 	int extract_size;
 
+	// Number of threads to extract the particles of one micrograph with
+	int nr_threads;
+
 	// Minimum threshold for autopickFigureOfMerit to extract particles
 	RFLOAT extract_minimum_fom;
 
@@ -223,6 +226,16 @@ public:
 	// Perform per-image operations (e.g. normalise, rescaling, rewindowing and inverting contrast) on an input stack (or STAR file)
 	void runOperateOnInputFile();
 
+	// Rescaling, rewindowing, normalisation and contrast inversion of an individual image, and its statistics afterwards
+	void applyPerImageOperations(
+			Image<RFLOAT> &Ipart,
+			RFLOAT tilt_deg,
+			RFLOAT psi_deg,
+			RFLOAT &avg,
+			RFLOAT &stddev,
+			RFLOAT &minval,
+			RFLOAT &maxval);
+
 	// Here normalisation, windowing etc is performed on an individual image and it is written to disc
 	// Jun24,2015 - Shaoda, extract helical segments
 	void performPerImageOperations(
@@ -4,6 +4,8 @@
 #include <vector>
 #include <algorithm>
 #include <omp.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <src/time.h>
 #include <src/metadata_table.h>
@@ -100,10 +102,8 @@ void EERRenderer::render4K(MultidimArray<T> &image, std::vector<unsigned int> &p
 EERRenderer::EERRenderer()
 {
 	ready = false;
-	read_data = false;
 	buf = NULL;
-	preread_start = -1;
-	preread_end = -1;
+	fd = -1;
 	eer_upsampling = 2;
 }
 
@@ -169,12 +169,17 @@ void EERRenderer::read(FileName _fn_movie, int eer_upsampling)
 		if (width != EER_IMAGE_WIDTH || height != EER_IMAGE_HEIGHT)
 			REPORT_ERROR("Currently we support only 4096x4096 pixel EER movies.");
 
-		// Find the number of frames
+		// Find the number of frames and where they are
 		nframes = TIFFNumberOfDirectories(ftiff);
+		indexTIFFStrips(ftiff);
 		TIFFClose(ftiff);
 #ifdef DEBUG_EER
 		printf("EER in TIFF: %s nframes = %d\n", fn_movie.c_str(), nframes);
 #endif
+
+		fd = open(fn_movie.c_str(), O_RDONLY);
+		if (fd < 0)
+			REPORT_ERROR("Failed to open " + fn_movie);
 	}
 
 	fclose(fh);
@@ -219,54 +224,66 @@ void EERRenderer::readLegacy(FILE *fh)
 	RCTOC(TIMING_BUILD_INDEX);
 
 	nframes = frame_starts.size();
-	read_data = true;
 }
 
-void EERRenderer::lazyReadFrames()
+void EERRenderer::indexTIFFStrips(TIFF *ftiff)
 {
-	#pragma omp critical(EERRenderer_lazyReadFrames)
+	RCTIC(TIMING_BUILD_INDEX);
+	frame_first_strip.resize(nframes + 1, 0);
+	strip_offsets.clear();
+	strip_sizes.clear();
+
+	for (int frame = 0; frame < nframes; frame++)
 	{
-		if (!read_data) // cannot return from within omp critical
-		{	
-			TIFF *ftiff = TIFFOpen(fn_movie.c_str(), "r");
-
-			frame_starts.resize(nframes, 0);
-			frame_sizes.resize(nframes, 0);
-			buf = (unsigned char*)malloc(file_size); // This is big enough
-			if (buf == NULL)
-				REPORT_ERROR("Failed to allocate the buffer for " + fn_movie);
-			long long pos = 0;
-
-			// Read everything
-			for (int frame = 0; frame < nframes; frame++)
-			{
-				if ((preread_start > 0 && frame < preread_start) ||
-				    (preread_end > 0 && frame > preread_end))
-					continue;
+		// Directories are visited in order, which is much faster than TIFFSetDirectory for many frames
+		if (frame > 0 && !TIFFReadDirectory(ftiff))
+			REPORT_ERROR("EER: failed to read the TIFF directory of frame " + integerToString(frame + 1) + " in " + fn_movie);
 
-				TIFFSetDirectory(ftiff, frame);
-				const int nstrips = TIFFNumberOfStrips(ftiff);
-				frame_starts[frame] = pos;
+		const int nstrips = TIFFNumberOfStrips(ftiff);
+		toff_t *offsets = NULL, *sizes = NULL;
+		if (!TIFFGetField(ftiff, TIFFTAG_STRIPOFFSETS, &offsets) ||
+		    !TIFFGetField(ftiff, TIFFTAG_STRIPBYTECOUNTS, &sizes))
+			REPORT_ERROR("EER: no strips in frame " + integerToString(frame + 1) + " of " + fn_movie);
 
-				for (int strip = 0; strip < nstrips; strip++)
-				{
-					const int strip_size = TIFFRawStripSize(ftiff, strip);
-					if (pos + strip_size >= file_size)
-						REPORT_ERROR("EER: buffer overflow when reading raw strips.");
+		for (int strip = 0; strip < nstrips; strip++)
+		{
+			if (offsets[strip] + sizes[strip] > file_size)
+				REPORT_ERROR("EER: strip beyond the end of the file in " + fn_movie);
 
-					TIFFReadRawStrip(ftiff, strip, buf + pos, strip_size);
-					pos += strip_size;
-					frame_sizes[frame] += strip_size;
-				}
-	#ifdef DEBUG_EER
-				printf("EER in TIFF: Read frame %d from %s, nstrips = %d, current pos in buffer = %lld / %lld\n", frame, fn_movie.c_str(), nstrips, pos, file_size);
-	#endif
-			}
+			strip_offsets.push_back(offsets[strip]);
+			strip_sizes.push_back(sizes[strip]);
+		}
+		frame_first_strip[frame + 1] = strip_offsets.size();
+#ifdef DEBUG_EER
+		printf("EER in TIFF: Indexed frame %d from %s, nstrips = %d\n", frame, fn_movie.c_str(), nstrips);
+#endif
+	}
+	RCTOC(TIMING_BUILD_INDEX);
+}
+
+void EERRenderer::readTIFFFrame(int iframe, std::vector<unsigned char> &buffer)
+{
+	long long frame_size = 0;
+	for (int strip = frame_first_strip[iframe]; strip < frame_first_strip[iframe + 1]; strip++)
+		frame_size += strip_sizes[strip];
 
-			TIFFClose(ftiff);
+	// The decoders read up to 4 bytes beyond the end of the frame
+	buffer.resize(frame_size + 8);
+	std::fill(buffer.begin() + frame_size, buffer.end(), 0);
 
-			read_data = true;
+	long long pos = 0;
+	for (int strip = frame_first_strip[iframe]; strip < frame_first_strip[iframe + 1]; strip++)
+	{
+		long long done = 0;
+		while (done < strip_sizes[strip])
+		{
+			// pread does not move the file offset, so many threads can read from the same descriptor
+			ssize_t n = pread(fd, &buffer[pos + done], strip_sizes[strip] - done, strip_offsets[strip] + done);
+			if (n <= 0)
+				REPORT_ERROR("EER: failed to read frame " + integerToString(iframe + 1) + " from " + fn_movie);
+			done += n;
 		}
+		pos += strip_sizes[strip];
 	}
 }
 
@@ -274,6 +291,8 @@ EERRenderer::~EERRenderer()
 {
 	if (buf != NULL)
 		free(buf);
+	if (fd >= 0)
+		close(fd);
 }
 
 int EERRenderer::getNFrames()
@@ -306,8 +325,6 @@ long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArra
 	if (!ready)
 		REPORT_ERROR("EERRenderer::renderNFrames called before ready.");
 
-	lazyReadFrames();
-
 	if (frame_start <= 0 || frame_start > getNFrames() ||
 	    frame_end < frame_start || frame_end > getNFrames())
 	{
@@ -323,21 +340,32 @@ long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArra
 
 	std::vector<unsigned int> positions;
 	std::vector<unsigned char> symbols;
+	std::vector<unsigned char> frame_buf;
 	image.initZeros(getHeight(), getWidth());
 
 	for (int iframe = frame_start; iframe <= frame_end; iframe++)
 	{
-		RCTIC(TIMING_UNPACK_RLE);
-		if ((preread_start > 0 && iframe < preread_start) ||
-	  	    (preread_end > 0 && iframe > preread_end))
+		// Get the raw data of this frame
+		RCTIC(TIMING_READ_EER);
+		const unsigned char *data;
+		long long frame_size;
+		if (is_legacy)
+		{
+			data = buf + frame_starts[iframe];
+			frame_size = frame_sizes[iframe];
+		}
+		else
 		{
-			std::cerr << "EERRenderer::renderFrames(frame_start = " << frame_start + 1 << ", frame_end = " << frame_end + 1<< "),  NFrames = " << getNFrames() << " preread_start = " << preread_start + 1 << " prered_end = " << preread_end + 1<< std::endl;
-			REPORT_ERROR("Tried to render frames outside pre-read region");
-		}		
+			readTIFFFrame(iframe, frame_buf);
+			data = &frame_buf[0];
+			frame_size = frame_buf.size() - 8;
+		}
+		RCTOC(TIMING_READ_EER);
 
-		long long pos = frame_starts[iframe];
+		RCTIC(TIMING_UNPACK_RLE);
+		long long pos = 0;
 		unsigned int n_pix = 0, n_electron = 0;
-		const int max_electrons = frame_sizes[iframe] * 2; // at 4 bits per electron (very permissive bound!)
+		const int max_electrons = frame_size * 2; // at 4 bits per electron (very permissive bound!)
 		if (positions.size() < max_electrons)
 		{
 			positions.resize(max_electrons);
@@ -353,12 +381,12 @@ long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArra
 			{
 				// Fetch 32 bits and unpack up to 2 chunks of 7 + 4 bits.
 				// This is faster than unpack 7 and 4 bits sequentially.
-				// Since the size of buf is larger than the actual size by the TIFF header size,
+				// Since the data is followed by the footer (legacy) or by padding (TIFF),
 				// it is always safe to read ahead.
 
 				long long first_byte = pos + (bit_pos >> 3);
 				const unsigned int bit_offset_in_first_byte = bit_pos & 7; // 7 = 00000111 (same as % 8)
-				const unsigned int chunk = (*(unsigned int*)(buf + first_byte)) >> bit_offset_in_first_byte;
+				const unsigned int chunk = (*(unsigned int*)(data + first_byte)) >> bit_offset_in_first_byte;
 
 				p = (unsigned char)(chunk & 127); // 127 = 01111111
 				bit_pos += 7; // TODO: we can remove this for further speed.
@@ -394,16 +422,16 @@ long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArra
 			// With SIMD intrinsics at the SSSE3 level, we can unpack 10 symbols (120 bits) simultaneously.
 			unsigned char p1, p2, s1, s2;
 
-			const long long pos_limit = frame_starts[iframe] + frame_sizes[iframe];
-			// Because there is a footer, it is safe to go beyond the limit by two bytes.
+			const long long pos_limit = frame_size;
+			// Because there is a footer (or padding), it is safe to go beyond the limit by two bytes.
 			while (pos < pos_limit)
 			{
 				// symbol is bit tricky. 0000YyXx; Y and X must be flipped.
-				p1 = buf[pos];
-				s1 = (buf[pos + 1] & 0x0F) ^ 0x0A; // 0x0F = 00001111, 0x0A = 00001010
+				p1 = data[pos];
+				s1 = (data[pos + 1] & 0x0F) ^ 0x0A; // 0x0F = 00001111, 0x0A = 00001010
 
-				p2 = (buf[pos + 1] >> 4) | (buf[pos + 2] << 4);
-				s2 = (buf[pos + 2] >> 4) ^ 0x0A;
+				p2 = (data[pos + 1] >> 4) | (data[pos + 2] << 4);
+				s2 = (data[pos + 2] >> 4) ^ 0x0A;
 
 				// Note the order. Add p before checking the size and placing a new electron.
 				n_pix += p1;
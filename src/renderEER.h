@@ -17,11 +17,17 @@ class EERRenderer {
 	bool ready;
 	bool is_legacy;
 	bool is_7bit;
-	bool read_data;
 
+	// Legacy format: the whole file is in buf, and frame i is at buf + frame_starts[i]
 	std::vector<long long> frame_starts, frame_sizes;
 	unsigned char* buf;
 
+	// TIFF format: frame i consists of the raw strips frame_first_strip[i] to frame_first_strip[i + 1] - 1,
+	// which are read from fd when the frame is rendered
+	std::vector<long long> strip_offsets, strip_sizes;
+	std::vector<int> frame_first_strip;
+	int fd;
+
 	static const char EER_FOOTER_OK[];
 	static const char EER_FOOTER_ERR[];
 	static const int EER_IMAGE_WIDTH, EER_IMAGE_HEIGHT, EER_IMAGE_PIXELS;
@@ -30,10 +36,12 @@ class EERRenderer {
 
 	int eer_upsampling;
 	int nframes;
-	int preread_start, preread_end;
 	long long file_size;
 	void readLegacy(FILE *fh);
-	void lazyReadFrames();
+	void indexTIFFStrips(TIFF *ftiff);
+
+	// Read the raw data of one frame of a TIFF file into buffer (which is thread-safe)
+	void readTIFFFrame(int iframe, std::vector<unsigned char> &buffer);
 
 	template <typename T>
 	void render16K(MultidimArray<T> &image, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols, int n_electrons);
@@ -67,15 +75,9 @@ class EERRenderer {
 	static void silenceTIFFWarnings();
 
 	// 1-indexed
+	// Only frames that are rendered are read from (TIFF) files, so this is no longer needed.
 	void setFramesOfInterest(int start, int end)
 	{
-		if (is_legacy)
-			return;
-
-		if (read_data)
-			REPORT_ERROR("Logic error in EERRenderer::setFramesOfInterest(). This must be set before rendering.");
-		preread_start = start - 1;
-		preread_end = end - 1;
 	}
 
 	void read(FileName _fn_movie, int eer_upsampling=2);
@@ -86,7 +88,8 @@ class EERRenderer {
 
 	// Frame indices are 1-indexed.
 	// image is cleared.
-	// This function is thread-safe (except for timing).
+	// This function is thread-safe (except for timing): different fractions can be rendered in parallel,
+	// and for TIFF files each call only reads the frames it renders.
 	// It is caller's responsibility to make sure type T does not overflow.
 	template <typename T>
 	long long renderFrames(int frame_start, int frame_end, MultidimArray<T> &image);
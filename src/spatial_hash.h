@@ -0,0 +1,114 @@
+/***************************************************************************
+ *
+ * MRC Laboratory of Molecular Biology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <stdint.h>
+#include "src/macros.h"
+
+/*	class SpatialHash:
+ *
+ *	Uniform grid over 2D or 3D points (e.g. particle coordinates), stored in a
+ *	hash table of the occupied cells only. Every point that lies within
+ *	cell_size of a given position is in one of the 3x3(x3) cells around the cell
+ *	of that position, so finding the neighbours of a point only touches the
+ *	points in those cells instead of all points.
+ *
+ *	The caller identifies points by an id (e.g. their index in a vector) and
+ *	checks the actual distances: getCandidates() returns a superset of the
+ *	neighbours, in the order in which they were added to each cell.
+ */
+class SpatialHash
+{
+public:
+
+	// Any cell_size <= 0 is replaced by a small positive one, so that coinciding points can still be found
+	SpatialHash(RFLOAT _cell_size)
+	{
+		// Slightly larger cells, so that rounding in the divisions below never misses a point at exactly cell_size
+		cell_size = (_cell_size > 0.) ? _cell_size * 1.0001 : 1.;
+	}
+
+	void add(long int id, RFLOAT x, RFLOAT y, RFLOAT z = 0.)
+	{
+		cells[key(cell(x), cell(y), cell(z))].push_back(id);
+	}
+
+	// Remove a point that was added with the same id and position
+	void remove(long int id, RFLOAT x, RFLOAT y, RFLOAT z = 0.)
+	{
+		std::unordered_map<uint64_t, std::vector<long int> >::iterator it = cells.find(key(cell(x), cell(y), cell(z)));
+		if (it == cells.end())
+			return;
+
+		std::vector<long int> &ids = it->second;
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			if (ids[i] == id)
+			{
+				ids.erase(ids.begin() + i);
+				break;
+			}
+		}
+		if (ids.empty())
+			cells.erase(it);
+	}
+
+	// Append the ids of all points in the cells around (x, y, z) to ids. These include all points within cell_size.
+	void getCandidates(RFLOAT x, RFLOAT y, RFLOAT z, std::vector<long int> &ids, bool is_3D = false) const
+	{
+		const long int cx = cell(x), cy = cell(y), cz = cell(z);
+		const int dz_max = (is_3D) ? 1 : 0;
+		for (int dz = -dz_max; dz <= dz_max; dz++)
+		for (int dy = -1; dy <= 1; dy++)
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			std::unordered_map<uint64_t, std::vector<long int> >::const_iterator it = cells.find(key(cx + dx, cy + dy, cz + dz));
+			if (it != cells.end())
+				ids.insert(ids.end(), it->second.begin(), it->second.end());
+		}
+	}
+
+	void clear()
+	{
+		cells.clear();
+	}
+
+private:
+
+	RFLOAT cell_size;
+	std::unordered_map<uint64_t, std::vector<long int> > cells;
+
+	long int cell(RFLOAT v) const
+	{
+		return (long int)std::floor(v / cell_size);
+	}
+
+	// 21 bits per dimension; cells that wrap around onto the same key only add candidates
+	static uint64_t key(long int cx, long int cy, long int cz)
+	{
+		return ((uint64_t)(cx & 0x1FFFFF)) | ((uint64_t)(cy & 0x1FFFFF) << 21) | ((uint64_t)(cz & 0x1FFFFF) << 42);
+	}
+};
+
+#endif